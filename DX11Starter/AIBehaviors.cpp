@@ -1,15 +1,17 @@
 #include <vector>
 #include "AIBehaviors.h"
+#include "Scene.h"
 
 using namespace DirectX;
 
 AIBehaviors::AIBehaviors(Entity* ai)
 {
-	this->agent = ai;
+	this->agent = ai->GetHandle();
+	this->scene = ai->GetScene();
 	initLerp = false;
 	lerping = false;
 	innerLerp = false;
-	speed = 0.00015f;
+	speed = 0.009f;
 	lerpPeriods = 0;
 }
 
@@ -55,7 +57,13 @@ void AIBehaviors::WaypointsLerp(std::vector<DirectX::XMFLOAT3> pts) {
 
 */
 
-void AIBehaviors::WaypointsLerp(DirectX::XMFLOAT3 pt1, DirectX::XMFLOAT3 pt2) {
+void AIBehaviors::WaypointsLerp(DirectX::XMFLOAT3 pt1, DirectX::XMFLOAT3 pt2, float deltaTime) {
+
+	// Nothing to move if the agent has been destroyed
+	Entity* agent = scene->GetEntity(this->agent);
+	if (agent == nullptr) {
+		return;
+	}
 
 	if (!initLerp) {
 		t = 0;
@@ -64,7 +72,8 @@ void AIBehaviors::WaypointsLerp(DirectX::XMFLOAT3 pt1, DirectX::XMFLOAT3 pt2) {
 		lerping = true;
 	}
 
-	t += speed;
+	// Scaled by time rather than per call, so the agent moves at the same speed whatever the tick rate
+	t += speed * deltaTime;
 
 	if (t > 1) {
 		t = 1;
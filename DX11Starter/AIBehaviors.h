@@ -3,17 +3,24 @@
 #include <vector>
 #include <DirectXMath.h>
 #include "Entity.h"
+#include "EntityHandle.h"
+
+class Scene;
 
 class AIBehaviors
 {
 public:
 	AIBehaviors(Entity*);
 	~AIBehaviors();
-	Entity* agent = nullptr;
+
+	// Held as a handle, the agent may be destroyed while this behavior is still around
+	EntityHandle agent;
+	Scene* scene = nullptr;
 
 	void SetWaypoints(std::vector<DirectX::XMFLOAT3>);
 	// void WaypointsLerp(std::vector<DirectX::XMFLOAT3>);
-	void WaypointsLerp(DirectX::XMFLOAT3, DirectX::XMFLOAT3);
+	// Moves the agent from pt1 towards pt2 ; call once per simulation tick
+	void WaypointsLerp(DirectX::XMFLOAT3 pt1, DirectX::XMFLOAT3 pt2, float deltaTime);
 	float lerp(float, float, float);
 
 	bool initLerp;
@@ -25,5 +32,5 @@ private:
 
 	bool innerLerp;
 	bool lerping;
-	float speed;
+	float speed; // Fraction of the way covered per second
 };
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef AFFINE_H_
+#define AFFINE_H_
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+// Affine transformation stored as 4 columns of 3 rows - the constant last row of a 4x4 is implied
+// Used for cached world and inverse matrices, only expanded to a full 4x4 when handed to shaders
+typedef glm::mat4x3 affine;
+
+// Equivalent of translate * rotate * scale, built directly from the rotation's basis
+inline affine AffineFromTRS(glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	glm::mat3 r = glm::toMat3(rotation);
+	return affine(r[0] * scale.x, r[1] * scale.y, r[2] * scale.z, position);
+}
+
+// Inverse of translate * rotate * scale, worked out analytically as scale^-1 * rotate^T * translate^-1
+inline affine AffineInverseTRS(glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	glm::mat3 rt = glm::transpose(glm::toMat3(rotation));
+	glm::vec3 inv = 1.0f / scale;
+
+	// Scaling from the left scales the rows of the transposed rotation
+	glm::mat3 m(rt[0] * inv, rt[1] * inv, rt[2] * inv);
+	return affine(m[0], m[1], m[2], -(m * position));
+}
+
+// Inverse of an arbitrary affine transformation (e.g. one involving shear), for when no decomposition is at hand
+inline affine AffineInverse(const affine& a)
+{
+	glm::mat3 m = glm::inverse(glm::mat3(a[0], a[1], a[2]));
+	return affine(m[0], m[1], m[2], -(m * a[3]));
+}
+
+// Same as multiplying the equivalent 4x4 matrices, a applied last
+inline affine AffineMultiply(const affine& a, const affine& b)
+{
+	glm::mat3 a3(a[0], a[1], a[2]);
+	return affine(a3 * b[0], a3 * b[1], a3 * b[2], a3 * b[3] + a[3]);
+}
+
+inline glm::vec3 AffineTransformPoint(const affine& a, glm::vec3 point)  { return a * glm::vec4(point, 1.0f); }
+inline glm::vec3 AffineTransformVector(const affine& a, glm::vec3 vector) { return a * glm::vec4(vector, 0.0f); }
+
+inline glm::mat4 AffineToMatrix(const affine& a)
+{
+	return glm::mat4(glm::vec4(a[0], 0.0f), glm::vec4(a[1], 0.0f), glm::vec4(a[2], 0.0f), glm::vec4(a[3], 1.0f));
+}
+
+#endif
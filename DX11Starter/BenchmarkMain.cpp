@@ -0,0 +1,8 @@
+#include "Benchmarks.h"
+
+// Console entry point of the portable BenchmarkRunner target ; the game runs the same benchmarks from WinMain
+// when started with "-benchmark"
+int main()
+{
+	return RunBenchmarks() ? 0 : 1;
+}
@@ -0,0 +1,1472 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ClusteredLighting.h"
+#include "DynamicAABBTree.h"
+#include "FramePipeline.h"
+#include "FrustumCulling.h"
+#include "NullRenderDevice.h"
+#include "OcclusionCulling.h"
+#include "Object.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "ShadowCascades.h"
+#include "TransformKernels.h"
+#include "WorkerPool.h"
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock BenchClock;
+
+	inline double MillisecondsSince(BenchClock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+	}
+
+	// Single triangle, enough for the null device
+	Mesh* CreateBenchMesh(RenderDevice* device)
+	{
+		Vertex vertices[3] = {};
+		vertices[1].Position.x = 1.0f;
+		vertices[2].Position.y = 1.0f;
+		unsigned int indices[3] = { 0, 1, 2 };
+		return new Mesh(vertices, 3, indices, 3, device);
+	}
+
+	// Instanced draws recorded by the null device must cover the packed instance buffer exactly once, and it must hold
+	// every submitted world exactly once ; worlds are told apart by their translation, laid out on a 100 wide grid
+	bool CheckInstancePacking(const NullRenderDevice& device, const std::vector<affine>& worlds)
+	{
+		typedef glm::mat3x4 InstanceData;
+
+		const InstanceData* instances = nullptr;
+		std::vector<u32> drawnTimes(worlds.size(), 0);
+		const std::vector<NullRenderDevice::Command>& commands = device.GetCommands();
+		for (u64 c = 0; c < commands.size(); ++c)
+		{
+			const NullRenderDevice::Command& command = commands[c];
+			if (command.type == NullRenderDevice::CMD_UPDATE_BUFFER)
+			{
+				if (command.args[0] != worlds.size() * sizeof(InstanceData)) { return false; }
+				instances = reinterpret_cast<const InstanceData*>(device.GetBufferContents(static_cast<const GPUBuffer*>(command.object)));
+			}
+			else if (command.type == NullRenderDevice::CMD_DRAW_INDEXED_INSTANCED)
+			{
+				u32 first = command.args[2];
+				u32 count = command.args[1];
+				if ((u64)first + count > worlds.size()) { return false; }
+				for (u32 i = first; i < first + count; ++i) { ++drawnTimes[i]; }
+			}
+		}
+		if (instances == nullptr) { return false; }
+
+		std::vector<u32> packedTimes(worlds.size(), 0);
+		for (u64 i = 0; i < worlds.size(); ++i)
+		{
+			if (drawnTimes[i] != 1) { return false; }
+
+			// Instances are transposed worlds, so the translation is the last element of each row
+			u64 w = (u64)instances[i][0][3] + 100 * (u64)instances[i][2][3];
+			if (w >= worlds.size() || instances[i] != glm::transpose(worlds[w])) { return false; }
+			++packedTimes[w];
+		}
+		return std::count(packedTimes.begin(), packedTimes.end(), 1u) == (std::ptrdiff_t)worlds.size();
+	}
+
+	// What a draw put on screen, as far as the null device can tell
+	struct RecordedDraw
+	{
+		const void* vertexBuffer;
+		const void* texture;
+		affine world;
+
+		bool operator< (const RecordedDraw& other) const
+		{
+			if (vertexBuffer != other.vertexBuffer) { return vertexBuffer < other.vertexBuffer; }
+			if (texture != other.texture) { return texture < other.texture; }
+			return memcmp(&world, &other.world, sizeof(affine)) < 0;
+		}
+		bool operator== (const RecordedDraw& other) const
+		{
+			return vertexBuffer == other.vertexBuffer && texture == other.texture && world == other.world;
+		}
+	};
+
+	// Every object drawn by a recorded command stream, instanced or not, sorted so streams can be compared
+	std::vector<RecordedDraw> CollectDraws(const NullRenderDevice& device)
+	{
+		typedef glm::mat3x4 InstanceData;
+
+		std::vector<RecordedDraw> draws;
+		RecordedDraw current = { nullptr, nullptr, affine(1.0f) };
+		const InstanceData* instances = nullptr;
+
+		const std::vector<NullRenderDevice::Command>& commands = device.GetCommands();
+		for (u64 c = 0; c < commands.size(); ++c)
+		{
+			const NullRenderDevice::Command& command = commands[c];
+			switch (command.type)
+			{
+			case NullRenderDevice::CMD_SET_VERTEX_BUFFER:
+				if (command.args[0] == 0) { current.vertexBuffer = command.object; }
+				break;
+			case NullRenderDevice::CMD_SET_SHADER_RESOURCE:
+				if (strcmp(command.name, "res") == 0) { current.texture = command.object; }
+				break;
+			case NullRenderDevice::CMD_SET_MATRIX:
+				if (strcmp(command.name, "world") == 0)
+				{
+					// Shaders get the transposed matrix, whose rows are the world's columns
+					const float* data = device.GetMatrix(command);
+					for (u32 col = 0; col < 4; ++col)
+					{
+						for (u32 row = 0; row < 3; ++row) { current.world[col][row] = data[row * 4 + col]; }
+					}
+				}
+				break;
+			case NullRenderDevice::CMD_UPDATE_BUFFER:
+				// Only the instance buffer gets updated while drawing
+				instances = reinterpret_cast<const InstanceData*>(device.GetBufferContents(static_cast<const GPUBuffer*>(command.object)));
+				break;
+			case NullRenderDevice::CMD_DRAW_INDEXED:
+				draws.push_back(current);
+				break;
+			case NullRenderDevice::CMD_DRAW_INDEXED_INSTANCED:
+				for (u32 i = command.args[2]; i < command.args[2] + command.args[1]; ++i)
+				{
+					RecordedDraw draw = current;
+					draw.world = glm::transpose(instances[i]);
+					draws.push_back(draw);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+
+		std::sort(draws.begin(), draws.end());
+		return draws;
+	}
+
+	// Records which frame the simulation side last filled it for, so rendering can tell it got that frame's data
+	struct BenchSnapshot : FrameSnapshot
+	{
+		u64 simulatedFrame = U64_MAX;
+	};
+
+	// Keeps the calling thread busy for a while, standing in for a half of a frame
+	inline void BusyWork(double milliseconds)
+	{
+		BenchClock::time_point start = BenchClock::now();
+		while (MillisecondsSince(start) < milliseconds) { }
+	}
+
+	// ParallelFor over a count its grain doesn't divide must hand out every index exactly once, in chunks no larger
+	// than the grain
+	bool CheckParallelFor(WorkerPool& pool)
+	{
+		const u64 count = 100003;
+		const u64 grain = 1000;
+
+		std::unique_ptr<std::atomic<u32>[]> visits(new std::atomic<u32>[count]);
+		for (u64 i = 0; i < count; ++i) { visits[i].store(0, std::memory_order_relaxed); }
+		std::atomic<bool> badChunk(false);
+
+		pool.ParallelFor(count, grain, [&](u64 begin, u64 end)
+		{
+			if (begin >= end || end > count || end - begin > grain) { badChunk.store(true); return; }
+			for (u64 i = begin; i < end; ++i) { visits[i].fetch_add(1, std::memory_order_relaxed); }
+		});
+
+		bool once = !badChunk.load();
+		for (u64 i = 0; i < count; ++i) { once &= visits[i].load(std::memory_order_relaxed) == 1; }
+		return once;
+	}
+
+	// Jobs queued with a dependency must not start before every job counted on it has finished
+	bool CheckDependencies(WorkerPool& pool)
+	{
+		const u32 firstJobs = 64;
+		const u32 dependentJobs = 64;
+
+		JobCounter first;
+		JobCounter second;
+		std::atomic<u32> finished(0);
+		std::atomic<u32> early(0);
+
+		// The first jobs take a while, so the dependent ones are queued while most of them haven't even started
+		for (u32 j = 0; j < firstJobs; ++j)
+		{
+			pool.Run([&]() { BusyWork(0.02); finished.fetch_add(1); }, &first);
+		}
+		for (u32 j = 0; j < dependentJobs; ++j)
+		{
+			pool.Run([&]() { if (finished.load() != firstJobs) { early.fetch_add(1); } }, &second, &first);
+		}
+
+		pool.Wait(&second);
+		pool.Wait(&first);
+		return early.load() == 0 && finished.load() == firstJobs;
+	}
+
+	// Minimal copy of the old Object update scheme : every change walks the whole subtree flagging it dirty,
+	// and world matrices are pulled lazily through parent pointers
+	struct LegacyNode
+	{
+		Transform local;
+		mat4 world;
+		bool needsUpdated;
+		LegacyNode* parent;
+		std::vector<LegacyNode*> children;
+
+		LegacyNode(const Transform& t, LegacyNode* parentNode) :
+			local(t),
+			world(identity<mat4>()),
+			needsUpdated(true),
+			parent(parentNode)
+		{
+			if (parent != nullptr) { parent->children.push_back(this); }
+		}
+
+		void RequireUpdate()
+		{
+			needsUpdated = true;
+			u64 cc = children.size();
+			for (u64 i = 0; i < cc; ++i)
+			{
+				children[i]->RequireUpdate();
+			}
+		}
+
+		const mat4& GetWorldMatrix()
+		{
+			if (needsUpdated)
+			{
+				world = (parent != nullptr) ? parent->GetWorldMatrix() * local.GetMatrix() : local.GetMatrix();
+				needsUpdated = false;
+			}
+			return world;
+		}
+
+		void Translate(vec3 v)
+		{
+			local.TranslateGlobal(v);
+			RequireUpdate();
+		}
+	};
+
+	// Parent index for each node of a test hierarchy, parents always precede their children
+	std::vector<u32> BuildDeepHierarchy(u32 count)
+	{
+		// A single chain, as in a long skeleton or attachment chain
+		std::vector<u32> parents(count);
+		parents[0] = U32_MAX;
+		for (u32 i = 1; i < count; ++i) { parents[i] = i - 1; }
+		return parents;
+	}
+
+	std::vector<u32> BuildWideHierarchy(u32 count, u32 fanOut)
+	{
+		// A shallow, bushy tree, as in a level root holding many props
+		std::vector<u32> parents(count);
+		parents[0] = U32_MAX;
+		for (u32 i = 1; i < count; ++i) { parents[i] = (i - 1) / fanOut; }
+		return parents;
+	}
+
+	// Each frame moves the root several times (as separate gameplay systems would), then reads every world matrix
+	// Both version stamp runs start from the same hierarchy as the old scheme, so all three must read the same worlds
+	bool CompareSchemes(const char* name, const std::vector<u32>& parents, u32 frames, u32 movesPerFrame)
+	{
+		u64 count = parents.size();
+		Transform t(vec3(0.0f, 1.0f, 0.0f));
+		double checksum[3] = { 0.0, 0.0, 0.0 };
+
+		// Old scheme
+		std::vector<LegacyNode*> legacy;
+		legacy.reserve(count);
+		for (u64 i = 0; i < count; ++i)
+		{
+			legacy.push_back(new LegacyNode(t, parents[i] == U32_MAX ? nullptr : legacy[parents[i]]));
+		}
+
+		BenchClock::time_point start = BenchClock::now();
+		for (u32 f = 0; f < frames; ++f)
+		{
+			for (u32 m = 0; m < movesPerFrame; ++m) { legacy[0]->Translate(vec3(0.001f, 0.0f, 0.0f)); }
+			for (u64 i = 0; i < count; ++i) { checksum[0] += legacy[i]->GetWorldMatrix()[3][0]; }
+		}
+		double legacyTime = MillisecondsSince(start);
+
+		for (u64 i = 0; i < count; ++i) { delete legacy[i]; }
+
+		// Version stamps, read both lazily and through the propagation pass, each over a fresh copy of the hierarchy
+		auto buildObjects = [&](TransformStore& store, std::vector<Object*>& objects)
+		{
+			store.Reserve(count);
+			objects.reserve(count);
+			for (u64 i = 0; i < count; ++i)
+			{
+				objects.push_back(new Object(&store, t, parents[i] == U32_MAX ? nullptr : objects[parents[i]]));
+			}
+		};
+
+		double lazyTime = 0.0;
+		{
+			TransformStore store;
+			std::vector<Object*> objects;
+			buildObjects(store, objects);
+
+			start = BenchClock::now();
+			for (u32 f = 0; f < frames; ++f)
+			{
+				for (u32 m = 0; m < movesPerFrame; ++m) { objects[0]->Translate(vec3(0.001f, 0.0f, 0.0f)); }
+				for (u64 i = 0; i < count; ++i) { checksum[1] += store.ResolveWorld(objects[i]->GetTransformSlot())[3][0]; }
+			}
+			lazyTime = MillisecondsSince(start);
+
+			for (u64 i = 0; i < count; ++i) { delete objects[i]; }
+		}
+
+		double passTime = 0.0;
+		{
+			TransformStore store;
+			std::vector<Object*> objects;
+			buildObjects(store, objects);
+
+			start = BenchClock::now();
+			for (u32 f = 0; f < frames; ++f)
+			{
+				for (u32 m = 0; m < movesPerFrame; ++m) { objects[0]->Translate(vec3(0.001f, 0.0f, 0.0f)); }
+				store.UpdateWorldMatrices();
+				for (u64 i = 0; i < count; ++i) { checksum[2] += store.GetWorld(objects[i]->GetTransformSlot())[3][0]; }
+			}
+			passTime = MillisecondsSince(start);
+
+			for (u64 i = 0; i < count; ++i) { delete objects[i]; }
+		}
+
+		// The batch kernels may round differently from glm's matrix products, so the sums only have to agree closely
+		double tolerance = 1e-5 * std::max(1.0, std::abs(checksum[0]));
+		bool matches = std::abs(checksum[1] - checksum[0]) <= tolerance && std::abs(checksum[2] - checksum[0]) <= tolerance;
+
+		printf("%-6s %6llu nodes, %u moves/frame : recursive flags %8.2f ms | versions (lazy) %8.2f ms | versions (pass) %8.2f ms | %s\n",
+			name, (unsigned long long)count, movesPerFrame, legacyTime, lazyTime, passTime, matches ? "same worlds" : "MISMATCH vs recursive flags");
+		return matches;
+	}
+}
+
+bool RunTransformBenchmarks()
+{
+	printf("Transform dirty tracking, 100 frames each\n");
+	bool matches = true;
+	matches &= CompareSchemes("Deep", BuildDeepHierarchy(500), 100, 1);
+	matches &= CompareSchemes("Deep", BuildDeepHierarchy(500), 100, 10);
+	matches &= CompareSchemes("Wide", BuildWideHierarchy(20000, 16), 100, 1);
+	matches &= CompareSchemes("Wide", BuildWideHierarchy(20000, 16), 100, 10);
+	return matches;
+}
+
+bool RunSpawnBenchmarks()
+{
+	const u32 waveSize = 10000;
+	const u32 waves = 50;
+
+	TagID enemy = TagRegistry::Intern("enemy");
+	std::vector<Transform> placements(waveSize);
+	for (u32 i = 0; i < waveSize; ++i) { placements[i] = Transform(vec3((float)(i % 100), 0.0f, (float)(i / 100))); }
+
+	// Single entity enemies
+	Prefab single;
+	single.AddNode(nullptr, nullptr);
+	single.AddTag(0, enemy);
+	single.Compile();
+
+	// Enemies carrying a turret with a barrel
+	Prefab turreted;
+	u32 body = turreted.AddNode(nullptr, nullptr);
+	u32 turret = turreted.AddNode(nullptr, nullptr, Transform(vec3(0.0f, 1.0f, 0.0f)), body);
+	turreted.AddNode(nullptr, nullptr, Transform(vec3(0.0f, 0.0f, 1.0f)), turret);
+	turreted.AddTag(body, enemy);
+	turreted.Compile();
+
+	printf("Spawning a wave of %u enemies\n", waveSize);
+
+	{
+		Scene scene;
+		BenchClock::time_point start = BenchClock::now();
+		for (u32 i = 0; i < waveSize; ++i) { scene.SpawnEntity(nullptr, nullptr, nullptr, placements[i])->AddTag(enemy); }
+		printf("SpawnEntity loop,  1 node  : %8.3f ms\n", MillisecondsSince(start));
+	}
+	{
+		Scene scene;
+		BenchClock::time_point start = BenchClock::now();
+		scene.SpawnBatch(single, waveSize, placements.data());
+		printf("SpawnBatch,        1 node  : %8.3f ms\n", MillisecondsSince(start));
+	}
+	{
+		Scene scene;
+		BenchClock::time_point start = BenchClock::now();
+		for (u32 i = 0; i < waveSize; ++i)
+		{
+			Entity* root = scene.SpawnEntity(nullptr, nullptr, nullptr, placements[i]);
+			root->AddTag(enemy);
+			Entity* top = scene.SpawnEntity(nullptr, nullptr, root, Transform(vec3(0.0f, 1.0f, 0.0f)));
+			scene.SpawnEntity(nullptr, nullptr, top, Transform(vec3(0.0f, 0.0f, 1.0f)));
+		}
+		printf("SpawnEntity loop,  3 nodes : %8.3f ms\n", MillisecondsSince(start));
+	}
+	{
+		Scene scene;
+		BenchClock::time_point start = BenchClock::now();
+		scene.SpawnBatch(turreted, waveSize, placements.data());
+		printf("SpawnBatch,        3 nodes : %8.3f ms\n", MillisecondsSince(start));
+	}
+
+	// Waves spawned and destroyed over and over mustn't keep growing the transform slots, and hierarchies built on
+	// reused slots must still place every barrel above and in front of its enemy
+	bool bounded = true;
+	bool placed = true;
+	{
+		Scene scene;
+		std::vector<EntityHandle> roots(waveSize);
+		u64 capacity = 0;
+		BenchClock::time_point start = BenchClock::now();
+		for (u32 w = 0; w < waves; ++w)
+		{
+			scene.SpawnBatch(turreted, waveSize, placements.data(), roots.data());
+			scene.UpdateTransforms();
+
+			TransformStore* store = scene.GetTransformStore();
+			if (w == 0) { capacity = store->GetSlotCapacity(); }
+			bounded &= store->GetSlotCapacity() == capacity;
+
+			for (u32 i = 0; i < waveSize; ++i)
+			{
+				Entity* root = scene.GetEntity(roots[i]);
+				if (root == nullptr || root->GetChildCount() != 1) { placed = false; continue; }
+				Object* top = root->GetChildren()[0];
+				if (top->GetChildCount() != 1) { placed = false; continue; }
+				vec3 barrel = top->GetChildren()[0]->GetWorldPosition();
+				placed &= length(barrel - (placements[i].GetPosition() + vec3(0.0f, 1.0f, 1.0f))) < 1e-4f;
+			}
+
+			for (u32 i = 0; i < waveSize; ++i) { scene.DestroyEntity(roots[i]); }
+		}
+		printf("Spawn + destroy, %u waves  : %8.3f ms per wave | %llu transform slots (%s) | %s\n", waves, MillisecondsSince(start) / waves,
+			(unsigned long long)scene.GetTransformStore()->GetSlotCapacity(), bounded ? "bounded" : "GROWING",
+			placed ? "hierarchies placed" : "MISPLACED hierarchies");
+	}
+
+	return bounded && placed;
+}
+
+bool RunTransformKernelBenchmarks()
+{
+	const u32 count = 4096;
+	const u32 repeats = 1000;
+
+	std::vector<vec3> positions(count);
+	std::vector<quat> rotations(count);
+	std::vector<vec3> scales(count);
+	for (u32 i = 0; i < count; ++i)
+	{
+		float f = (float)i;
+		positions[i] = vec3(f, f * 0.5f, -f);
+		rotations[i] = normalize(angleAxis(f * 0.01f, normalize(vec3(1.0f, f * 0.001f, 0.5f))));
+		scales[i] = vec3(1.0f + (i % 7) * 0.25f, 1.0f, 0.5f + (i % 3));
+	}
+
+	std::vector<affine> reference(count);
+	std::vector<affine> results(count);
+
+	struct Path { const char* name; ComposeTRSFunction fn; bool available; };
+	Path paths[] =
+	{
+		{ "Scalar", &ComposeTRSScalar, true },
+		{ "SSE",    &ComposeTRSSSE,    true },
+		{ "AVX2",   &ComposeTRSAVX2,   CPUSupportsAVX2() }
+	};
+
+	printf("Batch TRS composition, %u transforms x %u (dispatch picks %s)\n", count, repeats, GetComposeTRSPathName());
+	ComposeTRSScalar(count, positions.data(), rotations.data(), scales.data(), reference.data());
+
+	bool passed = true;
+
+	for (u32 k = 0; k < sizeof(paths) / sizeof(paths[0]); ++k)
+	{
+		if (!paths[k].available)
+		{
+			printf("%-6s : not supported on this CPU\n", paths[k].name);
+			continue;
+		}
+
+		BenchClock::time_point start = BenchClock::now();
+		for (u32 r = 0; r < repeats; ++r) { paths[k].fn(count, positions.data(), rotations.data(), scales.data(), results.data()); }
+		double time = MillisecondsSince(start);
+
+		// Vector paths may fuse multiply-adds, so compare with a tolerance relative to each element
+		float maxError = 0.0f;
+		for (u32 i = 0; i < count; ++i)
+		{
+			for (u32 c = 0; c < 4; ++c)
+			{
+				for (u32 e = 0; e < 3; ++e)
+				{
+					float error = std::fabs(results[i][c][e] - reference[i][c][e]) / std::fmax(1.0f, std::fabs(reference[i][c][e]));
+					maxError = std::fmax(maxError, error);
+				}
+			}
+		}
+		bool matches = maxError <= 1e-5f;
+		passed &= matches;
+
+		printf("%-6s : %8.2f ms (%6.2f ns/transform) | max relative error vs scalar %g | %s\n",
+			paths[k].name, time, time * 1000000.0 / ((double)count * repeats), maxError, matches ? "matches scalar" : "MISMATCH vs scalar");
+	}
+	return passed;
+}
+
+bool RunFrustumCullingBenchmarks()
+{
+	const u32 count = 100000;
+	const u32 repeats = 100;
+
+	// Units scattered over a 2 km square map, seen from the middle of it
+	MeshBounds unit = { vec3(0.0f, 1.0f, 0.0f), vec3(1.0f, 1.0f, 2.0f), 2.5f };
+	std::vector<affine> worlds(count);
+	u32 seed = 12345;
+	for (u32 i = 0; i < count; ++i)
+	{
+		vec3 p;
+		for (u32 c = 0; c < 3; ++c)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			p[c] = ((float)(seed >> 8) / 16777216.0f) * 2000.0f - 1000.0f;
+		}
+		p.y *= 0.01f;
+		worlds[i] = AffineFromTRS(p, angleAxis((float)i, vec3(0.0f, 1.0f, 0.0f)), vec3(1.0f + (i % 3)));
+	}
+
+	// Camera in the middle of the map, looking along it
+	mat4 view = lookAtLH(vec3(0.0f, 10.0f, 0.0f), vec3(0.0f, 10.0f, 1.0f), vec3(0.0f, 1.0f, 0.0f));
+	mat4 projection = perspectiveLH_ZO(0.25f * 3.14159265f, 16.0f / 9.0f, 0.1f, 500.0f);
+	Frustum frustum = Frustum::FromViewProjection(view, projection);
+
+	FrustumCuller culler;
+	BenchClock::time_point start = BenchClock::now();
+	for (u32 r = 0; r < repeats; ++r)
+	{
+		culler.Clear();
+		for (u32 i = 0; i < count; ++i) { culler.Add(unit, worlds[i]); }
+	}
+	double gather = MillisecondsSince(start);
+
+	printf("Frustum culling, %u boxes x %u (dispatch picks %s)\n", count, repeats, GetCullBoxesPathName());
+	printf("Gather : %8.2f ms (%6.2f ns/box)\n", gather, gather * 1000000.0 / ((double)count * repeats));
+
+	// Gathered boxes, read back through the same layout the culler hands the kernels
+	std::vector<float> soa[6];
+	for (u32 c = 0; c < 6; ++c) { soa[c].resize(count); }
+	for (u32 i = 0; i < count; ++i)
+	{
+		vec3 center;
+		vec3 extents;
+		TransformBounds(unit, worlds[i], center, extents);
+		for (u32 c = 0; c < 3; ++c)
+		{
+			soa[c][i] = center[c];
+			soa[c + 3][i] = extents[c];
+		}
+	}
+	BoxArrays boxes = { soa[0].data(), soa[1].data(), soa[2].data(), soa[3].data(), soa[4].data(), soa[5].data() };
+
+	std::vector<u32> reference(count);
+	std::vector<u32> results(count);
+	u64 referenceCount = CullBoxesScalar(count, boxes, frustum, reference.data());
+
+	struct Path { const char* name; CullBoxesFunction fn; bool available; };
+	Path paths[] =
+	{
+		{ "Scalar", &CullBoxesScalar, true },
+		{ "SSE",    &CullBoxesSSE,    true },
+		{ "AVX",    &CullBoxesAVX,    CPUSupportsAVX2() }
+	};
+
+	bool passed = true;
+	for (u32 k = 0; k < sizeof(paths) / sizeof(paths[0]); ++k)
+	{
+		if (!paths[k].available)
+		{
+			printf("%-6s : not supported on this CPU\n", paths[k].name);
+			continue;
+		}
+
+		u64 visibleCount = 0;
+		start = BenchClock::now();
+		for (u32 r = 0; r < repeats; ++r) { visibleCount = paths[k].fn(count, boxes, frustum, results.data()); }
+		double time = MillisecondsSince(start);
+
+		bool matches = visibleCount == referenceCount;
+		for (u64 i = 0; matches && i < visibleCount; ++i) { matches = results[i] == reference[i]; }
+		passed &= matches;
+
+		printf("%-6s : %8.2f ms (%6.2f ns/box) | %llu visible (%.1f%%) | %s\n",
+			paths[k].name, time, time * 1000000.0 / ((double)count * repeats), (unsigned long long)visibleCount,
+			100.0 * (double)visibleCount / count, matches ? "matches scalar" : "MISMATCH vs scalar");
+	}
+	return passed;
+}
+
+bool RunSpatialIndexBenchmarks()
+{
+	const u32 count = 100000;
+	const u32 queryCount = 1000;
+
+	// Same kind of map as the frustum culling benchmark : boxes a few units across, scattered over 2 km
+	u32 seed = 4321;
+	auto random = [&seed](float range) { seed = seed * 1664525u + 1013904223u; return ((float)(seed >> 8) / 16777216.0f) * 2.0f * range - range; };
+
+	std::vector<AABB> boxes(count);
+	for (u32 i = 0; i < count; ++i)
+	{
+		vec3 center(random(1000.0f), random(10.0f), random(1000.0f));
+		vec3 extents(1.0f + (i % 3));
+		boxes[i] = AABB{ center - extents, center + extents };
+	}
+
+	DynamicAABBTree tree;
+	std::vector<u32> proxies(count);
+	BenchClock::time_point start = BenchClock::now();
+	for (u32 i = 0; i < count; ++i) { proxies[i] = tree.CreateProxy(boxes[i], i); }
+	double build = MillisecondsSince(start);
+
+	printf("Spatial index, %u boxes, %u queries of each kind\n", count, queryCount);
+	printf("Build  : %8.2f ms (%6.2f ns/proxy) | height %u\n", build, build * 1000000.0 / count, tree.GetHeight());
+
+	// A tick's worth of movement : every box drifts a little, a few jump across the map
+	u64 reinserted = 0;
+	start = BenchClock::now();
+	for (u32 i = 0; i < count; ++i)
+	{
+		vec3 offset = (i % 100 == 0) ? vec3(random(1000.0f), 0.0f, random(1000.0f)) : vec3(random(0.1f), 0.0f, random(0.1f));
+		boxes[i].min += offset;
+		boxes[i].max += offset;
+		reinserted += tree.MoveProxy(proxies[i], boxes[i]) ? 1 : 0;
+	}
+	double move = MillisecondsSince(start);
+	printf("Move   : %8.2f ms (%6.2f ns/proxy) | %llu reinserted | height %u\n",
+		move, move * 1000000.0 / count, (unsigned long long)reinserted, tree.GetHeight());
+
+	// Queries are checked against a linear scan over the fat boxes, which is exactly what the tree tests
+	std::vector<AABB> fatBoxes(count);
+	for (u32 i = 0; i < count; ++i) { fatBoxes[i] = tree.GetFatBox(proxies[i]); }
+
+	std::vector<vec3> centers(queryCount);
+	std::vector<float> radii(queryCount);
+	for (u32 q = 0; q < queryCount; ++q)
+	{
+		centers[q] = vec3(random(1000.0f), 0.0f, random(1000.0f));
+		radii[q] = 25.0f;
+	}
+
+	std::vector<u32> results;
+	std::vector<u32> offsets;
+	start = BenchClock::now();
+	tree.QuerySpheres(queryCount, centers.data(), radii.data(), results, offsets);
+	double treeSpheres = MillisecondsSince(start);
+
+	std::vector<u32> linear;
+	std::vector<u32> linearOffsets(queryCount + 1);
+	start = BenchClock::now();
+	for (u32 q = 0; q < queryCount; ++q)
+	{
+		linearOffsets[q] = (u32)linear.size();
+		for (u32 i = 0; i < count; ++i)
+		{
+			if (DynamicAABBTree::Overlaps(fatBoxes[i], centers[q], radii[q])) { linear.push_back(i); }
+		}
+	}
+	linearOffsets[queryCount] = (u32)linear.size();
+	double linearSpheres = MillisecondsSince(start);
+
+	// Tree results come out in tree order, so both sides are compared as sorted user data
+	bool matches = results.size() == linear.size();
+	for (u32 q = 0; matches && q < queryCount; ++q)
+	{
+		std::vector<u32> found;
+		for (u32 r = offsets[q]; r < offsets[q + 1]; ++r) { found.push_back((u32)tree.GetUserData(results[r])); }
+		std::sort(found.begin(), found.end());
+		matches = std::equal(found.begin(), found.end(), linear.begin() + linearOffsets[q]) && found.size() == linearOffsets[q + 1] - linearOffsets[q];
+	}
+	printf("Sphere : tree %8.3f ms (%7.2f us/query) | linear %8.2f ms | %llu found | %s\n",
+		treeSpheres, treeSpheres * 1000.0 / queryCount, linearSpheres, (unsigned long long)results.size(), matches ? "matches linear" : "MISMATCH vs linear");
+	bool passed = matches;
+
+	// Frustum : the tree against the vector culling kernels over the same boxes
+	mat4 view = lookAtLH(vec3(0.0f, 10.0f, 0.0f), vec3(0.0f, 10.0f, 1.0f), vec3(0.0f, 1.0f, 0.0f));
+	mat4 projection = perspectiveLH_ZO(0.25f * 3.14159265f, 16.0f / 9.0f, 0.1f, 500.0f);
+	Frustum frustum = Frustum::FromViewProjection(view, projection);
+
+	const u32 frustumRepeats = 100;
+	u64 treeVisible = 0;
+	start = BenchClock::now();
+	for (u32 r = 0; r < frustumRepeats; ++r)
+	{
+		treeVisible = 0;
+		tree.QueryFrustum(frustum, [&treeVisible](u32) { ++treeVisible; });
+	}
+	double treeFrustum = MillisecondsSince(start);
+
+	std::vector<float> soa[6];
+	for (u32 c = 0; c < 6; ++c) { soa[c].resize(count); }
+	for (u32 i = 0; i < count; ++i)
+	{
+		for (u32 c = 0; c < 3; ++c)
+		{
+			soa[c][i] = (fatBoxes[i].min[c] + fatBoxes[i].max[c]) * 0.5f;
+			soa[c + 3][i] = (fatBoxes[i].max[c] - fatBoxes[i].min[c]) * 0.5f;
+		}
+	}
+	BoxArrays soaBoxes = { soa[0].data(), soa[1].data(), soa[2].data(), soa[3].data(), soa[4].data(), soa[5].data() };
+	std::vector<u32> visible(count);
+	u64 linearVisible = 0;
+	start = BenchClock::now();
+	for (u32 r = 0; r < frustumRepeats; ++r) { linearVisible = CullBoxes(count, soaBoxes, frustum, visible.data()); }
+	double linearFrustum = MillisecondsSince(start);
+
+	printf("Frustum: tree %8.3f ms (%7.2f us/query) | %s %8.2f ms | %llu visible | %s\n",
+		treeFrustum, treeFrustum * 1000.0 / frustumRepeats, GetCullBoxesPathName(), linearFrustum,
+		(unsigned long long)treeVisible, treeVisible == linearVisible ? "matches linear" : "MISMATCH vs linear");
+	passed &= treeVisible == linearVisible;
+
+	// Rays : nearest fat box along each, skimming the ground from a random point in a random direction
+	std::vector<vec3> origins(queryCount);
+	std::vector<vec3> directions(queryCount);
+	for (u32 q = 0; q < queryCount; ++q)
+	{
+		origins[q] = vec3(random(1000.0f), 5.0f, random(1000.0f));
+		float angle = random(3.14159265f);
+		directions[q] = vec3(std::cos(angle), -0.01f, std::sin(angle));
+	}
+
+	std::vector<float> treeHits(queryCount);
+	start = BenchClock::now();
+	for (u32 q = 0; q < queryCount; ++q)
+	{
+		float nearest = -1.0f;
+		tree.RayCast(origins[q], directions[q], 500.0f, [&nearest](u32, float distance) { nearest = distance; return distance; });
+		treeHits[q] = nearest;
+	}
+	double treeRays = MillisecondsSince(start);
+
+	std::vector<float> linearHits(queryCount);
+	start = BenchClock::now();
+	for (u32 q = 0; q < queryCount; ++q)
+	{
+		vec3 inverseDirection = 1.0f / directions[q];
+		float nearest = -1.0f;
+		float maxDistance = 500.0f;
+		for (u32 i = 0; i < count; ++i)
+		{
+			float distance = DynamicAABBTree::RayDistance(fatBoxes[i], origins[q], inverseDirection, maxDistance);
+			if (distance >= 0.0f) { nearest = distance; maxDistance = distance; }
+		}
+		linearHits[q] = nearest;
+	}
+	double linearRays = MillisecondsSince(start);
+
+	u32 hits = 0;
+	matches = true;
+	for (u32 q = 0; q < queryCount; ++q)
+	{
+		hits += treeHits[q] >= 0.0f ? 1 : 0;
+		matches = matches && treeHits[q] == linearHits[q];
+	}
+	printf("Ray    : tree %8.3f ms (%7.2f us/query) | linear %8.2f ms | %u hit | %s\n",
+		treeRays, treeRays * 1000.0 / queryCount, linearRays, hits, matches ? "matches linear" : "MISMATCH vs linear");
+	return passed && matches;
+}
+
+bool RunOcclusionCullingBenchmarks()
+{
+	const u32 occluderCount = 24;
+	const u32 boxCount = 20000;
+	const u32 repeats = 100;
+
+	// Unit cube as an occluder
+	Vertex cube[8];
+	for (u32 i = 0; i < 8; ++i)
+	{
+		cube[i] = Vertex();
+		cube[i].Position = vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+	}
+	u32 cubeIndices[36] = { 0,1,3, 0,3,2, 4,6,7, 4,7,5, 0,4,5, 0,5,1, 2,3,7, 2,7,6, 0,2,6, 0,6,4, 1,5,7, 1,7,3 };
+	OccluderMesh occluder = OccluderMesh::FromTriangles(cube, 8, cubeIndices, 36, 12);
+
+	// A row of tall blocks 40 units ahead, with small gaps between them, hiding most of what lies beyond
+	std::vector<affine> occluderWorlds;
+	for (u32 i = 0; i < occluderCount; ++i)
+	{
+		occluderWorlds.push_back(AffineFromTRS(vec3(-46.0f + 4.0f * i, 5.0f, 40.0f), quat(1.0f, 0.0f, 0.0f, 0.0f), vec3(1.8f, 15.0f, 1.0f)));
+	}
+
+	// Boxes in front of the row, which must all pass, and behind it, which mostly shouldn't
+	u32 seed = 777;
+	auto random = [&seed](float low, float high) { seed = seed * 1664525u + 1013904223u; return low + ((float)(seed >> 8) / 16777216.0f) * (high - low); };
+	std::vector<vec3> centers(boxCount);
+	std::vector<vec3> extents(boxCount);
+	for (u32 i = 0; i < boxCount; ++i)
+	{
+		bool front = (i % 4) == 0;
+		float z = front ? random(5.0f, 35.0f) : random(45.0f, 300.0f);
+		centers[i] = vec3(random(-0.3f, 0.3f) * z, random(0.0f, 0.1f) * z, z);
+		extents[i] = vec3(random(0.2f, 1.0f));
+	}
+
+	mat4 view = lookAtLH(vec3(0.0f, 2.0f, 0.0f), vec3(0.0f, 2.0f, 1.0f), vec3(0.0f, 1.0f, 0.0f));
+	mat4 projection = perspectiveLH_ZO(0.25f * 3.14159265f, 16.0f / 9.0f, 0.1f, 500.0f);
+
+	OcclusionBuffer serial;
+	OcclusionBuffer tiled;
+	WorkerPool* pool = WorkerPool::Shared();
+
+	BenchClock::time_point start = BenchClock::now();
+	for (u32 r = 0; r < repeats; ++r)
+	{
+		serial.Begin(view, projection);
+		for (u32 i = 0; i < occluderCount; ++i) { serial.AddOccluder(occluder, occluderWorlds[i]); }
+		serial.Rasterize();
+	}
+	double serialTime = MillisecondsSince(start);
+
+	start = BenchClock::now();
+	for (u32 r = 0; r < repeats; ++r)
+	{
+		tiled.Begin(view, projection);
+		for (u32 i = 0; i < occluderCount; ++i) { tiled.AddOccluder(occluder, occluderWorlds[i]); }
+		tiled.Rasterize(pool);
+	}
+	double tiledTime = MillisecondsSince(start);
+
+	bool same = true;
+	for (u32 y = 0; same && y < serial.GetHeight(); ++y)
+	{
+		for (u32 x = 0; same && x < serial.GetWidth(); ++x) { same = serial.GetDepth(x, y) == tiled.GetDepth(x, y); }
+	}
+
+	printf("Occlusion culling, %ux%u buffer, %llu occluder triangles, %u boxes\n",
+		serial.GetWidth(), serial.GetHeight(), (unsigned long long)serial.GetTriangleCount(), boxCount);
+	printf("Raster : 1 thread %7.3f ms/frame | %u workers %7.3f ms/frame | %s\n",
+		serialTime / repeats, pool->GetWorkerCount(), tiledTime / repeats, same ? "same depth" : "DEPTH MISMATCH");
+
+	u32 hidden = 0;
+	u32 wronglyHidden = 0;
+	start = BenchClock::now();
+	for (u32 r = 0; r < repeats; ++r)
+	{
+		hidden = 0;
+		wronglyHidden = 0;
+		for (u32 i = 0; i < boxCount; ++i)
+		{
+			if (tiled.IsBoxVisible(centers[i], extents[i])) { continue; }
+			hidden++;
+			if ((i % 4) == 0) { wronglyHidden++; }
+		}
+	}
+	double testTime = MillisecondsSince(start);
+
+	printf("Test   : %8.2f ms (%6.2f ns/box) | %u hidden (%.1f%% of those behind the row) | %u in front wrongly hidden\n",
+		testTime, testTime * 1000000.0 / ((double)boxCount * repeats), hidden, 100.0 * hidden / (boxCount - (boxCount + 3) / 4), wronglyHidden);
+
+	if (tiled.DumpDepth("OcclusionBenchmark.pgm")) { printf("Depth buffer written to OcclusionBenchmark.pgm\n"); }
+
+	// Hiding anything that's in front of every occluder is a culling bug, not a tuning question
+	return same && wronglyHidden == 0;
+}
+
+bool RunShadowCascadeBenchmarks()
+{
+	const u32 count = 50000;
+	const u32 repeats = 1000;
+	const u32 receiverCount = 1000;
+	const u32 frames = 600;
+
+	// Units and a few tall towers scattered over a 2 km square map
+	u32 seed = 4242;
+	auto random = [&seed](float low, float high) { seed = seed * 1664525u + 1013904223u; return low + ((float)(seed >> 8) / 16777216.0f) * (high - low); };
+	std::vector<float> soa[6];
+	for (u32 c = 0; c < 6; ++c) { soa[c].resize(count); }
+	for (u32 i = 0; i < count; ++i)
+	{
+		float height = (i % 50) == 0 ? random(10.0f, 40.0f) : random(0.5f, 3.0f);
+		vec3 center(random(-1000.0f, 1000.0f), height, random(-1000.0f, 1000.0f));
+		vec3 extents(random(0.5f, 2.0f), height, random(0.5f, 2.0f));
+		for (u32 c = 0; c < 3; ++c)
+		{
+			soa[c][i] = center[c];
+			soa[c + 3][i] = extents[c];
+		}
+	}
+	BoxArrays boxes = { soa[0].data(), soa[1].data(), soa[2].data(), soa[3].data(), soa[4].data(), soa[5].data() };
+
+	vec3 lightDirection = normalize(vec3(0.3f, -1.0f, 0.4f));
+	mat4 projection = perspectiveLH_ZO(0.25f * 3.14159265f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	mat4 view = lookAtLH(vec3(0.0f, 20.0f, 0.0f), vec3(0.0f, 0.0f, 100.0f), vec3(0.0f, 1.0f, 0.0f));
+
+	ShadowCascades cascades(ShadowCascades::MAX_CASCADES, 2048);
+	ShadowCascades single(1, 2048);
+
+	BenchClock::time_point start = BenchClock::now();
+	for (u32 r = 0; r < repeats; ++r) { cascades.Update(view, projection, 0.1f, 1000.0f, lightDirection); }
+	double fitTime = MillisecondsSince(start);
+	single.Update(view, projection, 0.1f, 1000.0f, lightDirection);
+
+	printf("Shadow cascades, %u casters, %u cascades over %.0f units of view\n", count, cascades.GetCascadeCount(), cascades.GetShadowDistance());
+	printf("Fit    : %8.3f us per update\n", fitTime * 1000.0 / repeats);
+
+	// Casters of each cascade, against a single map over the whole shadow distance
+	std::vector<u32> casters[ShadowCascades::MAX_CASCADES];
+	u64 casterTotal = 0;
+	start = BenchClock::now();
+	for (u32 r = 0; r < repeats / 10; ++r)
+	{
+		casterTotal = 0;
+		for (u32 i = 0; i < cascades.GetCascadeCount(); ++i)
+		{
+			casters[i].resize(count);
+			casters[i].resize((size_t)CullBoxes(count, boxes, cascades.GetCascade(i).casterVolume, casters[i].data()));
+			casterTotal += casters[i].size();
+		}
+	}
+	double cullTime = MillisecondsSince(start);
+
+	std::vector<u32> singleCasters(count);
+	singleCasters.resize((size_t)CullBoxes(count, boxes, single.GetCascade(0).casterVolume, singleCasters.data()));
+
+	printf("Cull   : %8.3f ms per frame for every cascade\n", cullTime / (repeats / 10));
+	for (u32 i = 0; i < cascades.GetCascadeCount(); ++i)
+	{
+		const ShadowCascades::Cascade& cascade = cascades.GetCascade(i);
+		printf("  cascade %u : depth %7.2f to %7.2f | radius %7.2f | texel %6.3f | %6llu casters\n", i, cascade.splitNear, cascade.splitFar,
+			cascade.radius, cascade.texelSize, (unsigned long long)casters[i].size());
+	}
+	printf("  %llu draws in all, against %llu for one map over the same distance (texel %.3f) and %u for every caster\n",
+		(unsigned long long)casterTotal, (unsigned long long)singleCasters.size(), single.GetCascade(0).texelSize, count);
+
+	// Receivers anywhere in the shadowed part of the view must land inside their cascade's map, and every box between
+	// them and the light must be among that cascade's casters
+	mat4 inverseView = inverse(view);
+	u32 outsideMap = 0;
+	u32 missedCasters = 0;
+	u32 shadowed = 0;
+	for (u32 k = 0; k < receiverCount; ++k)
+	{
+		u32 c = k % cascades.GetCascadeCount();
+		const ShadowCascades::Cascade& cascade = cascades.GetCascade(c);
+		float depth = random(cascade.splitNear, cascade.splitFar);
+		vec3 receiver = vec3(inverseView * vec4(random(-1.0f, 1.0f) * depth / projection[0][0], random(-1.0f, 1.0f) * depth / projection[1][1], depth, 1.0f));
+
+		vec4 clip = cascade.viewProjection * vec4(receiver, 1.0f);
+		if (abs(clip.x) > 1.0f || abs(clip.y) > 1.0f || clip.z < 0.0f || clip.z > 1.0f) { outsideMap++; }
+
+		vec3 origin = receiver;
+		vec3 inverseDirection = 1.0f / -lightDirection;
+		bool blocked = false;
+		for (u32 i = 0; i < count; ++i)
+		{
+			vec3 center(soa[0][i], soa[1][i], soa[2][i]);
+			vec3 extents(soa[3][i], soa[4][i], soa[5][i]);
+			AABB box = { center - extents, center + extents };
+			if (DynamicAABBTree::RayDistance(box, origin, inverseDirection, FLT_MAX) < 0.0f) { continue; }
+			blocked = true;
+			if (!std::binary_search(casters[c].begin(), casters[c].end(), i)) { missedCasters++; }
+		}
+		shadowed += blocked ? 1 : 0;
+	}
+	printf("Check  : %u receivers (%u shadowed) | %u outside their cascade's map | %u casters missed\n", receiverCount, shadowed, outsideMap, missedCasters);
+
+	// A camera turning a full circle, which mustn't change any cascade's size, then drifting slowly, where only cascades
+	// whose matrices changed need drawing again over a still scene
+	u32 unchanged[ShadowCascades::MAX_CASCADES] = {};
+	float maxSnapError = 0.0f;
+	bool sameSize = true;
+	mat4 previous[ShadowCascades::MAX_CASCADES];
+	float radii[ShadowCascades::MAX_CASCADES];
+	for (u32 f = 0; f < frames; ++f)
+	{
+		bool turning = f < frames / 2;
+		vec3 eye = turning ? vec3(0.0f, 20.0f, 0.0f) : vec3(0.0f, 20.0f, 0.01f * (f - frames / 2));
+		float yaw = turning ? 6.2831853f * f / (frames / 2) : 0.0f;
+		cascades.Update(lookAtLH(eye, eye + vec3(sin(yaw), -0.2f, cos(yaw)), vec3(0.0f, 1.0f, 0.0f)), projection, 0.1f, 1000.0f, lightDirection);
+		for (u32 i = 0; i < cascades.GetCascadeCount(); ++i)
+		{
+			const ShadowCascades::Cascade& cascade = cascades.GetCascade(i);
+			for (u32 r = 0; r < 3; ++r)
+			{
+				float texels = cascade.view[3][r] / cascade.texelSize;
+				maxSnapError = std::max(maxSnapError, std::abs(texels - std::round(texels)));
+			}
+			if (f > 0) { sameSize &= radii[i] == cascade.radius; }
+			if (f > frames / 2) { unchanged[i] += memcmp(&previous[i], &cascade.view, sizeof(previous[i])) == 0 ? 1 : 0; }
+			previous[i] = cascade.view;
+			radii[i] = cascade.radius;
+		}
+	}
+	printf("Moving : turning, sizes %s | worst snap %.4f texels | drifting 0.01 units a frame, unchanged frames per cascade :",
+		sameSize ? "constant" : "CHANGED", maxSnapError);
+	for (u32 i = 0; i < cascades.GetCascadeCount(); ++i) { printf(" %.1f%%", 100.0 * unchanged[i] / (frames / 2 - 1)); }
+	printf("\n");
+
+	return outsideMap == 0 && missedCasters == 0 && sameSize;
+}
+
+bool RunClusteredLightingBenchmarks()
+{
+	const u32 lightCount = 1000;
+	const u32 width = 1920;
+	const u32 height = 1080;
+	const u32 repeats = 100;
+
+	// Small lights scattered through the first 300 units in front of the camera, most of them in view
+	u32 seed = 9001;
+	auto random = [&seed](float low, float high) { seed = seed * 1664525u + 1013904223u; return low + ((float)(seed >> 8) / 16777216.0f) * (high - low); };
+	std::vector<PointLight> lights(lightCount);
+	for (u32 i = 0; i < lightCount; ++i)
+	{
+		float z = random(0.0f, 300.0f);
+		lights[i] = PointLight();
+		lights[i].Position = vec3(random(-0.6f, 0.6f) * z, random(-2.0f, 20.0f), z);
+		lights[i].Range = random(2.0f, 10.0f);
+	}
+
+	mat4 view = lookAtLH(vec3(0.0f, 10.0f, -5.0f), vec3(0.0f, 8.0f, 50.0f), vec3(0.0f, 1.0f, 0.0f));
+	mat4 projection = perspectiveLH_ZO(0.25f * 3.14159265f, (float)width / (float)height, 0.1f, 1000.0f);
+
+	LightClusters clusters;
+	BenchClock::time_point start = BenchClock::now();
+	clusters.Build(projection, width, height, 0.1f, 1000.0f);
+	double buildTime = MillisecondsSince(start);
+
+	start = BenchClock::now();
+	for (u32 r = 0; r < repeats; ++r) { clusters.Assign(view, lights.data(), lightCount); }
+	double serialTime = MillisecondsSince(start);
+	std::vector<LightClusters::ClusterRange> serialRanges = clusters.GetRanges();
+	std::vector<u32> serialIndices = clusters.GetLightIndices();
+
+	WorkerPool* pool = WorkerPool::Shared();
+	start = BenchClock::now();
+	for (u32 r = 0; r < repeats; ++r) { clusters.Assign(view, lights.data(), lightCount, pool); }
+	double pooledTime = MillisecondsSince(start);
+
+	// Reference : every light against every cluster box, one at a time
+	u32 clusterCount = clusters.GetClusterCount();
+	std::vector<vec3> viewPositions(lightCount);
+	for (u32 i = 0; i < lightCount; ++i) { viewPositions[i] = vec3(view * vec4(lights[i].Position, 1.0f)); }
+
+	start = BenchClock::now();
+	std::vector<u32> referenceIndices;
+	std::vector<u32> referenceOffsets(clusterCount + 1);
+	for (u32 c = 0; c < clusterCount; ++c)
+	{
+		referenceOffsets[c] = (u32)referenceIndices.size();
+		const AABB& box = clusters.GetClusterBox(c);
+		for (u32 i = 0; i < lightCount; ++i)
+		{
+			if (DynamicAABBTree::Overlaps(box, viewPositions[i], lights[i].Range)) { referenceIndices.push_back(i); }
+		}
+	}
+	referenceOffsets[clusterCount] = (u32)referenceIndices.size();
+	double referenceTime = MillisecondsSince(start);
+
+	const std::vector<LightClusters::ClusterRange>& ranges = clusters.GetRanges();
+	const std::vector<u32>& indices = clusters.GetLightIndices();
+	bool matches = indices == referenceIndices && serialIndices == indices;
+	u32 maxCount = 0;
+	u32 emptyClusters = 0;
+	for (u32 c = 0; matches && c < clusterCount; ++c)
+	{
+		matches = ranges[c].offset == referenceOffsets[c] && ranges[c].count == referenceOffsets[c + 1] - referenceOffsets[c] &&
+			serialRanges[c].offset == ranges[c].offset && serialRanges[c].count == ranges[c].count;
+		maxCount = std::max(maxCount, ranges[c].count);
+		emptyClusters += ranges[c].count == 0 ? 1 : 0;
+	}
+
+	printf("Clustered lighting, %u point lights, %ux%u screen : %ux%ux%u clusters (built in %.3f ms)\n", lightCount, width, height,
+		clusters.GetTilesX(), clusters.GetTilesY(), LightClusters::DEPTH_SLICES, buildTime);
+	printf("Assign : brute force %8.3f ms | 1 thread %7.3f ms/frame | %u workers %7.3f ms/frame | %s\n",
+		referenceTime, serialTime / repeats, pool->GetWorkerCount(), pooledTime / repeats, matches ? "matches brute force" : "MISMATCH vs brute force");
+	printf("Result : %llu light indices (%.2f per cluster, at most %u, %.1f%% of clusters empty) | %.1f KB to upload per frame\n",
+		(unsigned long long)indices.size(), (double)indices.size() / clusterCount, maxCount, 100.0 * emptyClusters / clusterCount,
+		(indices.size() * sizeof(u32) + ranges.size() * sizeof(LightClusters::ClusterRange) + lightCount * sizeof(PointLight)) / 1024.0);
+
+	return matches;
+}
+
+bool RunRenderQueueBenchmarks()
+{
+	const u32 meshCount = 5;
+	const u32 materialCount = 5;
+	const u32 frames = 20;
+
+	NullRenderDevice device;
+	Mesh* meshes[meshCount];
+	for (u32 m = 0; m < meshCount; ++m) { meshes[m] = CreateBenchMesh(&device); }
+	Material materials[materialCount];
+
+	// The null device never dereferences shaders, so any distinct address stands in for an instanced one
+	u08 instancedStandIn = 0;
+	SimpleVertexShader* instanced = reinterpret_cast<SimpleVertexShader*>(&instancedStandIn);
+
+	mat4 view = identity<mat4>();
+	bool sorted = true;
+	bool packed = true;
+
+	printf("Render queue submission, %u frames each\n", frames);
+	u32 counts[] = { 10000, 100000 };
+	for (u32 c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+	{
+		u32 count = counts[c];
+		std::vector<affine> worlds(count);
+		for (u32 i = 0; i < count; ++i) { worlds[i] = AffineFromTRS(vec3((float)(i % 100), 0.0f, (float)(i / 100)), identity<quat>(), vec3(1.0f)); }
+
+		RenderQueue queue(&device);
+		double submitTime = 0.0;
+		double sortTime = 0.0;
+		double batchTime = 0.0;
+		for (u32 f = 0; f < frames; ++f)
+		{
+			BenchClock::time_point start = BenchClock::now();
+			queue.Begin(view, 0.1f, 1000.0f);
+			for (u32 i = 0; i < count; ++i) { queue.Submit(PASS_OPAQUE, meshes[i % meshCount], &materials[(i / meshCount) % materialCount], worlds[i]); }
+			submitTime += MillisecondsSince(start);
+
+			start = BenchClock::now();
+			queue.Sort();
+			sortTime += MillisecondsSince(start);
+
+			start = BenchClock::now();
+			queue.BuildBatches();
+			batchTime += MillisecondsSince(start);
+		}
+
+		// The last frame's keys must have come out of the sort in order, and drawing it instanced must upload every
+		// world exactly once
+		bool keysSorted = true;
+		for (u64 i = 1; i < queue.GetDrawCount(); ++i) { keysSorted &= queue.GetKey(i - 1) <= queue.GetKey(i); }
+
+		device.Reset();
+		queue.SetInstancedShader(nullptr, instanced);
+		queue.Execute(view, view);
+		bool worldsPacked = CheckInstancePacking(device, worlds);
+
+		printf("%6u draws -> %llu batches : submit %7.3f ms | sort %7.3f ms | batch + pack %7.3f ms (per frame) | %s | %s\n",
+			count, (unsigned long long)queue.GetBatchCount(), submitTime / frames, sortTime / frames, batchTime / frames,
+			keysSorted ? "keys sorted" : "keys OUT OF ORDER", worldsPacked ? "worlds packed once" : "worlds MISPACKED");
+		sorted &= keysSorted;
+		packed &= worldsPacked;
+	}
+
+	for (u32 m = 0; m < meshCount; ++m) { delete meshes[m]; }
+	return sorted && packed;
+}
+
+bool RunHeadlessFrameBenchmarks()
+{
+	const u32 meshCount = 4;
+	const u32 materialCount = 4;
+	const u32 frames = 10;
+
+	NullRenderDevice device;
+	device.SetRecording(false);
+
+	Mesh* meshes[meshCount];
+	for (u32 m = 0; m < meshCount; ++m) { meshes[m] = CreateBenchMesh(&device); }
+
+	// Textures are never read either, but distinct ones tell the materials apart in the command stream
+	u08 textureStandIns[materialCount];
+	Material materials[materialCount];
+	for (u32 m = 0; m < materialCount; ++m) { materials[m].CreateMaterial(nullptr, nullptr, reinterpret_cast<GPUTextureView*>(&textureStandIns[m]), nullptr); }
+
+	// The null device never dereferences shaders, so any distinct address stands in for an instanced one
+	u08 instancedStandIn = 0;
+	SimpleVertexShader* instanced = reinterpret_cast<SimpleVertexShader*>(&instancedStandIn);
+
+	mat4 view = identity<mat4>();
+
+	printf("Headless frames against the null render device, %u frames each, 10%% of entities moving\n", frames);
+	bool sameDraws = true;
+	u32 counts[] = { 10000, 100000 };
+	for (u32 c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+	{
+		// The last frame drawn without instancing must draw every entity exactly once, and the instanced one the same
+		std::vector<RecordedDraw> expected;
+		for (u32 instancing = 0; instancing < 2; ++instancing)
+		{
+			u32 count = counts[c];
+
+			Scene scene;
+			for (u32 i = 0; i < count; ++i)
+			{
+				scene.SpawnEntity(meshes[i % meshCount], &materials[(i / meshCount) % materialCount], nullptr,
+					Transform(vec3((float)(i % 300), 0.0f, (float)(i / 300))));
+			}
+
+			RenderQueue queue(&device);
+			if (instancing) { queue.SetInstancedShader(nullptr, instanced); }
+
+			double updateTime = 0.0;
+			double submitTime = 0.0;
+			double executeTime = 0.0;
+			device.Reset();
+
+			const std::vector<Entity*>& entities = scene.GetEntities();
+			for (u32 f = 0; f < frames; ++f)
+			{
+				BenchClock::time_point start = BenchClock::now();
+				for (u32 i = f % 10; i < entities.size(); i += 10) { entities[i]->Translate(vec3(0.0f, 0.01f, 0.0f)); }
+				scene.ApplyStructuralChanges();
+				scene.UpdateTransforms();
+				updateTime += MillisecondsSince(start);
+
+				start = BenchClock::now();
+				queue.Begin(view, 0.1f, 1000.0f);
+				for (u64 i = 0; i < entities.size(); ++i) { queue.Submit(PASS_OPAQUE, entities[i]->meshObject, entities[i]->material, entities[i]->GetWorldAffine()); }
+				queue.Sort();
+				queue.BuildBatches();
+				submitTime += MillisecondsSince(start);
+
+				start = BenchClock::now();
+				queue.Execute(view, view);
+				executeTime += MillisecondsSince(start);
+			}
+
+			printf("%6u entities, instancing %-3s : update %7.3f ms | submit + sort + batch %7.3f ms | execute %7.3f ms | %u draws, %u constant copies (per frame)\n",
+				count, instancing ? "on" : "off", updateTime / frames, submitTime / frames, executeTime / frames,
+				(device.GetCount(NullRenderDevice::CMD_DRAW_INDEXED) + device.GetCount(NullRenderDevice::CMD_DRAW_INDEXED_INSTANCED)) / frames,
+				device.GetCount(NullRenderDevice::CMD_COPY_CONSTANTS) / frames);
+
+			// Drawn once more with recording on, to compare the draws themselves
+			device.SetRecording(true);
+			device.Reset();
+			queue.Execute(view, view);
+			std::vector<RecordedDraw> draws = CollectDraws(device);
+			device.Reset();
+			device.SetRecording(false);
+
+			if (!instancing)
+			{
+				for (u64 i = 0; i < entities.size(); ++i)
+				{
+					RecordedDraw draw = { entities[i]->meshObject->GetVertexBuffer(), entities[i]->material->GetShaderResourceView(), entities[i]->GetWorldAffine() };
+					expected.push_back(draw);
+				}
+				std::sort(expected.begin(), expected.end());
+			}
+			bool same = draws == expected;
+			printf("  %s\n", same ? (instancing ? "same draws as without instancing" : "every entity drawn once") : "DIFFERENT draws");
+			sameDraws &= same;
+		}
+	}
+
+	for (u32 m = 0; m < meshCount; ++m) { delete meshes[m]; }
+	return sameDraws;
+}
+
+bool RunJobSystemBenchmarks()
+{
+	const u64 elements = 1 << 20;
+	const u64 grain = 1024;
+	const u32 tinyJobs = 100000;
+
+	u32 maxThreads = std::thread::hardware_concurrency();
+	if (maxThreads == 0) { maxThreads = 1; }
+
+	// Enough math per element that the loop is compute bound rather than memory bound
+	std::vector<float> values(elements);
+	WorkerPool::RangeFunction work = [&](u64 begin, u64 end)
+	{
+		for (u64 i = begin; i < end; ++i)
+		{
+			float x = (float)i * 0.001f;
+			for (u32 k = 0; k < 16; ++k) { x = std::sqrt(x * x + 1.0f) * std::sin(x); }
+			values[i] = x;
+		}
+	};
+
+	printf("Job system scaling, parallel for over %llu elements (grain %llu) and %u empty jobs\n",
+		(unsigned long long)elements, (unsigned long long)grain, tinyJobs);
+
+	// Correctness is checked on a few threads even when the machine has fewer, so stealing always gets exercised
+	u32 checkedThreads = std::max(maxThreads, 4u);
+	bool correct = true;
+
+	double baseline = 0.0;
+	for (u32 threads = 1; threads <= checkedThreads; ++threads)
+	{
+		WorkerPool pool(threads - 1);
+
+		bool covered = CheckParallelFor(pool);
+		bool ordered = CheckDependencies(pool);
+		correct &= covered && ordered;
+		if (threads > maxThreads)
+		{
+			printf("%2u threads : %s | %s (checks only, more threads than the hardware has)\n", threads,
+				covered ? "every index once" : "indices MISSED OR REPEATED", ordered ? "dependencies respected" : "dependency STARTED EARLY");
+			continue;
+		}
+
+		BenchClock::time_point start = BenchClock::now();
+		pool.ParallelFor(elements, grain, work);
+		double loop = MillisecondsSince(start);
+		if (threads == 1) { baseline = loop; }
+
+		JobCounter counter;
+		std::atomic<u32> ran(0);
+		start = BenchClock::now();
+		for (u32 j = 0; j < tinyJobs; ++j) { pool.Run([&]() { ran.fetch_add(1, std::memory_order_relaxed); }, &counter); }
+		pool.Wait(&counter);
+		double jobs = MillisecondsSince(start);
+
+		printf("%2u threads : parallel for %8.2f ms (x%5.2f) | %6.1f ns/job | %s | %s\n",
+			threads, loop, baseline / loop, jobs * 1000000.0 / tinyJobs,
+			covered ? "every index once" : "indices MISSED OR REPEATED", ordered ? "dependencies respected" : "dependency STARTED EARLY");
+	}
+
+	return correct;
+}
+
+bool RunProfilerBenchmarks()
+{
+	const u32 zones = 1000000;
+	const u32 runs = 5;
+	const double budget = 50.0;
+
+	// Best of several runs, as anything else on the machine only ever makes a run slower
+	// Zones are used directly so this measures them even in builds where the macros compile out
+	double flat = DBL_MAX;
+	double nested = DBL_MAX;
+	double timestamps = DBL_MAX;
+	for (u32 r = 0; r < runs; ++r)
+	{
+		BenchClock::time_point start = BenchClock::now();
+		for (u32 i = 0; i < zones; ++i) { Profiler::Zone zone("Bench"); }
+		flat = std::min(flat, MillisecondsSince(start));
+
+		start = BenchClock::now();
+		for (u32 i = 0; i < zones / 2; ++i)
+		{
+			Profiler::Zone outer("Bench outer");
+			Profiler::Zone inner("Bench inner");
+		}
+		nested = std::min(nested, MillisecondsSince(start));
+
+		// The two timestamp reads every zone needs, which is as cheap as a zone can get ; the compiler never drops them
+		start = BenchClock::now();
+		for (u32 i = 0; i < zones; ++i)
+		{
+			Profiler::ReadTimestamp();
+			Profiler::ReadTimestamp();
+		}
+		timestamps = std::min(timestamps, MillisecondsSince(start));
+	}
+
+	double flatZone = flat * 1000000.0 / zones;
+	double nestedZone = nested * 1000000.0 / zones;
+	printf("Profiler zones, %u per run, best of %u (budget %.0f ns/zone, timestamps alone %.2f ns)\n",
+		zones, runs, budget, timestamps * 1000000.0 / zones);
+	printf("Flat   : %8.2f ms (%6.2f ns/zone) | %s\n", flat, flatZone, flatZone <= budget ? "within budget" : "OVER BUDGET");
+	printf("Nested : %8.2f ms (%6.2f ns/zone) | %s\n", nested, nestedZone, nestedZone <= budget ? "within budget" : "OVER BUDGET");
+	return flatZone <= budget && nestedZone <= budget;
+}
+
+bool RunFramePipelineBenchmarks()
+{
+	const u32 frames = 300;
+	const double simulationCost = 2.0;
+	const double renderCost = 2.0;
+
+	printf("Frame pipelining, %u frames of %.1f ms simulation + %.1f ms rendering (%u hardware threads)\n",
+		frames, simulationCost, renderCost, std::thread::hardware_concurrency());
+
+	// Serial : both halves back to back, latency is the frame itself
+	BenchClock::time_point start = BenchClock::now();
+	double serialLatency = 0.0;
+	for (u32 f = 0; f < frames; ++f)
+	{
+		BenchClock::time_point frameStart = BenchClock::now();
+		BusyWork(simulationCost);
+		BusyWork(renderCost);
+		serialLatency += MillisecondsSince(frameStart);
+	}
+	double serial = MillisecondsSince(start);
+
+	// Pipelined : one extra request fills the pipeline, so every requested frame also gets rendered
+	// Frames must come out in the order they were requested, each simulated for itself with what it was requested with
+	double pipelinedLatency = 0.0;
+	u32 rendered = 0;
+	bool inOrder = true;
+	start = BenchClock::now();
+	{
+		FramePipeline pipeline([&](FrameSnapshot* frame)
+		{
+			BusyWork(simulationCost);
+			static_cast<BenchSnapshot*>(frame)->simulatedFrame = frame->frameIndex;
+		}, new BenchSnapshot(), new BenchSnapshot());
+
+		for (u32 f = 0; f <= frames; ++f)
+		{
+			pipeline.RequestFrame(0.0f, (float)f);
+			FrameSnapshot* frame = pipeline.AcquireFrame();
+			if (frame == nullptr) { continue; }
+
+			inOrder &= frame->frameIndex == rendered && static_cast<BenchSnapshot*>(frame)->simulatedFrame == rendered &&
+				frame->totalTime == (float)rendered;
+			BusyWork(renderCost);
+			pipeline.ReleaseFrame(frame);
+			pipelinedLatency += pipeline.GetLastLatency();
+			rendered++;
+		}
+	}
+	double pipelined = MillisecondsSince(start);
+	bool complete = rendered == frames;
+
+	printf("Serial    : %8.2f ms (%6.3f ms/frame) | latency %6.3f ms\n", serial, serial / frames, serialLatency / frames);
+	printf("Pipelined : %8.2f ms (%6.3f ms/frame) | latency %6.3f ms | x%4.2f throughput | %u of %u frames %s\n",
+		pipelined, pipelined / rendered, pipelinedLatency / rendered, (serial / frames) / (pipelined / rendered),
+		rendered, frames, inOrder ? "in order" : "OUT OF ORDER");
+	return complete && inOrder;
+}
+
+bool RunBenchmarks()
+{
+	// Every benchmark runs even after a failure, so one report shows everything that's off
+	bool passed = true;
+	passed &= RunTransformBenchmarks();
+	passed &= RunSpawnBenchmarks();
+	passed &= RunTransformKernelBenchmarks();
+	passed &= RunFrustumCullingBenchmarks();
+	passed &= RunSpatialIndexBenchmarks();
+	passed &= RunOcclusionCullingBenchmarks();
+	passed &= RunShadowCascadeBenchmarks();
+	passed &= RunClusteredLightingBenchmarks();
+	passed &= RunRenderQueueBenchmarks();
+	passed &= RunHeadlessFrameBenchmarks();
+	passed &= RunJobSystemBenchmarks();
+	passed &= RunProfilerBenchmarks();
+	passed &= RunFramePipelineBenchmarks();
+
+	printf("%s\n", passed ? "All validation passed" : "VALIDATION FAILED");
+	return passed;
+}
@@ -0,0 +1,59 @@
+#ifndef BENCHMARKS_H_
+#define BENCHMARKS_H_
+
+// Engine microbenchmarks, run instead of the game when the executable is started with "-benchmark", or by the
+// portable BenchmarkRunner target
+// Results are printed to stdout ; nothing here touches DirectX
+// Every benchmark also checks its results, and returns false when they're wrong
+
+// Recursive dirty flags (the old Object scheme) versus the TransformStore's version stamps, which must read the same worlds
+bool RunTransformBenchmarks();
+
+// Spawning a wave entity by entity versus Scene::SpawnBatch, then waves spawned and destroyed over and over, which must
+// reuse their transform slots
+bool RunSpawnBenchmarks();
+
+// Scalar versus SSE versus AVX2 batch TRS composition, validated against the scalar results
+bool RunTransformKernelBenchmarks();
+
+// World box gathering, then scalar versus SSE versus AVX frustum culling over a large, mostly off screen map
+bool RunFrustumCullingBenchmarks();
+
+// Dynamic AABB tree : building, moving proxies, and sphere, frustum and ray queries against a linear scan of the same boxes
+bool RunSpatialIndexBenchmarks();
+
+// Software occlusion culling : occluder rasterization on one thread versus one job per tile, then box tests, none of
+// which may hide a box in front of the occluders
+bool RunOcclusionCullingBenchmarks();
+
+// Shadow cascades : fitting, casters per cascade against one map over the whole view, receivers checked against
+// brute force ray casts towards the light, and how often a slowly moving camera leaves a cascade's matrices unchanged
+bool RunShadowCascadeBenchmarks();
+
+// Clustered light assignment : 1000 point lights into a 1080p cluster grid, on one thread and one job per depth slice,
+// validated against testing every light against every cluster
+bool RunClusteredLightingBenchmarks();
+
+// RenderQueue submission, sorting and instance batching (CPU side only), checking the sorted keys' order and that an
+// instanced execute uploads every world exactly once
+bool RunRenderQueueBenchmarks();
+
+// Whole CPU side of a frame (scene update, submission, sorting, batching, draw calls) against a null render device,
+// checking that instanced and regular frames draw every entity exactly once
+bool RunHeadlessFrameBenchmarks();
+
+// Job system scaling from 1 to every hardware thread : a compute bound parallel for, and tiny job throughput
+// Every pool also checks that a parallel for visits each index once and that dependent jobs wait for their counter
+bool RunJobSystemBenchmarks();
+
+// Cost of recording a profiler zone, flat and nested, against the 50 ns per zone budget
+bool RunProfilerBenchmarks();
+
+// Serial versus pipelined frames (simulation on its own thread) with equal simulation and render costs : throughput and latency,
+// checking that every requested frame gets rendered, in order, with its own simulated data
+bool RunFramePipelineBenchmarks();
+
+// Runs every benchmark above ; false when any validation failed
+bool RunBenchmarks();
+
+#endif
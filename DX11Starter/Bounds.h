@@ -0,0 +1,32 @@
+#ifndef BOUNDS_H_
+#define BOUNDS_H_
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+
+#include "Affine.h"
+
+// Local space bounds of a mesh, calculated once when it is loaded
+struct MeshBounds
+{
+	glm::vec3 center;  // Of the box
+	glm::vec3 extents; // Half the size of the box
+	float radius;      // Of the sphere around center holding every vertex
+};
+
+// Axis aligned box by its corners, in whatever space its user works in
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Smallest world space box holding the mesh's box once transformed by world
+// Each world extent sums the absolute contributions of the local extents (works for any rotation, scale or shear)
+inline void TransformBounds(const MeshBounds& bounds, const affine& world, glm::vec3& center, glm::vec3& extents)
+{
+	center = world[0] * bounds.center.x + world[1] * bounds.center.y + world[2] * bounds.center.z + world[3];
+	extents = glm::abs(world[0]) * bounds.extents.x + glm::abs(world[1]) * bounds.extents.y + glm::abs(world[2]) * bounds.extents.z;
+}
+
+#endif
@@ -9,6 +9,8 @@ Camera::Camera()
 	camRotX = 0.0f;
 	camRotY = 0.0f;
 	cameraSpeed = 13.5f;
+	nearClip = 0.1f;
+	farClip = 1000.0f;
 	forward = XMVectorSet(0, 0, 1, 0);
 	up = XMVectorSet(0, 1, 0, 0);
 }
@@ -83,8 +85,8 @@ void Camera::UpdateProjectionMatrix(float aspect)
 	XMMATRIX P = XMMatrixPerspectiveFovLH(
 		0.25f * 3.1415926535f,		// Field of View Angle
 		aspect,		// Aspect ratio
-		0.1f,						// Near clip plane distance
-		1000.0f);					// Far clip plane distance
+		nearClip,					// Near clip plane distance
+		farClip);					// Far clip plane distance
 	XMStoreFloat4x4(&projMatrix, XMMatrixTranspose(P)); // Transpose for HLSL!
 }
 
@@ -132,6 +134,16 @@ float Camera::GetCameraRotationY()
 	return camRotY;
 }
 
+float Camera::GetNearClip()
+{
+	return nearClip;
+}
+
+float Camera::GetFarClip()
+{
+	return farClip;
+}
+
 void Camera::SetCameraRotationX(float newX)
 {
 	camRotX = newX;
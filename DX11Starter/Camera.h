@@ -27,6 +27,9 @@ public:
 	float GetCameraRotationX();
 	float GetCameraRotationY();
 
+	float GetNearClip();
+	float GetFarClip();
+
 	// Setter methods
 	void SetCameraPostion(DirectX::XMVECTOR newPos);
 	void SetCameraDirection(DirectX::XMVECTOR newDir);
@@ -50,5 +53,8 @@ private:
 	float camRotY;
 
 	float cameraSpeed;
+
+	float nearClip;
+	float farClip;
 };
 
@@ -0,0 +1,234 @@
+#include "ClusteredLighting.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <xmmintrin.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+const u32 LightClusters::TILE_SIZE;
+const u32 LightClusters::DEPTH_SLICES;
+
+namespace
+{
+	// Bit i set when light i of the 4 at x, y, z, radius reaches the box ; the distance from each center to the box
+	// is whichever of its distances to the two faces is positive along each axis
+	inline int SphereBoxMask(__m128 x, __m128 y, __m128 z, __m128 radius, const AABB& box)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.x), x), _mm_sub_ps(x, _mm_set1_ps(box.max.x))), zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.y), y), _mm_sub_ps(y, _mm_set1_ps(box.max.y))), zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.z), z), _mm_sub_ps(z, _mm_set1_ps(box.max.z))), zero);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		return _mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(radius, radius)));
+	}
+}
+
+void LightClusters::LightArrays::Clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+	index.clear();
+}
+
+void LightClusters::LightArrays::Add(float lx, float ly, float lz, float lr, u32 light)
+{
+	x.push_back(lx);
+	y.push_back(ly);
+	z.push_back(lz);
+	radius.push_back(lr);
+	index.push_back(light);
+}
+
+void LightClusters::LightArrays::Pad()
+{
+	// Infinitely far away, so distances to them are infinite rather than NaN, and no wider than a point
+	while ((index.size() & 3) != 0) { Add(FLT_MAX, FLT_MAX, FLT_MAX, 0.0f, U32_MAX); }
+}
+
+LightClusters::LightClusters(float firstSliceDepth) :
+	screenWidth(0),
+	screenHeight(0),
+	tilesX(0),
+	tilesY(0),
+	nearSliceDepth(firstSliceDepth),
+	sliceScale(0.0f),
+	sliceBias(0.0f),
+	builtProjection()
+{
+	// Nothing interesting to do here
+}
+
+void LightClusters::Build(const glm::mat4& projection, u32 width, u32 height, float nearClip, float farClip)
+{
+	if (!clusterBoxes.empty() && width == screenWidth && height == screenHeight &&
+		memcmp(&projection, &builtProjection, sizeof(projection)) == 0)
+	{
+		return;
+	}
+
+	screenWidth = width;
+	screenHeight = height;
+	builtProjection = projection;
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	// Slice 0 ends at the first slice depth, slices 1 on split the rest exponentially
+	float first = glm::clamp(nearSliceDepth, nearClip, farClip);
+	sliceDepths.resize(DEPTH_SLICES + 1);
+	sliceDepths[0] = nearClip;
+	for (u32 s = 1; s <= DEPTH_SLICES; ++s)
+	{
+		sliceDepths[s] = first * std::pow(farClip / first, (float)(s - 1) / (float)(DEPTH_SLICES - 1));
+	}
+	sliceDepths[DEPTH_SLICES] = farClip;
+	sliceScale = (float)(DEPTH_SLICES - 1) / std::log(farClip / first);
+	sliceBias = 1.0f - std::log(first) * sliceScale;
+
+	// Where x / w and y / w are ndc at view depth d is d * (ndc - offset) / scale, as in ShadowCascades
+	glm::vec2 scale(projection[0][0], projection[1][1]);
+	glm::vec2 offset(projection[2][0], projection[2][1]);
+
+	clusterBoxes.resize((size_t)tilesX * tilesY * DEPTH_SLICES);
+	rowBoxes.resize((size_t)tilesY * DEPTH_SLICES);
+	u32 cluster = 0;
+	for (u32 s = 0; s < DEPTH_SLICES; ++s)
+	{
+		for (u32 ty = 0; ty < tilesY; ++ty)
+		{
+			// Pixel rows run down the screen, ndc y up
+			float top = 1.0f - 2.0f * (float)(ty * TILE_SIZE) / (float)height;
+			float bottom = 1.0f - 2.0f * (float)glm::min((ty + 1) * TILE_SIZE, height) / (float)height;
+
+			AABB& row = rowBoxes[s * tilesY + ty];
+			row = AABB{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+			for (u32 tx = 0; tx < tilesX; ++tx)
+			{
+				float left = 2.0f * (float)(tx * TILE_SIZE) / (float)width - 1.0f;
+				float right = 2.0f * (float)glm::min((tx + 1) * TILE_SIZE, width) / (float)width - 1.0f;
+
+				AABB& box = clusterBoxes[cluster++];
+				box = AABB{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+				for (u32 k = 0; k < 8; ++k)
+				{
+					float d = sliceDepths[s + ((k >> 2) & 1)];
+					glm::vec2 ndc((k & 1) ? right : left, (k & 2) ? top : bottom);
+					glm::vec3 corner(d * (ndc - offset) / scale, d);
+					box.min = glm::min(box.min, corner);
+					box.max = glm::max(box.max, corner);
+				}
+				row.min = glm::min(row.min, box.min);
+				row.max = glm::max(row.max, box.max);
+			}
+		}
+	}
+}
+
+void LightClusters::Assign(const glm::mat4& view, const PointLight* lights, u32 count, WorkerPool* pool)
+{
+	PROFILE_FUNCTION();
+
+	viewLights.Clear();
+	for (u32 i = 0; i < count; ++i)
+	{
+		glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].Position, 1.0f));
+		viewLights.Add(p.x, p.y, p.z, lights[i].Range, i);
+	}
+	viewLights.Pad();
+
+	ranges.resize(GetClusterCount());
+	if (pool != nullptr)
+	{
+		pool->ParallelFor(DEPTH_SLICES, 1, [this](u64 begin, u64 end)
+		{
+			for (u64 s = begin; s < end; ++s) { AssignSlice((u32)s); }
+		});
+	}
+	else
+	{
+		for (u32 s = 0; s < DEPTH_SLICES; ++s) { AssignSlice(s); }
+	}
+
+	// Slices back to back, in cluster order
+	lightIndices.clear();
+	u32 clustersPerSlice = tilesX * tilesY;
+	for (u32 s = 0; s < DEPTH_SLICES; ++s)
+	{
+		u32 base = (u32)lightIndices.size();
+		lightIndices.insert(lightIndices.end(), slices[s].indices.begin(), slices[s].indices.end());
+		for (u32 c = s * clustersPerSlice; c < (s + 1) * clustersPerSlice; ++c) { ranges[c].offset += base; }
+	}
+}
+
+void LightClusters::AssignSlice(u32 slice)
+{
+	SliceScratch& scratch = slices[slice];
+
+	// Lights reaching the slice's depth range
+	const __m128 sliceNear = _mm_set1_ps(sliceDepths[slice]);
+	const __m128 sliceFar = _mm_set1_ps(sliceDepths[slice + 1]);
+	LightArrays& sliceLights = scratch.sliceLights;
+	sliceLights.Clear();
+	for (u32 i = 0; i < viewLights.GetCount(); i += 4)
+	{
+		__m128 z = _mm_loadu_ps(&viewLights.z[i]);
+		__m128 radius = _mm_loadu_ps(&viewLights.radius[i]);
+		int mask = _mm_movemask_ps(_mm_and_ps(
+			_mm_cmpge_ps(_mm_add_ps(z, radius), sliceNear),
+			_mm_cmple_ps(_mm_sub_ps(z, radius), sliceFar)));
+		for (u32 b = 0; mask != 0; ++b, mask >>= 1)
+		{
+			if (mask & 1) { sliceLights.Add(viewLights.x[i + b], viewLights.y[i + b], viewLights.z[i + b], viewLights.radius[i + b], viewLights.index[i + b]); }
+		}
+	}
+	sliceLights.Pad();
+
+	LightArrays& rowLights = scratch.rowLights;
+	u32 cluster = slice * tilesX * tilesY;
+	u32 used = 0;
+	for (u32 ty = 0; ty < tilesY; ++ty)
+	{
+		// Then those reaching the row
+		const AABB& row = rowBoxes[slice * tilesY + ty];
+		rowLights.Clear();
+		for (u32 i = 0; i < sliceLights.GetCount(); i += 4)
+		{
+			int mask = SphereBoxMask(_mm_loadu_ps(&sliceLights.x[i]), _mm_loadu_ps(&sliceLights.y[i]),
+				_mm_loadu_ps(&sliceLights.z[i]), _mm_loadu_ps(&sliceLights.radius[i]), row);
+			for (u32 b = 0; mask != 0; ++b, mask >>= 1)
+			{
+				if (mask & 1) { rowLights.Add(sliceLights.x[i + b], sliceLights.y[i + b], sliceLights.z[i + b], sliceLights.radius[i + b], sliceLights.index[i + b]); }
+			}
+		}
+		rowLights.Pad();
+
+		// Every cluster of the row ; room for all of the row's lights is made up front, so compaction is branchless
+		u32 rowCount = rowLights.GetCount();
+		for (u32 tx = 0; tx < tilesX; ++tx, ++cluster)
+		{
+			if (used + rowCount > scratch.indices.size()) { scratch.indices.resize(glm::max((size_t)(used + rowCount), scratch.indices.size() * 2)); }
+			u32* out = scratch.indices.data() + used;
+
+			const AABB& box = clusterBoxes[cluster];
+			u32 found = 0;
+			for (u32 i = 0; i < rowCount; i += 4)
+			{
+				int mask = SphereBoxMask(_mm_loadu_ps(&rowLights.x[i]), _mm_loadu_ps(&rowLights.y[i]),
+					_mm_loadu_ps(&rowLights.z[i]), _mm_loadu_ps(&rowLights.radius[i]), box);
+				for (u32 b = 0; b < 4; ++b)
+				{
+					out[found] = rowLights.index[i + b];
+					found += (mask >> b) & 1;
+				}
+			}
+
+			ranges[cluster] = ClusterRange{ used, found };
+			used += found;
+		}
+	}
+	scratch.indices.resize(used);
+}
@@ -0,0 +1,98 @@
+#ifndef CLUSTERED_LIGHTING_H_
+#define CLUSTERED_LIGHTING_H_
+
+#include <vector>
+
+#include "Types.h"
+#include "Bounds.h"
+#include "Lights.h"
+
+class WorkerPool;
+
+// Point lights sorted into a grid of clusters (froxels) over the camera's view, so each pixel only shades the lights
+// that can reach its cluster
+//  - The screen is split into TILE_SIZE pixel tiles, and depth into DEPTH_SLICES slices : the first runs from the near
+//    plane to nearSliceDepth, the rest are spaced exponentially out to the far plane, so clusters stay roughly cubic
+//  - Cluster boxes are in view space and only depend on the projection and screen size, so moving the camera
+//    doesn't rebuild them
+//  - Each depth slice is one job : lights are culled against the slice, then each row of it, then tested 4 at a time
+//    against every cluster in the row
+//  - The result is what the pixel shader reads : an offset and count per cluster into one compact list of light indices
+class LightClusters
+{
+public:
+	static const u32 TILE_SIZE = 64;
+	static const u32 DEPTH_SLICES = 24;
+
+	// Lights of cluster i are lightIndices[offset] up to lightIndices[offset + count]
+	struct ClusterRange
+	{
+		u32 offset;
+		u32 count;
+	};
+
+private:
+	// Lights in view space, one array per component, padded to a multiple of 4 with lights that reach nothing
+	struct LightArrays
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius;
+		std::vector<u32> index; // Into the lights given to Assign
+
+		void Clear();
+		void Add(float lx, float ly, float lz, float lr, u32 light);
+		void Pad();
+		inline u32 GetCount() const { return (u32)index.size(); }
+	};
+
+	// Per slice job output
+	struct SliceScratch
+	{
+		LightArrays sliceLights;
+		LightArrays rowLights;
+		std::vector<u32> indices; // Light indices of the slice's clusters, offsets in ranges relative to the slice
+	};
+
+	u32 screenWidth;
+	u32 screenHeight;
+	u32 tilesX;
+	u32 tilesY;
+	float nearSliceDepth;
+	float sliceScale; // Slice of a view depth d is floor(log(d) * sliceScale + sliceBias), clamped to the grid
+	float sliceBias;
+	glm::mat4 builtProjection;
+
+	std::vector<AABB> clusterBoxes; // View space, tile rows of each slice one after the other
+	std::vector<AABB> rowBoxes;     // Union of each row's clusters
+	std::vector<float> sliceDepths; // DEPTH_SLICES + 1 slice boundaries
+
+	LightArrays viewLights;
+	SliceScratch slices[DEPTH_SLICES];
+
+	std::vector<ClusterRange> ranges;
+	std::vector<u32> lightIndices;
+
+	void AssignSlice(u32 slice);
+
+public:
+	LightClusters(float firstSliceDepth = 5.0f);
+
+	// Fits the grid to a screen and the camera's column vector projection ; does nothing when neither changed since the
+	// last call
+	void Build(const glm::mat4& projection, u32 width, u32 height, float nearClip, float farClip);
+	// Sorts lights into the clusters, seen through the camera's view matrix ; one job per depth slice when given a pool
+	void Assign(const glm::mat4& view, const PointLight* lights, u32 count, WorkerPool* pool = nullptr);
+
+	inline u32 GetTilesX() const                          { return tilesX; }
+	inline u32 GetTilesY() const                          { return tilesY; }
+	inline u32 GetClusterCount() const                    { return tilesX * tilesY * DEPTH_SLICES; }
+	inline float GetSliceScale() const                    { return sliceScale; }
+	inline float GetSliceBias() const                     { return sliceBias; }
+	inline const AABB& GetClusterBox(u32 cluster) const   { return clusterBoxes[cluster]; }
+	inline const std::vector<ClusterRange>& GetRanges() const { return ranges; }
+	inline const std::vector<u32>& GetLightIndices() const    { return lightIndices; }
+};
+
+#endif
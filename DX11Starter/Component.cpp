@@ -0,0 +1,43 @@
+#include "Component.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+const u32 Component::MAX_TYPES;
+const u64 Component::MAX_ALIGNMENT;
+
+namespace
+{
+	// Fixed-size so readers never see the table move, while registration may happen from any thread
+	Component::TypeInfo typeInfos[Component::MAX_TYPES];
+	std::atomic<u32> typeCount(0);
+	std::mutex registerMutex;
+}
+
+u32 Component::Register(const TypeInfo& info)
+{
+	std::lock_guard<std::mutex> lock(registerMutex);
+
+	u32 id = typeCount.load();
+	if (id >= MAX_TYPES)
+	{
+		printf("Too many component types registered (max %u)\n", MAX_TYPES);
+		abort();
+	}
+
+	typeInfos[id] = info;
+	typeCount.store(id + 1);
+	return id;
+}
+
+const Component::TypeInfo& Component::GetInfo(u32 type)
+{
+	return typeInfos[type];
+}
+
+u32 Component::GetTypeCount()
+{
+	return typeCount.load();
+}
@@ -0,0 +1,58 @@
+#ifndef COMPONENT_H_
+#define COMPONENT_H_
+
+#include <new>
+#include <utility>
+
+#include "Types.h"
+
+// Set of component types, one bit per type ID
+typedef u64 ComponentMask;
+
+// Registry of component types stored by a ComponentStore
+// Any movable struct can be a component ; each type is given a small ID the first time it is used
+class Component
+{
+public:
+	static const u32 MAX_TYPES = 64;
+	// Chunk storage is allocated with plain operator new, so nothing stricter than this is supported
+	static const u64 MAX_ALIGNMENT = 16;
+
+	// Everything needed to move a component around without knowing its type
+	struct TypeInfo
+	{
+		u64 size;
+		u64 alignment;
+		void (*moveConstruct)(void* destination, void* source);
+		void (*destruct)(void* component);
+	};
+
+private:
+	static u32 Register(const TypeInfo& info);
+
+	template<typename T> static void MoveConstruct(void* destination, void* source) { new (destination) T(std::move(*static_cast<T*>(source))); }
+	template<typename T> static void Destruct(void* component) { static_cast<T*>(component)->~T(); }
+
+public:
+	template<typename T> static u32 GetTypeID()
+	{
+		static_assert(alignof(T) <= MAX_ALIGNMENT, "Component alignment is too strict for chunk storage");
+		static const u32 id = Register(TypeInfo{ sizeof(T), alignof(T), &MoveConstruct<T>, &Destruct<T> });
+		return id;
+	}
+
+	template<typename T> static ComponentMask GetMask() { return 1ull << GetTypeID<T>(); }
+
+	template<typename... Ts> static ComponentMask MaskOf()
+	{
+		ComponentMask mask = 0;
+		int expand[] = { 0, ((mask |= GetMask<Ts>()), 0)... };
+		(void)expand;
+		return mask;
+	}
+
+	static const TypeInfo& GetInfo(u32 type);
+	static u32 GetTypeCount();
+};
+
+#endif
@@ -0,0 +1,294 @@
+#include "ComponentStore.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+const u32 ComponentStore::CHUNK_SIZE;
+const u32 ComponentStore::INVALID;
+const u32 ComponentStore::REMOVE_ALL;
+
+ComponentStore::ComponentStore() :
+	archetypes(),
+	archetypeLookup(),
+	locations(),
+	queries(),
+	pending(),
+	payloadPages(),
+	payloadPage(0),
+	payloadUsed(0)
+{
+	// Nothing interesting to do here
+}
+
+ComponentStore::~ComponentStore()
+{
+	// Queued values were never moved into a chunk
+	for (u64 i = 0; i < pending.size(); ++i)
+	{
+		if (pending[i].value != nullptr) { Component::GetInfo(pending[i].type).destruct(pending[i].value); }
+	}
+
+	for (u64 a = 0; a < archetypes.size(); ++a)
+	{
+		Archetype& arch = archetypes[a];
+		for (u64 c = 0; c < arch.chunks.size(); ++c)
+		{
+			Chunk& chunk = arch.chunks[c];
+			for (u64 t = 0; t < arch.types.size(); ++t)
+			{
+				const Component::TypeInfo& info = Component::GetInfo(arch.types[t]);
+				u08* column = ColumnAt(arch, chunk, arch.types[t]);
+				for (u32 r = 0; r < chunk.count; ++r) { info.destruct(column + r * info.size); }
+			}
+			::operator delete(chunk.data);
+		}
+	}
+
+	for (u64 i = 0; i < payloadPages.size(); ++i)
+	{
+		::operator delete(payloadPages[i]);
+	}
+}
+
+u32 ComponentStore::GetArchetype(ComponentMask mask)
+{
+	std::unordered_map<ComponentMask, u32>::const_iterator found = archetypeLookup.find(mask);
+	if (found != archetypeLookup.end()) { return found->second; }
+
+	Archetype arch;
+	arch.mask = mask;
+	for (u32 t = 0; t < Component::MAX_TYPES; ++t)
+	{
+		arch.columnOffsets[t] = INVALID;
+		if (mask & (1ull << t)) { arch.types.push_back(t); }
+	}
+
+	// Start from an estimate ignoring padding, then back off until every column fits in the chunk
+	u64 rowSize = sizeof(EntityHandle);
+	for (u64 t = 0; t < arch.types.size(); ++t) { rowSize += Component::GetInfo(arch.types[t]).size; }
+
+	u32 capacity = (u32)(CHUNK_SIZE / rowSize);
+	for (; capacity > 0; --capacity)
+	{
+		u64 offset = sizeof(EntityHandle) * capacity;
+		for (u64 t = 0; t < arch.types.size(); ++t)
+		{
+			const Component::TypeInfo& info = Component::GetInfo(arch.types[t]);
+			offset = (offset + info.alignment - 1) & ~(info.alignment - 1);
+			arch.columnOffsets[arch.types[t]] = (u32)offset;
+			offset += info.size * capacity;
+		}
+		if (offset <= CHUNK_SIZE) { break; }
+	}
+
+	if (capacity == 0)
+	{
+		printf("Component set too large to fit a single entity in a %u byte chunk\n", CHUNK_SIZE);
+		abort();
+	}
+
+	arch.capacity = capacity;
+
+	u32 index = (u32)archetypes.size();
+	archetypes.push_back(std::move(arch));
+	archetypeLookup.emplace(mask, index);
+	return index;
+}
+
+void ComponentStore::AllocateRow(u32 archetype, EntityHandle entity, u32& chunk, u32& row)
+{
+	Archetype& arch = archetypes[archetype];
+
+	if (arch.chunks.size() == 0 || arch.chunks[arch.chunks.size() - 1].count == arch.capacity)
+	{
+		Chunk fresh;
+		fresh.data = static_cast<u08*>(::operator new(CHUNK_SIZE));
+		fresh.count = 0;
+		arch.chunks.push_back(fresh);
+	}
+
+	chunk = (u32)arch.chunks.size() - 1;
+	row = arch.chunks[chunk].count++;
+	reinterpret_cast<EntityHandle*>(arch.chunks[chunk].data)[row] = entity;
+}
+
+void ComponentStore::RemoveRow(u32 archetype, u32 chunk, u32 row)
+{
+	Archetype& arch = archetypes[archetype];
+	u32 lastChunk = (u32)arch.chunks.size() - 1;
+	Chunk& hole = arch.chunks[chunk];
+	Chunk& last = arch.chunks[lastChunk];
+	u32 lastRow = last.count - 1;
+	bool fill = (chunk != lastChunk || row != lastRow);
+
+	for (u64 t = 0; t < arch.types.size(); ++t)
+	{
+		const Component::TypeInfo& info = Component::GetInfo(arch.types[t]);
+		u08* target = ColumnAt(arch, hole, arch.types[t]) + row * info.size;
+		info.destruct(target);
+
+		// Order doesn't matter, so keep chunks packed by moving the very last row into the hole
+		if (fill)
+		{
+			u08* source = ColumnAt(arch, last, arch.types[t]) + lastRow * info.size;
+			info.moveConstruct(target, source);
+			info.destruct(source);
+		}
+	}
+
+	if (fill)
+	{
+		EntityHandle moved = reinterpret_cast<EntityHandle*>(last.data)[lastRow];
+		reinterpret_cast<EntityHandle*>(hole.data)[row] = moved;
+		locations[moved.GetIndex()].chunk = chunk;
+		locations[moved.GetIndex()].row = row;
+	}
+
+	if (--last.count == 0)
+	{
+		::operator delete(last.data);
+		arch.chunks.pop_back();
+	}
+}
+
+void ComponentStore::MoveEntity(EntityHandle entity, ComponentMask newMask, u32 addedType, void* addedValue)
+{
+	Location old = locations[entity.GetIndex()];
+	Location& loc = locations[entity.GetIndex()];
+
+	if (newMask == 0)
+	{
+		RemoveRow(old.archetype, old.chunk, old.row);
+		loc.archetype = INVALID;
+		return;
+	}
+
+	// May grow the archetype list, so no references into it are held across this
+	u32 target = GetArchetype(newMask);
+	u32 chunk, row;
+	AllocateRow(target, entity, chunk, row);
+
+	Archetype& arch = archetypes[target];
+	for (u64 t = 0; t < arch.types.size(); ++t)
+	{
+		u32 type = arch.types[t];
+		const Component::TypeInfo& info = Component::GetInfo(type);
+		u08* destination = ColumnAt(arch, arch.chunks[chunk], type) + row * info.size;
+
+		if (type == addedType && addedValue != nullptr)
+		{
+			info.moveConstruct(destination, addedValue);
+			info.destruct(addedValue);
+		}
+		else
+		{
+			Archetype& from = archetypes[old.archetype];
+			info.moveConstruct(destination, ColumnAt(from, from.chunks[old.chunk], type) + old.row * info.size);
+		}
+	}
+
+	// The moved-from values (and any removed component) are destroyed along with the old row
+	if (old.archetype != INVALID) { RemoveRow(old.archetype, old.chunk, old.row); }
+
+	loc.archetype = target;
+	loc.chunk = chunk;
+	loc.row = row;
+	loc.generation = entity.GetGeneration();
+}
+
+void* ComponentStore::AllocatePayload(u64 size, u64 alignment)
+{
+	u64 offset = (payloadUsed + alignment - 1) & ~(alignment - 1);
+
+	if (payloadPages.size() == 0 || offset + size > CHUNK_SIZE)
+	{
+		if (payloadPages.size() != 0) { ++payloadPage; }
+		if (payloadPage == payloadPages.size()) { payloadPages.push_back(static_cast<u08*>(::operator new(CHUNK_SIZE))); }
+		offset = 0;
+	}
+
+	payloadUsed = (u32)(offset + size);
+	return payloadPages[payloadPage] + offset;
+}
+
+void ComponentStore::Queue(EntityHandle entity, u32 type, void* value)
+{
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	pending.push_back(PendingChange{ entity, type, value });
+}
+
+void ComponentStore::Flush(const std::vector<u32>& generations)
+{
+	std::lock_guard<std::mutex> lock(pendingMutex);
+
+	for (u64 i = 0; i < pending.size(); ++i)
+	{
+		const PendingChange& change = pending[i];
+		u32 index = change.entity.GetIndex();
+		u32 generation = change.entity.GetGeneration();
+
+		if (index >= locations.size()) { locations.resize((index < generations.size()) ? generations.size() : index + 1, Location{ INVALID, 0, 0, 0 }); }
+		Location& loc = locations[index];
+		bool located = (loc.archetype != INVALID && loc.generation == generation);
+
+		if (change.type == REMOVE_ALL)
+		{
+			// Destroyed entities are cleaned up here, so liveness doesn't matter
+			if (located) { MoveEntity(change.entity, 0, INVALID, nullptr); }
+			continue;
+		}
+
+		const Component::TypeInfo& info = Component::GetInfo(change.type);
+		bool alive = (index < generations.size() && generations[index] == generation);
+		if (!alive)
+		{
+			if (change.value != nullptr) { info.destruct(change.value); }
+			continue;
+		}
+
+		// Anything still stored under an older generation belongs to an entity that is long gone
+		if (loc.archetype != INVALID && !located)
+		{
+			RemoveRow(loc.archetype, loc.chunk, loc.row);
+			loc.archetype = INVALID;
+		}
+
+		ComponentMask mask = located ? archetypes[loc.archetype].mask : 0;
+		ComponentMask bit = 1ull << change.type;
+
+		if (change.value == nullptr)
+		{
+			if (mask & bit) { MoveEntity(change.entity, mask & ~bit, INVALID, nullptr); }
+		}
+		else if (mask & bit)
+		{
+			// Already has one, just overwrite it in place
+			Archetype& arch = archetypes[loc.archetype];
+			u08* existing = ColumnAt(arch, arch.chunks[loc.chunk], change.type) + loc.row * info.size;
+			info.destruct(existing);
+			info.moveConstruct(existing, change.value);
+			info.destruct(change.value);
+		}
+		else
+		{
+			MoveEntity(change.entity, mask | bit, change.type, change.value);
+		}
+	}
+
+	pending.clear();
+	payloadPage = 0;
+	payloadUsed = 0;
+}
+
+const std::vector<u32>& ComponentStore::Match(ComponentMask mask)
+{
+	Query& query = queries[mask];
+
+	for (u32 a = query.checkedCount; a < archetypes.size(); ++a)
+	{
+		if ((archetypes[a].mask & mask) == mask) { query.archetypes.push_back(a); }
+	}
+	query.checkedCount = (u32)archetypes.size();
+
+	return query.archetypes;
+}
@@ -0,0 +1,202 @@
+#ifndef COMPONENT_STORE_H_
+#define COMPONENT_STORE_H_
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+#include "Component.h"
+#include "EntityHandle.h"
+#include "WorkerPool.h"
+
+// Archetype-based storage for the components of every entity in a scene
+//
+// Entities with exactly the same set of component types share an archetype, whose data lives in fixed-size
+// chunks holding one tightly packed column per component type (plus one for the owning entities). Systems
+// stream over the chunks of every archetype matching a query rather than visiting entities one by one.
+//
+// Adding or removing components moves an entity between archetypes, which would break anyone iterating,
+// so those changes are only queued up and get applied all at once by Flush at a sync point.
+class ComponentStore
+{
+public:
+	static const u32 CHUNK_SIZE = 16 * 1024;
+	static const u32 INVALID = 0xFFFFFFFF;
+
+private:
+	struct Chunk
+	{
+		u08* data;
+		u32 count;
+	};
+
+	struct Archetype
+	{
+		ComponentMask mask;
+		std::vector<u32> types;               // Component types in this archetype, ascending
+		u32 columnOffsets[Component::MAX_TYPES]; // Byte offset of each type's column within a chunk (INVALID if absent)
+		u32 capacity;                         // Rows per chunk
+		std::vector<Chunk> chunks;            // Every chunk but the last is always full
+	};
+
+	// Where the components of an entity live, indexed by the entity's storage index
+	struct Location
+	{
+		u32 archetype;
+		u32 chunk;
+		u32 row;
+		u32 generation;
+	};
+
+	// Queued structural change ; a null value means the type is being removed
+	struct PendingChange
+	{
+		EntityHandle entity;
+		u32 type;
+		void* value;
+	};
+	static const u32 REMOVE_ALL = 0xFFFFFFFF;
+
+	// Archetypes matching a signature, extended as new archetypes appear (archetypes are never removed)
+	struct Query
+	{
+		std::vector<u32> archetypes;
+		u32 checkedCount;
+
+		Query() : archetypes(), checkedCount(0) { }
+	};
+
+	std::vector<Archetype> archetypes;
+	std::unordered_map<ComponentMask, u32> archetypeLookup;
+	std::vector<Location> locations;
+	std::unordered_map<ComponentMask, Query> queries;
+
+	// Changes can be queued from any thread
+	std::mutex pendingMutex;
+	std::vector<PendingChange> pending;
+
+	// Queued component values are kept in pages that never move, and are recycled after every flush
+	std::vector<u08*> payloadPages;
+	u32 payloadPage;
+	u32 payloadUsed;
+
+	u32 GetArchetype(ComponentMask mask);
+	void AllocateRow(u32 archetype, EntityHandle entity, u32& chunk, u32& row);
+	// Destroys the components in a row, filling the hole with the archetype's last row
+	void RemoveRow(u32 archetype, u32 chunk, u32 row);
+	// Moves an entity into the archetype for a new signature, optionally adding a value on the way
+	void MoveEntity(EntityHandle entity, ComponentMask newMask, u32 addedType, void* addedValue);
+
+	void* AllocatePayload(u64 size, u64 alignment);
+	void Queue(EntityHandle entity, u32 type, void* value);
+
+	inline u08* ColumnAt(const Archetype& arch, const Chunk& chunk, u32 type) { return chunk.data + arch.columnOffsets[type]; }
+
+	template<typename... Ts, typename F>
+	inline void CallWithColumns(const Archetype& arch, const Chunk& chunk, F& fn)
+	{
+		fn(chunk.count, reinterpret_cast<const EntityHandle*>(chunk.data), reinterpret_cast<Ts*>(chunk.data + arch.columnOffsets[Component::GetTypeID<Ts>()])...);
+	}
+
+public:
+	ComponentStore();
+	~ComponentStore();
+
+	ComponentStore(const ComponentStore&) = delete;
+	ComponentStore& operator= (const ComponentStore&) = delete;
+
+	// <STRUCTURAL CHANGES> - queued, applied by Flush
+
+	template<typename T> void Add(EntityHandle entity, T value)
+	{
+		static_assert(sizeof(T) + sizeof(EntityHandle) <= CHUNK_SIZE, "Component too large for chunk storage");
+		u32 type = Component::GetTypeID<T>();
+
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		void* payload = AllocatePayload(sizeof(T), alignof(T));
+		new (payload) T(std::move(value));
+		pending.push_back(PendingChange{ entity, type, payload });
+	}
+
+	template<typename T> inline void Remove(EntityHandle entity) { Queue(entity, Component::GetTypeID<T>(), nullptr); }
+	inline void RemoveAll(EntityHandle entity) { Queue(entity, REMOVE_ALL, nullptr); }
+
+	// Applies every queued change in the order it was made
+	// Changes for entities that are no longer alive (per the scene's generations) are dropped, except removals
+	void Flush(const std::vector<u32>& generations);
+
+	// </STRUCTURAL CHANGES>
+
+	// Direct access to a component, nullptr if the entity doesn't (yet) have it
+	// Only valid until the next flush
+	template<typename T> T* Get(EntityHandle entity)
+	{
+		u32 index = entity.GetIndex();
+		if (index >= locations.size()) { return nullptr; }
+
+		const Location& loc = locations[index];
+		if (loc.archetype == INVALID || loc.generation != entity.GetGeneration()) { return nullptr; }
+
+		const Archetype& arch = archetypes[loc.archetype];
+		u32 type = Component::GetTypeID<T>();
+		if ((arch.mask & (1ull << type)) == 0) { return nullptr; }
+
+		return reinterpret_cast<T*>(ColumnAt(arch, arch.chunks[loc.chunk], type)) + loc.row;
+	}
+
+	template<typename T> inline bool Has(EntityHandle entity) { return Get<T>(entity) != nullptr; }
+
+	// Archetypes containing at least every type in a signature
+	const std::vector<u32>& Match(ComponentMask mask);
+
+	// Calls fn(count, handles, Ts* columns...) once per chunk holding all of Ts
+	template<typename... Ts, typename F> void ForEachChunk(F fn)
+	{
+		const std::vector<u32>& matches = Match(Component::MaskOf<Ts...>());
+		for (u64 m = 0; m < matches.size(); ++m)
+		{
+			const Archetype& arch = archetypes[matches[m]];
+			for (u64 c = 0; c < arch.chunks.size(); ++c)
+			{
+				CallWithColumns<Ts...>(arch, arch.chunks[c], fn);
+			}
+		}
+	}
+
+	// Same as above, with chunks spread across a worker pool - fn must be safe to run concurrently
+	template<typename... Ts, typename F> void ForEachChunkParallel(WorkerPool* pool, F fn)
+	{
+		const std::vector<u32>& matches = Match(Component::MaskOf<Ts...>());
+
+		std::vector<const Chunk*> chunks;
+		std::vector<const Archetype*> owners;
+		for (u64 m = 0; m < matches.size(); ++m)
+		{
+			const Archetype& arch = archetypes[matches[m]];
+			for (u64 c = 0; c < arch.chunks.size(); ++c)
+			{
+				chunks.push_back(&arch.chunks[c]);
+				owners.push_back(&arch);
+			}
+		}
+
+		pool->ParallelFor(chunks.size(), 1, [&](u64 begin, u64 end)
+		{
+			for (u64 i = begin; i < end; ++i) { CallWithColumns<Ts...>(*owners[i], *chunks[i], fn); }
+		});
+	}
+
+	// Calls fn(handle, Ts&...) for every entity holding all of Ts
+	template<typename... Ts, typename F> void ForEach(F fn)
+	{
+		ForEachChunk<Ts...>([&fn](u32 count, const EntityHandle* handles, Ts*... columns)
+		{
+			for (u32 i = 0; i < count; ++i) { fn(handles[i], columns[i]...); }
+		});
+	}
+
+	inline u64 GetArchetypeCount() const { return archetypes.size(); }
+};
+
+#endif
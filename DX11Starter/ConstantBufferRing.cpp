@@ -0,0 +1,80 @@
+#include "ConstantBufferRing.h"
+
+#include <cstring>
+
+const u32 ConstantBufferRing::ALIGNMENT;
+const u32 ConstantBufferRing::CONSTANT_SIZE;
+
+ConstantBufferRing::ConstantBufferRing() :
+	context(nullptr),
+	buffer(nullptr),
+	size(0),
+	cursor(0),
+	generation(0)
+{
+	// Nothing interesting to do here
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+	if (buffer != nullptr) { buffer->Release(); }
+	if (context != nullptr) { context->Release(); }
+}
+
+bool ConstantBufferRing::Init(ID3D11Device* device, ID3D11DeviceContext* immediateContext, u32 capacity)
+{
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+		!options.ConstantBufferOffsetting)
+	{
+		return false;
+	}
+
+	if (FAILED(immediateContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&context)))
+	{
+		context = nullptr;
+		return false;
+	}
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = (capacity + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	if (FAILED(device->CreateBuffer(&desc, nullptr, &buffer)))
+	{
+		buffer = nullptr;
+		context->Release();
+		context = nullptr;
+		return false;
+	}
+
+	size = desc.ByteWidth;
+	// Start full so the first allocation discards
+	cursor = size;
+	return true;
+}
+
+void ConstantBufferRing::Allocate(const void* data, u32 bytes, u32& firstConstant, u32& constantCount)
+{
+	u32 sliceSize = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	if (sliceSize == 0) { sliceSize = ALIGNMENT; }
+
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (cursor + sliceSize > size)
+	{
+		// Wrap: everything sliced out so far may still be in flight, so let the driver rename the buffer
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		cursor = 0;
+		generation++;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	context->Map(buffer, 0, mapType, 0, &mapped);
+	memcpy((u08*)mapped.pData + cursor, data, bytes);
+	context->Unmap(buffer, 0);
+
+	firstConstant = cursor / CONSTANT_SIZE;
+	constantCount = sliceSize / CONSTANT_SIZE;
+	cursor += sliceSize;
+}
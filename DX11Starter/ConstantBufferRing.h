@@ -0,0 +1,45 @@
+#ifndef CONSTANT_BUFFER_RING_H_
+#define CONSTANT_BUFFER_RING_H_
+
+#include <d3d11_1.h>
+
+#include "Types.h"
+
+// One large dynamic constant buffer that changed shader constants are sub-allocated from
+//
+// Slices are written with MAP_WRITE_NO_OVERWRITE and bound at an offset through the *SetConstantBuffers1
+// calls. When the ring is full it wraps with a MAP_WRITE_DISCARD, so the driver hands us fresh memory while
+// the GPU keeps reading the old contents. That also invalidates every slice handed out before the wrap,
+// which is what GetGeneration() is for: callers re-upload when their slice is from an older generation.
+//
+// Binding at an offset needs D3D11.1 constant buffer offsetting; Init() returns false when it is missing and
+// callers fall back to a buffer per cbuffer.
+class ConstantBufferRing
+{
+private:
+	ID3D11DeviceContext1* context;
+	ID3D11Buffer* buffer;
+	u32 size;
+	u32 cursor;
+	u32 generation;
+
+public:
+	// Slices are 256 bytes aligned, in both offset and size
+	static const u32 ALIGNMENT = 256;
+	// Shader constants are 16-byte registers
+	static const u32 CONSTANT_SIZE = 16;
+
+	ConstantBufferRing();
+	~ConstantBufferRing();
+
+	bool Init(ID3D11Device* device, ID3D11DeviceContext* immediateContext, u32 capacity);
+
+	// Copies data into a new slice and returns where it landed, in shader constants
+	void Allocate(const void* data, u32 bytes, u32& firstConstant, u32& constantCount);
+
+	inline ID3D11DeviceContext1* GetContext() const { return context; }
+	inline ID3D11Buffer* const* GetBuffer() const { return &buffer; }
+	inline u32 GetGeneration() const { return generation; }
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "D3D11RenderDevice.h"
+
+#include <cstring>
+
+#include "ConstantBufferRing.h"
+#include "D3D11StateCache.h"
+#include "SimpleShader.h"
+
+const u32 D3D11RenderDevice::UPLOAD_RING_SIZE;
+
+D3D11RenderDevice::D3D11RenderDevice(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext) :
+	device(d3dDevice),
+	context(d3dContext),
+	uploadRing(new ConstantBufferRing()),
+	stateCache(new D3D11StateCache(d3dContext))
+{
+	if (!uploadRing->Init(device, context, UPLOAD_RING_SIZE))
+	{
+		delete uploadRing;
+		uploadRing = nullptr;
+	}
+	ISimpleShader::SetUploadRing(uploadRing);
+	ISimpleShader::SetStateCache(stateCache);
+}
+
+D3D11RenderDevice::~D3D11RenderDevice()
+{
+	ISimpleShader::SetUploadRing(nullptr);
+	ISimpleShader::SetStateCache(nullptr);
+	delete uploadRing;
+	delete stateCache;
+}
+
+GPUBuffer* D3D11RenderDevice::CreateBuffer(const BufferDesc& desc, const void* initialData)
+{
+	D3D11_BUFFER_DESC d3dDesc = {};
+	d3dDesc.ByteWidth = desc.size;
+	if (desc.usage == BUFFER_DYNAMIC)
+	{
+		d3dDesc.Usage = D3D11_USAGE_DYNAMIC;
+		d3dDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	}
+	else
+	{
+		d3dDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	}
+	if (desc.bindings & BIND_VERTEX_BUFFER) { d3dDesc.BindFlags |= D3D11_BIND_VERTEX_BUFFER; }
+	if (desc.bindings & BIND_INDEX_BUFFER) { d3dDesc.BindFlags |= D3D11_BIND_INDEX_BUFFER; }
+	if (desc.bindings & BIND_SHADER_RESOURCE)
+	{
+		d3dDesc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+		d3dDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		d3dDesc.StructureByteStride = desc.elementStride;
+	}
+
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = initialData;
+
+	ID3D11Buffer* buffer = nullptr;
+	device->CreateBuffer(&d3dDesc, initialData != nullptr ? &data : nullptr, &buffer);
+	return FromD3D(buffer);
+}
+
+void D3D11RenderDevice::ReleaseBuffer(GPUBuffer* buffer)
+{
+	if (buffer != nullptr) { ToD3D(buffer)->Release(); }
+}
+
+void D3D11RenderDevice::UpdateBuffer(GPUBuffer* buffer, const void* data, u32 size)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	context->Map(ToD3D(buffer), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, data, size);
+	context->Unmap(ToD3D(buffer), 0);
+}
+
+void D3D11RenderDevice::SetVertexBuffer(u32 slot, GPUBuffer* buffer, u32 stride)
+{
+	stateCache->SetVertexBuffer(slot, ToD3D(buffer), stride, 0);
+}
+
+void D3D11RenderDevice::SetIndexBuffer(GPUBuffer* buffer)
+{
+	stateCache->SetIndexBuffer(ToD3D(buffer), DXGI_FORMAT_R32_UINT, 0);
+}
+
+ShaderVarHandle D3D11RenderDevice::GetVariableHandle(SimpleVertexShader* vs, const char* name)
+{
+	return vs->GetVariableHandle(name);
+}
+
+ShaderResourceHandle D3D11RenderDevice::GetShaderResourceHandle(SimplePixelShader* ps, const char* name)
+{
+	return ps->GetShaderResourceHandle(name);
+}
+
+ShaderResourceHandle D3D11RenderDevice::GetSamplerHandle(SimplePixelShader* ps, const char* name)
+{
+	return ps->GetSamplerHandle(name);
+}
+
+bool D3D11RenderDevice::IsPerInstanceCompatible(SimpleVertexShader* vs)
+{
+	return vs->GetPerInstanceCompatible();
+}
+
+void D3D11RenderDevice::SetShaders(SimpleVertexShader* vs, SimplePixelShader* ps)
+{
+	vs->SetShader();
+	ps->SetShader();
+}
+
+void D3D11RenderDevice::SetMatrix(SimpleVertexShader* vs, const ShaderVarHandle& variable, const float data[16])
+{
+	vs->SetMatrix4x4(variable, data);
+}
+
+void D3D11RenderDevice::SetShaderResource(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUTextureView* view)
+{
+	ps->SetShaderResourceView(resource, ToD3D(view));
+}
+
+void D3D11RenderDevice::SetSampler(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUSampler* sampler)
+{
+	ps->SetSamplerState(resource, ToD3D(sampler));
+}
+
+void D3D11RenderDevice::CopyConstants(SimpleVertexShader* vs)
+{
+	vs->CopyAllBufferData();
+}
+
+void D3D11RenderDevice::CopyConstants(SimplePixelShader* ps)
+{
+	ps->CopyAllBufferData();
+}
+
+void D3D11RenderDevice::DrawIndexed(u32 indexCount)
+{
+	context->DrawIndexed(indexCount, 0, 0);
+}
+
+void D3D11RenderDevice::DrawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 firstInstance)
+{
+	context->DrawIndexedInstanced(indexCount, instanceCount, 0, 0, firstInstance);
+}
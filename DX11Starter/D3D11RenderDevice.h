@@ -0,0 +1,67 @@
+#ifndef D3D11_RENDER_DEVICE_H_
+#define D3D11_RENDER_DEVICE_H_
+
+#include <d3d11.h>
+
+#include "RenderDevice.h"
+
+class ConstantBufferRing;
+class D3D11StateCache;
+
+// Render device backed by a live D3D11 device and immediate context (owned elsewhere, e.g. DXCore)
+//
+// Also owns the ring SimpleShader uploads changed constant buffers through, when the device supports it,
+// and the state cache every bind on the immediate context goes through
+//
+// Its GPU object handles are the D3D11 objects themselves ; ToD3D and FromD3D convert between the two
+class D3D11RenderDevice : public RenderDevice
+{
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	ConstantBufferRing* uploadRing;
+	D3D11StateCache* stateCache;
+
+public:
+	static const u32 UPLOAD_RING_SIZE = 4 * 1024 * 1024;
+
+	D3D11RenderDevice(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext);
+	~D3D11RenderDevice();
+
+	GPUBuffer* CreateBuffer(const BufferDesc& desc, const void* initialData) override;
+	void ReleaseBuffer(GPUBuffer* buffer) override;
+	void UpdateBuffer(GPUBuffer* buffer, const void* data, u32 size) override;
+
+	void SetVertexBuffer(u32 slot, GPUBuffer* buffer, u32 stride) override;
+	void SetIndexBuffer(GPUBuffer* buffer) override;
+
+	ShaderVarHandle GetVariableHandle(SimpleVertexShader* vs, const char* name) override;
+	ShaderResourceHandle GetShaderResourceHandle(SimplePixelShader* ps, const char* name) override;
+	ShaderResourceHandle GetSamplerHandle(SimplePixelShader* ps, const char* name) override;
+	bool IsPerInstanceCompatible(SimpleVertexShader* vs) override;
+
+	void SetShaders(SimpleVertexShader* vs, SimplePixelShader* ps) override;
+	void SetMatrix(SimpleVertexShader* vs, const ShaderVarHandle& variable, const float data[16]) override;
+	void SetShaderResource(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUTextureView* view) override;
+	void SetSampler(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUSampler* sampler) override;
+	void CopyConstants(SimpleVertexShader* vs) override;
+	void CopyConstants(SimplePixelShader* ps) override;
+
+	void DrawIndexed(u32 indexCount) override;
+	void DrawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 firstInstance) override;
+
+	inline ID3D11Device* GetDevice() const { return device; }
+	inline ID3D11DeviceContext* GetContext() const { return context; }
+	// Null when constant buffer offsetting is unsupported
+	inline ConstantBufferRing* GetUploadRing() const { return uploadRing; }
+	inline D3D11StateCache* GetStateCache() const { return stateCache; }
+
+	static inline ID3D11Buffer* ToD3D(GPUBuffer* buffer)                       { return reinterpret_cast<ID3D11Buffer*>(buffer); }
+	static inline ID3D11ShaderResourceView* ToD3D(GPUTextureView* view)        { return reinterpret_cast<ID3D11ShaderResourceView*>(view); }
+	static inline ID3D11SamplerState* ToD3D(GPUSampler* sampler)               { return reinterpret_cast<ID3D11SamplerState*>(sampler); }
+	static inline GPUBuffer* FromD3D(ID3D11Buffer* buffer)                     { return reinterpret_cast<GPUBuffer*>(buffer); }
+	static inline GPUTextureView* FromD3D(ID3D11ShaderResourceView* view)      { return reinterpret_cast<GPUTextureView*>(view); }
+	static inline GPUSampler* FromD3D(ID3D11SamplerState* sampler)             { return reinterpret_cast<GPUSampler*>(sampler); }
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include "D3D11StateCache.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	// Never a real object, so whatever gets set next differs from it
+	template <typename T>
+	inline T* Unknown() { return reinterpret_cast<T*>(~(uintptr_t)0); }
+}
+
+const u32 D3D11StateCache::VERTEX_BUFFER_SLOTS;
+const u32 D3D11StateCache::CONSTANT_BUFFER_SLOTS;
+const u32 D3D11StateCache::SHADER_RESOURCE_SLOTS;
+const u32 D3D11StateCache::SAMPLER_SLOTS;
+
+u32 D3D11StateCache::Stats::GetIssued() const
+{
+	u32 total = 0;
+	for (u32 i = 0; i < STATE_COUNT; ++i) { total += issued[i]; }
+	return total;
+}
+
+u32 D3D11StateCache::Stats::GetFiltered() const
+{
+	u32 total = 0;
+	for (u32 i = 0; i < STATE_COUNT; ++i) { total += filtered[i]; }
+	return total;
+}
+
+D3D11StateCache::D3D11StateCache(ID3D11DeviceContext* immediateContext) :
+	context(immediateContext),
+	context1(nullptr),
+	stats()
+{
+	// Only needed for ranged constant buffer binds, which are never asked for without D3D11.1
+	if (FAILED(context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&context1))) { context1 = nullptr; }
+
+	Invalidate();
+}
+
+D3D11StateCache::~D3D11StateCache()
+{
+	if (context1 != nullptr) { context1->Release(); }
+}
+
+void D3D11StateCache::Invalidate()
+{
+	// Only the object pointers matter, but keep the rest defined too
+	memset(constantBuffers, 0, sizeof(constantBuffers));
+	memset(vertexBuffers, 0, sizeof(vertexBuffers));
+	memset(blendFactor, 0, sizeof(blendFactor));
+
+	for (u32 s = 0; s < STAGE_COUNT; ++s)
+	{
+		shaders[s] = Unknown<ID3D11DeviceChild>();
+		for (u32 i = 0; i < CONSTANT_BUFFER_SLOTS; ++i) { constantBuffers[s][i].buffer = Unknown<ID3D11Buffer>(); }
+		for (u32 i = 0; i < SHADER_RESOURCE_SLOTS; ++i) { shaderResources[s][i] = Unknown<ID3D11ShaderResourceView>(); }
+		for (u32 i = 0; i < SAMPLER_SLOTS; ++i) { samplers[s][i] = Unknown<ID3D11SamplerState>(); }
+	}
+
+	for (u32 i = 0; i < VERTEX_BUFFER_SLOTS; ++i) { vertexBuffers[i].buffer = Unknown<ID3D11Buffer>(); }
+
+	inputLayout = Unknown<ID3D11InputLayout>();
+	topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	indexBuffer = Unknown<ID3D11Buffer>();
+	indexFormat = DXGI_FORMAT_UNKNOWN;
+	indexOffset = 0;
+	rasterizerState = Unknown<ID3D11RasterizerState>();
+	blendState = Unknown<ID3D11BlendState>();
+	sampleMask = 0;
+	depthStencilState = Unknown<ID3D11DepthStencilState>();
+	stencilRef = 0;
+}
+
+void D3D11StateCache::ResetStats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void D3D11StateCache::SetShader(ShaderStage stage, ID3D11DeviceChild* shader)
+{
+	if (!Changed(STATE_SHADER, shaders[stage] != shader)) { return; }
+	shaders[stage] = shader;
+
+	switch (stage)
+	{
+	case STAGE_VERTEX:   context->VSSetShader(static_cast<ID3D11VertexShader*>(shader), nullptr, 0); break;
+	case STAGE_HULL:     context->HSSetShader(static_cast<ID3D11HullShader*>(shader), nullptr, 0); break;
+	case STAGE_DOMAIN:   context->DSSetShader(static_cast<ID3D11DomainShader*>(shader), nullptr, 0); break;
+	case STAGE_GEOMETRY: context->GSSetShader(static_cast<ID3D11GeometryShader*>(shader), nullptr, 0); break;
+	case STAGE_PIXEL:    context->PSSetShader(static_cast<ID3D11PixelShader*>(shader), nullptr, 0); break;
+	case STAGE_COMPUTE:  context->CSSetShader(static_cast<ID3D11ComputeShader*>(shader), nullptr, 0); break;
+	default: break;
+	}
+}
+
+void D3D11StateCache::SetVertexShader(ID3D11VertexShader* shader) { SetShader(STAGE_VERTEX, shader); }
+void D3D11StateCache::SetHullShader(ID3D11HullShader* shader) { SetShader(STAGE_HULL, shader); }
+void D3D11StateCache::SetDomainShader(ID3D11DomainShader* shader) { SetShader(STAGE_DOMAIN, shader); }
+void D3D11StateCache::SetGeometryShader(ID3D11GeometryShader* shader) { SetShader(STAGE_GEOMETRY, shader); }
+void D3D11StateCache::SetPixelShader(ID3D11PixelShader* shader) { SetShader(STAGE_PIXEL, shader); }
+void D3D11StateCache::SetComputeShader(ID3D11ComputeShader* shader) { SetShader(STAGE_COMPUTE, shader); }
+
+void D3D11StateCache::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (!Changed(STATE_INPUT_LAYOUT, inputLayout != layout)) { return; }
+	inputLayout = layout;
+	context->IASetInputLayout(layout);
+}
+
+void D3D11StateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY primitiveTopology)
+{
+	// UNDEFINED doubles as unknown, so setting it is never filtered
+	bool changed = topology != primitiveTopology || primitiveTopology == D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	if (!Changed(STATE_TOPOLOGY, changed)) { return; }
+	topology = primitiveTopology;
+	context->IASetPrimitiveTopology(primitiveTopology);
+}
+
+void D3D11StateCache::SetVertexBuffer(u32 slot, ID3D11Buffer* buffer, u32 stride, u32 offset)
+{
+	VertexBufferBinding& bound = vertexBuffers[slot];
+	if (!Changed(STATE_VERTEX_BUFFER, bound.buffer != buffer || bound.stride != stride || bound.offset != offset)) { return; }
+	bound.buffer = buffer;
+	bound.stride = stride;
+	bound.offset = offset;
+
+	UINT strides = stride;
+	UINT offsets = offset;
+	context->IASetVertexBuffers(slot, 1, &buffer, &strides, &offsets);
+}
+
+void D3D11StateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, u32 offset)
+{
+	if (!Changed(STATE_INDEX_BUFFER, indexBuffer != buffer || indexFormat != format || indexOffset != offset)) { return; }
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void D3D11StateCache::SetConstantBuffer(ShaderStage stage, u32 slot, ID3D11Buffer* buffer, u32 firstConstant, u32 constantCount)
+{
+	ConstantBufferBinding& bound = constantBuffers[stage][slot];
+	bool changed = bound.buffer != buffer || bound.constantCount != constantCount ||
+		(constantCount != 0 && bound.firstConstant != firstConstant);
+	if (!Changed(STATE_CONSTANT_BUFFER, changed)) { return; }
+	bound.buffer = buffer;
+	bound.firstConstant = firstConstant;
+	bound.constantCount = constantCount;
+
+	if (constantCount != 0)
+	{
+		UINT first = firstConstant;
+		UINT count = constantCount;
+		switch (stage)
+		{
+		case STAGE_VERTEX:   context1->VSSetConstantBuffers1(slot, 1, &buffer, &first, &count); break;
+		case STAGE_HULL:     context1->HSSetConstantBuffers1(slot, 1, &buffer, &first, &count); break;
+		case STAGE_DOMAIN:   context1->DSSetConstantBuffers1(slot, 1, &buffer, &first, &count); break;
+		case STAGE_GEOMETRY: context1->GSSetConstantBuffers1(slot, 1, &buffer, &first, &count); break;
+		case STAGE_PIXEL:    context1->PSSetConstantBuffers1(slot, 1, &buffer, &first, &count); break;
+		case STAGE_COMPUTE:  context1->CSSetConstantBuffers1(slot, 1, &buffer, &first, &count); break;
+		default: break;
+		}
+		return;
+	}
+
+	switch (stage)
+	{
+	case STAGE_VERTEX:   context->VSSetConstantBuffers(slot, 1, &buffer); break;
+	case STAGE_HULL:     context->HSSetConstantBuffers(slot, 1, &buffer); break;
+	case STAGE_DOMAIN:   context->DSSetConstantBuffers(slot, 1, &buffer); break;
+	case STAGE_GEOMETRY: context->GSSetConstantBuffers(slot, 1, &buffer); break;
+	case STAGE_PIXEL:    context->PSSetConstantBuffers(slot, 1, &buffer); break;
+	case STAGE_COMPUTE:  context->CSSetConstantBuffers(slot, 1, &buffer); break;
+	default: break;
+	}
+}
+
+void D3D11StateCache::SetShaderResource(ShaderStage stage, u32 slot, ID3D11ShaderResourceView* srv)
+{
+	if (!Changed(STATE_SHADER_RESOURCE, shaderResources[stage][slot] != srv)) { return; }
+	shaderResources[stage][slot] = srv;
+
+	switch (stage)
+	{
+	case STAGE_VERTEX:   context->VSSetShaderResources(slot, 1, &srv); break;
+	case STAGE_HULL:     context->HSSetShaderResources(slot, 1, &srv); break;
+	case STAGE_DOMAIN:   context->DSSetShaderResources(slot, 1, &srv); break;
+	case STAGE_GEOMETRY: context->GSSetShaderResources(slot, 1, &srv); break;
+	case STAGE_PIXEL:    context->PSSetShaderResources(slot, 1, &srv); break;
+	case STAGE_COMPUTE:  context->CSSetShaderResources(slot, 1, &srv); break;
+	default: break;
+	}
+}
+
+void D3D11StateCache::SetSampler(ShaderStage stage, u32 slot, ID3D11SamplerState* sampler)
+{
+	if (!Changed(STATE_SAMPLER, samplers[stage][slot] != sampler)) { return; }
+	samplers[stage][slot] = sampler;
+
+	switch (stage)
+	{
+	case STAGE_VERTEX:   context->VSSetSamplers(slot, 1, &sampler); break;
+	case STAGE_HULL:     context->HSSetSamplers(slot, 1, &sampler); break;
+	case STAGE_DOMAIN:   context->DSSetSamplers(slot, 1, &sampler); break;
+	case STAGE_GEOMETRY: context->GSSetSamplers(slot, 1, &sampler); break;
+	case STAGE_PIXEL:    context->PSSetSamplers(slot, 1, &sampler); break;
+	case STAGE_COMPUTE:  context->CSSetSamplers(slot, 1, &sampler); break;
+	default: break;
+	}
+}
+
+void D3D11StateCache::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	if (!Changed(STATE_RASTERIZER, rasterizerState != state)) { return; }
+	rasterizerState = state;
+	context->RSSetState(state);
+}
+
+void D3D11StateCache::SetBlendState(ID3D11BlendState* state, const float factor[4], u32 mask)
+{
+	static const float ONES[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	if (factor == nullptr) { factor = ONES; }
+
+	bool changed = blendState != state || sampleMask != mask || memcmp(blendFactor, factor, sizeof(blendFactor)) != 0;
+	if (!Changed(STATE_BLEND, changed)) { return; }
+	blendState = state;
+	memcpy(blendFactor, factor, sizeof(blendFactor));
+	sampleMask = mask;
+	context->OMSetBlendState(state, factor, mask);
+}
+
+void D3D11StateCache::SetDepthStencilState(ID3D11DepthStencilState* state, u32 ref)
+{
+	if (!Changed(STATE_DEPTH_STENCIL, depthStencilState != state || stencilRef != ref)) { return; }
+	depthStencilState = state;
+	stencilRef = ref;
+	context->OMSetDepthStencilState(state, ref);
+}
@@ -0,0 +1,142 @@
+#ifndef D3D11_STATE_CACHE_H_
+#define D3D11_STATE_CACHE_H_
+
+#include <d3d11_1.h>
+
+#include "Types.h"
+
+enum ShaderStage : u08
+{
+	STAGE_VERTEX,
+	STAGE_HULL,
+	STAGE_DOMAIN,
+	STAGE_GEOMETRY,
+	STAGE_PIXEL,
+	STAGE_COMPUTE,
+	STAGE_COUNT
+};
+
+// Shadows what is bound on an immediate context and drops sets that would not change anything
+//
+// Everything that binds shaders, input layout, vertex / index buffers, topology, constant buffers, SRVs,
+// samplers or rasterizer / blend / depth stencil states should go through here. Anything that bypasses it
+// must be followed by Invalidate(), or the cache may filter a set that was actually needed.
+// Render targets and viewports are not tracked.
+class D3D11StateCache
+{
+public:
+	enum StateType : u08
+	{
+		STATE_SHADER,
+		STATE_INPUT_LAYOUT,
+		STATE_VERTEX_BUFFER,
+		STATE_INDEX_BUFFER,
+		STATE_TOPOLOGY,
+		STATE_CONSTANT_BUFFER,
+		STATE_SHADER_RESOURCE,
+		STATE_SAMPLER,
+		STATE_RASTERIZER,
+		STATE_BLEND,
+		STATE_DEPTH_STENCIL,
+		STATE_COUNT
+	};
+
+	// Calls passed on to the context versus dropped, since the last ResetStats()
+	struct Stats
+	{
+		u32 issued[STATE_COUNT];
+		u32 filtered[STATE_COUNT];
+
+		u32 GetIssued() const;
+		u32 GetFiltered() const;
+	};
+
+	static const u32 VERTEX_BUFFER_SLOTS = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+	static const u32 CONSTANT_BUFFER_SLOTS = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static const u32 SHADER_RESOURCE_SLOTS = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	static const u32 SAMPLER_SLOTS = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+
+private:
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		u32 stride;
+		u32 offset;
+	};
+
+	// constantCount is zero for a whole buffer bound without an offset
+	struct ConstantBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		u32 firstConstant;
+		u32 constantCount;
+	};
+
+	ID3D11DeviceContext* context;
+	ID3D11DeviceContext1* context1;
+
+	ID3D11DeviceChild* shaders[STAGE_COUNT];
+	ID3D11InputLayout* inputLayout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	VertexBufferBinding vertexBuffers[VERTEX_BUFFER_SLOTS];
+	ID3D11Buffer* indexBuffer;
+	DXGI_FORMAT indexFormat;
+	u32 indexOffset;
+	ConstantBufferBinding constantBuffers[STAGE_COUNT][CONSTANT_BUFFER_SLOTS];
+	ID3D11ShaderResourceView* shaderResources[STAGE_COUNT][SHADER_RESOURCE_SLOTS];
+	ID3D11SamplerState* samplers[STAGE_COUNT][SAMPLER_SLOTS];
+	ID3D11RasterizerState* rasterizerState;
+	ID3D11BlendState* blendState;
+	float blendFactor[4];
+	u32 sampleMask;
+	ID3D11DepthStencilState* depthStencilState;
+	u32 stencilRef;
+
+	Stats stats;
+
+	// Counts the call either way ; true if it has to be issued
+	inline bool Changed(StateType type, bool changed)
+	{
+		++(changed ? stats.issued : stats.filtered)[type];
+		return changed;
+	}
+
+	void SetShader(ShaderStage stage, ID3D11DeviceChild* shader);
+
+public:
+	D3D11StateCache(ID3D11DeviceContext* immediateContext);
+	~D3D11StateCache();
+
+	D3D11StateCache(const D3D11StateCache&) = delete;
+	D3D11StateCache& operator= (const D3D11StateCache&) = delete;
+
+	// Forgets everything, so the next set of each state is issued
+	void Invalidate();
+
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetHullShader(ID3D11HullShader* shader);
+	void SetDomainShader(ID3D11DomainShader* shader);
+	void SetGeometryShader(ID3D11GeometryShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetComputeShader(ID3D11ComputeShader* shader);
+
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY primitiveTopology);
+	void SetVertexBuffer(u32 slot, ID3D11Buffer* buffer, u32 stride, u32 offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, u32 offset);
+
+	// A non-zero constantCount binds only that range of the buffer, which needs D3D11.1
+	void SetConstantBuffer(ShaderStage stage, u32 slot, ID3D11Buffer* buffer, u32 firstConstant = 0, u32 constantCount = 0);
+	void SetShaderResource(ShaderStage stage, u32 slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(ShaderStage stage, u32 slot, ID3D11SamplerState* sampler);
+
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	// A null blendFactor means all ones, like OMSetBlendState
+	void SetBlendState(ID3D11BlendState* state, const float blendFactor[4], u32 sampleMask);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, u32 stencilRef);
+
+	inline const Stats& GetStats() const { return stats; }
+	void ResetStats();
+};
+
+#endif
@@ -1,6 +1,11 @@
 #include "DXCore.h"
+#include "SimpleShader.h"
+#include "D3D11StateCache.h"
+#include "Profiler.h"
+#include "WorkerPool.h"
 
 #include <WindowsX.h>
+#include <cmath>
 #include <sstream>
 
 // Define the static instance variable so our OS-level 
@@ -50,6 +55,16 @@ DXCore::DXCore(
 	// Initialize fields
 	fpsFrameCount = 0;
 	fpsTimeElapsed = 0.0f;
+
+	fixedTimeStep = 1.0f / 60.0f;
+	maxCatchUpSteps = 5;
+	simulationTime = 0.0f;
+	simulationAccumulator = 0.0f;
+	interpolationAlpha = 0.0f;
+
+	pipelined = false;
+	pipeline = 0;
+	latencyTotal = 0.0;
 	
 	device = 0;
 	context = 0;
@@ -350,8 +365,24 @@ HRESULT DXCore::Run()
 	currentTime = now;
 	previousTime = now;
 
+	PROFILE_THREAD("Main");
+
+	// Whoever creates the shared job pool becomes its main thread, so make sure that's this one
+	WorkerPool* jobs = WorkerPool::Shared();
+
 	// Give subclass a chance to initialize
-	Init();
+	{
+		PROFILE_ZONE("Init");
+		Init();
+	}
+
+	if (pipelined)
+	{
+		pipeline = new FramePipeline(
+			[this](FrameSnapshot* frame) { SimulateFrame(frame); },
+			CreateFrameSnapshot(),
+			CreateFrameSnapshot());
+	}
 
 	// Our overall game and message loop
 	MSG msg = {};
@@ -367,23 +398,132 @@ HRESULT DXCore::Run()
 		}
 		else
 		{
+			PROFILE_FRAME();
+
+			// Device work queued by jobs since last frame
+			jobs->RunMainThreadJobs();
+
 			// Update timer and title bar (if necessary)
 			UpdateTimer();
 			if(titleBarStats)
 				UpdateTitleBarStats();
 
+			// Constant buffer upload and state cache counters are per frame
+			ISimpleShader::ResetUploadStats();
+			if (ISimpleShader::GetStateCache() != nullptr) { ISimpleShader::GetStateCache()->ResetStats(); }
+
 			// The game loop
-			Update(deltaTime, totalTime);
-			Draw(deltaTime, totalTime);
+			if (pipeline)
+			{
+				// Frame N+1 gets simulated while this thread renders frame N
+				pipeline->RequestFrame(deltaTime, totalTime);
+
+				FrameSnapshot* frame = pipeline->AcquireFrame();
+				if (frame)
+				{
+					{
+						PROFILE_ZONE("RenderFrame");
+						RenderFrame(frame);
+					}
+					pipeline->ReleaseFrame(frame);
+					latencyTotal += pipeline->GetLastLatency();
+				}
+			}
+			else
+			{
+				UpdateSimulation(deltaTime);
+				{
+					PROFILE_ZONE("Update");
+					Update(deltaTime, totalTime);
+				}
+				{
+					PROFILE_ZONE("Draw");
+					Draw(deltaTime, totalTime);
+				}
+
+				QueryPerformanceCounter((LARGE_INTEGER*)&now);
+				latencyTotal += (now - currentTime) * perfCounterSeconds * 1000.0;
+			}
 		}
 	}
 
+	// Lets the frame being simulated finish before the game goes away
+	delete pipeline;
+	pipeline = 0;
+
+	// Zones of the last few seconds, next to the executable
+	PROFILE_DUMP("profile_trace.json", "profile_stats.txt");
+
 	// We'll end up here once we get a WM_QUIT message,
 	// which usually comes from the user closing the window
 	return (HRESULT)msg.wParam;
 }
 
 
+// --------------------------------------------------------
+// Sets how many simulation ticks run per second
+// --------------------------------------------------------
+void DXCore::SetSimulationRate(float ticksPerSecond)
+{
+	fixedTimeStep = 1.0f / ticksPerSecond;
+}
+
+
+// --------------------------------------------------------
+// Runs as many fixed simulation steps as the time since the
+// last frame allows, carrying any remainder over to the next
+// --------------------------------------------------------
+void DXCore::UpdateSimulation(float frameTime)
+{
+	PROFILE_ZONE("FixedUpdate");
+
+	simulationAccumulator += frameTime;
+
+	unsigned int steps = 0;
+	while (simulationAccumulator >= fixedTimeStep && steps < maxCatchUpSteps)
+	{
+		simulationAccumulator -= fixedTimeStep;
+		simulationTime += fixedTimeStep;
+		FixedUpdate(fixedTimeStep, simulationTime);
+		steps++;
+	}
+
+	// Fell too far behind : let go of the time we couldn't catch up on
+	if (simulationAccumulator >= fixedTimeStep)
+		simulationAccumulator = fmodf(simulationAccumulator, fixedTimeStep);
+
+	interpolationAlpha = simulationAccumulator / fixedTimeStep;
+}
+
+
+// --------------------------------------------------------
+// Turns pipelined frames on or off ; see ExtractFrame and
+// RenderFrame. Only takes effect when Run starts.
+// --------------------------------------------------------
+void DXCore::SetPipelined(bool enabled)
+{
+	pipelined = enabled;
+}
+
+
+// --------------------------------------------------------
+// Simulation half of a pipelined frame, run on the
+// simulation thread
+// --------------------------------------------------------
+void DXCore::SimulateFrame(FrameSnapshot* frame)
+{
+	UpdateSimulation(frame->deltaTime);
+	{
+		PROFILE_ZONE("Update");
+		Update(frame->deltaTime, frame->totalTime);
+	}
+	{
+		PROFILE_ZONE("ExtractFrame");
+		ExtractFrame(frame);
+	}
+}
+
+
 // --------------------------------------------------------
 // Sends an OS-level window close message to our process, which
 // will be handled by our message processing function
@@ -444,7 +584,23 @@ void DXCore::UpdateTitleBarStats()
 		"    Width: "		<< width <<
 		"    Height: "		<< height <<
 		"    FPS: "			<< fpsFrameCount <<
-		"    Frame Time: "	<< mspf << "ms";
+		"    Frame Time: "	<< mspf << "ms" <<
+		"    Latency: "		<< latencyTotal / fpsFrameCount << "ms" << (pipeline ? " (pipelined)" : "");
+
+	// Constant buffer traffic of the last frame
+	const SimpleUploadStats& uploads = ISimpleShader::GetUploadStats();
+	output <<
+		"    CB Uploads: "	<< uploads.Uploads << " (" << uploads.BytesUploaded / 1024 << " KB)" <<
+		"    Skipped: "		<< uploads.UploadsSkipped;
+
+	// State changes that reached the context versus the redundant ones dropped
+	if (ISimpleShader::GetStateCache() != nullptr)
+	{
+		const D3D11StateCache::Stats& states = ISimpleShader::GetStateCache()->GetStats();
+		output <<
+			"    State Calls: "	<< states.GetIssued() <<
+			"    Filtered: "	<< states.GetFiltered();
+	}
 
 	// Append the version of DirectX the app is using
 	switch (dxFeatureLevel)
@@ -463,6 +619,7 @@ void DXCore::UpdateTitleBarStats()
 	SetWindowText(hWnd, output.str().c_str());
 	fpsFrameCount = 0;
 	fpsTimeElapsed += 1.0f;
+	latencyTotal = 0.0;
 }
 
 // --------------------------------------------------------
@@ -541,6 +698,11 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		if (wParam == SIZE_MINIMIZED)
 			return 0;
 
+		// The simulation thread may be reading what a resize
+		// changes (e.g. the camera's projection)
+		if (pipeline)
+			pipeline->WaitForSimulation();
+
 		// Save the new client area dimensions.
 		width = LOWORD(lParam);
 		height = HIWORD(lParam);
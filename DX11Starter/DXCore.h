@@ -4,6 +4,8 @@
 #include <d3d11.h>
 #include <string>
 
+#include "FramePipeline.h"
+
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
 #pragma comment(lib, "d3d11.lib")
@@ -43,6 +45,22 @@ public:
 	virtual void Update(float deltaTime, float totalTime)	= 0;
 	virtual void Draw(float deltaTime, float totalTime)		= 0;
 
+	// Simulation tick, called zero or more times per frame (before Update) so that it always
+	// advances by exactly stepTime ; simulationTime is the time at the end of the tick
+	virtual void FixedUpdate(float stepTime, float simulationTime) { }
+
+	// Simulation ticks per second
+	void SetSimulationRate(float ticksPerSecond);
+
+	// Pipelined mode (opt-in, see SetPipelined ; Game enables it with -pipelined) splits each frame in two : a simulation thread runs FixedUpdate,
+	// Update and ExtractFrame for frame N+1 while the main thread runs RenderFrame for frame N. Draw is not called.
+	//  - ExtractFrame copies whatever rendering needs into the snapshot ; RenderFrame must only read the snapshot
+	//  - Window messages (mouse input) are still handled on the main thread, concurrently with the simulation,
+	//    except OnResize, which only runs once the simulation thread is idle
+	virtual FrameSnapshot* CreateFrameSnapshot() { return nullptr; }
+	virtual void ExtractFrame(FrameSnapshot* frame) { }
+	virtual void RenderFrame(const FrameSnapshot* frame) { }
+
 	// Convenience methods for handling mouse input, since we
 	// can easily grab mouse input from OS-level messages
 	virtual void OnMouseDown (WPARAM buttonState, int x, int y) { }
@@ -72,6 +90,17 @@ protected:
 	// Helper function for allocating a console window
 	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
 
+	// How far the frame is between the last simulation tick and the next one, from 0 to 1
+	//  - Draw blends the last two ticks by this much, so motion stays smooth whatever the frame rate
+	float interpolationAlpha;
+
+	// Most ticks a single frame may run to catch up ; time beyond that is dropped, so a long stall
+	// slows the game down for a moment rather than making every following frame even longer
+	unsigned int maxCatchUpSteps;
+
+	// Takes effect when Run starts ; the game must implement the snapshot methods above
+	void SetPipelined(bool enabled);
+
 private:
 	// Timing related data
 	double perfCounterSeconds;
@@ -81,11 +110,25 @@ private:
 	__int64 currentTime;
 	__int64 previousTime;
 
+	// Fixed step simulation
+	float fixedTimeStep;
+	float simulationTime;
+	float simulationAccumulator;
+
 	// FPS calculation
 	int fpsFrameCount;
 	float fpsTimeElapsed;
+
+	// Pipelined frames
+	bool pipelined;
+	FramePipeline* pipeline;
+
+	// Input to presentation time, summed over the frames counted by the title bar
+	double latencyTotal;
 	
 	void UpdateTimer();			// Updates the timer for this frame
+	void UpdateSimulation(float frameTime);		// Runs the simulation ticks this frame owes
+	void SimulateFrame(FrameSnapshot* frame);	// Simulation half of a pipelined frame
 	void UpdateTitleBarStats();	// Puts debug info in the title bar
 };
 
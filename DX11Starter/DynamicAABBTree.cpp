@@ -0,0 +1,307 @@
+#include "DynamicAABBTree.h"
+
+const u32 DynamicAABBTree::INVALID;
+const u32 DynamicAABBTree::STACK_SIZE;
+const u32 DynamicAABBTree::INSIDE_BIT;
+
+DynamicAABBTree::DynamicAABBTree(float fatMargin) :
+	nodes(),
+	root(INVALID),
+	freeList(INVALID),
+	proxyCount(0),
+	margin(fatMargin)
+{
+	// Nothing interesting to do here
+}
+
+u32 DynamicAABBTree::AllocateNode()
+{
+	u32 node;
+	if (freeList != INVALID)
+	{
+		node = freeList;
+		freeList = nodes[node].parent;
+	}
+	else
+	{
+		node = (u32)nodes.size();
+		nodes.push_back(Node());
+	}
+
+	nodes[node].parent = INVALID;
+	nodes[node].child1 = INVALID;
+	nodes[node].child2 = INVALID;
+	nodes[node].userData = 0;
+	nodes[node].height = 0;
+	return node;
+}
+
+void DynamicAABBTree::FreeNode(u32 node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+u32 DynamicAABBTree::CreateProxy(const AABB& box, u64 userData)
+{
+	u32 proxy = AllocateNode();
+	nodes[proxy].box = AABB{ box.min - glm::vec3(margin), box.max + glm::vec3(margin) };
+	nodes[proxy].userData = userData;
+
+	InsertLeaf(proxy);
+	++proxyCount;
+	return proxy;
+}
+
+void DynamicAABBTree::DestroyProxy(u32 proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	--proxyCount;
+}
+
+bool DynamicAABBTree::MoveProxy(u32 proxy, const AABB& box)
+{
+	const AABB& fat = nodes[proxy].box;
+	bool contained = glm::all(glm::lessThanEqual(fat.min, box.min)) && glm::all(glm::lessThanEqual(box.max, fat.max));
+
+	// A fat box left far bigger than its contents (after a fast move, say) would make every query around it report it
+	glm::vec3 slack(margin * 4.0f);
+	bool tooLoose = glm::any(glm::lessThan(fat.min, box.min - slack)) || glm::any(glm::greaterThan(fat.max, box.max + slack));
+	if (contained && !tooLoose) { return false; }
+
+	RemoveLeaf(proxy);
+	nodes[proxy].box = AABB{ box.min - glm::vec3(margin), box.max + glm::vec3(margin) };
+	InsertLeaf(proxy);
+	return true;
+}
+
+void DynamicAABBTree::Clear()
+{
+	nodes.clear();
+	root = INVALID;
+	freeList = INVALID;
+	proxyCount = 0;
+}
+
+void DynamicAABBTree::InsertLeaf(u32 leaf)
+{
+	if (root == INVALID)
+	{
+		root = leaf;
+		nodes[leaf].parent = INVALID;
+		return;
+	}
+
+	// Walk down towards whichever child the leaf enlarges least, stopping once pairing it with the current node is cheaper
+	AABB leafBox = nodes[leaf].box;
+	u32 index = root;
+	while (nodes[index].child1 != INVALID)
+	{
+		const Node& node = nodes[index];
+		const Node& child1 = nodes[node.child1];
+		const Node& child2 = nodes[node.child2];
+
+		float combinedArea = Area(Union(node.box, leafBox));
+		// Cost of a new parent here, and what every ancestor below it grows by when the leaf goes further down
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - Area(node.box));
+
+		float cost1 = Area(Union(leafBox, child1.box)) + inheritance;
+		if (child1.child1 != INVALID) { cost1 -= Area(child1.box); }
+		float cost2 = Area(Union(leafBox, child2.box)) + inheritance;
+		if (child2.child1 != INVALID) { cost2 -= Area(child2.box); }
+
+		if (cost < cost1 && cost < cost2) { break; }
+		index = (cost1 < cost2) ? node.child1 : node.child2;
+	}
+
+	// New branch taking the sibling's place, with the sibling and the leaf below it
+	u32 sibling = index;
+	u32 newParent = AllocateNode();
+	u32 oldParent = nodes[sibling].parent;
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = Union(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == INVALID) { root = newParent; }
+	else if (nodes[oldParent].child1 == sibling) { nodes[oldParent].child1 = newParent; }
+	else { nodes[oldParent].child2 = newParent; }
+
+	// Refit and rebalance every ancestor
+	for (index = newParent; index != INVALID; index = nodes[index].parent)
+	{
+		index = Balance(index);
+
+		Node& node = nodes[index];
+		node.height = 1 + glm::max(nodes[node.child1].height, nodes[node.child2].height);
+		node.box = Union(nodes[node.child1].box, nodes[node.child2].box);
+	}
+}
+
+void DynamicAABBTree::RemoveLeaf(u32 leaf)
+{
+	if (leaf == root)
+	{
+		root = INVALID;
+		return;
+	}
+
+	// The leaf's sibling takes its parent's place
+	u32 parent = nodes[leaf].parent;
+	u32 grandParent = nodes[parent].parent;
+	u32 sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+	FreeNode(parent);
+
+	nodes[sibling].parent = grandParent;
+	if (grandParent == INVALID)
+	{
+		root = sibling;
+		return;
+	}
+
+	if (nodes[grandParent].child1 == parent) { nodes[grandParent].child1 = sibling; }
+	else { nodes[grandParent].child2 = sibling; }
+
+	for (u32 index = grandParent; index != INVALID; index = nodes[index].parent)
+	{
+		index = Balance(index);
+
+		Node& node = nodes[index];
+		node.height = 1 + glm::max(nodes[node.child1].height, nodes[node.child2].height);
+		node.box = Union(nodes[node.child1].box, nodes[node.child2].box);
+	}
+}
+
+u32 DynamicAABBTree::Balance(u32 iA)
+{
+	Node& a = nodes[iA];
+	if (a.child1 == INVALID || a.height < 2) { return iA; }
+
+	u32 iB = a.child1;
+	u32 iC = a.child2;
+	Node& b = nodes[iB];
+	Node& c = nodes[iC];
+
+	i32 balance = c.height - b.height;
+	if (balance > 1)
+	{
+		// C moves up, A becomes its first child, and the shorter of C's children goes to A
+		u32 iF = c.child1;
+		u32 iG = c.child2;
+		Node& f = nodes[iF];
+		Node& g = nodes[iG];
+
+		c.child1 = iA;
+		c.parent = a.parent;
+		a.parent = iC;
+
+		if (c.parent == INVALID) { root = iC; }
+		else if (nodes[c.parent].child1 == iA) { nodes[c.parent].child1 = iC; }
+		else { nodes[c.parent].child2 = iC; }
+
+		if (f.height > g.height)
+		{
+			c.child2 = iF;
+			a.child2 = iG;
+			g.parent = iA;
+			a.box = Union(b.box, g.box);
+			c.box = Union(a.box, f.box);
+			a.height = 1 + glm::max(b.height, g.height);
+			c.height = 1 + glm::max(a.height, f.height);
+		}
+		else
+		{
+			c.child2 = iG;
+			a.child2 = iF;
+			f.parent = iA;
+			a.box = Union(b.box, f.box);
+			c.box = Union(a.box, g.box);
+			a.height = 1 + glm::max(b.height, f.height);
+			c.height = 1 + glm::max(a.height, g.height);
+		}
+		return iC;
+	}
+
+	if (balance < -1)
+	{
+		// Mirror image, B moves up
+		u32 iD = b.child1;
+		u32 iE = b.child2;
+		Node& d = nodes[iD];
+		Node& e = nodes[iE];
+
+		b.child1 = iA;
+		b.parent = a.parent;
+		a.parent = iB;
+
+		if (b.parent == INVALID) { root = iB; }
+		else if (nodes[b.parent].child1 == iA) { nodes[b.parent].child1 = iB; }
+		else { nodes[b.parent].child2 = iB; }
+
+		if (d.height > e.height)
+		{
+			b.child2 = iD;
+			a.child1 = iE;
+			e.parent = iA;
+			a.box = Union(c.box, e.box);
+			b.box = Union(a.box, d.box);
+			a.height = 1 + glm::max(c.height, e.height);
+			b.height = 1 + glm::max(a.height, d.height);
+		}
+		else
+		{
+			b.child2 = iE;
+			a.child1 = iD;
+			d.parent = iA;
+			a.box = Union(c.box, d.box);
+			b.box = Union(a.box, e.box);
+			a.height = 1 + glm::max(c.height, d.height);
+			b.height = 1 + glm::max(a.height, e.height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
+
+void DynamicAABBTree::QueryBoxes(u64 count, const AABB* boxes, std::vector<u32>& results, std::vector<u32>& offsets) const
+{
+	results.clear();
+	offsets.resize((size_t)count + 1);
+	for (u64 i = 0; i < count; ++i)
+	{
+		offsets[i] = (u32)results.size();
+		QueryBox(boxes[i], [&](u32 proxy) { results.push_back(proxy); });
+	}
+	offsets[count] = (u32)results.size();
+}
+
+void DynamicAABBTree::QuerySpheres(u64 count, const glm::vec3* centers, const float* radii, std::vector<u32>& results, std::vector<u32>& offsets) const
+{
+	results.clear();
+	offsets.resize((size_t)count + 1);
+	for (u64 i = 0; i < count; ++i)
+	{
+		offsets[i] = (u32)results.size();
+		QuerySphere(centers[i], radii[i], [&](u32 proxy) { results.push_back(proxy); });
+	}
+	offsets[count] = (u32)results.size();
+}
+
+void DynamicAABBTree::QueryFrustums(u64 count, const Frustum* frustums, std::vector<u32>& results, std::vector<u32>& offsets) const
+{
+	results.clear();
+	offsets.resize((size_t)count + 1);
+	for (u64 i = 0; i < count; ++i)
+	{
+		offsets[i] = (u32)results.size();
+		QueryFrustum(frustums[i], [&](u32 proxy) { results.push_back(proxy); });
+	}
+	offsets[count] = (u32)results.size();
+}
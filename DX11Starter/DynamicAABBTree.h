@@ -0,0 +1,231 @@
+#ifndef DYNAMIC_AABB_TREE_H_
+#define DYNAMIC_AABB_TREE_H_
+
+#include <vector>
+
+#include "Types.h"
+#include "Bounds.h"
+#include "FrustumCulling.h"
+
+// Bounding volume hierarchy over boxes that move, for queries in logarithmic rather than linear time
+//  - Every proxy (leaf) stores a fat box : its box grown by a margin, so small moves don't touch the tree at all
+//  - Leaves are inserted where they grow the tree's surface area least, and rotations keep the tree balanced
+//  - Queries test the fat boxes, so they can report proxies slightly outside what was asked for
+class DynamicAABBTree
+{
+public:
+	static const u32 INVALID = 0xFFFFFFFF;
+
+private:
+	// Deeper than a balanced tree over 4 billion proxies ever gets
+	static const u32 STACK_SIZE = 256;
+	// Marks a node on the frustum query stack whose box is known to be entirely inside
+	static const u32 INSIDE_BIT = 0x80000000;
+
+	struct Node
+	{
+		AABB box;     // Fat box for leaves, union of the children for branches
+		u64 userData; // Leaves only
+		u32 parent;   // Doubles as the next free node while on the free list
+		u32 child1;   // INVALID for leaves
+		u32 child2;
+		i32 height;   // 0 for leaves, -1 while free
+	};
+
+	std::vector<Node> nodes;
+	u32 root;
+	u32 freeList;
+	u64 proxyCount;
+	float margin;
+
+	u32 AllocateNode();
+	void FreeNode(u32 node);
+
+	void InsertLeaf(u32 leaf);
+	void RemoveLeaf(u32 leaf);
+	// Rotates the taller grandchild up when a node's children differ in height by more than one, returning the subtree's new root
+	u32 Balance(u32 node);
+
+	static inline AABB Union(const AABB& a, const AABB& b) { return AABB{ glm::min(a.min, b.min), glm::max(a.max, b.max) }; }
+	// Half the surface area, all the insertion cost needs
+	static inline float Area(const AABB& a) { glm::vec3 d = a.max - a.min; return d.x * d.y + d.y * d.z + d.z * d.x; }
+
+public:
+	// Margin is how far (in world units) a box can move in any direction before its proxy has to be reinserted
+	DynamicAABBTree(float fatMargin = 0.5f);
+
+	// Returns the proxy to hand back to the other methods ; user data is returned by GetUserData
+	u32 CreateProxy(const AABB& box, u64 userData);
+	void DestroyProxy(u32 proxy);
+	// Reinserts the proxy only when box left its fat box (or shrank far inside it), returning whether it did
+	bool MoveProxy(u32 proxy, const AABB& box);
+
+	inline u64 GetUserData(u32 proxy) const      { return nodes[proxy].userData; }
+	inline const AABB& GetFatBox(u32 proxy) const { return nodes[proxy].box; }
+	inline u64 GetProxyCount() const              { return proxyCount; }
+	inline u32 GetHeight() const                  { return root == INVALID ? 0 : (u32)nodes[root].height; }
+
+	// Drops every proxy
+	void Clear();
+
+	// <QUERIES>
+
+	static inline bool Overlaps(const AABB& a, const AABB& b)
+	{
+		return a.min.x <= b.max.x && a.min.y <= b.max.y && a.min.z <= b.max.z &&
+			b.min.x <= a.max.x && b.min.y <= a.max.y && b.min.z <= a.max.z;
+	}
+	static inline bool Overlaps(const AABB& a, const glm::vec3& center, float radius)
+	{
+		glm::vec3 d = center - glm::clamp(center, a.min, a.max);
+		return glm::dot(d, d) <= radius * radius;
+	}
+	// Distance along the ray at which it enters the box (0 when starting inside), or a negative value on a miss
+	// inverseDirection is 1 / direction per component ; infinities for axis aligned rays work out
+	static inline float RayDistance(const AABB& a, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+	{
+		glm::vec3 t1 = (a.min - origin) * inverseDirection;
+		glm::vec3 t2 = (a.max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t1, t2);
+		glm::vec3 tFar = glm::max(t1, t2);
+		float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+		float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+		return enter <= exit ? enter : -1.0f;
+	}
+
+	// Each calls fn(proxy) for every proxy whose fat box overlaps the shape
+	template<typename F> void QueryBox(const AABB& box, F fn) const;
+	template<typename F> void QuerySphere(const glm::vec3& center, float radius, F fn) const;
+	// Subtrees entirely inside the frustum are reported without testing the boxes below them
+	template<typename F> void QueryFrustum(const Frustum& frustum, F fn) const;
+	// Calls fn(proxy, distance) for every proxy whose fat box the ray enters within maxDistance ; fn returns the new
+	// maxDistance, so returning the distance of a confirmed hit finds the nearest one, and returning 0 stops the cast
+	// Distances are in units of direction, which needn't be normalized
+	template<typename F> void RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F fn) const;
+
+	// Batched versions, running the queries back to back so the top of the tree stays in cache
+	// The proxies found by query i are results[offsets[i]] up to results[offsets[i + 1]] ; both vectors are overwritten
+	void QueryBoxes(u64 count, const AABB* boxes, std::vector<u32>& results, std::vector<u32>& offsets) const;
+	void QuerySpheres(u64 count, const glm::vec3* centers, const float* radii, std::vector<u32>& results, std::vector<u32>& offsets) const;
+	void QueryFrustums(u64 count, const Frustum* frustums, std::vector<u32>& results, std::vector<u32>& offsets) const;
+
+	// </QUERIES>
+};
+
+template<typename F> void DynamicAABBTree::QueryBox(const AABB& box, F fn) const
+{
+	if (root == INVALID) { return; }
+
+	u32 stack[STACK_SIZE];
+	u32 top = 0;
+	stack[top++] = root;
+	while (top != 0)
+	{
+		u32 index = stack[--top];
+		const Node& node = nodes[index];
+		if (!Overlaps(node.box, box)) { continue; }
+
+		if (node.child1 == INVALID) { fn(index); }
+		else
+		{
+			stack[top++] = node.child1;
+			stack[top++] = node.child2;
+		}
+	}
+}
+
+template<typename F> void DynamicAABBTree::QuerySphere(const glm::vec3& center, float radius, F fn) const
+{
+	if (root == INVALID) { return; }
+
+	u32 stack[STACK_SIZE];
+	u32 top = 0;
+	stack[top++] = root;
+	while (top != 0)
+	{
+		u32 index = stack[--top];
+		const Node& node = nodes[index];
+		if (!Overlaps(node.box, center, radius)) { continue; }
+
+		if (node.child1 == INVALID) { fn(index); }
+		else
+		{
+			stack[top++] = node.child1;
+			stack[top++] = node.child2;
+		}
+	}
+}
+
+template<typename F> void DynamicAABBTree::QueryFrustum(const Frustum& frustum, F fn) const
+{
+	if (root == INVALID) { return; }
+
+	u32 stack[STACK_SIZE];
+	u32 top = 0;
+	stack[top++] = root;
+	while (top != 0)
+	{
+		u32 entry = stack[--top];
+		u32 index = entry & ~INSIDE_BIT;
+		const Node& node = nodes[index];
+
+		// Same test as IsBoxVisible, also noting whether the box is entirely on the inner side of every plane
+		u32 inside = entry & INSIDE_BIT;
+		if (inside == 0)
+		{
+			glm::vec3 center = (node.box.min + node.box.max) * 0.5f;
+			glm::vec3 extents = (node.box.max - node.box.min) * 0.5f;
+
+			bool outside = false;
+			inside = INSIDE_BIT;
+			for (u32 p = 0; p < 6; ++p)
+			{
+				const glm::vec4& n = frustum.planes[p];
+				float distance = n.x * center.x + n.y * center.y + n.z * center.z + n.w;
+				float reach = glm::abs(n.x) * extents.x + glm::abs(n.y) * extents.y + glm::abs(n.z) * extents.z;
+				if (distance + reach < 0.0f) { outside = true; break; }
+				if (distance - reach < 0.0f) { inside = 0; }
+			}
+			if (outside) { continue; }
+		}
+
+		if (node.child1 == INVALID) { fn(index); }
+		else
+		{
+			stack[top++] = node.child1 | inside;
+			stack[top++] = node.child2 | inside;
+		}
+	}
+}
+
+template<typename F> void DynamicAABBTree::RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F fn) const
+{
+	if (root == INVALID) { return; }
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+
+	u32 stack[STACK_SIZE];
+	u32 top = 0;
+	stack[top++] = root;
+	while (top != 0)
+	{
+		u32 index = stack[--top];
+		const Node& node = nodes[index];
+
+		float distance = RayDistance(node.box, origin, inverseDirection, maxDistance);
+		if (distance < 0.0f) { continue; }
+
+		if (node.child1 == INVALID)
+		{
+			maxDistance = fn(index, distance);
+			if (maxDistance <= 0.0f) { return; }
+		}
+		else
+		{
+			stack[top++] = node.child1;
+			stack[top++] = node.child2;
+		}
+	}
+}
+
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include <DirectXMath.h>
 #include "Material.h"
 
 class Emitter
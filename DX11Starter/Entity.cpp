@@ -1,25 +1,22 @@
 #include "Entity.h"
 
-using namespace DirectX;
-
 #include "Scene.h"
 
 void Entity::DestroyInternal()
 {
+	std::vector<Object*> children = GetChildren();
 	u64 cc = children.size();
 	for (u64 i = 0; i < cc; ++i)
 	{
-		((Entity*)(children[i]))->Destroy();
+		// Already inside a sync point, so children can go right away
+		scene.GetScene()->DestroyEntity((Entity*)(children[i]));
 	}
 
-	if (parent != nullptr) { parent->RemoveChild(this); }
-
 	// Safety block - maybe remove later for performance?
-	children.clear();
-	parent = nullptr;
-	scene = SceneRef();
+	DetachHierarchy();
 
-	// TODO : Perform component login here
+	// Component data goes away at the next sync point, once nobody can be iterating over it
+	scene.GetScene()->GetComponentStore()->RemoveAll(GetHandle());
 }
 
 Entity::Entity() :
@@ -30,10 +27,10 @@ Entity::Entity() :
 	// Nothing interesting to do here
 }
 
-Entity::Entity(Scene* parentScene, u64 ind, u64 sID, u64 tID, Mesh* mesh, Material* mat, const Transform& t, Entity* parentEntity) :
-	Object(t, parentEntity),
+Entity::Entity(Scene* parentScene, u64 ind, u32 gen, u64 sID, u64 tID, Mesh* mesh, Material* mat, const Transform& t, Entity* parentEntity) :
+	Object(parentScene->GetTransformStore(), t, parentEntity),
 	tags(),
-	scene(parentScene, ind, sID, tID),
+	scene(parentScene, ind, gen, sID, tID),
 	meshObject(nullptr),
 	material(nullptr)
 {
@@ -41,37 +38,57 @@ Entity::Entity(Scene* parentScene, u64 ind, u64 sID, u64 tID, Mesh* mesh, Materi
 	material = mat;
 }
 
+Entity::Entity(Scene* parentScene, u64 ind, u32 gen, u64 sID, u64 tID, Mesh* mesh, Material* mat, u32 transformSlot) :
+	Object(parentScene->GetTransformStore(), transformSlot),
+	tags(),
+	scene(parentScene, ind, gen, sID, tID),
+	meshObject(mesh),
+	material(mat)
+{
+	// Nothing interesting to do here
+}
+
 void Entity::Destroy()
 {
-	scene.GetScene()->DestroyEntity(this);
+	scene.GetScene()->GetCommandBuffer()->Destroy(GetHandle());
 }
 
-void Entity::AddTag(std::string tag)
+void Entity::AddTag(TagID tag)
 {
-	// TODO : Add logic for interfacing scene - various tag optimizations
-	tags.push_back(tag);
+	if (tag >= TagRegistry::MAX_TAGS || tags.Has(tag)) { return; }
+
+	tags.Add(tag);
+
+	// Keep the scene's tag index in sync so tag queries never have to scan entities
+	Scene* parentScene = scene.GetScene();
+	if (parentScene != nullptr) { parentScene->IndexTag(this, tag); }
 }
 
-void Entity::RemoveTag(std::string tag)
+void Entity::AddTag(const std::string& tag)
 {
-	// TODO : Add logic for interfacing scene - various tag optimizations
-	for (u64 i = 0; i < tags.size(); ++i)
-	{
-		if (tags[i] == tag)
-		{
-			tags[i] = tags[tags.size() - 1];
-			tags.pop_back();
-			return;
-		}
-	}
+	AddTag(TagRegistry::Intern(tag));
 }
 
-void Entity::AddTags(std::vector<std::string> newTags)
+void Entity::RemoveTag(TagID tag)
+{
+	if (!tags.Has(tag)) { return; }
+
+	tags.Remove(tag);
+
+	Scene* parentScene = scene.GetScene();
+	if (parentScene != nullptr) { parentScene->UnindexTag(this, tag); }
+}
+
+void Entity::RemoveTag(const std::string& tag)
+{
+	RemoveTag(TagRegistry::Find(tag));
+}
+
+void Entity::AddTags(const std::vector<std::string>& newTags)
 {
-	// TODO : Add logic for interfacing scene - various tag optimizations
 	for (u64 i = 0; i < newTags.size(); ++i)
 	{
-		tags.push_back(newTags[i]);
+		AddTag(TagRegistry::Intern(newTags[i]));
 	}
 }
 
@@ -92,22 +109,3 @@ inline void Entity::GetScale()
 inline void Entity::GetRotation()
 {
 }
-
-void Entity::PrepareShader(DirectX::XMFLOAT4X4 viewMatrix, DirectX::XMFLOAT4X4 projMatrix)
-{
-	material->GetVertexShader()->SetMatrix4x4("view", viewMatrix);
-	material->GetVertexShader()->SetMatrix4x4("projection", projMatrix);
-	mat4 worldMat = glm::transpose(GetWorldMatrix());
-	float* matarr = &(worldMat[0][0]);
-	material->GetVertexShader()->SetMatrix4x4("world", matarr);
-
-	material->GetPixelShader()->SetShaderResourceView("res", material->GetShaderResourceView());
-	material->GetPixelShader()->SetShaderResourceView("normalMap", material->GetNormalResourceView());
-	material->GetPixelShader()->SetSamplerState("state", material->GetSamplerState());
-
-	material->GetVertexShader()->CopyAllBufferData();
-	material->GetPixelShader()->CopyAllBufferData();
-
-	material->GetVertexShader()->SetShader();
-	material->GetPixelShader()->SetShader();
-}
\ No newline at end of file
@@ -3,6 +3,8 @@
 
 #include "Object.h"
 #include "SceneRef.h"
+#include "EntityHandle.h"
+#include "Tags.h"
 
 #include "Mesh.h"
 #include "Material.h"
@@ -16,12 +18,15 @@ class Component;
 class Entity : public Object
 {
 private:
-	std::vector<std::string> tags;
+	TagSet tags;
 	SceneRef scene;
 
 	// Actually handles internal entity deletion, called by managing scene
 	void DestroyInternal();
 
+	// Used by batch spawning, where the transform slot has already been claimed as part of a block
+	Entity(Scene* parentScene, u64 ind, u32 gen, u64 sID, u64 tID, Mesh* mesh, Material* mat, u32 transformSlot);
+
 	friend class Scene;
 
 public:
@@ -29,7 +34,9 @@ public:
 	Material * material = nullptr;
 
 	Entity();
-	Entity(Scene* parentScene, u64 ind, u64 sID, u64 tID, Mesh* mesh, Material* mat, const Transform& t = Transform(), Entity* parentEntity = nullptr);
+	Entity(Scene* parentScene, u64 ind, u32 gen, u64 sID, u64 tID, Mesh* mesh, Material* mat, const Transform& t = Transform(), Entity* parentEntity = nullptr);
+	Entity(Entity&& other) = default;
+	Entity& operator= (Entity&& other) = default;
 	~Entity();
 
 	inline void SetPositionF(float x, float y, float z) { SetPositionWorld(glm::vec3(x, y, z)); }
@@ -38,20 +45,28 @@ public:
 	inline void GetPosition();
 	inline void GetScale();
 	inline void GetRotation();
-	void PrepareShader(DirectX::XMFLOAT4X4 viewMatrix, DirectX::XMFLOAT4X4 projMatrix);
 
-	// Flags the entity for deletion
+	// Flags the entity for deletion, which happens at the scene's next sync point
 	void Destroy();
 
+	// Generational handle that stays safe to hold after this entity is destroyed
+	inline EntityHandle GetHandle() const { return EntityHandle((u32)scene.GetIndex(), scene.GetGeneration()); }
+	inline Scene* GetScene() const { return scene.GetScene(); }
+
 	// <TAGS>
 
-	inline std::vector<std::string> GetTags() const { return tags; }
-	inline bool HasTag(std::string tag) const { for (u64 i = 0; i < tags.size(); ++i) { if (tags[i] == tag) { return true; } } return false; }
+	inline const TagSet& GetTags() const { return tags; }
+	inline bool HasTag(TagID tag) const { return tags.Has(tag); }
+	// Only looks the tag up, so asking about a tag nobody uses doesn't register it
+	inline bool HasTag(const std::string& tag) const { return tags.Has(TagRegistry::Find(tag)); }
 
 	// Will probably move tag system purely into script-side once that's up-and-running
-	void AddTag(std::string tag);
-	void RemoveTag(std::string tag);
-	void AddTags(std::vector<std::string> newTags);
+	// Prefer the TagID overloads in hot code, the string ones go through the registry
+	void AddTag(TagID tag);
+	void AddTag(const std::string& tag);
+	void RemoveTag(TagID tag);
+	void RemoveTag(const std::string& tag);
+	void AddTags(const std::vector<std::string>& newTags);
 
 	// </TAGS>
 };
@@ -0,0 +1,64 @@
+#include "EntityCommandBuffer.h"
+
+const u32 CommandTarget::INVALID;
+
+void EntityCommandBuffer::BeginPlayback()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	commands.swap(playbackCommands);
+	spawns.swap(playbackSpawns);
+}
+
+void EntityCommandBuffer::EndPlayback()
+{
+	// Cleared rather than freed, so the next frame's recording doesn't have to allocate again
+	playbackCommands.clear();
+	playbackSpawns.clear();
+}
+
+EntityCommandBuffer::EntityCommandBuffer() :
+	commands(),
+	spawns(),
+	playbackCommands(),
+	playbackSpawns()
+{
+	// Nothing interesting to do here
+}
+
+EntityCommandBuffer::~EntityCommandBuffer()
+{
+	// Nothing interesting to do here
+}
+
+CommandTarget EntityCommandBuffer::Spawn(Mesh* mesh, Material* mat, const Transform& transform, CommandTarget parent)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	CommandTarget spawned;
+	spawned.spawnIndex = (u32)spawns.size();
+
+	spawns.push_back(SpawnData{ mesh, mat, transform });
+	commands.push_back(Command{ SPAWN, false, TagRegistry::INVALID_TAG, spawned, parent });
+
+	return spawned;
+}
+
+void EntityCommandBuffer::Destroy(CommandTarget entity)
+{
+	Record(Command{ DESTROY, false, TagRegistry::INVALID_TAG, entity, CommandTarget() });
+}
+
+void EntityCommandBuffer::SetParent(CommandTarget entity, CommandTarget parent, bool keepWorldTransform)
+{
+	Record(Command{ SET_PARENT, keepWorldTransform, TagRegistry::INVALID_TAG, entity, parent });
+}
+
+void EntityCommandBuffer::AddTag(CommandTarget entity, TagID tag)
+{
+	Record(Command{ ADD_TAG, false, tag, entity, CommandTarget() });
+}
+
+void EntityCommandBuffer::RemoveTag(CommandTarget entity, TagID tag)
+{
+	Record(Command{ REMOVE_TAG, false, tag, entity, CommandTarget() });
+}
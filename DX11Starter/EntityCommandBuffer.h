@@ -0,0 +1,94 @@
+#ifndef ENTITY_COMMAND_BUFFER_H_
+#define ENTITY_COMMAND_BUFFER_H_
+
+#include <mutex>
+#include <vector>
+
+#include "Types.h"
+#include "Transform.h"
+#include "EntityHandle.h"
+#include "Tags.h"
+
+class Mesh;
+class Material;
+
+// Entity a recorded command applies to - either an existing entity, or one spawned earlier in the same buffer
+// Targets referring to spawns only mean something until the buffer they came from is played back
+class CommandTarget
+{
+private:
+	EntityHandle handle;
+	u32 spawnIndex; // Index of the spawn command within the buffer (INVALID for existing entities)
+
+	friend class Scene;
+	friend class EntityCommandBuffer;
+
+public:
+	static const u32 INVALID = 0xFFFFFFFF;
+
+	inline CommandTarget() : handle(), spawnIndex(INVALID) { }
+	inline CommandTarget(EntityHandle entity) : handle(entity), spawnIndex(INVALID) { }
+
+	inline bool IsNull() const { return handle.IsNull() && spawnIndex == INVALID; }
+};
+
+// Records entity spawns, destroys, reparenting and tag changes, to be played back by a scene at its next sync point
+// Recording is thread-safe, so gameplay systems can issue structural changes from worker threads while iterating
+class EntityCommandBuffer
+{
+private:
+	enum CommandType : u08
+	{
+		SPAWN,
+		DESTROY,
+		SET_PARENT,
+		ADD_TAG,
+		REMOVE_TAG
+	};
+
+	struct Command
+	{
+		CommandType type;
+		bool keepWorldTransform;
+		TagID tag;
+		CommandTarget target; // For SPAWN, the placeholder handed back to the recorder
+		CommandTarget other;  // New parent for SPAWN and SET_PARENT
+	};
+
+	struct SpawnData
+	{
+		Mesh* mesh;
+		Material* material;
+		Transform transform;
+	};
+
+	std::mutex mutex;
+
+	// Double buffered, so recording can carry on (and storage is reused) while the scene plays the other half back
+	std::vector<Command> commands;
+	std::vector<SpawnData> spawns;
+	std::vector<Command> playbackCommands;
+	std::vector<SpawnData> playbackSpawns;
+
+	inline void Record(const Command& command) { std::lock_guard<std::mutex> lock(mutex); commands.push_back(command); }
+
+	// Hands everything recorded so far over to the playback side
+	void BeginPlayback();
+	void EndPlayback();
+
+	friend class Scene;
+
+public:
+	EntityCommandBuffer();
+	~EntityCommandBuffer();
+
+	CommandTarget Spawn(Mesh* mesh, Material* mat, const Transform& transform = Transform(), CommandTarget parent = CommandTarget());
+	void Destroy(CommandTarget entity);
+	void SetParent(CommandTarget entity, CommandTarget parent, bool keepWorldTransform);
+	void AddTag(CommandTarget entity, TagID tag);
+	void RemoveTag(CommandTarget entity, TagID tag);
+
+	inline bool IsEmpty() { std::lock_guard<std::mutex> lock(mutex); return commands.size() == 0; }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef ENTITY_HANDLE_H_
+#define ENTITY_HANDLE_H_
+
+#include "Types.h"
+
+// Generational reference to an entity within a scene
+// Unlike a raw Entity*, a handle can be held across spawns and destroys - once the entity it refers to is
+// destroyed, the generation stored in the scene moves on and the handle simply stops resolving
+class EntityHandle
+{
+private:
+	u32 index;      // Position in the owning scene's entity storage
+	u32 generation; // Generation of that position at the time the handle was created
+
+	friend class Scene;
+
+public:
+	static const u32 INVALID_INDEX = U32_MAX;
+
+	inline EntityHandle() :
+		index(INVALID_INDEX),
+		generation(0)
+	{
+		// Nothing interesting to do here
+	}
+
+	inline EntityHandle(u32 ind, u32 gen) :
+		index(ind),
+		generation(gen)
+	{
+		// Nothing interesting to do here
+	}
+
+	inline u32 GetIndex() const      { return index; }
+	inline u32 GetGeneration() const { return generation; }
+
+	// Both halves packed into a single value, useful as a key
+	inline u64 GetID() const { return ((u64)generation << 32) | (u64)index; }
+
+	inline bool IsNull() const { return index == INVALID_INDEX; }
+
+	inline bool operator== (const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+	inline bool operator!= (const EntityHandle& other) const { return !(*this == other); }
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "FramePipeline.h"
+#include "Profiler.h"
+
+const u32 FramePipeline::PIPELINE_DEPTH;
+
+FramePipeline::FramePipeline(const SimulateFunction& simulateFunction, FrameSnapshot* first, FrameSnapshot* second) :
+	simulate(simulateFunction),
+	completedFrames(0),
+	requestedFrames(0),
+	acquiredFrames(0),
+	lastLatency(0.0)
+{
+	snapshots[0] = first;
+	snapshots[1] = second;
+	for (u32 i = 0; i < PIPELINE_DEPTH; ++i) { released.Push(snapshots[i]); }
+
+	thread = std::thread(&FramePipeline::SimulationMain, this);
+}
+
+FramePipeline::~FramePipeline()
+{
+	FrameRequest request = {};
+	request.quit = true;
+	while (!requests.Push(request)) { std::this_thread::yield(); }
+	thread.join();
+
+	for (u32 i = 0; i < PIPELINE_DEPTH; ++i) { delete snapshots[i]; }
+}
+
+void FramePipeline::SimulationMain()
+{
+	PROFILE_THREAD("Simulation");
+
+	for (;;)
+	{
+		FrameRequest request;
+		while (!requests.Pop(request)) { std::this_thread::yield(); }
+		if (request.quit) { return; }
+
+		// Only ever waits when rendering fell behind ; the main thread releases a snapshot before its next request
+		FrameSnapshot* frame = nullptr;
+		while (!released.Pop(frame)) { std::this_thread::yield(); }
+
+		frame->frameIndex = request.frameIndex;
+		frame->deltaTime = request.deltaTime;
+		frame->totalTime = request.totalTime;
+		frame->requested = request.requested;
+		simulate(frame);
+
+		simulated.Push(frame);
+		completedFrames.store(request.frameIndex + 1, std::memory_order_release);
+	}
+}
+
+void FramePipeline::RequestFrame(float deltaTime, float totalTime)
+{
+	FrameRequest request;
+	request.frameIndex = requestedFrames++;
+	request.deltaTime = deltaTime;
+	request.totalTime = totalTime;
+	request.requested = std::chrono::steady_clock::now();
+	request.quit = false;
+
+	// Can't be full, there are never more than PIPELINE_DEPTH frames in flight
+	requests.Push(request);
+}
+
+FrameSnapshot* FramePipeline::AcquireFrame()
+{
+	// Until the second request, there is nothing to render alongside the simulation
+	if (requestedFrames - acquiredFrames < PIPELINE_DEPTH) { return nullptr; }
+
+	PROFILE_ZONE("Wait for simulation");
+
+	FrameSnapshot* frame = nullptr;
+	while (!simulated.Pop(frame)) { std::this_thread::yield(); }
+	acquiredFrames++;
+	return frame;
+}
+
+void FramePipeline::ReleaseFrame(FrameSnapshot* frame)
+{
+	lastLatency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame->requested).count();
+	released.Push(frame);
+}
+
+void FramePipeline::WaitForSimulation()
+{
+	PROFILE_ZONE("Wait for simulation");
+
+	while (completedFrames.load(std::memory_order_acquire) != requestedFrames) { std::this_thread::yield(); }
+}
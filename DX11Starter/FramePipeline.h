@@ -0,0 +1,92 @@
+#ifndef FRAME_PIPELINE_H_
+#define FRAME_PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include "Types.h"
+#include "SPSCQueue.h"
+
+// What the simulation side of a frame hands over to the render side ; games derive their own with the actual
+// draws, camera and so on. Rendering must only read the snapshot, never the live simulation state.
+struct FrameSnapshot
+{
+	u64 frameIndex;
+	float deltaTime;
+	float totalTime;
+	// When the main thread asked for this frame ; latency runs from here until the frame is released
+	std::chrono::steady_clock::time_point requested;
+
+	virtual ~FrameSnapshot() { }
+};
+
+// Runs the simulation half of each frame on a thread of its own, one frame ahead of rendering
+//
+// While the main thread renders frame N from its snapshot, the simulation thread works on frame N+1 and fills
+// the other snapshot. A frame then costs the longer of the two halves rather than their sum, for one extra
+// frame of latency. The threads only share snapshots and requests, passed back and forth through lock-free
+// queues ; waiting spins and yields rather than sleeping, since the other side is never more than a frame away.
+class FramePipeline
+{
+public:
+	// Snapshots in flight : one being rendered, one being simulated
+	static const u32 PIPELINE_DEPTH = 2;
+
+	// Runs on the simulation thread, filling the snapshot for one frame
+	typedef std::function<void(FrameSnapshot* frame)> SimulateFunction;
+
+private:
+	struct FrameRequest
+	{
+		u64 frameIndex;
+		float deltaTime;
+		float totalTime;
+		std::chrono::steady_clock::time_point requested;
+		bool quit;
+	};
+
+	SimulateFunction simulate;
+	FrameSnapshot* snapshots[PIPELINE_DEPTH];
+
+	SPSCQueue<FrameRequest, 4> requests;    // Main thread to simulation thread
+	SPSCQueue<FrameSnapshot*, 4> simulated; // Simulation thread to main thread, in frame order
+	SPSCQueue<FrameSnapshot*, 4> released;  // Main thread to simulation thread, free to be filled again
+
+	std::atomic<u64> completedFrames;
+	std::thread thread;
+
+	// Main thread only
+	u64 requestedFrames;
+	u64 acquiredFrames;
+	double lastLatency;
+
+	void SimulationMain();
+
+public:
+	// Takes ownership of the snapshots and starts the simulation thread
+	FramePipeline(const SimulateFunction& simulateFunction, FrameSnapshot* first, FrameSnapshot* second);
+	// Lets the frame being simulated finish, then stops the thread
+	~FramePipeline();
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator= (const FramePipeline&) = delete;
+
+	// Everything below is main thread only
+
+	// Queues the simulation of the next frame
+	void RequestFrame(float deltaTime, float totalTime);
+	// Oldest simulated frame, waiting for it if needed ; null while the pipeline is still filling up
+	FrameSnapshot* AcquireFrame();
+	// Done rendering an acquired frame, which goes back to the simulation thread
+	void ReleaseFrame(FrameSnapshot* frame);
+
+	// Waits until every requested frame has been simulated, e.g. before touching state the simulation reads
+	void WaitForSimulation();
+
+	// Milliseconds from RequestFrame to ReleaseFrame for the last frame released
+	inline double GetLastLatency() const { return lastLatency; }
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "FrustumCulling.h"
+#include "TransformKernels.h"
+
+#include <xmmintrin.h>
+
+namespace
+{
+	struct Dispatch
+	{
+		CullBoxesFunction fn;
+		const char* name;
+	};
+
+	// Picked once, on first use from whichever thread gets there first
+	const Dispatch& GetDispatch()
+	{
+		static const Dispatch dispatch = CPUSupportsAVX2() ? Dispatch{ &CullBoxesAVX, "AVX" } : Dispatch{ &CullBoxesSSE, "SSE" };
+		return dispatch;
+	}
+}
+
+Frustum Frustum::FromViewProjection(const glm::mat4& view, const glm::mat4& projection)
+{
+	// clip = P * V * p, and each clip component is one row of P * V dotted with p
+	glm::mat4 vp = projection * view;
+
+	glm::vec4 row[4];
+	for (u32 r = 0; r < 4; ++r) { row[r] = glm::vec4(vp[0][r], vp[1][r], vp[2][r], vp[3][r]); }
+
+	// -w <= x <= w, -w <= y <= w and 0 <= z <= w, one plane per inequality
+	Frustum frustum;
+	frustum.planes[0] = row[3] + row[0];
+	frustum.planes[1] = row[3] - row[0];
+	frustum.planes[2] = row[3] + row[1];
+	frustum.planes[3] = row[3] - row[1];
+	frustum.planes[4] = row[2];
+	frustum.planes[5] = row[3] - row[2];
+
+	// Normalized, so distances are in world units
+	for (u32 p = 0; p < 6; ++p) { frustum.planes[p] /= glm::length(glm::vec3(frustum.planes[p])); }
+
+	return frustum;
+}
+
+u64 CullBoxesScalar(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible)
+{
+	u64 visibleCount = 0;
+	for (u64 i = 0; i < count; ++i)
+	{
+		if (IsBoxVisible(boxes, i, frustum)) { visible[visibleCount++] = (u32)i; }
+	}
+	return visibleCount;
+}
+
+u64 CullBoxesSSE(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	// Planes splatted once ; absolute normals give how far a box reaches towards each plane
+	__m128 n[6][4];
+	__m128 absN[6][3];
+	for (u32 p = 0; p < 6; ++p)
+	{
+		for (u32 c = 0; c < 4; ++c) { n[p][c] = _mm_set1_ps(frustum.planes[p][c]); }
+		for (u32 c = 0; c < 3; ++c) { absN[p][c] = _mm_andnot_ps(signMask, n[p][c]); }
+	}
+
+	u64 visibleCount = 0;
+	u64 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(boxes.centerX + i);
+		__m128 cy = _mm_loadu_ps(boxes.centerY + i);
+		__m128 cz = _mm_loadu_ps(boxes.centerZ + i);
+		__m128 ex = _mm_loadu_ps(boxes.extentX + i);
+		__m128 ey = _mm_loadu_ps(boxes.extentY + i);
+		__m128 ez = _mm_loadu_ps(boxes.extentZ + i);
+
+		__m128 outside = zero;
+		for (u32 p = 0; p < 6; ++p)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[p][0], cx), _mm_mul_ps(n[p][1], cy)), _mm_add_ps(_mm_mul_ps(n[p][2], cz), n[p][3]));
+			__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absN[p][0], ex), _mm_mul_ps(absN[p][1], ey)), _mm_mul_ps(absN[p][2], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+		}
+
+		// Branchless compaction : every index gets written, only visible ones advance the count
+		u32 mask = ~(u32)_mm_movemask_ps(outside);
+		for (u32 b = 0; b < 4; ++b)
+		{
+			visible[visibleCount] = (u32)(i + b);
+			visibleCount += (mask >> b) & 1;
+		}
+	}
+
+	for (; i < count; ++i)
+	{
+		if (IsBoxVisible(boxes, i, frustum)) { visible[visibleCount++] = (u32)i; }
+	}
+
+	return visibleCount;
+}
+
+u64 CullBoxes(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible)
+{
+	return GetDispatch().fn(count, boxes, frustum, visible);
+}
+
+const char* GetCullBoxesPathName()
+{
+	return GetDispatch().name;
+}
+
+void FrustumCuller::Clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+u32 FrustumCuller::Add(const MeshBounds& bounds, const affine& world)
+{
+	glm::vec3 center;
+	glm::vec3 extents;
+	TransformBounds(bounds, world, center, extents);
+
+	centerX.push_back(center.x);
+	centerY.push_back(center.y);
+	centerZ.push_back(center.z);
+	extentX.push_back(extents.x);
+	extentY.push_back(extents.y);
+	extentZ.push_back(extents.z);
+	return (u32)(centerX.size() - 1);
+}
+
+const std::vector<u32>& FrustumCuller::Cull(const Frustum& frustum)
+{
+	BoxArrays boxes = { centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data() };
+
+	visible.resize(centerX.size());
+	visible.resize((size_t)CullBoxes(centerX.size(), boxes, frustum, visible.data()));
+	return visible;
+}
@@ -0,0 +1,83 @@
+#ifndef FRUSTUM_CULLING_H_
+#define FRUSTUM_CULLING_H_
+
+#include <vector>
+
+#include "Types.h"
+#include "Bounds.h"
+
+// Planes bounding what a camera sees : left, right, bottom, top, near, far
+// Each is a normal pointing into the frustum (xyz) and a distance (w), so a point p is inside when dot(n, p) + w >= 0
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	// From column vector view and projection matrices, with Direct3D's 0 to 1 clip depth
+	static Frustum FromViewProjection(const glm::mat4& view, const glm::mat4& projection);
+};
+
+// World space boxes as one array per component, so a register can hold the same component of several boxes
+struct BoxArrays
+{
+	const float* centerX;
+	const float* centerY;
+	const float* centerZ;
+	const float* extentX;
+	const float* extentY;
+	const float* extentZ;
+};
+
+// Box i is outside once it lies entirely behind any one plane
+inline bool IsBoxVisible(const BoxArrays& boxes, u64 i, const Frustum& frustum)
+{
+	for (u32 p = 0; p < 6; ++p)
+	{
+		const glm::vec4& n = frustum.planes[p];
+		float distance = n.x * boxes.centerX[i] + n.y * boxes.centerY[i] + n.z * boxes.centerZ[i] + n.w;
+		float reach = glm::abs(n.x) * boxes.extentX[i] + glm::abs(n.y) * boxes.extentY[i] + glm::abs(n.z) * boxes.extentZ[i];
+		if (distance + reach < 0.0f) { return false; }
+	}
+	return true;
+}
+
+// Batch kernels writing the indices of the boxes at least partly inside a frustum to visible, in increasing
+// order, and returning how many there are ; visible must have room for count indices
+
+typedef u64 (*CullBoxesFunction)(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible);
+
+// One box at a time, the reference the vector paths are validated against
+u64 CullBoxesScalar(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible);
+// 4 boxes at a time
+u64 CullBoxesSSE(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible);
+// 8 boxes at a time, only callable when the CPU supports AVX (picked along with the AVX2 transform kernels)
+u64 CullBoxesAVX(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible);
+
+// Fastest path the running CPU supports, picked on first use
+u64 CullBoxes(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible);
+const char* GetCullBoxesPathName();
+
+// Gathers the world space boxes of a frame's draw candidates, then culls them all in one batch
+class FrustumCuller
+{
+private:
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+	std::vector<u32> visible;
+
+public:
+	void Clear();
+	// Adds the box around a mesh's bounds placed by world, returning its index
+	u32 Add(const MeshBounds& bounds, const affine& world);
+
+	// Indices of the boxes added since Clear that touch the frustum, in the order they were added
+	// Stays valid until the next call to any of these methods
+	const std::vector<u32>& Cull(const Frustum& frustum);
+
+	inline u64 GetCount() const { return centerX.size(); }
+};
+
+#endif
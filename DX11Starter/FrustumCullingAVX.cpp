@@ -0,0 +1,64 @@
+// Built with AVX code generation enabled (see the project file), so only call into here once CullBoxes picked it
+//
+// Nothing inline from outside this file may be called here, glm included : in builds that don't inline, the
+// linker keeps one copy of each such function for the whole program, and may pick the one compiled with AVX
+// for the scalar and SSE paths too. Only data members of the shared types are touched.
+#include "FrustumCulling.h"
+
+#include <immintrin.h>
+
+u64 CullBoxesAVX(u64 count, const BoxArrays& boxes, const Frustum& frustum, u32* visible)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	// Planes splatted once ; absolute normals give how far a box reaches towards each plane
+	__m256 n[6][4];
+	__m256 absN[6][3];
+	for (u32 p = 0; p < 6; ++p)
+	{
+		const float* plane = &frustum.planes[p].x;
+		for (u32 c = 0; c < 4; ++c) { n[p][c] = _mm256_set1_ps(plane[c]); }
+		for (u32 c = 0; c < 3; ++c) { absN[p][c] = _mm256_andnot_ps(signMask, n[p][c]); }
+	}
+
+	u64 visibleCount = 0;
+	u64 i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(boxes.centerX + i);
+		__m256 cy = _mm256_loadu_ps(boxes.centerY + i);
+		__m256 cz = _mm256_loadu_ps(boxes.centerZ + i);
+		__m256 ex = _mm256_loadu_ps(boxes.extentX + i);
+		__m256 ey = _mm256_loadu_ps(boxes.extentY + i);
+		__m256 ez = _mm256_loadu_ps(boxes.extentZ + i);
+
+		__m256 outside = zero;
+		for (u32 p = 0; p < 6; ++p)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(n[p][0], cx), _mm256_mul_ps(n[p][1], cy)), _mm256_add_ps(_mm256_mul_ps(n[p][2], cz), n[p][3]));
+			__m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absN[p][0], ex), _mm256_mul_ps(absN[p][1], ey)), _mm256_mul_ps(absN[p][2], ez));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+		}
+
+		// Whole group off screen, the common case on a large map
+		u32 mask = ~(u32)_mm256_movemask_ps(outside) & 0xFF;
+		if (mask == 0) { continue; }
+
+		// Branchless compaction : every index gets written, only visible ones advance the count
+		for (u32 b = 0; b < 8; ++b)
+		{
+			visible[visibleCount] = (u32)(i + b);
+			visibleCount += (mask >> b) & 1;
+		}
+	}
+
+	// The last few boxes go through the scalar kernel, compiled without AVX, then get their indices back
+	BoxArrays tail = {
+		boxes.centerX + i, boxes.centerY + i, boxes.centerZ + i,
+		boxes.extentX + i, boxes.extentY + i, boxes.extentZ + i };
+	u64 tailCount = CullBoxesScalar(count - i, tail, frustum, visible + visibleCount);
+	for (u64 t = 0; t < tailCount; ++t) { visible[visibleCount + t] += (u32)i; }
+
+	return visibleCount + tailCount;
+}
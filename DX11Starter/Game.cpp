@@ -3,6 +3,36 @@
 // For the DirectX Math library
 using namespace DirectX;
 
+namespace
+{
+	// Camera hands out its matrices transposed for HLSL, so element [r][c] of each is column c, row r of its glm counterpart
+	glm::mat4 FromShaderMatrix(const XMFLOAT4X4& m)
+	{
+		glm::mat4 result;
+		for (int r = 0; r < 4; r++) {
+			for (int c = 0; c < 4; c++) {
+				result[c][r] = m.m[r][c];
+			}
+		}
+		return result;
+	}
+
+	XMFLOAT4X4 ToShaderMatrix(const glm::mat4& m)
+	{
+		XMFLOAT4X4 result;
+		for (int r = 0; r < 4; r++) {
+			for (int c = 0; c < 4; c++) {
+				result.m[r][c] = m[c][r];
+			}
+		}
+		return result;
+	}
+}
+
+const u32 Game::TOWER_COUNT;
+const u32 Game::MAX_OCCLUDERS;
+const u32 Game::OCCLUDER_TRIANGLES;
+
 Game::Game(HINSTANCE hInstance)
 	: DXCore(
 		hInstance,		// The application's handle
@@ -13,12 +43,34 @@ Game::Game(HINSTANCE hInstance)
 {
 	// Initialize fields
 	vertexShader = 0;
+	instancedVS = 0;
 	pixelShader = 0;
 	skyPS = 0;
 	skyVS = 0;
 	shadowVS = 0;
 	t = 0;
 
+	mouseDeltaX = 0;
+	mouseDeltaY = 0;
+	pendingPick = U32_MAX;
+
+	for (u32 i = 0; i < ShadowCascades::MAX_CASCADES; i++) {
+		shadowDSVs[i] = 0;
+		renderedCascadeSignatures[i] = 0;
+	}
+
+	// Gameplay ticks at a fixed rate ; rendering interpolates between ticks
+	SetSimulationRate(60.0f);
+
+	// Serial unless asked for with -pipelined ; overlapping simulation and draw submission only pays off with a
+	// core to spare, and adds a frame of latency either way
+	if (strstr(GetCommandLineA(), "-pipelined") != nullptr && std::thread::hardware_concurrency() > 1) {
+		SetPipelined(true);
+	}
+
+	// Cascaded shadow maps, which the L key turns on and off while running
+	renderShadows = strstr(GetCommandLineA(), "-shadows") != nullptr;
+
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
 	CreateConsoleWindow(500, 120, 32, 120);
@@ -32,6 +84,7 @@ Game::~Game()
 	// Delete our simple shader objects, which
 	// will clean up their own internal DirectX stuff
 	delete vertexShader;
+	delete instancedVS;
 	delete pixelShader;
 	delete skyVS;
 	delete skyPS;
@@ -43,6 +96,9 @@ Game::~Game()
 	for (int i = 0; i < meshes.size(); i++) {
 		delete meshes[i];
 	}
+	for (int i = 0; i < occluderMeshes.size(); i++) {
+		delete occluderMeshes[i];
+	}
 
 	// Deleting textures
 	for (int i = 0; i < textures.size(); i++) {
@@ -61,6 +117,13 @@ Game::~Game()
 
 	delete scene;
 
+	// The queue hands its buffers back to the device, and so do the light buffers
+	delete renderQueue;
+	ReleaseShaderBuffer(pointLightBuffer);
+	ReleaseShaderBuffer(lightClusterBuffer);
+	ReleaseShaderBuffer(lightIndexBuffer);
+	delete renderDevice;
+
 	// Deleting cam
 	delete cam;
 
@@ -74,7 +137,8 @@ Game::~Game()
 	delete wayPtsAI;
 
 	//Deleting Shadows
-	shadowDSV->Release();
+	for (u32 i = 0; i < ShadowCascades::MAX_CASCADES; i++)
+		shadowDSVs[i]->Release();
 	shadowSRV->Release();
 	shadowSamplerState->Release();
 	shadowRasterizer->Release();
@@ -87,13 +151,24 @@ Game::~Game()
 void Game::Init()
 {
 	LoadShaders();
+
+	renderDevice = new D3D11RenderDevice(device, context);
+	renderQueue = new RenderQueue(renderDevice);
+	stateCache = renderDevice->GetStateCache();
+
+	// Materials drawn with the regular vertex shader get instanced, unless instancedVS lacks per instance inputs
+	renderQueue->SetInstancedShader(vertexShader, instancedVS);
+
 	InitVectors();
 	GenerateMaterials();
 	InitStates();
 	CreateBasicGeometry();
 	GenerateLights();
 
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	// The first frame can come before the first simulation tick, which is what normally calculates world matrices
+	scene->UpdateTransforms();
+
+	stateCache->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 }
 
 // --------------------------------------------------------
@@ -104,9 +179,14 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadShaders()
 {
+	PROFILE_FUNCTION();
+
 	vertexShader = new SimpleVertexShader(device, context);
 	vertexShader->LoadShaderFile(L"VertexShader.cso");
 
+	instancedVS = new SimpleVertexShader(device, context);
+	instancedVS->LoadShaderFile(L"InstancedVS.cso");
+
 	pixelShader = new SimplePixelShader(device, context);
 	pixelShader->LoadShaderFile(L"PixelShader.cso");
 
@@ -196,13 +276,53 @@ void Game::CreateBasicGeometry()
 
 	meshes.reserve(10000);
 
-	meshes.push_back(new Mesh("Assets/Models/cube.obj", device));
-	meshes.push_back(new Mesh("Assets/Models/sphere.obj", device));
-	meshes.push_back(new Mesh("Assets/Models/Battleship_TB.obj", device));
-	meshes.push_back(new Mesh("Assets/Models/LightningTower.obj", device));
-	meshes.push_back(new Mesh("Assets/Models/AirTower.obj", device));
-	meshes.push_back(new Mesh("Assets/Models/WaterTower.obj", device));
-	meshes.push_back(new Mesh("Assets/Models/FireTower.obj", device));
+	const char* meshFiles[] =
+	{
+		"Assets/Models/cube.obj",
+		"Assets/Models/sphere.obj",
+		"Assets/Models/Battleship_TB.obj",
+		"Assets/Models/LightningTower.obj",
+		"Assets/Models/AirTower.obj",
+		"Assets/Models/WaterTower.obj",
+		"Assets/Models/FireTower.obj"
+	};
+	const u32 meshCount = sizeof(meshFiles) / sizeof(meshFiles[0]);
+
+	// Files are decoded in parallel ; each mesh's buffers are created on this thread as soon as it is decoded
+	WorkerPool* jobs = WorkerPool::Shared();
+	std::vector<Vertex> meshVerts[meshCount];
+	std::vector<unsigned int> meshIndices[meshCount];
+	JobCounter decoded[meshCount];
+	JobCounter created;
+
+	size_t firstMesh = meshes.size();
+	meshes.resize(firstMesh + meshCount, nullptr);
+	for (u32 i = 0; i < meshCount; ++i)
+	{
+		jobs->Run([&, i]() { Mesh::LoadOBJ(meshFiles[i], meshVerts[i], meshIndices[i]); }, &decoded[i]);
+		jobs->RunOnMainThread([&, i]()
+		{
+			if (meshIndices[i].empty())
+			{
+				// Failed to load : the file constructor gives the same empty mesh it always did
+				meshes[firstMesh + i] = new Mesh(const_cast<char*>(meshFiles[i]), renderDevice);
+				return;
+			}
+			meshes[firstMesh + i] = new Mesh(meshVerts[i].data(), (int)meshVerts[i].size(), meshIndices[i].data(), (int)meshIndices[i].size(), renderDevice);
+		}, &created, &decoded[i]);
+	}
+	jobs->Wait(&created);
+
+	// The battleship and towers hide a lot of the field ; their biggest triangles stand in for them in the occlusion buffer
+	for (u32 i = 2; i < meshCount; ++i)
+	{
+		if (meshIndices[i].empty()) { continue; }
+
+		OccluderMesh* occluder = new OccluderMesh(OccluderMesh::FromTriangles(meshVerts[i].data(), meshVerts[i].size(),
+			meshIndices[i].data(), meshIndices[i].size(), OCCLUDER_TRIANGLES));
+		occluderMeshes.push_back(occluder);
+		meshes[firstMesh + i]->SetOccluder(occluder);
+	}
 
 	skyBox         = scene->SpawnEntity(meshes[0], skyBoxMaterial);
 	battleship     = scene->SpawnEntity(meshes[2], battleship_Material);
@@ -211,6 +331,14 @@ void Game::CreateBasicGeometry()
 	waterTower     = scene->SpawnEntity(meshes[5], waterTower_Material);
 	fireTower      = scene->SpawnEntity(meshes[6], fireTower_Material);
 
+	skyTag = TagRegistry::Intern("Sky");
+	towerTag = TagRegistry::Intern("Tower");
+	skyBox->AddTag(skyTag);
+	lightningTower->AddTag(towerTag);
+	airTower->AddTag(towerTag);
+	waterTower->AddTag(towerTag);
+	fireTower->AddTag(towerTag);
+
 	// lightningTower->SetParent(battleship, false);
 
 	entities.push_back(skyBox);
@@ -236,39 +364,58 @@ void Game::CreateBasicGeometry()
 void Game::GenerateLights()
 {
 	/// Setting variables for both Directional lights
-	dLight.AmbientColor = XMFLOAT4(0.1f, 0.1f, 0.1f, 1.0f);
-	dLight.DiffuseColor = XMFLOAT4(0.4f, 0.4f, 0.4f, 0.1f);
-	dLight.Direction = XMFLOAT3(0, -1, 0);
+	dLight.AmbientColor = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
+	dLight.DiffuseColor = glm::vec4(0.4f, 0.4f, 0.4f, 0.1f);
+	dLight.Direction = glm::vec3(0, -1, 0);
 	dLight.Shine = 25.0f;
 
-	dLight2.AmbientColor = XMFLOAT4(0.1f, 0.1f, 0.05f, 1.0f);
-	dLight2.DiffuseColor = XMFLOAT4(0.4f, 0.4f, 0.4f, 0.1f);
-	dLight2.Direction = XMFLOAT3(0, 1, 0);
+	dLight2.AmbientColor = glm::vec4(0.1f, 0.1f, 0.05f, 1.0f);
+	dLight2.DiffuseColor = glm::vec4(0.4f, 0.4f, 0.4f, 0.1f);
+	dLight2.Direction = glm::vec3(0, 1, 0);
 	dLight2.Shine = 52.0f;
 	///
 
-	/// Setting variables for both Point Light
-	pLight.AmbientColor = XMFLOAT4(0.1f, 0.1f, 0.1f, 1.0f);
-	pLight.DiffuseColor = XMFLOAT4(0.4f, 0.4f, 0.4f, 0.4f);
-	pLight.Position = XMFLOAT3(0, 0, -1);
+	/// Setting variables for both static Point Lights
+	pointLights.resize(STATIC_POINT_LIGHTS + TOWER_COUNT * TOWER_LIGHTS);
+
+	PointLight& pLight = pointLights[0];
+	pLight.AmbientColor = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
+	pLight.DiffuseColor = glm::vec4(0.4f, 0.4f, 0.4f, 0.4f);
+	pLight.Position = glm::vec3(0, 0, -1);
 	pLight.Shine = 100.0f;
 	pLight.Range = 20.0f;
 
-	pLight2.AmbientColor = XMFLOAT4(0.1f, 0.1f, 0.1f, 1.0f);
-	pLight2.DiffuseColor = XMFLOAT4(0.4f, 0.4f, 0.4f, 0.1f);
-	pLight2.Position = XMFLOAT3(0, 0, 1);
+	PointLight& pLight2 = pointLights[1];
+	pLight2.AmbientColor = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
+	pLight2.DiffuseColor = glm::vec4(0.4f, 0.4f, 0.4f, 0.1f);
+	pLight2.Position = glm::vec3(0, 0, 1);
 	pLight2.Shine = 100.0f;
 	pLight2.Range = 20.0f;
 	///
 
-	/// Sending all of the light data to the shaders for both lights
+	/// Tower lights, tinted by element ; UpdateTowerLights moves them every tick
+	const glm::vec4 towerColors[TOWER_COUNT] = {
+		glm::vec4(0.6f, 0.7f, 1.0f, 1.0f),  // Lightning
+		glm::vec4(0.8f, 0.9f, 0.8f, 1.0f),  // Air
+		glm::vec4(0.2f, 0.5f, 1.0f, 1.0f),  // Water
+		glm::vec4(1.0f, 0.45f, 0.1f, 1.0f)  // Fire
+	};
+	for (u32 t = 0; t < TOWER_COUNT; t++) {
+		for (u32 k = 0; k < TOWER_LIGHTS; k++) {
+			PointLight& light = pointLights[STATIC_POINT_LIGHTS + t * TOWER_LIGHTS + k];
+			light.AmbientColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			light.DiffuseColor = towerColors[t];
+			light.Position = glm::vec3(0, 0, 0);
+			light.Shine = 50.0f;
+			light.Range = 4.0f + (k % 3);
+		}
+	}
+	///
+
+	/// Sending the directional light data to the shaders ; point lights go through the light clusters every frame
 	pixelShader->SetData("DLight", &dLight, sizeof(DirectionalLight));
 
 	pixelShader->SetData("DLight2", &dLight2, sizeof(DirectionalLight));
-
-	pixelShader->SetData("PLight", &pLight, sizeof(PointLight));
-
-	pixelShader->SetData("PLight2", &pLight2, sizeof(PointLight));
 	///
 
 	pixelShader->CopyAllBufferData();
@@ -299,7 +446,7 @@ void Game::GenerateMaterials()
 {
 	// Skybox Texture
 	skyBoxTexture->CreateCubeMap(device, context, L"Assets/Textures/SunnyCubeMap.dds", &skyResourceView, &skyRasterState, &skyDepthState);
-	skyBoxMaterial->CreateMaterial(skyVS, skyPS, skyBoxTexture->GetShaderResourceView(), skyBoxTexture->GetSamplerState());
+	skyBoxMaterial->CreateMaterial(skyVS, skyPS, D3D11RenderDevice::FromD3D(skyBoxTexture->GetShaderResourceView()), D3D11RenderDevice::FromD3D(skyBoxTexture->GetSamplerState()));
 
 	/// Textures
 	battleship_Texture ->CreateTexure(device, context, L"Assets/Textures/BattleShip_Texture.png", &battleshipSR);
@@ -318,11 +465,11 @@ void Game::GenerateMaterials()
 	///
 
 	// passing pixel and vertex to materials
-	battleship_Material->CreateMaterial(vertexShader, pixelShader, battleship_Texture->GetShaderResourceView(), battleship_Texture->GetSamplerState());
-	lightningTower_Material->CreateMaterial(vertexShader, pixelShader, lightningTower_Texture->GetShaderResourceView(), lightningTower_Texture->GetSamplerState());
-	airTower_Material->CreateMaterial(vertexShader, pixelShader, airTower_Texture->GetShaderResourceView(), airTower_Texture->GetSamplerState());
-	waterTower_Material->CreateMaterial(vertexShader, pixelShader, waterTower_Texture->GetShaderResourceView(), waterTower_Texture->GetSamplerState());
-	fireTower_Material->CreateMaterial(vertexShader, pixelShader, fireTower_Texture->GetShaderResourceView(), fireTower_Texture->GetSamplerState());
+	battleship_Material->CreateMaterial(vertexShader, pixelShader, D3D11RenderDevice::FromD3D(battleship_Texture->GetShaderResourceView()), D3D11RenderDevice::FromD3D(battleship_Texture->GetSamplerState()));
+	lightningTower_Material->CreateMaterial(vertexShader, pixelShader, D3D11RenderDevice::FromD3D(lightningTower_Texture->GetShaderResourceView()), D3D11RenderDevice::FromD3D(lightningTower_Texture->GetSamplerState()));
+	airTower_Material->CreateMaterial(vertexShader, pixelShader, D3D11RenderDevice::FromD3D(airTower_Texture->GetShaderResourceView()), D3D11RenderDevice::FromD3D(airTower_Texture->GetSamplerState()));
+	waterTower_Material->CreateMaterial(vertexShader, pixelShader, D3D11RenderDevice::FromD3D(waterTower_Texture->GetShaderResourceView()), D3D11RenderDevice::FromD3D(waterTower_Texture->GetSamplerState()));
+	fireTower_Material->CreateMaterial(vertexShader, pixelShader, D3D11RenderDevice::FromD3D(fireTower_Texture->GetShaderResourceView()), D3D11RenderDevice::FromD3D(fireTower_Texture->GetSamplerState()));
 }
 
 void Game::InitStates()
@@ -336,7 +483,7 @@ void Game::InitStates()
 	// Turn on the rasterizer state (note: this is usually done
 	// inside Draw() as necessary for each object, but we're doing
 	// it here cause it's a simple demo)
-	context->RSSetState(rasterState);
+	stateCache->SetRasterizerState(rasterState);
 	///
 
 	/// Depth State
@@ -367,15 +514,16 @@ void Game::InitStates()
 	device->CreateBlendState(&bd, &blendState);
 
 	// Set the state! (For last param, set all the bits!)
-	context->OMSetBlendState(blendState, 0, 0xFFFFFFFF);
+	stateCache->SetBlendState(blendState, 0, 0xFFFFFFFF);
 
-	//Shadowmap init
+	//Shadowmap init ; one slice of a texture array per cascade
 	nShadowMapSize = 2048;
+	shadowCascades = ShadowCascades(ShadowCascades::MAX_CASCADES, nShadowMapSize);
 
 	D3D11_TEXTURE2D_DESC shadowDesc = {};
 	shadowDesc.Width = nShadowMapSize;
 	shadowDesc.Height = nShadowMapSize;
-	shadowDesc.ArraySize = 1;
+	shadowDesc.ArraySize = ShadowCascades::MAX_CASCADES;
 	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	shadowDesc.CPUAccessFlags = 0;
 	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
@@ -387,19 +535,25 @@ void Game::InitStates()
 	ID3D11Texture2D* shadowTexture;
 	device->CreateTexture2D(&shadowDesc, 0, &shadowTexture);
 
-	// Create the depth/stencil
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	device->CreateDepthStencilView(shadowTexture, &shadowDSDesc, &shadowDSV);
+	// Create a depth/stencil for each cascade
+	for (u32 i = 0; i < ShadowCascades::MAX_CASCADES; i++) {
+		D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
+		shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		shadowDSDesc.Texture2DArray.MipSlice = 0;
+		shadowDSDesc.Texture2DArray.FirstArraySlice = i;
+		shadowDSDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(shadowTexture, &shadowDSDesc, &shadowDSVs[i]);
+	}
 
-	// Create the SRV for the shadow map
+	// Create the SRV for the shadow map, every cascade at once
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = ShadowCascades::MAX_CASCADES;
 	device->CreateShaderResourceView(shadowTexture, &srvDesc, &shadowSRV);
 
 	// Release the texture reference since we don't need it
@@ -422,7 +576,7 @@ void Game::InitStates()
 	D3D11_RASTERIZER_DESC shadowRastDesc = {};
 	shadowRastDesc.FillMode = D3D11_FILL_SOLID;
 	shadowRastDesc.CullMode = D3D11_CULL_BACK;
-	shadowRastDesc.DepthClipEnable = true;
+	shadowRastDesc.DepthClipEnable = false; // Casters in front of a cascade are flattened onto its near plane rather than lost
 	shadowRastDesc.DepthBias = 1000; // Multiplied by (smallest possible value > 0 in depth buffer)
 	shadowRastDesc.DepthBiasClamp = 0.0f;
 	shadowRastDesc.SlopeScaledDepthBias = 1.0f;
@@ -442,20 +596,18 @@ void Game::OnResize()
 	cam->UpdateProjectionMatrix((float)width / height);
 }
 
-void Game::Update(float deltaTime, float totalTime)
+// --------------------------------------------------------
+// Advance the simulation by exactly one step
+// --------------------------------------------------------
+void Game::FixedUpdate(float stepTime, float simulationTime)
 {
-	// Quit if the escape key is pressed
-	if (GetAsyncKeyState(VK_ESCAPE))
-		Quit();
-
-	// Camera
-	cam->Update(deltaTime);
+	// What the last tick ended on is what Draw interpolates from
+	scene->SavePreviousTransforms();
 
-	XMFLOAT3 camPosHolder;
-	XMStoreFloat3(&camPosHolder, cam->GetCameraPostion());
-	pixelShader->SetFloat3("cameraPos", camPosHolder);
+	// Apply component changes queued up since last tick before any system runs
+	scene->ApplyStructuralChanges();
 
-	float sinTime = (sin(totalTime * 10) + 2.0f) / 5.0f;
+	float sinTime = (sin(simulationTime * 10) + 2.0f) / 5.0f;
 
 	// SkyBox
 	entities[0]->SetPositionF(0, 0, 0);
@@ -493,9 +645,122 @@ void Game::Update(float deltaTime, float totalTime)
 	///
 
 	switch (wayPtsAI->lerpPeriods) {
-		//case 0: wayPtsAI->WaypointsLerp(entities[2]->GetWorldPosition(), entities[4]->GetWorldPosition()); break;
-		//case 1: wayPtsAI->WaypointsLerp(entities[4]->GetWorldPosition(), entities[3]->GetWorldPosition()); break;
+		//case 0: wayPtsAI->WaypointsLerp(entities[2]->GetWorldPosition(), entities[4]->GetWorldPosition(), stepTime); break;
+		//case 1: wayPtsAI->WaypointsLerp(entities[4]->GetWorldPosition(), entities[3]->GetWorldPosition(), stepTime); break;
+	}
+
+	// Bring every world matrix up to date in one pass at the end of the tick
+	scene->UpdateTransforms();
+
+	UpdateTowerTargets();
+	UpdateTowerLights(simulationTime);
+}
+
+// --------------------------------------------------------
+// Rings of small lights orbiting each tower, bobbing up
+// and down out of step with each other
+// --------------------------------------------------------
+void Game::UpdateTowerLights(float simulationTime)
+{
+	Entity* towers[TOWER_COUNT] = { lightningTower, airTower, waterTower, fireTower };
+	for (u32 t = 0; t < TOWER_COUNT; t++) {
+		glm::vec3 center = towers[t]->GetWorldPosition();
+		for (u32 k = 0; k < TOWER_LIGHTS; k++) {
+			float angle = simulationTime * (0.5f + 0.1f * (k % 5)) + k * (6.2831853f / TOWER_LIGHTS);
+			float orbit = 3.0f + (k % 4);
+			float bob = sin(simulationTime * 3.0f + k) * 1.5f;
+
+			PointLight& light = pointLights[STATIC_POINT_LIGHTS + t * TOWER_LIGHTS + k];
+			light.Position = glm::vec3(center.x + cos(angle) * orbit, center.y + 2.0f + bob, center.z + sin(angle) * orbit);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Finds the nearest entity in range of each tower ; the
+// spatial index narrows the scene down to a few candidates
+// --------------------------------------------------------
+void Game::UpdateTowerTargets()
+{
+	Entity* towers[TOWER_COUNT] = { lightningTower, airTower, waterTower, fireTower };
+	glm::vec3 centers[TOWER_COUNT];
+	float radii[TOWER_COUNT];
+	for (u32 t = 0; t < TOWER_COUNT; t++) {
+		centers[t] = towers[t]->GetWorldPosition();
+		radii[t] = towerRange;
+	}
+
+	scene->QuerySpheres(TOWER_COUNT, centers, radii, towerCandidates, towerOffsets);
+
+	// Candidates only overlap the range by their boxes, so the range itself is checked against their positions
+	for (u32 t = 0; t < TOWER_COUNT; t++) {
+		towerTargets[t] = EntityHandle();
+		float nearest = towerRange * towerRange;
+		for (u32 c = towerOffsets[t]; c < towerOffsets[t + 1]; c++) {
+			Entity* candidate = towerCandidates[c];
+			if (candidate->HasTag(towerTag) || candidate->HasTag(skyTag)) { continue; }
+
+			glm::vec3 offset = candidate->GetWorldPosition() - centers[t];
+			float distance = glm::dot(offset, offset);
+			if (distance <= nearest) {
+				nearest = distance;
+				towerTargets[t] = candidate->GetHandle();
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Per frame work that doesn't belong to the simulation (input, camera)
+// --------------------------------------------------------
+void Game::Update(float deltaTime, float totalTime)
+{
+	// Quit if the escape key is pressed
+	if (GetAsyncKeyState(VK_ESCAPE))
+		Quit();
+
+	// Camera, turned by however far the mouse was dragged since last frame
+	int mouseX = mouseDeltaX.exchange(0);
+	int mouseY = mouseDeltaY.exchange(0);
+	if (mouseX != 0 || mouseY != 0) {
+		cam->RotateCamera(mouseX / 160.0f, mouseY / 160.0f);
 	}
+	cam->Update(deltaTime);
+
+	if (GetAsyncKeyState('O') & 0x0001)
+		dumpOcclusionBuffer = true;
+
+	if (GetAsyncKeyState('L') & 0x0001)
+		renderShadows = !renderShadows;
+
+	// Clicks wait here rather than being handled by the window procedure, as the scene may belong to another thread
+	u32 pick = pendingPick.exchange(U32_MAX);
+	if (pick != U32_MAX) {
+		PickEntity((int)(pick >> 16), (int)(pick & 0xFFFF));
+	}
+}
+
+// --------------------------------------------------------
+// Casts a ray from the camera through a point of the window
+// into the scene's spatial index
+// --------------------------------------------------------
+void Game::PickEntity(int x, int y)
+{
+	glm::mat4 viewMatrix = FromShaderMatrix(cam->GetViewMatrix());
+	glm::mat4 projectionMatrix = FromShaderMatrix(cam->GetProjectionMatrix());
+	glm::mat4 inverseViewProjection = glm::inverse(projectionMatrix * viewMatrix);
+
+	// From the window to the near and far planes, then back out into the world
+	float ndcX = 2.0f * x / width - 1.0f;
+	float ndcY = 1.0f - 2.0f * y / height;
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 0.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+	// Distances are fractions of the way to the far plane
+	Entity* picked = scene->Raycast(origin, direction, 1.0f, nullptr, skyTag);
+	pickedEntity = (picked != nullptr) ? picked->GetHandle() : EntityHandle();
 }
 
 // --------------------------------------------------------
@@ -503,7 +768,207 @@ void Game::Update(float deltaTime, float totalTime)
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
-	//RenderShadowMap();
+	// Same split as pipelined frames, only back to back on this thread
+	ExtractFrame(&serialFrame);
+	RenderFrame(&serialFrame);
+}
+
+FrameSnapshot* Game::CreateFrameSnapshot()
+{
+	return new GameFrame();
+}
+
+// --------------------------------------------------------
+// Copy what rendering needs out of the scene ; may run on
+// the simulation thread
+// --------------------------------------------------------
+void Game::ExtractFrame(FrameSnapshot* frame)
+{
+	GameFrame* gameFrame = static_cast<GameFrame*>(frame);
+
+	// Entities are drawn where they are between the last two simulation ticks
+	scene->InterpolateTransforms(interpolationAlpha);
+
+	gameFrame->view = FromShaderMatrix(cam->GetViewMatrix());
+	gameFrame->projection = FromShaderMatrix(cam->GetProjectionMatrix());
+	XMStoreFloat3(&gameFrame->cameraPosition, cam->GetCameraPostion());
+	gameFrame->nearClip = cam->GetNearClip();
+	gameFrame->farClip = cam->GetFarClip();
+
+	// The spatial index finds what might be in each view, in one batch ; casters outside the camera's view can still
+	// shadow what's in it, so every shadow cascade is a view of its own
+	// Read once, as the flag can be toggled from the main thread while a pipelined frame is being extracted
+	bool shadows = renderShadows;
+	u32 viewCount = 1;
+	Frustum views[1 + ShadowCascades::MAX_CASCADES];
+	views[0] = Frustum::FromViewProjection(gameFrame->view, gameFrame->projection);
+	if (shadows) {
+		shadowCascades.Update(gameFrame->view, gameFrame->projection, gameFrame->nearClip, gameFrame->farClip,
+			vec3(dLight.Direction.x, dLight.Direction.y, dLight.Direction.z));
+		for (u32 i = 0; i < shadowCascades.GetCascadeCount(); i++) {
+			views[viewCount++] = shadowCascades.GetCascade(i).casterVolume;
+		}
+	}
+	scene->QueryFrustums(viewCount, views, viewCandidates, viewOffsets);
+
+	gameFrame->draws.clear();
+	CullDraws(views[0], viewOffsets[0], viewOffsets[1], gameFrame->draws);
+	if (occlusionCulling) {
+		CullOccludedDraws(*gameFrame);
+	}
+
+	gameFrame->shadowCascadeCount = 0;
+	if (shadows) {
+		ExtractShadowCascades(*gameFrame, views + 1, 1);
+	}
+
+	gameFrame->skyMesh = entities[0]->meshObject;
+
+	gameFrame->directionalLights[0] = dLight;
+	gameFrame->directionalLights[1] = dLight2;
+	gameFrame->pointLights = pointLights;
+
+	// Clusters only get rebuilt when the projection or window size changed ; lights are sorted into them every frame
+	lightClusters.Build(gameFrame->projection, width, height, gameFrame->nearClip, gameFrame->farClip);
+	lightClusters.Assign(gameFrame->view, pointLights.data(), (u32)pointLights.size(), WorkerPool::Shared());
+	gameFrame->lightClusterRanges = lightClusters.GetRanges();
+	gameFrame->lightIndices = lightClusters.GetLightIndices();
+	gameFrame->lightClusterTiles[0] = lightClusters.GetTilesX();
+	gameFrame->lightClusterTiles[1] = lightClusters.GetTilesY();
+	gameFrame->lightSliceScale = lightClusters.GetSliceScale();
+	gameFrame->lightSliceBias = lightClusters.GetSliceBias();
+}
+
+// --------------------------------------------------------
+// Each cascade only gets the casters over its own slice of
+// the view, so shadow cost follows what's in each one
+// --------------------------------------------------------
+void Game::ExtractShadowCascades(GameFrame& frame, const Frustum* casterVolumes, u32 begin)
+{
+	PROFILE_FUNCTION();
+
+	frame.shadowCascadeCount = shadowCascades.GetCascadeCount();
+	for (u32 i = 0; i < frame.shadowCascadeCount; i++) {
+		const ShadowCascades::Cascade& cascade = shadowCascades.GetCascade(i);
+		GameFrame::ShadowCascade& target = frame.shadowCascades[i];
+
+		target.view = ToShaderMatrix(cascade.view);
+		target.projection = ToShaderMatrix(cascade.projection);
+		target.viewProjection = ToShaderMatrix(cascade.viewProjection);
+		target.splitFar = cascade.splitFar;
+
+		target.casters.clear();
+		CullDraws(casterVolumes[i], viewOffsets[begin + i], viewOffsets[begin + i + 1], target.casters);
+
+		// FNV-1a over everything that ends up in the slice ; draws come out of the index in the same order as long as
+		// it doesn't change, so a still camera over still casters hashes the same every frame
+		u64 signature = 14695981039346656037ULL;
+		auto hash = [&signature](const void* data, size_t size) {
+			const u08* bytes = static_cast<const u08*>(data);
+			for (size_t b = 0; b < size; b++) {
+				signature = (signature ^ bytes[b]) * 1099511628211ULL;
+			}
+		};
+		hash(&target.view, sizeof(target.view));
+		hash(&target.projection, sizeof(target.projection));
+		for (const GameFrame::Draw& draw : target.casters) {
+			hash(&draw.mesh, sizeof(draw.mesh));
+			hash(&draw.world, sizeof(draw.world));
+		}
+		target.signature = signature;
+	}
+}
+
+// --------------------------------------------------------
+// The index's boxes are loose and cover a whole tick, so
+// its candidates are culled again where they're drawn
+// --------------------------------------------------------
+void Game::CullDraws(const Frustum& frustum, u32 begin, u32 end, std::vector<GameFrame::Draw>& draws)
+{
+	culler.Clear();
+	cullCandidates.clear();
+	for (u32 i = begin; i < end; i++) {
+		Entity* entity = viewCandidates[i];
+		if (entity == skyBox || entity->material == nullptr) { continue; }
+		culler.Add(entity->meshObject->GetBounds(), entity->GetRenderAffine());
+		cullCandidates.push_back(entity);
+	}
+
+	for (u32 c : culler.Cull(frustum)) {
+		Entity* entity = cullCandidates[c];
+		GameFrame::Draw draw = { entity->meshObject, entity->material, entity->GetRenderAffine(), PASS_OPAQUE };
+		draws.push_back(draw);
+	}
+}
+
+// --------------------------------------------------------
+// Rasterizes the occluders that look biggest into a small
+// CPU depth buffer, then drops the draws hidden behind them
+// --------------------------------------------------------
+void Game::CullOccludedDraws(GameFrame& frame)
+{
+	PROFILE_FUNCTION();
+
+	std::vector<GameFrame::Draw>& draws = frame.draws;
+	glm::vec3 eye(frame.cameraPosition.x, frame.cameraPosition.y, frame.cameraPosition.z);
+
+	// How big a draw looks : its bounding radius over its distance
+	auto screenSize = [&](u32 d) {
+		const affine& world = draws[d].world;
+		float scale = glm::max(glm::length(world[0]), glm::max(glm::length(world[1]), glm::length(world[2])));
+		return draws[d].mesh->GetBounds().radius * scale / glm::max(glm::length(world[3] - eye), 0.001f);
+	};
+
+	occluderDraws.clear();
+	for (u32 d = 0; d < draws.size(); d++) {
+		if (draws[d].mesh->GetOccluder() != nullptr) { occluderDraws.push_back(d); }
+	}
+	if (occluderDraws.size() > MAX_OCCLUDERS) {
+		std::partial_sort(occluderDraws.begin(), occluderDraws.begin() + MAX_OCCLUDERS, occluderDraws.end(),
+			[&](u32 a, u32 b) { return screenSize(a) > screenSize(b); });
+		occluderDraws.resize(MAX_OCCLUDERS);
+		std::sort(occluderDraws.begin(), occluderDraws.end());
+	}
+
+	occlusionBuffer.Begin(frame.view, frame.projection);
+	for (u32 d : occluderDraws) {
+		occlusionBuffer.AddOccluder(*draws[d].mesh->GetOccluder(), draws[d].world);
+	}
+	occlusionBuffer.Rasterize(WorkerPool::Shared());
+
+	if (dumpOcclusionBuffer) {
+		occlusionBuffer.DumpDepth("OcclusionDepth.pgm");
+		dumpOcclusionBuffer = false;
+	}
+
+	// Occluders are drawn whatever the buffer says ; they would only be tested against themselves
+	u32 kept = 0;
+	u32 nextOccluder = 0;
+	for (u32 d = 0; d < draws.size(); d++) {
+		if (nextOccluder < occluderDraws.size() && occluderDraws[nextOccluder] == d) {
+			nextOccluder++;
+		}
+		else {
+			glm::vec3 center;
+			glm::vec3 extents;
+			TransformBounds(draws[d].mesh->GetBounds(), draws[d].world, center, extents);
+			if (!occlusionBuffer.IsBoxVisible(center, extents)) { continue; }
+		}
+		draws[kept++] = draws[d];
+	}
+	draws.resize(kept);
+}
+
+// --------------------------------------------------------
+// Draw a frame extracted earlier ; main thread only, and
+// only reads the frame
+// --------------------------------------------------------
+void Game::RenderFrame(const FrameSnapshot* frame)
+{
+	const GameFrame& gameFrame = *static_cast<const GameFrame*>(frame);
+
+	if (gameFrame.shadowCascadeCount > 0)
+		RenderShadowMap(gameFrame);
 
 	// Background color (Cornflower Blue in this case) for clearing
 	const float color[4] = { 0.4f, 0.6f, 0.75f, 0.0f };
@@ -518,92 +983,150 @@ void Game::Draw(float deltaTime, float totalTime)
 		1.0f,
 		0);
 
-	vertexShader->SetMatrix4x4("view", cam->GetViewMatrix());
-	vertexShader->SetMatrix4x4("projection", cam->GetProjectionMatrix());
-
-	// Set the vertex and pixel shaders to use for the next Draw() command
-	//  - These don't technically need to be set every frame...YET
-	//  - Once you start applying different shaders to different objects,
-	//    you'll need to swap the current shaders before each draw
-	vertexShader->SetShader();
+	// Opaque geometry uses the default states ; these only reach the context when the sky changed them
+	stateCache->SetRasterizerState(0);
+	stateCache->SetDepthStencilState(0, 0);
 
+	// Per frame shader data ; unchanged values don't get uploaded again
+	pixelShader->SetFloat3("cameraPos", gameFrame.cameraPosition);
+	pixelShader->SetData("DLight", &gameFrame.directionalLights[0], sizeof(DirectionalLight));
+	pixelShader->SetData("DLight2", &gameFrame.directionalLights[1], sizeof(DirectionalLight));
 	pixelShader->SetShaderResourceView("Sky", skyResourceView);
-	pixelShader->SetShader();
 
-	// Set buffers in the input assembler
-	//  - Do this ONCE PER OBJECT you're drawing, since each object might
-	//    have different geometry.
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-
-	for (int i = 1; i < entities.size(); i++) {
-		entities[i]->PrepareShader(cam->GetViewMatrix(), cam->GetProjectionMatrix());
-
-		mat4 worldMat = glm::transpose(entities[i]->GetWorldMatrix());
-		float* matarr = &(worldMat[0][0]);
-
-		vertexShader->SetMatrix4x4("world", matarr);
-		vertexShader->CopyAllBufferData();
-
-		ID3D11Buffer * passVB = entities[i]->meshObject->GetVertexBuffer();
-		context->IASetVertexBuffers(0, 1, &passVB, &stride, &offset);
-		context->IASetIndexBuffer(entities[i]->meshObject->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
-
-		context->DrawIndexed(
-			entities[i]->meshObject->GetIndexCount(),
-			0,
-			0);
+	// Receivers pick their cascade by view depth ; a count of 0 turns shadows off without sampling the map
+	XMFLOAT4X4 cascadeViewProjections[ShadowCascades::MAX_CASCADES] = {};
+	XMFLOAT4 cascadeSplits(0.0f, 0.0f, 0.0f, 0.0f);
+	for (u32 i = 0; i < gameFrame.shadowCascadeCount; i++) {
+		cascadeViewProjections[i] = gameFrame.shadowCascades[i].viewProjection;
+		(&cascadeSplits.x)[i] = gameFrame.shadowCascades[i].splitFar;
 	}
+	XMFLOAT4 cameraDepthPlane(gameFrame.view[0][2], gameFrame.view[1][2], gameFrame.view[2][2], gameFrame.view[3][2]);
+	pixelShader->SetData("cascadeViewProjection", cascadeViewProjections, sizeof(cascadeViewProjections));
+	pixelShader->SetFloat4("cascadeSplits", cascadeSplits);
+	pixelShader->SetFloat4("cameraDepthPlane", cameraDepthPlane);
+	pixelShader->SetInt("cascadeCount", (int)gameFrame.shadowCascadeCount);
+	pixelShader->SetShaderResourceView("ShadowMap", gameFrame.shadowCascadeCount > 0 ? shadowSRV : 0);
+	pixelShader->SetSamplerState("ShadowSampler", shadowSamplerState);
+
+	// Point lights, and which of them reach each cluster
+	UploadShaderBuffer(pointLightBuffer, gameFrame.pointLights.data(), (u32)gameFrame.pointLights.size(), sizeof(PointLight));
+	UploadShaderBuffer(lightClusterBuffer, gameFrame.lightClusterRanges.data(), (u32)gameFrame.lightClusterRanges.size(), sizeof(LightClusters::ClusterRange));
+	UploadShaderBuffer(lightIndexBuffer, gameFrame.lightIndices.data(), (u32)gameFrame.lightIndices.size(), sizeof(u32));
+	pixelShader->SetShaderResourceView("PointLights", pointLightBuffer.srv);
+	pixelShader->SetShaderResourceView("LightClusterRanges", lightClusterBuffer.srv);
+	pixelShader->SetShaderResourceView("LightIndices", lightIndexBuffer.srv);
+	pixelShader->SetData("clusterTiles", gameFrame.lightClusterTiles, sizeof(gameFrame.lightClusterTiles));
+	pixelShader->SetInt("clusterTileSize", (int)LightClusters::TILE_SIZE);
+	pixelShader->SetInt("clusterSlices", (int)LightClusters::DEPTH_SLICES);
+	pixelShader->SetFloat("clusterSliceScale", gameFrame.lightSliceScale);
+	pixelShader->SetFloat("clusterSliceBias", gameFrame.lightSliceBias);
+
+	// Entities only submit their draws ; the queue sorts them by state and depth, then binds each state once
+	renderQueue->Begin(gameFrame.view, gameFrame.nearClip, gameFrame.farClip);
+	for (const GameFrame::Draw& draw : gameFrame.draws) {
+		renderQueue->Submit(draw.pass, draw.mesh, draw.material, draw.world);
+	}
+	renderQueue->Sort();
+	renderQueue->BuildBatches();
+	renderQueue->Execute(gameFrame.view, gameFrame.projection);
 
 	// Draw the sky AFTER all opaque geometry
-	DrawSky();
+	DrawSky(gameFrame);
 
 	// Present the back buffer to the user
 	//  - Puts the final frame we're drawing into the window so the user can see it
 	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
-	swapChain->Present(0, 0);
+	{
+		PROFILE_ZONE("Present");
+		swapChain->Present(0, 0);
+	}
+}
+
+// --------------------------------------------------------
+// Replaces the contents of a structured buffer, recreating
+// it (and its view) when it's too small
+// --------------------------------------------------------
+void Game::UploadShaderBuffer(ShaderBuffer& target, const void* data, u32 count, u32 stride)
+{
+	if (target.buffer == nullptr || count > target.capacity) {
+		ReleaseShaderBuffer(target);
+		target.capacity = glm::max(count, target.capacity * 2);
+		target.capacity = glm::max(target.capacity, 1u);
+
+		BufferDesc desc = {};
+		desc.size = target.capacity * stride;
+		desc.elementStride = stride;
+		desc.usage = BUFFER_DYNAMIC;
+		desc.bindings = BIND_SHADER_RESOURCE;
+		target.buffer = renderDevice->CreateBuffer(desc, nullptr);
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = target.capacity;
+		device->CreateShaderResourceView(D3D11RenderDevice::ToD3D(target.buffer), &srvDesc, &target.srv);
+	}
+
+	if (count > 0)
+		renderDevice->UpdateBuffer(target.buffer, data, count * stride);
 }
 
-void Game::DrawSky()
+void Game::ReleaseShaderBuffer(ShaderBuffer& target)
 {
-	ID3D11Buffer* skyVB = entities[0]->meshObject->GetVertexBuffer();
-	ID3D11Buffer* skyIB = entities[0]->meshObject->GetIndexBuffer();
+	if (target.srv != nullptr)
+		target.srv->Release();
+	if (target.buffer != nullptr)
+		renderDevice->ReleaseBuffer(target.buffer);
+	target.srv = nullptr;
+	target.buffer = nullptr;
+}
+
+void Game::DrawSky(const GameFrame& frame)
+{
+	PROFILE_FUNCTION();
+
+	ID3D11Buffer* skyVB = D3D11RenderDevice::ToD3D(frame.skyMesh->GetVertexBuffer());
+	ID3D11Buffer* skyIB = D3D11RenderDevice::ToD3D(frame.skyMesh->GetIndexBuffer());
 
 	// Set buffers in the input assembler
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	context->IASetVertexBuffers(0, 1, &skyVB, &stride, &offset);
-	context->IASetIndexBuffer(skyIB, DXGI_FORMAT_R32_UINT, 0);
+	stateCache->SetVertexBuffer(0, skyVB, sizeof(Vertex), 0);
+	stateCache->SetIndexBuffer(skyIB, DXGI_FORMAT_R32_UINT, 0);
 
 	// Set up shaders
-	skyVS->SetMatrix4x4("view", cam->GetViewMatrix());
-	skyVS->SetMatrix4x4("projection", cam->GetProjectionMatrix());
+	skyVS->SetMatrix4x4("view", ToShaderMatrix(frame.view));
+	skyVS->SetMatrix4x4("projection", ToShaderMatrix(frame.projection));
 	skyVS->CopyAllBufferData();
 	skyVS->SetShader();
 
-	skyPS->SetShaderResourceView("Sky", skyBoxMaterial->GetShaderResourceView());
-	skyPS->SetSamplerState("BasicSampler", skyBoxMaterial->GetSamplerState());
+	skyPS->SetShaderResourceView("Sky", D3D11RenderDevice::ToD3D(skyBoxMaterial->GetShaderResourceView()));
+	skyPS->SetSamplerState("BasicSampler", D3D11RenderDevice::ToD3D(skyBoxMaterial->GetSamplerState()));
 	skyPS->SetShader();
 
 
 	// Set up sky-specific render states
-	context->RSSetState(skyRasterState);
-	context->OMSetDepthStencilState(skyDepthState, 0);
+	stateCache->SetRasterizerState(skyRasterState);
+	stateCache->SetDepthStencilState(skyDepthState, 0);
 
-	// Draw
-	context->DrawIndexed(entities[0]->meshObject->GetIndexCount(), 0, 0);
-
-	// Reset your states
-	context->RSSetState(0);
-	context->OMSetDepthStencilState(0, 0);
+	// Draw (RenderFrame() puts the default states back before the next frame's opaque pass)
+	context->DrawIndexed(frame.skyMesh->GetIndexCount(), 0, 0);
 }
 
-void Game::RenderShadowMap()
+void Game::RenderShadowMap(const GameFrame& frame)
 {
-	// Initial setup of targets and states
-	context->OMSetRenderTargets(0, 0, shadowDSV);
-	context->ClearDepthStencilView(shadowDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
-	context->RSSetState(shadowRasterizer);
+	PROFILE_FUNCTION();
+
+	// Cascades holding exactly what this frame would draw into them are left alone
+	bool anyDirty = false;
+	for (u32 i = 0; i < frame.shadowCascadeCount; i++) {
+		anyDirty |= !cacheShadowCascades || frame.shadowCascades[i].signature != renderedCascadeSignatures[i];
+	}
+	if (!anyDirty)
+		return;
+
+	// The map can't be read while it's being drawn to ; RenderFrame binds it again afterwards
+	pixelShader->SetShaderResourceView("ShadowMap", 0);
+	stateCache->SetRasterizerState(shadowRasterizer);
 
 
 	D3D11_VIEWPORT shadowViewport = {};
@@ -617,41 +1140,45 @@ void Game::RenderShadowMap()
 
 
 	shadowVS->SetShader();
-	shadowVS->SetMatrix4x4("view", dirLightView);
-	shadowVS->SetMatrix4x4("projection", dirLightProjection);
-
-
-	context->PSSetShader(0, 0, 0); // Unbinds the pixel shader
-
-
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
+	stateCache->SetPixelShader(0); // Unbinds the pixel shader
 
-	for (UINT i = 0; i < entities.size(); i++)
+	ShaderVarHandle shadowWorld = shadowVS->GetVariableHandle("world");
+	for (u32 i = 0; i < frame.shadowCascadeCount; i++)
 	{
+		const GameFrame::ShadowCascade& cascade = frame.shadowCascades[i];
+		if (cacheShadowCascades && cascade.signature == renderedCascadeSignatures[i])
+			continue;
 
-		Entity* currentEntity = entities[i];
-		ID3D11Buffer* vb = currentEntity->meshObject->GetVertexBuffer();
-		ID3D11Buffer* ib = currentEntity->meshObject->GetIndexBuffer();
+		PROFILE_ZONE("Shadow Cascade");
 
-		// printf("%d    %d", vb, ib);
+		context->OMSetRenderTargets(0, 0, shadowDSVs[i]);
+		context->ClearDepthStencilView(shadowDSVs[i], D3D11_CLEAR_DEPTH, 1.0f, 0);
 
+		shadowVS->SetMatrix4x4("view", cascade.view);
+		shadowVS->SetMatrix4x4("projection", cascade.projection);
 
-		context->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
-		context->IASetIndexBuffer(ib, DXGI_FORMAT_R32_UINT, 0);
+		for (const GameFrame::Draw& draw : cascade.casters)
+		{
+			ID3D11Buffer* vb = D3D11RenderDevice::ToD3D(draw.mesh->GetVertexBuffer());
+			ID3D11Buffer* ib = D3D11RenderDevice::ToD3D(draw.mesh->GetIndexBuffer());
+
+			stateCache->SetVertexBuffer(0, vb, sizeof(Vertex), 0);
+			stateCache->SetIndexBuffer(ib, DXGI_FORMAT_R32_UINT, 0);
 
-		mat4 worldMat = glm::transpose(entities[i]->GetWorldMatrix());
-		float* matarr = &(worldMat[0][0]);
+			mat4 worldMat = glm::transpose(AffineToMatrix(draw.world));
+			float* matarr = &(worldMat[0][0]);
 
-		shadowVS->SetMatrix4x4("world", matarr);
-		shadowVS->CopyAllBufferData();
+			shadowVS->SetMatrix4x4(shadowWorld, matarr);
+			shadowVS->CopyAllBufferData();
 
+			context->DrawIndexed(draw.mesh->GetIndexCount(), 0, 0);
+		}
 
-		context->DrawIndexed(currentEntity->meshObject->GetIndexCount(), 0, 0);
+		renderedCascadeSignatures[i] = cascade.signature;
 	}
 
 	context->OMSetRenderTargets(1, &backBufferRTV, depthStencilView);
-	context->RSSetState(0);
+	stateCache->SetRasterizerState(0);
 	shadowViewport.Width = (float)this->width;
 	shadowViewport.Height = (float)this->height;
 	context->RSSetViewports(1, &shadowViewport);
@@ -663,7 +1190,10 @@ void Game::RenderShadowMap()
 
 void Game::OnMouseDown(WPARAM buttonState, int x, int y)
 {
-	// Add any custom code here...
+	// Right click selects ; left drags the camera
+	if (buttonState & MK_RBUTTON) {
+		pendingPick = ((u32)x << 16) | ((u32)y & 0xFFFF);
+	}
 	
 	// Save the previous mouse position, so we have it for the future
 	prevMousePos.x = x;
@@ -686,9 +1216,10 @@ void Game::OnMouseUp(WPARAM buttonState, int x, int y)
 
 void Game::OnMouseMove(WPARAM buttonState, int x, int y)
 {
-	// passing mouse values for camera rotation
+	// passing mouse values for camera rotation ; applied in Update, which may be running on another thread
 	if (buttonState & 0x0001) {
-		cam->RotateCamera((x - prevMousePos.x)/160.0f, (y - prevMousePos.y)/160.0f);
+		mouseDeltaX += x - prevMousePos.x;
+		mouseDeltaY += y - prevMousePos.y;
 	}
 
 	// Save the previous mouse position, so we have it for the future
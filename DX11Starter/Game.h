@@ -2,14 +2,76 @@
 #include "DXCore.h"
 #include "SimpleShader.h"
 #include "Mesh.h"
+#include "Texture.h"
 #include "Entity.h"
 #include "Camera.h"
 #include "Lights.h"
 #include "AIBehaviors.h"
 #include "Scene.h"
 #include "AudioManager.h"
+#include "RenderQueue.h"
+#include "D3D11RenderDevice.h"
+#include "D3D11StateCache.h"
+#include "Profiler.h"
+#include "WorkerPool.h"
+#include "FramePipeline.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include "ClusteredLighting.h"
+#include "ShadowCascades.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
 #include <vector>
 
+// Everything Game renders a frame from, captured on the simulation side so rendering never reads the scene
+struct GameFrame : public FrameSnapshot
+{
+	struct Draw
+	{
+		Mesh* mesh;
+		Material* material;
+		affine world; // Already interpolated between simulation ticks
+		u08 pass;
+	};
+
+	// One slice of the directional light's shadow map and what casts shadows into it
+	struct ShadowCascade
+	{
+		DirectX::XMFLOAT4X4 view;           // Shader ready, like the camera's
+		DirectX::XMFLOAT4X4 projection;
+		DirectX::XMFLOAT4X4 viewProjection; // What receivers sample the cascade through
+		float splitFar;                     // View depth up to which receivers use this cascade
+		std::vector<Draw> casters;
+		u64 signature;                      // Of the matrices and casters ; when it didn't change, the cascade isn't drawn again
+	};
+
+	std::vector<Draw> draws; // Visible to the camera
+	Mesh* skyMesh;
+
+	ShadowCascade shadowCascades[ShadowCascades::MAX_CASCADES];
+	u32 shadowCascadeCount; // 0 when shadows are off
+
+	// Camera ; column vector convention, as culling and lighting take them
+	glm::mat4 view;
+	glm::mat4 projection;
+	DirectX::XMFLOAT3 cameraPosition;
+	float nearClip;
+	float farClip;
+
+	// Lights
+	DirectionalLight directionalLights[2];
+	std::vector<PointLight> pointLights;
+
+	// Point lights sorted into clusters over the view, as the pixel shader reads them
+	std::vector<LightClusters::ClusterRange> lightClusterRanges;
+	std::vector<u32> lightIndices;
+	u32 lightClusterTiles[2]; // Across and down
+	float lightSliceScale;
+	float lightSliceBias;
+};
+
 class Game 
 	: public DXCore
 {
@@ -22,10 +84,16 @@ public:
 	// will be called automatically
 	void Init();
 	void OnResize();
+	void FixedUpdate(float stepTime, float simulationTime);
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
-	void DrawSky();
-	void RenderShadowMap();
+	void DrawSky(const GameFrame& frame);
+	void RenderShadowMap(const GameFrame& frame);
+
+	// Pipelined frames
+	FrameSnapshot* CreateFrameSnapshot();
+	void ExtractFrame(FrameSnapshot* frame);
+	void RenderFrame(const FrameSnapshot* frame);
 
 	// Overridden mouse input helper methods
 	void OnMouseDown(WPARAM buttonState, int x, int y);
@@ -44,8 +112,22 @@ private:
 	void LoadHeightTexture();
 	void GenerateTerrainVertices(std::vector<float> heightList);
 
+	// Precise culling of what the spatial index found for one view (viewCandidates[begin] up to viewCandidates[end])
+	void CullDraws(const Frustum& frustum, u32 begin, u32 end, std::vector<GameFrame::Draw>& draws);
+	// Drops the camera's draws hidden behind the biggest occluders on screen
+	void CullOccludedDraws(GameFrame& frame);
+	// Refits the shadow cascades to the camera and culls each one's casters (viewCandidates[begin] onwards, one view per cascade)
+	void ExtractShadowCascades(GameFrame& frame, const Frustum* casterVolumes, u32 begin);
+	// Nearest entity in range of each tower, found with one batched query against the scene's spatial index
+	void UpdateTowerTargets();
+	// Moves the lights orbiting each tower
+	void UpdateTowerLights(float simulationTime);
+	// Selects whatever is under a point of the window
+	void PickEntity(int x, int y);
+
 	// Wrappers for DirectX shaders to provide simplified functionality
 	SimpleVertexShader* vertexShader = nullptr;
+	SimpleVertexShader* instancedVS = nullptr;
 	SimplePixelShader* pixelShader = nullptr;
 	SimpleVertexShader* skyVS = nullptr;
 	SimplePixelShader* skyPS = nullptr;
@@ -56,6 +138,43 @@ private:
 	// determining how far the mouse moved in a single frame.
 	POINT prevMousePos;
 
+	// Mouse movement waiting for the next Update, which may run on the simulation thread
+	std::atomic<int> mouseDeltaX;
+	std::atomic<int> mouseDeltaY;
+
+	// Extracted and rendered back to back when frames aren't pipelined
+	GameFrame serialFrame;
+
+	// Frustum culling scratch, only used while extracting a frame
+	FrustumCuller culler;
+	std::vector<Entity*> cullCandidates;
+	std::vector<Entity*> viewCandidates; // Broad phase results of every view, from the scene's spatial index
+	std::vector<u32> viewOffsets;
+
+	// Occlusion culling of the camera's view
+	static const u32 MAX_OCCLUDERS = 8;         // Per frame, the ones looking biggest
+	static const u32 OCCLUDER_TRIANGLES = 256;  // Per occluder mesh
+	bool occlusionCulling = true;
+	bool dumpOcclusionBuffer = false;           // Set by pressing O ; the next frame extracted writes OcclusionDepth.pgm
+	OcclusionBuffer occlusionBuffer;
+	std::vector<OccluderMesh*> occluderMeshes;
+	std::vector<u32> occluderDraws;
+
+	// Picking passes through the sky, and towers don't target each other
+	TagID skyTag = TagRegistry::INVALID_TAG;
+	TagID towerTag = TagRegistry::INVALID_TAG;
+
+	// Tower targeting
+	static const u32 TOWER_COUNT = 4;
+	float towerRange = 25.0f;
+	EntityHandle towerTargets[TOWER_COUNT]; // Null when nothing is in range
+	std::vector<Entity*> towerCandidates;
+	std::vector<u32> towerOffsets;
+
+	// Window position of the last right click not yet handled by Update, as x << 16 | y, or U32_MAX
+	std::atomic<u32> pendingPick;
+	EntityHandle pickedEntity; // Null when nothing is selected
+
 	// The scene
 	Scene* scene;
 
@@ -73,13 +192,36 @@ private:
 	// Camera
 	Camera * cam = nullptr;
 
+	// Everything drawn goes through the render device, most of it sorted by the render queue first
+	D3D11RenderDevice* renderDevice = nullptr;
+	RenderQueue* renderQueue = nullptr;
+	// Owned by the render device ; every bind Game makes itself goes through it too
+	D3D11StateCache* stateCache = nullptr;
+
 	//Directional Light
 	DirectionalLight dLight;
 	DirectionalLight dLight2;
 
-	// Point Lights
-	PointLight pLight;
-	PointLight pLight2;
+	// Point Lights ; the first STATIC_POINT_LIGHTS stay put, TOWER_LIGHTS more orbit each tower
+	static const u32 STATIC_POINT_LIGHTS = 2;
+	static const u32 TOWER_LIGHTS = 64;
+	std::vector<PointLight> pointLights;
+
+	// Sorts the point lights into clusters every extracted frame
+	LightClusters lightClusters;
+
+	// Dynamic structured buffer the pixel shader reads, grown as needed
+	struct ShaderBuffer
+	{
+		GPUBuffer* buffer = nullptr;
+		ID3D11ShaderResourceView* srv = nullptr;
+		u32 capacity = 0; // In elements
+	};
+	ShaderBuffer pointLightBuffer;
+	ShaderBuffer lightClusterBuffer;
+	ShaderBuffer lightIndexBuffer;
+	void UploadShaderBuffer(ShaderBuffer& target, const void* data, u32 count, u32 stride);
+	void ReleaseShaderBuffer(ShaderBuffer& target);
 
 	// Meshes
 	std::vector<Mesh*> meshes;
@@ -142,12 +284,16 @@ private:
 
 	//Shadowmap Resources
 	int nShadowMapSize;
-	ID3D11DepthStencilView* shadowDSV;
+	ID3D11DepthStencilView* shadowDSVs[ShadowCascades::MAX_CASCADES]; // One per cascade, each a slice of the same texture array
 	ID3D11ShaderResourceView* shadowSRV;
 	ID3D11SamplerState* shadowSamplerState;
 	ID3D11RasterizerState* shadowRasterizer;
 	SimpleVertexShader* shadowVS;
-	DirectX::XMFLOAT4X4 dirLightProjection;
-	DirectX::XMFLOAT4X4 dirLightView;
+	std::atomic<bool> renderShadows; // Off unless started with -shadows ; L toggles it while running
+
+	// Cascades of dLight's shadow map, refitted to the camera every extracted frame
+	ShadowCascades shadowCascades;
+	bool cacheShadowCascades = true; // Skip drawing cascades whose matrices and casters didn't change
+	u64 renderedCascadeSignatures[ShadowCascades::MAX_CASCADES]; // Render side ; what each slice of the map holds now
 };
 
@@ -0,0 +1,48 @@
+
+// Same as VertexShader.hlsl, except world matrices come in per instance
+// (second vertex buffer, filled by the RenderQueue) rather than through the constant buffer
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+	float3 normal		: NORMAL;
+	float2 uv			: TEXCOORD;
+	float3 tangent		: TANGENT;
+
+	// Top three rows of the world matrix ; the "_PER_INSTANCE" suffix puts them in input slot 1
+	float4 world0		: WORLD_PER_INSTANCE0;
+	float4 world1		: WORLD_PER_INSTANCE1;
+	float4 world2		: WORLD_PER_INSTANCE2;
+};
+
+// Must match the pixel shader's input
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float3 normal		: NORMAL;
+	float3 worldPos		: POSITION;
+	float2 uv			: TEXCOORD;
+	float3 tangent		: TANGENT;
+};
+
+VertexToPixel main(VertexShaderInput input)
+{
+	VertexToPixel output;
+
+	float3x4 world = float3x4(input.world0, input.world1, input.world2);
+
+	output.worldPos = mul(world, float4(input.position, 1.0f));
+	output.position = mul(mul(float4(output.worldPos, 1.0f), view), projection);
+
+	output.normal = mul((float3x3)world, input.normal);
+	output.tangent = normalize(mul((float3x3)world, input.tangent));
+
+	output.uv = input.uv;
+
+	return output;
+}
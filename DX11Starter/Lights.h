@@ -1,17 +1,17 @@
 #pragma once
-#include <DirectXMath.h>
+#include <glm/glm.hpp>
 
 struct DirectionalLight {
-	DirectX::XMFLOAT4 AmbientColor;
-	DirectX::XMFLOAT4 DiffuseColor;
-	DirectX::XMFLOAT3 Direction;
+	glm::vec4 AmbientColor;
+	glm::vec4 DiffuseColor;
+	glm::vec3 Direction;
 	float Shine;
 };
 
 struct PointLight {
-	DirectX::XMFLOAT4 AmbientColor;
-	DirectX::XMFLOAT4 DiffuseColor;
-	DirectX::XMFLOAT3 Position;
+	glm::vec4 AmbientColor;
+	glm::vec4 DiffuseColor;
+	glm::vec3 Position;
 	float Shine;
 	float Range;
 };
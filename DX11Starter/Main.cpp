@@ -1,6 +1,8 @@
 
+#include <cstdio>
 #include <Windows.h>
 #include "Game.h"
+#include "Benchmarks.h"
 
 // --------------------------------------------------------
 // Entry point for a graphical (non-console) Windows application
@@ -44,6 +46,21 @@ int WINAPI WinMain(
 		}
 	}
 
+	// Run the engine benchmarks in a console instead of the game when asked to
+	if (strstr(lpCmdLine, "-benchmark") != nullptr)
+	{
+		AllocConsole();
+		FILE* stream;
+		freopen_s(&stream, "CONOUT$", "w", stdout);
+
+		bool passed = RunBenchmarks();
+
+		printf("Press enter to exit\n");
+		freopen_s(&stream, "CONIN$", "r", stdin);
+		getchar();
+		return passed ? 0 : 1;
+	}
+
 	// Create the Game object using
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
@@ -4,7 +4,7 @@ Material::Material()
 {
 }
 
-void Material::CreateMaterial(SimpleVertexShader * vShader, SimplePixelShader * pShader, ID3D11ShaderResourceView * resource, ID3D11SamplerState * state)
+void Material::CreateMaterial(SimpleVertexShader * vShader, SimplePixelShader * pShader, GPUTextureView * resource, GPUSampler * state)
 {
 	vertexShader = vShader;
 	pixelShader = pShader;
@@ -12,7 +12,7 @@ void Material::CreateMaterial(SimpleVertexShader * vShader, SimplePixelShader *
 	samplerState = state;
 	}
 
-void Material::CreateNormalMaterial(SimpleVertexShader * vShader, SimplePixelShader * pShader, ID3D11ShaderResourceView * resource, ID3D11ShaderResourceView * normal, ID3D11SamplerState * state)
+void Material::CreateNormalMaterial(SimpleVertexShader * vShader, SimplePixelShader * pShader, GPUTextureView * resource, GPUTextureView * normal, GPUSampler * state)
 {
 	vertexShader = vShader;
 	pixelShader = pShader;
@@ -35,17 +35,17 @@ SimplePixelShader * Material::GetPixelShader()
 	return pixelShader;
 }
 
-ID3D11ShaderResourceView * Material::GetShaderResourceView()
+GPUTextureView * Material::GetShaderResourceView()
 {
 	return shaderRes;
 }
 
-ID3D11ShaderResourceView * Material::GetNormalResourceView()
+GPUTextureView * Material::GetNormalResourceView()
 {
 	return shaderNorm;
 }
 
-ID3D11SamplerState * Material::GetSamplerState()
+GPUSampler * Material::GetSamplerState()
 {
 	return samplerState;
 }
@@ -1,27 +1,49 @@
 #include "Mesh.h"
-using namespace DirectX;
+#include "Profiler.h"
 using namespace std;
 
-Mesh::Mesh(Vertex * verts, int numVerts, unsigned int * inds, int numInd, ID3D11Device * createBuff)
+// Only MSVC has the checked version, and nothing read here is a string
+#ifndef _MSC_VER
+#define sscanf_s sscanf
+#endif
+
+Mesh::Mesh(Vertex * verts, int numVerts, unsigned int * inds, int numInd, RenderDevice * createBuff)
 {
 	CreateBuffers(&verts[0], numVerts, &inds[0], numInd, createBuff);
 }
 
-Mesh::Mesh(char * filename, ID3D11Device * createBuff)
+Mesh::Mesh(char * filename, RenderDevice * createBuff)
+{
+	renderDevice = nullptr;
+	vertexBuff = nullptr;
+	indexBuff = nullptr;
+	numIndicies = 0;
+	CalculateBounds(nullptr, 0);
+
+	// Decode the file, then create the actual buffers
+	vector<Vertex> verts;
+	vector<unsigned int> indices;
+	if (!LoadOBJ(filename, verts, indices))
+		return;
+
+	CreateBuffers(&verts[0], (int)verts.size(), &indices[0], (int)indices.size(), createBuff);
+}
+
+bool Mesh::LoadOBJ(const char * filename, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
 {
+	PROFILE_ZONE("Mesh::LoadOBJ");
+
 	// File input object
 	ifstream obj(filename);
 
 	// Check for successful open
 	if (!obj.is_open())
-		return;
+		return false;
 
 	// Variables used while reading the file
-	vector<XMFLOAT3> positions;     // Positions from the file
-	vector<XMFLOAT3> normals;       // Normals from the file
-	vector<XMFLOAT2> uvs;           // UVs from the file
-	vector<Vertex> verts;           // Verts we're assembling
-	vector<UINT> indices;           // Indices of these verts
+	vector<glm::vec3> positions;     // Positions from the file
+	vector<glm::vec3> normals;       // Normals from the file
+	vector<glm::vec2> uvs;           // UVs from the file
 	unsigned int vertCounter = 0;        // Count of vertices/indices
 	char chars[100];                     // String for line reading
 
@@ -34,8 +56,8 @@ Mesh::Mesh(char * filename, ID3D11Device * createBuff)
 		// Check the type of line
 		if (chars[0] == 'v' && chars[1] == 'n')
 		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
+			// Read the 3 numbers directly into a vec3
+			glm::vec3 norm;
 			sscanf_s(
 				chars,
 				"vn %f %f %f",
@@ -46,8 +68,8 @@ Mesh::Mesh(char * filename, ID3D11Device * createBuff)
 		}
 		else if (chars[0] == 'v' && chars[1] == 't')
 		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
+			// Read the 2 numbers directly into a vec2
+			glm::vec2 uv;
 			sscanf_s(
 				chars,
 				"vt %f %f",
@@ -58,8 +80,8 @@ Mesh::Mesh(char * filename, ID3D11Device * createBuff)
 		}
 		else if (chars[0] == 'v')
 		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
+			// Read the 3 numbers directly into a vec3
+			glm::vec3 pos;
 			sscanf_s(
 				chars,
 				"v %f %f %f",
@@ -151,48 +173,39 @@ Mesh::Mesh(char * filename, ID3D11Device * createBuff)
 		}
 	}
 
-	// Close the file and create the actual buffers
+	// Close the file
 	obj.close();
 
-	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter, createBuff);
+	return !indices.empty();
 }
 
-void Mesh::CreateBuffers(Vertex * verts, int numVerts, unsigned int * inds, int numInd, ID3D11Device * createBuff)
+void Mesh::CreateBuffers(Vertex * verts, int numVerts, unsigned int * inds, int numInd, RenderDevice * createBuff)
 {
+	renderDevice = createBuff;
+
 	// Calculate the tangents before copying to buffer
 	CalculateTangents(verts, numVerts, inds, numInd);
+	CalculateBounds(verts, numVerts);
 
 	numIndicies = numInd;
 
-	D3D11_BUFFER_DESC vbd;
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * numInd;
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial vertex data
-	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = verts;
+	BufferDesc vbd;
+	vbd.size = sizeof(Vertex) * numVerts;
+	vbd.elementStride = 0;
+	vbd.usage = BUFFER_IMMUTABLE;
+	vbd.bindings = BIND_VERTEX_BUFFER;
 
 	// Actually create the buffer with the initial data
-	createBuff->CreateBuffer(&vbd, &initialVertexData, &vertexBuff);
+	vertexBuff = createBuff->CreateBuffer(vbd, verts);
 
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(int) * numInd;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial index data
-	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = inds;
+	BufferDesc ibd;
+	ibd.size = sizeof(int) * numInd;
+	ibd.elementStride = 0;
+	ibd.usage = BUFFER_IMMUTABLE;
+	ibd.bindings = BIND_INDEX_BUFFER;
 
 	// Actually create the buffer with the initial data
-	createBuff->CreateBuffer(&ibd, &initialIndexData, &indexBuff);
+	indexBuff = createBuff->CreateBuffer(ibd, inds);
 }
 
 void Mesh::CalculateTangents(Vertex * verts, int numVerts, unsigned int * indices, int numIndices)
@@ -200,7 +213,7 @@ void Mesh::CalculateTangents(Vertex * verts, int numVerts, unsigned int * indice
 	// Reset tangents
 	for (int i = 0; i < numVerts; i++)
 	{
-		verts[i].Tangent = XMFLOAT3(0, 0, 0);
+		verts[i].Tangent = glm::vec3(0, 0, 0);
 	}
 
 	// Calculate tangents one whole triangle at a time
@@ -255,30 +268,32 @@ void Mesh::CalculateTangents(Vertex * verts, int numVerts, unsigned int * indice
 	for (int i = 0; i < numVerts; i++)
 	{
 		// Grab the two vectors
-		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+		glm::vec3 normal = verts[i].Normal;
+		glm::vec3 tangent = verts[i].Tangent;
 
-		// Use Gram-Schmidt orthogonalize
-		tangent = XMVector3Normalize(
-			tangent - normal * XMVector3Dot(normal, tangent));
+		// Use Gram-Schmidt orthogonalize ; degenerate tangents stay zero rather than becoming NaN
+		tangent = tangent - normal * glm::dot(normal, tangent);
+		float length = glm::length(tangent);
 
 		// Store the tangent
-		XMStoreFloat3(&verts[i].Tangent, tangent);
+		verts[i].Tangent = length > 0.0f ? tangent / length : glm::vec3(0.0f);
 	}
 }
 
 Mesh::~Mesh()
 {
-	vertexBuff->Release();
-	indexBuff->Release();
+	if (renderDevice == nullptr) { return; }
+
+	renderDevice->ReleaseBuffer(vertexBuff);
+	renderDevice->ReleaseBuffer(indexBuff);
 }
 
-ID3D11Buffer * Mesh::GetVertexBuffer()
+GPUBuffer * Mesh::GetVertexBuffer()
 {
 	return vertexBuff;
 }
 
-ID3D11Buffer * Mesh::GetIndexBuffer()
+GPUBuffer * Mesh::GetIndexBuffer()
 {
 	return indexBuff;
 }
@@ -288,3 +303,40 @@ int Mesh::GetIndexCount()
 	return numIndicies;
 }
 
+const MeshBounds & Mesh::GetBounds()
+{
+	return bounds;
+}
+
+void Mesh::CalculateBounds(Vertex * verts, int numVerts)
+{
+	if (numVerts == 0)
+	{
+		bounds.center = glm::vec3(0.0f);
+		bounds.extents = glm::vec3(0.0f);
+		bounds.radius = 0.0f;
+		return;
+	}
+
+	glm::vec3 low(verts[0].Position.x, verts[0].Position.y, verts[0].Position.z);
+	glm::vec3 high = low;
+	for (int i = 1; i < numVerts; i++)
+	{
+		glm::vec3 p(verts[i].Position.x, verts[i].Position.y, verts[i].Position.z);
+		low = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+
+	bounds.center = (low + high) * 0.5f;
+	bounds.extents = (high - low) * 0.5f;
+
+	// Centered on the box rather than fitted, which is good enough for culling and a single extra pass
+	float radiusSquared = 0.0f;
+	for (int i = 0; i < numVerts; i++)
+	{
+		glm::vec3 p(verts[i].Position.x, verts[i].Position.y, verts[i].Position.z);
+		radiusSquared = glm::max(radiusSquared, glm::dot(p - bounds.center, p - bounds.center));
+	}
+	bounds.radius = sqrtf(radiusSquared);
+}
+
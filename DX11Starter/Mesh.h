@@ -1,30 +1,49 @@
 #pragma once
-#include <d3d11.h>
-#include <DirectXMath.h>
 #include "Vertex.h"
+#include "RenderDevice.h"
+#include "Bounds.h"
 #include <vector>
 #include <fstream>
 
+struct OccluderMesh;
+
 class Mesh
 {
 public:
 	// Constructor and Deconstructor
-	Mesh(Vertex * verts, int numVerts, unsigned int* inds, int numInd, ID3D11Device * createBuff);
-	Mesh(char* filename, ID3D11Device * createBuff);
+	Mesh(Vertex * verts, int numVerts, unsigned int* inds, int numInd, RenderDevice * createBuff);
+	Mesh(char* filename, RenderDevice * createBuff);
 	~Mesh();
 
+	// Parses an OBJ file into a triangle list, returning false if it couldn't be read or had no faces
+	// Touches no device, so it can run on any thread
+	static bool LoadOBJ(const char* filename, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
 	// Getter methods
-	ID3D11Buffer * GetVertexBuffer();
-	ID3D11Buffer * GetIndexBuffer();
+	GPUBuffer * GetVertexBuffer();
+	GPUBuffer * GetIndexBuffer();
 	int GetIndexCount();
+	// Local space box and sphere around every vertex
+	const MeshBounds& GetBounds();
+
+	// Stand-in rasterized into the occlusion buffer when this mesh is drawn, or nullptr if it hides nothing ; not owned
+	inline const OccluderMesh* GetOccluder() const     { return occluder; }
+	inline void SetOccluder(const OccluderMesh* stand) { occluder = stand; }
 
 private:
-	void CreateBuffers(Vertex * verts, int numVerts, unsigned int* inds, int numInd, ID3D11Device * createBuff);
+	void CreateBuffers(Vertex * verts, int numVerts, unsigned int* inds, int numInd, RenderDevice * createBuff);
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	void CalculateBounds(Vertex* verts, int numVerts);
+
+	// Device the buffers came from, and have to go back to
+	RenderDevice * renderDevice;
 
 	// Buffer pointers
-	ID3D11Buffer * vertexBuff;
-	ID3D11Buffer * indexBuff;
+	GPUBuffer * vertexBuff;
+	GPUBuffer * indexBuff;
 	int numIndicies;
+
+	MeshBounds bounds;
+	const OccluderMesh* occluder = nullptr;
 };
 
@@ -0,0 +1,169 @@
+#include "NullRenderDevice.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+NullRenderDevice::NullRenderDevice() :
+	commands(),
+	matrices(),
+	counts(),
+	recording(true),
+	buffers(),
+	names()
+{
+	// Nothing interesting to do here
+}
+
+NullRenderDevice::~NullRenderDevice()
+{
+	for (std::unordered_map<const GPUBuffer*, Buffer*>::iterator it = buffers.begin(); it != buffers.end(); ++it)
+	{
+		delete it->second;
+	}
+}
+
+void NullRenderDevice::Record(CommandType type, const void* object, const void* target, const char* name, u32 a, u32 b, u32 c)
+{
+	++counts[type];
+	if (!recording) { return; }
+
+	Command command = { type, object, target, name, { a, b, c } };
+	commands.push_back(command);
+}
+
+void NullRenderDevice::Reset()
+{
+	commands.clear();
+	matrices.clear();
+	memset(counts, 0, sizeof(counts));
+}
+
+GPUBuffer* NullRenderDevice::CreateBuffer(const BufferDesc& desc, const void* initialData)
+{
+	Buffer* buffer = new Buffer();
+	buffer->contents.resize(desc.size);
+	buffer->bindings = desc.bindings;
+	if (initialData != nullptr) { memcpy(buffer->contents.data(), initialData, desc.size); }
+
+	// The handle is only ever compared, so the bookkeeping object's address doubles as one
+	GPUBuffer* handle = reinterpret_cast<GPUBuffer*>(buffer);
+	buffers.emplace(handle, buffer);
+	return handle;
+}
+
+void NullRenderDevice::ReleaseBuffer(GPUBuffer* buffer)
+{
+	std::unordered_map<const GPUBuffer*, Buffer*>::iterator found = buffers.find(buffer);
+	if (found == buffers.end()) { return; }
+
+	delete found->second;
+	buffers.erase(found);
+}
+
+void NullRenderDevice::UpdateBuffer(GPUBuffer* buffer, const void* data, u32 size)
+{
+	std::unordered_map<const GPUBuffer*, Buffer*>::iterator found = buffers.find(buffer);
+	if (found == buffers.end() || size > found->second->contents.size())
+	{
+		printf("NullRenderDevice : update of %u bytes into an unknown or smaller buffer\n", size);
+		abort();
+	}
+
+	memcpy(found->second->contents.data(), data, size);
+	Record(CMD_UPDATE_BUFFER, buffer, nullptr, nullptr, size);
+}
+
+void NullRenderDevice::SetVertexBuffer(u32 slot, GPUBuffer* buffer, u32 stride)
+{
+	Record(CMD_SET_VERTEX_BUFFER, buffer, nullptr, nullptr, slot, stride);
+}
+
+void NullRenderDevice::SetIndexBuffer(GPUBuffer* buffer)
+{
+	Record(CMD_SET_INDEX_BUFFER, buffer, nullptr, nullptr);
+}
+
+u32 NullRenderDevice::GetNameIndex(const char* name)
+{
+	for (u32 i = 0; i < names.size(); ++i)
+	{
+		if (strcmp(names[i], name) == 0) { return i; }
+	}
+
+	names.push_back(name);
+	return (u32)names.size() - 1;
+}
+
+ShaderVarHandle NullRenderDevice::GetVariableHandle(SimpleVertexShader* vs, const char* name)
+{
+	// Any non-zero size makes it valid
+	ShaderVarHandle handle = { 0, GetNameIndex(name), 1 };
+	return handle;
+}
+
+ShaderResourceHandle NullRenderDevice::GetShaderResourceHandle(SimplePixelShader* ps, const char* name)
+{
+	ShaderResourceHandle handle = { GetNameIndex(name) };
+	return handle;
+}
+
+ShaderResourceHandle NullRenderDevice::GetSamplerHandle(SimplePixelShader* ps, const char* name)
+{
+	ShaderResourceHandle handle = { GetNameIndex(name) };
+	return handle;
+}
+
+bool NullRenderDevice::IsPerInstanceCompatible(SimpleVertexShader* vs)
+{
+	// Stand-in shaders can't be asked, so whatever is registered as instanced is taken at its word
+	return true;
+}
+
+void NullRenderDevice::SetShaders(SimpleVertexShader* vs, SimplePixelShader* ps)
+{
+	Record(CMD_SET_SHADERS, vs, ps, nullptr);
+}
+
+void NullRenderDevice::SetMatrix(SimpleVertexShader* vs, const ShaderVarHandle& variable, const float data[16])
+{
+	u32 index = (u32)(matrices.size() / 16);
+	if (recording) { matrices.insert(matrices.end(), data, data + 16); }
+	Record(CMD_SET_MATRIX, nullptr, vs, names[variable.ByteOffset], index);
+}
+
+void NullRenderDevice::SetShaderResource(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUTextureView* view)
+{
+	Record(CMD_SET_SHADER_RESOURCE, view, ps, names[resource.BindIndex]);
+}
+
+void NullRenderDevice::SetSampler(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUSampler* sampler)
+{
+	Record(CMD_SET_SAMPLER, sampler, ps, names[resource.BindIndex]);
+}
+
+void NullRenderDevice::CopyConstants(SimpleVertexShader* vs)
+{
+	Record(CMD_COPY_CONSTANTS, nullptr, vs, nullptr);
+}
+
+void NullRenderDevice::CopyConstants(SimplePixelShader* ps)
+{
+	Record(CMD_COPY_CONSTANTS, nullptr, ps, nullptr);
+}
+
+void NullRenderDevice::DrawIndexed(u32 indexCount)
+{
+	Record(CMD_DRAW_INDEXED, nullptr, nullptr, nullptr, indexCount);
+}
+
+void NullRenderDevice::DrawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 firstInstance)
+{
+	Record(CMD_DRAW_INDEXED_INSTANCED, nullptr, nullptr, nullptr, indexCount, instanceCount, firstInstance);
+}
+
+const u08* NullRenderDevice::GetBufferContents(const GPUBuffer* buffer) const
+{
+	std::unordered_map<const GPUBuffer*, Buffer*>::const_iterator found = buffers.find(buffer);
+	return found != buffers.end() ? found->second->contents.data() : nullptr;
+}
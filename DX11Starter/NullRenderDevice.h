@@ -0,0 +1,107 @@
+#ifndef NULL_RENDER_DEVICE_H_
+#define NULL_RENDER_DEVICE_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "RenderDevice.h"
+
+// Render device with no GPU behind it : every call is appended to an in-memory command stream
+//
+// Buffers are plain system memory, so their contents (e.g. packed instance data) can be inspected, and so
+// can the matrices set on shaders. Shaders, views and samplers are only recorded as pointers and never
+// touched. Variable and resource handles only carry an index into a table of the names asked for, so
+// commands can still be named.
+class NullRenderDevice : public RenderDevice
+{
+public:
+	enum CommandType : u08
+	{
+		CMD_UPDATE_BUFFER,
+		CMD_SET_VERTEX_BUFFER,
+		CMD_SET_INDEX_BUFFER,
+		CMD_SET_SHADERS,
+		CMD_SET_MATRIX,
+		CMD_SET_SHADER_RESOURCE,
+		CMD_SET_SAMPLER,
+		CMD_COPY_CONSTANTS,
+		CMD_DRAW_INDEXED,
+		CMD_DRAW_INDEXED_INSTANCED,
+		CMD_COUNT
+	};
+
+	// Unused fields are null / zero ; e.g. CMD_SET_VERTEX_BUFFER has object = buffer, args = (slot, stride)
+	// CMD_SET_MATRIX has args = (index of the matrix, see GetMatrix)
+	struct Command
+	{
+		CommandType type;
+		const void* object; // Buffer, shader or view the command is about
+		const void* target; // Shader it goes through, if any (the pixel shader for CMD_SET_SHADERS)
+		const char* name;   // Shader variable name, if any
+		u32 args[3];
+	};
+
+private:
+	struct Buffer
+	{
+		std::vector<u08> contents;
+		u08 bindings;
+	};
+
+	std::vector<Command> commands;
+	std::vector<float> matrices; // 16 floats per CMD_SET_MATRIX, as given
+	u32 counts[CMD_COUNT];
+	bool recording;
+
+	std::unordered_map<const GPUBuffer*, Buffer*> buffers;
+	std::vector<const char*> names;
+
+	u32 GetNameIndex(const char* name);
+
+	void Record(CommandType type, const void* object, const void* target, const char* name, u32 a = 0, u32 b = 0, u32 c = 0);
+
+public:
+	NullRenderDevice();
+	~NullRenderDevice();
+
+	NullRenderDevice(const NullRenderDevice&) = delete;
+	NullRenderDevice& operator= (const NullRenderDevice&) = delete;
+
+	GPUBuffer* CreateBuffer(const BufferDesc& desc, const void* initialData) override;
+	void ReleaseBuffer(GPUBuffer* buffer) override;
+	void UpdateBuffer(GPUBuffer* buffer, const void* data, u32 size) override;
+
+	void SetVertexBuffer(u32 slot, GPUBuffer* buffer, u32 stride) override;
+	void SetIndexBuffer(GPUBuffer* buffer) override;
+
+	ShaderVarHandle GetVariableHandle(SimpleVertexShader* vs, const char* name) override;
+	ShaderResourceHandle GetShaderResourceHandle(SimplePixelShader* ps, const char* name) override;
+	ShaderResourceHandle GetSamplerHandle(SimplePixelShader* ps, const char* name) override;
+	bool IsPerInstanceCompatible(SimpleVertexShader* vs) override;
+
+	void SetShaders(SimpleVertexShader* vs, SimplePixelShader* ps) override;
+	void SetMatrix(SimpleVertexShader* vs, const ShaderVarHandle& variable, const float data[16]) override;
+	void SetShaderResource(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUTextureView* view) override;
+	void SetSampler(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUSampler* sampler) override;
+	void CopyConstants(SimpleVertexShader* vs) override;
+	void CopyConstants(SimplePixelShader* ps) override;
+
+	void DrawIndexed(u32 indexCount) override;
+	void DrawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 firstInstance) override;
+
+	// Only counting is much cheaper when profiling large frames
+	inline void SetRecording(bool keepCommands) { recording = keepCommands; }
+	// Forgets recorded commands and counts, but not buffers
+	void Reset();
+
+	inline const std::vector<Command>& GetCommands() const { return commands; }
+	inline u32 GetCount(CommandType type) const { return counts[type]; }
+	// Data of a recorded CMD_SET_MATRIX
+	inline const float* GetMatrix(const Command& command) const { return &matrices[command.args[0] * 16]; }
+
+	// nullptr for anything not created by this device (or already released)
+	const u08* GetBufferContents(const GPUBuffer* buffer) const;
+	inline u64 GetBufferCount() const { return buffers.size(); }
+};
+
+#endif
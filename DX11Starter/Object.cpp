@@ -1,197 +1,134 @@
 #include "Object.h"
 
-#ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
-void Object::RequireUpdate()
+void Object::DetachHierarchy()
 {
-	needsUpdated = true;
-	needsInverseUpdated = true;
-	needsRotationUpdated = true;
-
-	// Recursively require updates in all children, as a change in this affects them
-	u64 cc = children.size();
-	for (u64 i = 0; i < cc; ++i)
+	u32 child = transforms->GetFirstChild(slot);
+	while (child != TransformStore::INVALID)
 	{
-		children[i]->RequireUpdate();
+		u32 next = transforms->GetNextSibling(child);
+		transforms->SetParent(child, TransformStore::INVALID);
+		child = next;
 	}
-}
-#endif
-
-void Object::AddChild(Object* newChild)
-{
-	children.push_back(newChild);
-}
 
-void Object::RemoveChild(Object* child)
-{
-	// Because order doesn't matter, we can zip through and pop it out quickly
-	u64 cc = children.size();
-	for (u64 i = 0; i < cc; ++i)
-	{
-		if (children[i] == child)
-		{
-			children[i] = children[cc - 1];
-			children.pop_back();
-			return;
-		}
-	}
+	transforms->SetParent(slot, TransformStore::INVALID);
+	RequireUpdate();
 }
 
 Object::Object() :
-	children(),
-	parent(nullptr),
-	world(identity<mat4>()),
-	invWorld(identity<mat4>()),
-	worldRotation(identity<quat>()),
-	local()
-#ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
-	,needsUpdated(false),
-	needsInverseUpdated(false),
-	needsRotationUpdated(false)
-#endif
+	transforms(TransformStore::Shared()),
+	slot(TransformStore::INVALID)
 {
-	// Nothing interesting to do here
+	slot = transforms->Allocate(this, Transform());
 }
 
 Object::Object(const Transform& t, Object* parentObject) :
-	children(),
-	parent(parentObject),
-	world(identity<mat4>()),
-	invWorld(identity<mat4>()),
-	worldRotation(identity<quat>()),
-	local(t)
-#ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
-	,needsUpdated(true),
-	needsInverseUpdated(true),
-	needsRotationUpdated(true)
-#endif
+	transforms(parentObject != nullptr ? parentObject->transforms : TransformStore::Shared()),
+	slot(TransformStore::INVALID)
 {
-	if (parent != nullptr)
-	{
-		parent->AddChild(this);
-	}
+	slot = transforms->Allocate(this, t, parentObject != nullptr ? parentObject->slot : TransformStore::INVALID);
 }
 
-Object::~Object()
+Object::Object(TransformStore* store, const Transform& t, Object* parentObject) :
+	transforms(store),
+	slot(TransformStore::INVALID)
 {
-	// Nothing interesting to do here
+	slot = transforms->Allocate(this, t, parentObject != nullptr ? parentObject->slot : TransformStore::INVALID);
 }
 
-void Object::SetParent(Object* newParent, bool keepWorldTransform)
+Object::Object(TransformStore* store, u32 adoptedSlot) :
+	transforms(store),
+	slot(adoptedSlot)
 {
-	vec3 curPos = GetWorldPosition();
-	quat curRot = GetWorldRotation();
-
-	if (parent) { parent->RemoveChild(this); }
-	if (newParent) { newParent->AddChild(this); }
-	parent = newParent;
-
-	if (keepWorldTransform)
-	{
-		SetPositionWorld(curPos);
-		SetRotationWorld(curRot);
-	}
-
-	RequireUpdate();
+	transforms->Rebind(slot, this);
 }
 
-#ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
-
-vec3 Object::GetWorldPosition()
+Object::Object(Object&& other) noexcept :
+	transforms(other.transforms),
+	slot(other.slot)
 {
-	if (parent != nullptr)
-	{
-		return vec3(parent->GetWorldMatrix() * vec4(local.GetPosition(), 1.0f));
-	}
-	else
-	{
-		return local.GetPosition();
-	}
+	other.transforms = nullptr;
+	other.slot = TransformStore::INVALID;
+
+	if (transforms != nullptr) { transforms->Rebind(slot, this); }
 }
 
-quat Object::GetWorldRotation()
+Object& Object::operator= (Object&& other) noexcept
 {
-	if (needsRotationUpdated)
+	if (this != &other)
 	{
-		quat worldRot = local.GetRotation();
+		if (transforms != nullptr) { transforms->Release(slot); }
 
-		if (parent)
-		{
-			worldRot = cross(parent->GetWorldRotation(), worldRot);
-		}
+		transforms = other.transforms;
+		slot = other.slot;
+		other.transforms = nullptr;
+		other.slot = TransformStore::INVALID;
 
-		worldRotation = worldRot;
-		needsRotationUpdated = false;
+		if (transforms != nullptr) { transforms->Rebind(slot, this); }
 	}
 
-	return worldRotation;
+	return *this;
 }
 
-mat4 Object::GetWorldMatrix()
+Object::~Object()
 {
-	if (needsUpdated)
-	{
-		if (parent != nullptr)
-		{
-			world = parent->GetWorldMatrix() * local.GetMatrix();
-		}
-		else
-		{
-			world = local.GetMatrix();
-		}
-
-		needsUpdated = false;
-	}
-
-	return world;
+	// Moved-from objects no longer own a slot
+	if (transforms != nullptr) { transforms->Release(slot); }
 }
 
-mat4 Object::GetInverseMatrix()
+std::vector<Object*> Object::GetChildren() const
 {
-	if (needsInverseUpdated)
+	std::vector<Object*> result;
+	result.reserve(transforms->GetChildCount(slot));
+
+	for (u32 child = transforms->GetFirstChild(slot); child != TransformStore::INVALID; child = transforms->GetNextSibling(child))
 	{
-		invWorld = inverse(GetWorldMatrix());
-		needsInverseUpdated = false;
+		result.push_back(transforms->GetOwner(child));
 	}
 
-	return invWorld;
+	return result;
 }
 
-#else
-
-void Object::UpdateTransformationsRoot()
+void Object::SetParent(Object* newParent, bool keepWorldTransform)
 {
-	world = local.GetMatrix();
-	invWorld = inverse(world);
-	worldRotation = local.GetRotation();
-	worldPosition = local.GetPosition();
-}
+	// Parent-child relationships can only exist within a single store
+	if (newParent != nullptr && newParent->transforms != transforms) { return; }
 
-void Object::UpdateTransformationsChild()
-{
-	world = parent->world * local.GetMatrix();
-	invWorld = inverse(world);
-	worldRotation = cross(parent->worldRotation, local.GetRotation());
-	worldPosition = parent->world * vec4(local.GetPosition(), 1.0f);
-}
+	vec3 curPos = GetWorldPosition();
+	quat curRot = GetWorldRotation();
 
-#endif
+	transforms->SetParent(slot, newParent != nullptr ? newParent->slot : TransformStore::INVALID);
+	RequireUpdate();
+
+	if (keepWorldTransform)
+	{
+		SetPositionWorld(curPos);
+		SetRotationWorld(curRot);
+	}
+
+	RequireUpdate();
+}
 
 void Object::SetPosition(vec3 v)
 {
-	local.SetPosition(v);
+	transforms->SetPosition(slot, v);
 
 	RequireUpdate();
 }
 
 void Object::SetPositionLocal(vec3 v)
 {
+	Transform local = GetTransform();
 	local.SetPosition(rotate(local.GetRotation(), v));
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::SetPositionWorld(vec3 v)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetPosition(vec3(parent->GetInverseMatrix() * vec4(v, 1.0f)));
@@ -201,18 +138,22 @@ void Object::SetPositionWorld(vec3 v)
 		local.SetPosition(v);
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::SetRotation(quat q)
 {
-	local.SetRotation(q);
+	transforms->SetRotation(slot, q);
 
 	RequireUpdate();
 }
 
 void Object::SetRotationWorld(quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetRotation(cross(conjugate(parent->GetWorldRotation()), q));
@@ -222,32 +163,40 @@ void Object::SetRotationWorld(quat q)
 		local.SetRotation(q);
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::SetScale(vec3 v)
 {
-	local.SetScale(v);
+	transforms->SetScale(slot, v);
 
 	RequireUpdate();
 }
 
 void Object::Translate(vec3 v)
 {
+	Transform local = GetTransform();
 	local.TranslateGlobal(v);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::TranslateLocal(vec3 v)
 {
+	Transform local = GetTransform();
 	local.TranslateLocal(v);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::TranslateWorld(vec3 v)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.TranslateGlobal(vec3(parent->GetInverseMatrix() * (parent->GetWorldMatrix() * vec4(v, 1.0f))));
@@ -257,25 +206,33 @@ void Object::TranslateWorld(vec3 v)
 		local.TranslateGlobal(v);
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::Rotate(quat q)
 {
+	Transform local = GetTransform();
 	local.RotateGlobal(q);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RotateLocal(quat q)
 {
+	Transform local = GetTransform();
 	local.RotateLocal(q);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RotateWorld(quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetRotation(cross(conjugate(parent->GetWorldRotation()), cross(q, GetWorldRotation())));
@@ -285,31 +242,41 @@ void Object::RotateWorld(quat q)
 		local.RotateGlobal(q);
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::Scale(vec3 v)
 {
+	Transform local = GetTransform();
 	local.ScaleMul(v);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::ScaleAdd(vec3 v)
 {
+	Transform local = GetTransform();
 	local.ScaleAdd(v);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::OrbitAboutParent(quat q)
 {
+	Transform local = GetTransform();
 	local.SetPosition(rotate(q, local.GetPosition()));
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::OrbitAboutWorld(quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetPosition(vec3(parent->GetInverseMatrix() * vec4(rotate(q, vec3(parent->GetWorldMatrix() * vec4(local.GetPosition(), 1.0f))), 1.0f)));
@@ -319,11 +286,15 @@ void Object::OrbitAboutWorld(quat q)
 		local.SetPosition(rotate(q, local.GetPosition()));
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::OrbitAboutObject(Object* o, quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetPosition(vec3(parent->GetInverseMatrix() * o->GetWorldMatrix() * vec4(rotate(q, vec3(o->GetInverseMatrix() * parent->GetWorldMatrix() * vec4(local.GetPosition(), 1.0f))), 1.0f)));
@@ -333,25 +304,33 @@ void Object::OrbitAboutObject(Object* o, quat q)
 		local.SetPosition(vec3(o->GetWorldMatrix() * vec4(rotate(q, vec3(o->GetInverseMatrix() * vec4(local.GetPosition(), 1.0f))), 1.0f)));
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::OrbitAboutPoint(vec3 v, quat q)
 {
+	Transform local = GetTransform();
 	vec3 offset = rotate(local.GetRotation(), v);
 	local.SetPosition(rotate(q, local.GetPosition() - offset) + offset);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::OrbitAboutPointParent(vec3 v, quat q)
 {
+	Transform local = GetTransform();
 	local.SetPosition(rotate(q, local.GetPosition() - v) + v);
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::OrbitAboutPointWorld(vec3 v, quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetPosition(vec3(parent->GetInverseMatrix() * vec4(rotate(q, vec3(parent->GetWorldMatrix() * vec4(local.GetPosition(), 1.0f)) - v) + v, 1.0f)));
@@ -361,11 +340,15 @@ void Object::OrbitAboutPointWorld(vec3 v, quat q)
 		local.SetPosition(rotate(q, local.GetPosition() - v) + v);
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::OrbitAboutPointObject(Object* o, vec3 v, quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetPosition(vec3(parent->GetInverseMatrix() * o->GetWorldMatrix() * vec4(rotate(q, vec3(o->GetInverseMatrix() * parent->GetWorldMatrix() * vec4(local.GetPosition(), 1.0f)) - v) + v, 1.0f)));
@@ -375,19 +358,25 @@ void Object::OrbitAboutPointObject(Object* o, vec3 v, quat q)
 		local.SetPosition(vec3(o->GetWorldMatrix() * vec4(rotate(q, vec3(o->GetInverseMatrix() * vec4(local.GetPosition(), 1.0f)) - v) + v, 1.0f)));
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RevolveAboutParent(quat q)
 {
+	Transform local = GetTransform();
 	local.SetPosition(rotate(q, local.GetPosition()));
 	local.RotateGlobal(q);
 	
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RevolveAboutWorld(quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetPosition(vec3(parent->GetInverseMatrix() * vec4(rotate(q, vec3(parent->GetWorldMatrix() * vec4(local.GetPosition(), 1.0f))), 1.0f)));
@@ -400,11 +389,15 @@ void Object::RevolveAboutWorld(quat q)
 		local.RotateGlobal(q);
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RevolveAboutObject(Object* o, quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	quat eRot = o->GetWorldRotation();
 
 	if (parent != nullptr)
@@ -418,29 +411,37 @@ void Object::RevolveAboutObject(Object* o, quat q)
 		local.RotateGlobal(cross(conjugate(eRot), cross(q, eRot)));
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RevolveAboutPoint(vec3 v, quat q)
 {
+	Transform local = GetTransform();
 	vec3 offset = rotate(local.GetRotation(), v);
 
 	local.SetPosition(rotate(q, local.GetPosition() - offset) + offset);
 	local.RotateLocal(q);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RevolveAboutPointParent(vec3 v, quat q)
 {
+	Transform local = GetTransform();
 	local.SetPosition(rotate(q, local.GetPosition() - v) + v);
 	local.RotateGlobal(q);
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RevolveAboutPointWorld(vec3 v, quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	if (parent != nullptr)
 	{
 		local.SetPosition(vec3(parent->GetInverseMatrix() * vec4(rotate(q, vec3(parent->GetWorldMatrix() * vec4(local.GetPosition(), 1.0f)) - v) + v, 1.0f)));
@@ -453,11 +454,15 @@ void Object::RevolveAboutPointWorld(vec3 v, quat q)
 		local.RotateGlobal(q);
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
 
 void Object::RevolveAboutPointObject(Object* o, vec3 v, quat q)
 {
+	Transform local = GetTransform();
+	Object* parent = GetParent();
+
 	quat eRot = o->GetWorldRotation();
 
 	if (parent != nullptr)
@@ -471,5 +476,6 @@ void Object::RevolveAboutPointObject(Object* o, vec3 v, quat q)
 		local.RotateGlobal(cross(conjugate(eRot), cross(q, eRot)));
 	}
 
+	transforms->SetTransform(slot, local);
 	RequireUpdate();
 }
@@ -10,66 +10,60 @@
 
 #include "Types.h"
 #include "Transform.h"
+#include "TransformStore.h"
 
 // Base class for Entities and any other objects that would make use of parent-child transformational relationships (e.g. bones for model animation)
+// All transformation data lives in a TransformStore, an Object is only a handle to its slot in it
 class Object
 {
 private:
-	// Cached data for speeding up repeated access operations
-	mat4 world;
-	mat4 invWorld;
-	quat worldRotation;
-#ifdef CORE_OBJECT_NO_DYNAMIC_UPDATE
-	vec3 worldPosition;
-#endif
-
-	// Transform defining transformation relative to parent
-	Transform local;
-
-	// Control variables for determining when to recalculate world or inverse matrix
-#ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
-	bool needsUpdated;
-	bool needsInverseUpdated;
-	bool needsRotationUpdated;
-#endif
+	// Store holding this object's transformation data, and the slot within it
+	TransformStore* transforms;
+	u32 slot;
 
-#ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
-	void RequireUpdate();
-#else
-// Effectively disabled
-#define RequireUpdate() 
-#endif
+	// Flags cached data for recalculation ; children notice through their version stamps
+	inline void RequireUpdate() { transforms->MarkChanged(slot); }
 
 	// TODO : Why is C++ bad about this ; find something more clever to do
 	friend class Entity;
 
 protected:
-	std::vector<Object*> children;
-	Object* parent;
+	// Detaches this object from its parent and all of its children
+	void DetachHierarchy();
 
-	void AddChild(Object* newChild);
-	void RemoveChild(Object* child);
+	// Takes ownership of a slot already claimed from the store (e.g. by TransformStore::AllocateBlock)
+	Object(TransformStore* store, u32 adoptedSlot);
 
 public:
 	Object();
 	Object(const Transform& t, Object* parentObject = nullptr);
+	Object(TransformStore* store, const Transform& t, Object* parentObject = nullptr);
+	Object(Object&& other) noexcept;
+	Object& operator= (Object&& other) noexcept;
 	virtual ~Object();
 
+	// Two objects must never share a slot
+	Object(const Object&) = delete;
+	Object& operator= (const Object&) = delete;
+
+	inline TransformStore* GetTransformStore() const { return transforms; }
+	inline u32 GetTransformSlot() const { return slot; }
+
 	// Changes the parent Object to another or none (nullptr)
 	void SetParent(Object* newParent, bool keepWorldTransform);
 	// Will probably implement more functionality for handling parent-child relations (likely only script-side)
-	inline Object* GetParent() const { return parent; }
-	inline std::vector<Object*> GetChildren() const { return children; }
-	inline u64 GetChildCount() const { return children.size(); }
+	inline Object* GetParent() const { return transforms->GetOwner(transforms->GetParent(slot)); }
+	std::vector<Object*> GetChildren() const;
+	inline u64 GetChildCount() const { return transforms->GetChildCount(slot); }
 
-	inline Transform GetTransform() const { return local; }
-	inline vec3      GetPosition() const  { return local.GetPosition(); }
-	inline quat      GetRotation() const  { return local.GetRotation(); }
-	inline vec3      GetScale() const     { return local.GetScale(); }
+	inline Transform GetTransform() const { return transforms->GetTransform(slot); }
+	inline vec3      GetPosition() const  { return transforms->GetPosition(slot); }
+	inline quat      GetRotation() const  { return transforms->GetRotation(slot); }
+	inline vec3      GetScale() const     { return transforms->GetScale(slot); }
 
-	inline vec3 GetLocalForward() const { return local.ForwardVector(); }
-	inline vec3 GetLocalRight() const   { return local.RightVector(); }
-	inline vec3 GetLocalUp() const      { return local.UpVector(); }
+	inline vec3 GetLocalForward() const { return rotate(GetRotation(), vec3(0.0f, 0.0f, 1.0f)); }
+	inline vec3 GetLocalRight() const   { return rotate(GetRotation(), vec3(1.0f, 0.0f, 0.0f)); }
+	inline vec3 GetLocalUp() const      { return rotate(GetRotation(), vec3(0.0f, 1.0f, 0.0f)); }
 
 	inline vec3 GetWorldForward() { return rotate(GetWorldRotation(), vec3(0.0f, 0.0f, 1.0f)); }
 	inline vec3 GetWorldRight()   { return rotate(GetWorldRotation(), vec3(1.0f, 0.0f, 0.0f)); }
@@ -77,22 +71,31 @@ public:
 	
 #ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
 	// Not const because these can regenerate cached data under the hood
-	vec3 GetWorldPosition();
-	quat GetWorldRotation();
+	inline vec3 GetWorldPosition() { return transforms->ResolveWorld(slot)[3]; }
+	inline quat GetWorldRotation() { return transforms->ResolveWorldRotation(slot); }
 
 	// Ditto
-	mat4 GetWorldMatrix();
-	mat4 GetInverseMatrix();
+	inline const affine& GetWorldAffine()   { return transforms->ResolveWorld(slot); }
+	inline const affine& GetInverseAffine() { return transforms->ResolveInverse(slot); }
+	// Expanded to a full 4x4, e.g. for shader upload
+	inline mat4 GetWorldMatrix()   { return AffineToMatrix(GetWorldAffine()); }
+	inline mat4 GetInverseMatrix() { return AffineToMatrix(GetInverseAffine()); }
 #else
-	inline vec3 GetWorldPosition() const { return worldPosition; }
-	inline quat GetWorldRotation() const { return worldRotation; }
-	inline mat4 GetWorldMatrix() const { return world; }
-	inline mat4 GetInverseMatrix() const { return invWorld; }
-
-	void UpdateTransformationsRoot();
-	void UpdateTransformationsChild();
+	// Only as fresh as the last TransformStore::UpdateWorldMatrices
+	inline vec3 GetWorldPosition() const { return transforms->GetWorld(slot)[3]; }
+	inline quat GetWorldRotation() const { return transforms->GetWorldRotation(slot); }
+	inline const affine& GetWorldAffine() const { return transforms->GetWorld(slot); }
+	// Inverses are only kept up to date for objects that keep asking for them, others are calculated here
+	inline const affine& GetInverseAffine() const { return transforms->ResolveInverse(slot); }
+	// Expanded to a full 4x4, e.g. for shader upload
+	inline mat4 GetWorldMatrix() const   { return AffineToMatrix(GetWorldAffine()); }
+	inline mat4 GetInverseMatrix() const { return AffineToMatrix(GetInverseAffine()); }
 #endif
 
+	// World matrix blended between the last two simulation ticks, as of the last TransformStore::InterpolateWorlds
+	inline const affine& GetRenderAffine() const { return transforms->GetRenderWorld(slot); }
+	inline mat4 GetRenderMatrix() const          { return AffineToMatrix(GetRenderAffine()); }
+
 	// Set position with respect to parent
 	void SetPosition(vec3 position);
 	// Set position with respect to self
@@ -0,0 +1,400 @@
+#include "OcclusionCulling.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+const u32 OcclusionBuffer::TILE_WIDTH;
+const u32 OcclusionBuffer::TILE_HEIGHT;
+const u32 OcclusionBuffer::BLOCK_SIZE;
+
+namespace
+{
+	FILE* OpenForBinaryWriting(const char* path)
+	{
+#ifdef _MSC_VER
+		FILE* file = nullptr;
+		return fopen_s(&file, path, "wb") == 0 ? file : nullptr;
+#else
+		return fopen(path, "wb");
+#endif
+	}
+}
+
+OccluderMesh OccluderMesh::FromTriangles(const Vertex* verts, u64 vertexCount, const u32* indices, u64 indexCount, u64 maxTriangles)
+{
+	struct Candidate
+	{
+		float area;
+		u64 first; // Index of the triangle's first index
+	};
+
+	std::vector<Candidate> candidates;
+	candidates.reserve((size_t)(indexCount / 3));
+	for (u64 i = 0; i + 2 < indexCount; i += 3)
+	{
+		glm::vec3 p[3];
+		for (u32 k = 0; k < 3; ++k) { p[k] = verts[indices[i + k]].Position; }
+		candidates.push_back(Candidate{ glm::length(glm::cross(p[1] - p[0], p[2] - p[0])), i });
+	}
+
+	// Biggest first, then back in mesh order so neighbouring triangles stay together
+	if (candidates.size() > maxTriangles)
+	{
+		std::nth_element(candidates.begin(), candidates.begin() + (size_t)maxTriangles, candidates.end(),
+			[](const Candidate& a, const Candidate& b) { return a.area > b.area; });
+		candidates.resize((size_t)maxTriangles);
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.first < b.first; });
+	}
+
+	// Only the vertices still in use are kept
+	OccluderMesh occluder;
+	std::vector<u32> remap((size_t)vertexCount, U32_MAX);
+	for (const Candidate& candidate : candidates)
+	{
+		for (u32 k = 0; k < 3; ++k)
+		{
+			u32 vertex = indices[candidate.first + k];
+			if (remap[vertex] == U32_MAX)
+			{
+				remap[vertex] = (u32)occluder.positions.size();
+				occluder.positions.push_back(verts[vertex].Position);
+			}
+			occluder.indices.push_back(remap[vertex]);
+		}
+	}
+	return occluder;
+}
+
+OcclusionBuffer::OcclusionBuffer(u32 bufferWidth, u32 bufferHeight) :
+	width(((bufferWidth + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH),
+	height(((bufferHeight + TILE_HEIGHT - 1) / TILE_HEIGHT) * TILE_HEIGHT),
+	tilesX(width / TILE_WIDTH),
+	tilesY(height / TILE_HEIGHT),
+	depth(width * height, 1.0f),
+	blockDepth((width / BLOCK_SIZE) * (height / BLOCK_SIZE), 1.0f),
+	viewProjection(1.0f),
+	triangles(),
+	bins(tilesX * tilesY),
+	clipScratch()
+{
+	// Nothing interesting to do here
+}
+
+void OcclusionBuffer::Begin(const glm::mat4& view, const glm::mat4& projection)
+{
+	viewProjection = projection * view;
+
+	triangles.clear();
+	for (std::vector<u32>& bin : bins) { bin.clear(); }
+}
+
+void OcclusionBuffer::AddOccluder(const OccluderMesh& occluder, const affine& world)
+{
+	glm::mat4 worldViewProjection = viewProjection * AffineToMatrix(world);
+
+	u64 vertexCount = occluder.positions.size();
+	clipScratch.resize((size_t)vertexCount);
+	for (u64 i = 0; i < vertexCount; ++i) { clipScratch[i] = worldViewProjection * glm::vec4(occluder.positions[i], 1.0f); }
+
+	u64 indexCount = occluder.indices.size();
+	for (u64 i = 0; i + 2 < indexCount; i += 3)
+	{
+		const glm::vec4& a = clipScratch[occluder.indices[i]];
+		const glm::vec4& b = clipScratch[occluder.indices[i + 1]];
+		const glm::vec4& c = clipScratch[occluder.indices[i + 2]];
+
+		// Entirely outside one of the side planes, or past the far one
+		if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w)) { continue; }
+		if ((a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w)) { continue; }
+		if (a.z > a.w && b.z > b.w && c.z > c.w) { continue; }
+
+		u32 behind = (a.z < 0.0f ? 1 : 0) + (b.z < 0.0f ? 1 : 0) + (c.z < 0.0f ? 1 : 0);
+		if (behind == 3) { continue; }
+		if (behind == 0)
+		{
+			AddTriangle(a, b, c);
+			continue;
+		}
+
+		// Clipped against the near plane (z = 0), which leaves a triangle or a quad
+		const glm::vec4* in[3] = { &a, &b, &c };
+		glm::vec4 out[4];
+		u32 outCount = 0;
+		for (u32 k = 0; k < 3; ++k)
+		{
+			const glm::vec4& from = *in[k];
+			const glm::vec4& to = *in[(k + 1) % 3];
+			if (from.z >= 0.0f) { out[outCount++] = from; }
+			if ((from.z >= 0.0f) != (to.z >= 0.0f)) { out[outCount++] = from + (to - from) * (from.z / (from.z - to.z)); }
+		}
+
+		AddTriangle(out[0], out[1], out[2]);
+		if (outCount == 4) { AddTriangle(out[0], out[2], out[3]); }
+	}
+}
+
+void OcclusionBuffer::AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+	Triangle triangle;
+	const glm::vec4* clip[3] = { &a, &b, &c };
+	for (u32 k = 0; k < 3; ++k)
+	{
+		float inverseW = 1.0f / clip[k]->w;
+		triangle.v[k] = glm::vec3(
+			(clip[k]->x * inverseW * 0.5f + 0.5f) * width,
+			(0.5f - clip[k]->y * inverseW * 0.5f) * height,
+			clip[k]->z * inverseW);
+	}
+
+	const glm::vec3& p0 = triangle.v[0];
+	const glm::vec3& p1 = triangle.v[1];
+	const glm::vec3& p2 = triangle.v[2];
+	if ((p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y) == 0.0f) { return; }
+
+	// Clamped as floats first, clipped vertices can land far off screen
+	float minX = std::fmax(std::floor(std::fmin(std::fmin(p0.x, p1.x), p2.x)), 0.0f);
+	float maxX = std::fmin(std::ceil(std::fmax(std::fmax(p0.x, p1.x), p2.x)), (float)width);
+	float minY = std::fmax(std::floor(std::fmin(std::fmin(p0.y, p1.y), p2.y)), 0.0f);
+	float maxY = std::fmin(std::ceil(std::fmax(std::fmax(p0.y, p1.y), p2.y)), (float)height);
+	if (minX >= maxX || minY >= maxY) { return; }
+
+	u32 index = (u32)triangles.size();
+	triangles.push_back(triangle);
+
+	u32 tileX0 = (u32)minX / TILE_WIDTH;
+	u32 tileX1 = ((u32)maxX - 1) / TILE_WIDTH;
+	u32 tileY0 = (u32)minY / TILE_HEIGHT;
+	u32 tileY1 = ((u32)maxY - 1) / TILE_HEIGHT;
+	for (u32 ty = tileY0; ty <= tileY1; ++ty)
+	{
+		for (u32 tx = tileX0; tx <= tileX1; ++tx) { bins[ty * tilesX + tx].push_back(index); }
+	}
+}
+
+void OcclusionBuffer::Rasterize(WorkerPool* pool)
+{
+	PROFILE_FUNCTION();
+
+	u32 tileCount = tilesX * tilesY;
+	if (pool == nullptr)
+	{
+		for (u32 t = 0; t < tileCount; ++t) { RasterizeTile(t); }
+		return;
+	}
+
+	pool->ParallelFor(tileCount, 1, [this](u64 begin, u64 end)
+	{
+		for (u64 t = begin; t < end; ++t) { RasterizeTile((u32)t); }
+	});
+}
+
+void OcclusionBuffer::RasterizeTile(u32 tile)
+{
+	u32 tileX = (tile % tilesX) * TILE_WIDTH;
+	u32 tileY = (tile / tilesX) * TILE_HEIGHT;
+
+	for (u32 y = tileY; y < tileY + TILE_HEIGHT; ++y)
+	{
+		std::fill(depth.begin() + y * width + tileX, depth.begin() + y * width + tileX + TILE_WIDTH, 1.0f);
+	}
+
+	// Pixels are sampled at their centers, 4 at a time along a row
+	const __m128 laneCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 allOnes = _mm_cmpeq_ps(zero, zero);
+
+	for (u32 index : bins[tile])
+	{
+		const Triangle& triangle = triangles[index];
+		const glm::vec3& a = triangle.v[0];
+		const glm::vec3& b = triangle.v[1];
+		const glm::vec3& c = triangle.v[2];
+
+		float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+
+		// Edge functions, positive inside whichever way the triangle winds
+		// Each is measured from the same end of its edge in both triangles sharing it, so they get exactly opposite values,
+		// and pixels exactly on the edge go to the triangle on its left or top ; no gaps, no pixel covered twice
+		float sign = area > 0.0f ? 1.0f : -1.0f;
+		const glm::vec3* from[3] = { &a, &b, &c };
+		const glm::vec3* to[3] = { &b, &c, &a };
+		__m128 stepX[3];
+		float stepY[3];
+		const glm::vec3* origin[3];
+		__m128 owns[3];
+		for (u32 e = 0; e < 3; ++e)
+		{
+			const glm::vec3& p = *from[e];
+			const glm::vec3& q = *to[e];
+			float dx = (p.y - q.y) * sign;
+			float dy = (q.x - p.x) * sign;
+			stepX[e] = _mm_set1_ps(dx);
+			stepY[e] = dy;
+			origin[e] = (p.x < q.x || (p.x == q.x && p.y < q.y)) ? &p : &q;
+			owns[e] = (dx > 0.0f || (dx == 0.0f && dy > 0.0f)) ? allOnes : zero;
+		}
+
+		// Depth is a plane in screen space
+		float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+		float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+		__m128 dzdxs = _mm_set1_ps(dzdx);
+
+		// Bounding box within the tile, starting on a multiple of 4 (tiles are a multiple of 4 wide)
+		float minX = std::fmax(std::floor(std::fmin(std::fmin(a.x, b.x), c.x)), (float)tileX);
+		float maxX = std::fmin(std::ceil(std::fmax(std::fmax(a.x, b.x), c.x)), (float)(tileX + TILE_WIDTH));
+		float minY = std::fmax(std::floor(std::fmin(std::fmin(a.y, b.y), c.y)), (float)tileY);
+		float maxY = std::fmin(std::ceil(std::fmax(std::fmax(a.y, b.y), c.y)), (float)(tileY + TILE_HEIGHT));
+		if (minX >= maxX || minY >= maxY) { continue; }
+		u32 x0 = (u32)minX & ~3u;
+		u32 x1 = (u32)maxX;
+		u32 y0 = (u32)minY;
+		u32 y1 = (u32)maxY;
+
+		for (u32 y = y0; y < y1; ++y)
+		{
+			float centerY = (float)y + 0.5f;
+			__m128 rowEdge[3];
+			__m128 originX[3];
+			for (u32 e = 0; e < 3; ++e)
+			{
+				rowEdge[e] = _mm_set1_ps(stepY[e] * (centerY - origin[e]->y));
+				originX[e] = _mm_set1_ps(origin[e]->x);
+			}
+			__m128 rowDepth = _mm_set1_ps(a.z + dzdy * (centerY - a.y));
+			__m128 ax = _mm_set1_ps(a.x);
+
+			float* row = &depth[y * width];
+			for (u32 x = x0; x < x1; x += 4)
+			{
+				__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneCenters);
+
+				__m128 inside = allOnes;
+				for (u32 e = 0; e < 3; ++e)
+				{
+					__m128 edge = _mm_add_ps(_mm_mul_ps(stepX[e], _mm_sub_ps(centerX, originX[e])), rowEdge[e]);
+					__m128 onEdge = _mm_and_ps(_mm_cmpeq_ps(edge, zero), owns[e]);
+					inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(edge, zero), onEdge));
+				}
+				if (_mm_movemask_ps(inside) == 0) { continue; }
+
+				__m128 z = _mm_add_ps(rowDepth, _mm_mul_ps(dzdxs, _mm_sub_ps(centerX, ax)));
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(current, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+			}
+		}
+	}
+
+	// Farthest depth of every block in the tile
+	u32 blocksPerRow = width / BLOCK_SIZE;
+	for (u32 by = tileY; by < tileY + TILE_HEIGHT; by += BLOCK_SIZE)
+	{
+		for (u32 bx = tileX; bx < tileX + TILE_WIDTH; bx += BLOCK_SIZE)
+		{
+			__m128 farthest = zero;
+			for (u32 y = by; y < by + BLOCK_SIZE; ++y)
+			{
+				const float* row = &depth[y * width + bx];
+				farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+			}
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+			blockDepth[(by / BLOCK_SIZE) * blocksPerRow + bx / BLOCK_SIZE] = _mm_cvtss_f32(farthest);
+		}
+	}
+}
+
+bool OcclusionBuffer::IsBoxVisible(const glm::vec3& center, const glm::vec3& extents) const
+{
+	// Screen rectangle and nearest depth of the box's corners
+	float minX = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float minY = FLT_MAX;
+	float maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	for (u32 i = 0; i < 8; ++i)
+	{
+		glm::vec3 corner = center + extents * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+		// Reaching past the near plane, where projecting would flip it
+		if (clip.z < 0.0f || clip.w <= 0.0f) { return true; }
+
+		float inverseW = 1.0f / clip.w;
+		float x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip.y * inverseW * 0.5f) * height;
+		minX = std::fmin(minX, x);
+		maxX = std::fmax(maxX, x);
+		minY = std::fmin(minY, y);
+		maxY = std::fmax(maxY, y);
+		nearest = std::fmin(nearest, clip.z * inverseW);
+	}
+
+	// Every pixel the rectangle touches
+	minX = std::fmax(std::floor(minX), 0.0f);
+	maxX = std::fmin(std::ceil(maxX), (float)width);
+	minY = std::fmax(std::floor(minY), 0.0f);
+	maxY = std::fmin(std::ceil(maxY), (float)height);
+	if (minX >= maxX || minY >= maxY) { return true; }
+	u32 x0 = (u32)minX;
+	u32 x1 = (u32)maxX;
+	u32 y0 = (u32)minY;
+	u32 y1 = (u32)maxY;
+
+	const __m128 laneIndices = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 nearestDepth = _mm_set1_ps(nearest);
+	const __m128 left = _mm_set1_ps((float)x0);
+	const __m128 right = _mm_set1_ps((float)x1);
+
+	u32 blocksPerRow = width / BLOCK_SIZE;
+	for (u32 by = y0 / BLOCK_SIZE; by <= (y1 - 1) / BLOCK_SIZE; ++by)
+	{
+		for (u32 bx = x0 / BLOCK_SIZE; bx <= (x1 - 1) / BLOCK_SIZE; ++bx)
+		{
+			// The box is behind everything in this block
+			if (nearest > blockDepth[by * blocksPerRow + bx]) { continue; }
+
+			// Something in the block is farther than the box, but that may be outside the rectangle
+			u32 rowBegin = std::max(y0, by * BLOCK_SIZE);
+			u32 rowEnd = std::min(y1, (by + 1) * BLOCK_SIZE);
+			for (u32 y = rowBegin; y < rowEnd; ++y)
+			{
+				const float* row = &depth[y * width];
+				for (u32 x = bx * BLOCK_SIZE; x < (bx + 1) * BLOCK_SIZE; x += 4)
+				{
+					__m128 lanes = _mm_add_ps(_mm_set1_ps((float)x), laneIndices);
+					__m128 covered = _mm_and_ps(_mm_cmpge_ps(lanes, left), _mm_cmplt_ps(lanes, right));
+					__m128 farther = _mm_cmpge_ps(_mm_loadu_ps(row + x), nearestDepth);
+					if (_mm_movemask_ps(_mm_and_ps(covered, farther)) != 0) { return true; }
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+bool OcclusionBuffer::DumpDepth(const char* path) const
+{
+	FILE* file = OpenForBinaryWriting(path);
+	if (file == nullptr) { return false; }
+
+	// Perspective depth bunches up near 1, so the range actually in use is stretched over the whole image
+	float nearest = 1.0f;
+	for (float d : depth) { nearest = std::fmin(nearest, d); }
+	float scale = (nearest < 1.0f) ? 255.0f / (1.0f - nearest) : 0.0f;
+
+	std::vector<u08> pixels(depth.size());
+	for (size_t i = 0; i < depth.size(); ++i) { pixels[i] = (u08)((1.0f - depth[i]) * scale + 0.5f); }
+
+	fprintf(file, "P5\n%u %u\n255\n", width, height);
+	bool written = fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+	fclose(file);
+	return written;
+}
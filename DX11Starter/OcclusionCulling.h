@@ -0,0 +1,83 @@
+#ifndef OCCLUSION_CULLING_H_
+#define OCCLUSION_CULLING_H_
+
+#include <vector>
+
+#include "Types.h"
+#include "Bounds.h"
+#include "Vertex.h"
+
+class WorkerPool;
+
+// Triangles standing in for a mesh in the occlusion buffer, kept on the CPU
+// Must never cover more than the mesh it stands for, or things behind its edges get culled while visible
+struct OccluderMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<u32> indices;
+
+	// Keeps the maxTriangles largest triangles of a mesh ; leaving out small triangles only ever hides less
+	static OccluderMesh FromTriangles(const Vertex* verts, u64 vertexCount, const u32* indices, u64 indexCount, u64 maxTriangles);
+
+	inline u64 GetTriangleCount() const { return indices.size() / 3; }
+};
+
+// Small CPU depth buffer that occluders are rasterized into, so boxes hidden behind them can be culled before submission
+//  - Depth is z / w as Direct3D has it (0 at the near plane, 1 at the far one), interpolated exactly in screen space
+//  - The screen is split into tiles, each rasterized on its own from the triangles binned into it
+//  - A second level keeps the farthest depth of every 8x8 block, so most box tests never look at single pixels
+class OcclusionBuffer
+{
+public:
+	static const u32 TILE_WIDTH = 64;
+	static const u32 TILE_HEIGHT = 32;
+	static const u32 BLOCK_SIZE = 8;
+
+private:
+	// Screen x and y in pixels, and depth
+	struct Triangle
+	{
+		glm::vec3 v[3];
+	};
+
+	u32 width;
+	u32 height;
+	u32 tilesX;
+	u32 tilesY;
+
+	std::vector<float> depth;      // width * height, row by row
+	std::vector<float> blockDepth; // Farthest depth in each BLOCK_SIZE square, row by row
+	glm::mat4 viewProjection;      // Column vector convention
+
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<u32>> bins; // Triangles touching each tile
+	std::vector<glm::vec4> clipScratch; // Occluder vertices in clip space
+
+	void AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	void RasterizeTile(u32 tile);
+
+public:
+	// Width and height are rounded up to whole tiles
+	OcclusionBuffer(u32 bufferWidth = 256, u32 bufferHeight = 128);
+
+	// Starts a frame seen through column vector view and projection matrices
+	void Begin(const glm::mat4& view, const glm::mat4& projection);
+	// Transforms an occluder's triangles to the screen, clipping them against the near plane, and bins them into tiles
+	void AddOccluder(const OccluderMesh& occluder, const affine& world);
+	// Clears and rasterizes every tile, one job per tile when given a pool
+	void Rasterize(WorkerPool* pool = nullptr);
+
+	// Whether any part of a world space box could be seen past the occluders ; boxes reaching behind the camera or off
+	// screen always pass, frustum culling deals with those
+	bool IsBoxVisible(const glm::vec3& center, const glm::vec3& extents) const;
+
+	// Writes the depth buffer as a binary PGM image, near in white and the far plane in black
+	bool DumpDepth(const char* path) const;
+
+	inline u32 GetWidth() const                  { return width; }
+	inline u32 GetHeight() const                 { return height; }
+	inline float GetDepth(u32 x, u32 y) const    { return depth[y * width + x]; }
+	inline u64 GetTriangleCount() const          { return triangles.size(); }
+};
+
+#endif
@@ -6,7 +6,9 @@
 Texture2D res : register(t0);
 Texture2D normalMap : register(t1);
 TextureCube Sky	: register(t2);
+Texture2DArray ShadowMap : register(t3); // One slice per cascade
 SamplerState state  : register(s0);
+SamplerComparisonState ShadowSampler : register(s1);
 
 struct VertexToPixel
 {
@@ -43,11 +45,51 @@ cbuffer PixelBuff : register(b0)
 {
 	DirectionalLight DLight;
 	DirectionalLight DLight2;
-	PointLight PLight;
-	PointLight PLight2;
 	float3 cameraPos;
 };
 
+// Point lights sorted into clusters over the view on the CPU (see LightClusters)
+StructuredBuffer<PointLight> PointLights : register(t4);
+StructuredBuffer<uint2> LightClusterRanges : register(t5); // Offset and count into LightIndices, per cluster
+StructuredBuffer<uint> LightIndices : register(t6);
+
+cbuffer ClusterBuff : register(b2)
+{
+	uint2 clusterTiles;      // Across and down
+	uint clusterTileSize;    // In pixels
+	uint clusterSlices;
+	float clusterSliceScale; // Slice of view depth d is floor(log(d) * scale + bias)
+	float clusterSliceBias;
+};
+
+cbuffer ShadowBuff : register(b1)
+{
+	matrix cascadeViewProjection[4];
+	float4 cascadeSplits;    // View depth up to which each cascade is used
+	float4 cameraDepthPlane; // View depth of a world position is dot(xyz, position) + w ; clustered lights use it too
+	int cascadeCount;        // 0 when shadows are off
+};
+
+// How much of DLight reaches a world position, from the cascade covering its view depth
+float ShadowFactor(float3 worldPos)
+{
+	if (cascadeCount == 0)
+		return 1.0f;
+
+	float depth = dot(cameraDepthPlane.xyz, worldPos) + cameraDepthPlane.w;
+	if (depth > cascadeSplits[cascadeCount - 1])
+		return 1.0f;
+
+	int cascade = 0;
+	[unroll]
+	for (int i = 0; i < 3; i++)
+		cascade += (i < cascadeCount - 1 && depth > cascadeSplits[i]) ? 1 : 0;
+
+	float4 lightPos = mul(float4(worldPos, 1.0f), cascadeViewProjection[cascade]);
+	float2 shadowUV = lightPos.xy * float2(0.5f, -0.5f) + 0.5f;
+	return ShadowMap.SampleCmpLevelZero(ShadowSampler, float3(shadowUV, cascade), lightPos.z);
+}
+
 // Range-based attenuation function
 float Attenuate(PointLight light, float3 worldPos)
 {
@@ -60,7 +102,7 @@ float Attenuate(PointLight light, float3 worldPos)
 	return att * att;
 }
 
-float4 DirectLightLambert(VertexToPixel input, DirectionalLight lightType) {
+float4 DirectLightLambert(VertexToPixel input, DirectionalLight lightType, float shadow) {
 	float3 nDir = -normalize(lightType.Direction);
 
 	float NdotL = dot(input.normal, nDir);
@@ -73,10 +115,10 @@ float4 DirectLightLambert(VertexToPixel input, DirectionalLight lightType) {
 	if (textureColor.a < 0.2f)
 		discard;
 
-	return (lightType.AmbientColor + (lightType.DiffuseColor * NdotL)) * textureColor;
+	return (lightType.AmbientColor + (lightType.DiffuseColor * NdotL * shadow)) * textureColor;
 }
 
-float4 DirectLightPhong(VertexToPixel input, DirectionalLight lightType) {
+float4 DirectLightPhong(VertexToPixel input, DirectionalLight lightType, float shadow) {
 	float3 dirToCamera = normalize(cameraPos - input.worldPos);
 
 	float3 nDir = -normalize(lightType.Direction);
@@ -97,7 +139,7 @@ float4 DirectLightPhong(VertexToPixel input, DirectionalLight lightType) {
 	if (textureColor.a < 0.2f)
 		discard;
 
-	return (lightType.AmbientColor + (lightType.DiffuseColor * NdotL) + specular.rrrr) * textureColor;
+	return (lightType.AmbientColor + (lightType.DiffuseColor * NdotL + specular.rrrr) * shadow) * textureColor;
 }
 
 float4 PointLightLambert(VertexToPixel input, PointLight lightType) {
@@ -149,6 +191,26 @@ float4 PointLightPhong(VertexToPixel input, PointLight lightType) {
 	return float4((lightType.AmbientColor * textureColor.rgb) + (lightType.DiffuseColor * NdotL* textureColor.rgb) + specular, textureColor.a) * atten;
 }
 
+// Diffuse light from every point light reaching the pixel's cluster
+float3 ClusteredPointLights(VertexToPixel input)
+{
+	float depth = dot(cameraDepthPlane.xyz, input.worldPos) + cameraDepthPlane.w;
+	uint2 tile = min(uint2(input.position.xy) / clusterTileSize, clusterTiles - 1);
+	uint slice = (uint)clamp(floor(log(max(depth, 0.0001f)) * clusterSliceScale + clusterSliceBias), 0.0f, (float)(clusterSlices - 1));
+	uint2 range = LightClusterRanges[(slice * clusterTiles.y + tile.y) * clusterTiles.x + tile.x];
+
+	float3 total = float3(0, 0, 0);
+	for (uint i = 0; i < range.y; i++)
+	{
+		PointLight light = PointLights[LightIndices[range.x + i]];
+
+		float3 dirToLight = normalize(light.Position - input.worldPos);
+		float NdotL = saturate(dot(input.normal, dirToLight));
+		total += (light.AmbientColor.rgb + light.DiffuseColor.rgb * NdotL) * Attenuate(light, input.worldPos);
+	}
+	return total;
+}
+
 float4 main(VertexToPixel input) : SV_TARGET
 {
 	input.normal = normalize(input.normal);
@@ -165,11 +227,14 @@ float4 main(VertexToPixel input) : SV_TARGET
 	input.normal = normalize(mul(unpackedNormal, TBN));
 	///
 
+	// Only DLight casts shadows
+	float shadow = ShadowFactor(input.worldPos);
+
 	// Directional light calculations for both Lambert and Phong shading
-	//return (DirectLightLambert(input, DLight) + DirectLightLambert(input, DLight2));
-	return (DirectLightPhong(input, DLight) + DirectLightPhong(input, DLight2));
+	//float4 color = DirectLightLambert(input, DLight, shadow) + DirectLightLambert(input, DLight2, 1.0f);
+	float4 color = DirectLightPhong(input, DLight, shadow) + DirectLightPhong(input, DLight2, 1.0f);
 
-	// Point light calculations for both Lambert and Phong shading
-	//return (PointLightLambert(input, PLight) + PointLightLambert(input, PLight2));
-	//return (PointLightPhong(input, PLight) + PointLightPhong(input, PLight2));
+	// Point lights, however many reach this pixel's cluster
+	color.rgb += ClusteredPointLights(input) * res.Sample(state, input.uv).rgb;
+	return color;
 }
\ No newline at end of file
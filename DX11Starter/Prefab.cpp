@@ -0,0 +1,103 @@
+#include "Prefab.h"
+
+const u32 Prefab::INVALID;
+
+Prefab::Prefab() :
+	nodes(),
+	meshes(),
+	materials(),
+	positions(),
+	rotations(),
+	scales(),
+	parents(),
+	tagStarts(),
+	tags(),
+	compiled(false)
+{
+	// Nothing interesting to do here
+}
+
+Prefab::~Prefab()
+{
+	// Nothing interesting to do here
+}
+
+u32 Prefab::AddNode(Mesh* mesh, Material* mat, const Transform& local, u32 parent)
+{
+	// Exactly one root, and parents always before their children
+	if ((nodes.size() == 0) != (parent == INVALID)) { return INVALID; }
+	if (parent != INVALID && parent >= nodes.size()) { return INVALID; }
+
+	Node node;
+	node.mesh = mesh;
+	node.material = mat;
+	node.local = local;
+	node.parent = parent;
+	nodes.push_back(node);
+
+	compiled = false;
+	return (u32)nodes.size() - 1;
+}
+
+void Prefab::AddTag(u32 node, TagID tag)
+{
+	nodes[node].tags.push_back(tag);
+	compiled = false;
+}
+
+void Prefab::Compile()
+{
+	u32 count = (u32)nodes.size();
+
+	// Parents precede their children, so depths can be worked out in one forward pass
+	std::vector<u32> depths(count, 0);
+	u32 maxDepth = 0;
+	for (u32 i = 1; i < count; ++i)
+	{
+		depths[i] = depths[nodes[i].parent] + 1;
+		if (depths[i] > maxDepth) { maxDepth = depths[i]; }
+	}
+
+	// Stable counting sort by depth
+	std::vector<u32> levelStarts(maxDepth + 2, 0);
+	for (u32 i = 0; i < count; ++i) { ++levelStarts[depths[i] + 1]; }
+	for (u32 d = 1; d < levelStarts.size(); ++d) { levelStarts[d] += levelStarts[d - 1]; }
+
+	std::vector<u32> remap(count);
+	for (u32 i = 0; i < count; ++i) { remap[i] = levelStarts[depths[i]]++; }
+
+	meshes.resize(count);
+	materials.resize(count);
+	positions.resize(count);
+	rotations.resize(count);
+	scales.resize(count);
+	parents.resize(count);
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		const Node& node = nodes[i];
+		u32 c = remap[i];
+
+		meshes[c] = node.mesh;
+		materials[c] = node.material;
+		positions[c] = node.local.GetPosition();
+		rotations[c] = node.local.GetRotation();
+		scales[c] = node.local.GetScale();
+		parents[c] = (node.parent == INVALID) ? INVALID : remap[node.parent];
+	}
+
+	// Tags in compiled order
+	std::vector<u32> order(count);
+	for (u32 i = 0; i < count; ++i) { order[remap[i]] = i; }
+
+	tagStarts.assign(1, 0);
+	tags.clear();
+	for (u32 c = 0; c < count; ++c)
+	{
+		const std::vector<TagID>& nodeTags = nodes[order[c]].tags;
+		tags.insert(tags.end(), nodeTags.begin(), nodeTags.end());
+		tagStarts.push_back((u32)tags.size());
+	}
+
+	compiled = true;
+}
@@ -0,0 +1,75 @@
+#ifndef PREFAB_H_
+#define PREFAB_H_
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <vector>
+
+#include "Types.h"
+#include "Transform.h"
+#include "Tags.h"
+
+class Mesh;
+class Material;
+
+// Description of an entity subtree that can be instantiated many times over with Scene::SpawnBatch
+//
+// Built up node by node, then compiled into flat arrays ordered by depth, so that a batch of instances can
+// be laid out one whole level at a time and copied into the scene's storage in blocks.
+class Prefab
+{
+public:
+	static const u32 INVALID = 0xFFFFFFFF;
+
+private:
+	struct Node
+	{
+		Mesh* mesh;
+		Material* material;
+		Transform local;
+		u32 parent;
+		std::vector<TagID> tags;
+	};
+
+	std::vector<Node> nodes; // In the order they were added ; node 0 is always the root
+
+	// Compiled form, indexed by depth-sorted node order
+	std::vector<Mesh*> meshes;
+	std::vector<Material*> materials;
+	std::vector<vec3> positions;
+	std::vector<quat> rotations;
+	std::vector<vec3> scales;
+	std::vector<u32> parents;   // Compiled index of each node's parent (INVALID for the root)
+	std::vector<u32> tagStarts; // Range of each node's tags within tags, plus one past the end
+	std::vector<TagID> tags;
+	bool compiled;
+
+public:
+	Prefab();
+	~Prefab();
+
+	// Adds a node under an earlier one, returning its index (INVALID if the parent doesn't exist)
+	//  - The first node added is the root and must have no parent, every later one must have one
+	u32 AddNode(Mesh* mesh, Material* mat, const Transform& local = Transform(), u32 parent = INVALID);
+	void AddTag(u32 node, TagID tag);
+
+	// Must be called after the last change and before spawning
+	void Compile();
+
+	inline bool IsCompiled() const  { return compiled; }
+	inline u32 GetNodeCount() const { return (u32)parents.size(); }
+
+	// <COMPILED DATA>
+	inline Mesh* const*     GetMeshes() const    { return meshes.data(); }
+	inline Material* const* GetMaterials() const { return materials.data(); }
+	inline const vec3*      GetPositions() const { return positions.data(); }
+	inline const quat*      GetRotations() const { return rotations.data(); }
+	inline const vec3*      GetScales() const    { return scales.data(); }
+	inline const u32*       GetParents() const   { return parents.data(); }
+	inline const TagID*     GetTags(u32 node, u32& count) const { count = tagStarts[node + 1] - tagStarts[node]; return tags.data() + tagStarts[node]; }
+	// </COMPILED DATA>
+};
+
+#endif
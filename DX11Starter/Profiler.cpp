@@ -0,0 +1,309 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	typedef std::chrono::steady_clock CalibrationClock;
+
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<Profiler::ThreadBuffer>> registry;
+
+	// Timestamp counter and wall clock read together once, so a dump can convert ticks to time
+	u64 calibrationTicks = 0;
+	CalibrationClock::time_point calibrationTime;
+
+	struct ThreadEvents
+	{
+		const Profiler::ThreadBuffer* buffer;
+		std::vector<Profiler::ZoneEvent> events; // In the order the zones ended
+	};
+
+	struct ZoneStats
+	{
+		const char* name;
+		std::vector<double> durations; // Microseconds
+		double total;
+		double self;
+	};
+
+	// Copies out what every ring still holds. Slots the owning thread may have overwritten while they were being
+	// copied are dropped, everything else is a consistent event.
+	std::vector<ThreadEvents> Snapshot()
+	{
+		std::vector<ThreadEvents> threads;
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const std::unique_ptr<Profiler::ThreadBuffer>& buffer : registry)
+		{
+			ThreadEvents thread;
+			thread.buffer = buffer.get();
+
+			u64 end = buffer->head.load(std::memory_order_acquire);
+			u64 begin = end > Profiler::ZONE_CAPACITY ? end - Profiler::ZONE_CAPACITY : 0;
+			thread.events.reserve((size_t)(end - begin));
+			for (u64 i = begin; i < end; ++i) { thread.events.push_back(buffer->events[i & (Profiler::ZONE_CAPACITY - 1)]); }
+
+			u64 headAfter = buffer->head.load(std::memory_order_acquire);
+			u64 overwritten = headAfter > Profiler::ZONE_CAPACITY ? headAfter - Profiler::ZONE_CAPACITY : 0;
+			if (overwritten > begin)
+			{
+				u64 drop = std::min(overwritten - begin, (u64)thread.events.size());
+				thread.events.erase(thread.events.begin(), thread.events.begin() + (size_t)drop);
+			}
+
+			threads.push_back(std::move(thread));
+		}
+
+		return threads;
+	}
+
+	double Percentile(const std::vector<double>& sorted, double p)
+	{
+		size_t index = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+		return sorted[index];
+	}
+
+	FILE* OpenForWriting(const char* path)
+	{
+#ifdef _MSC_VER
+		FILE* file = nullptr;
+		return fopen_s(&file, path, "w") == 0 ? file : nullptr;
+#else
+		return fopen(path, "w");
+#endif
+	}
+
+	void WriteJSONString(FILE* file, const char* s)
+	{
+		fputc('"', file);
+		for (; *s != 0; ++s)
+		{
+			if (*s == '"' || *s == '\\') { fputc('\\', file); }
+			fputc(*s, file);
+		}
+		fputc('"', file);
+	}
+}
+
+const u32 Profiler::ZONE_CAPACITY;
+const u32 Profiler::FRAME_CAPACITY;
+const u32 Profiler::MAX_DEPTH;
+
+thread_local Profiler::ThreadBuffer* Profiler::threadBuffer = nullptr;
+u64 Profiler::frames[FRAME_CAPACITY];
+std::atomic<u64> Profiler::frameHead(0);
+
+Profiler::ThreadBuffer* Profiler::RegisterThread()
+{
+	std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+	buffer->head.store(0, std::memory_order_relaxed);
+	buffer->depth = 0;
+	buffer->threadName = nullptr;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	if (registry.empty())
+	{
+		calibrationTime = CalibrationClock::now();
+		calibrationTicks = ReadTimestamp();
+	}
+
+	buffer->threadIndex = (u32)registry.size();
+	threadBuffer = buffer.get();
+	registry.push_back(std::move(buffer));
+	return threadBuffer;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+
+	// Dump() reads names from other threads
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer->threadName = name;
+}
+
+void Profiler::MarkFrame()
+{
+	// Also makes sure calibration has started before the first frame
+	GetThreadBuffer();
+
+	u64 index = frameHead.load(std::memory_order_relaxed);
+	frames[index & (FRAME_CAPACITY - 1)] = ReadTimestamp();
+	frameHead.store(index + 1, std::memory_order_release);
+}
+
+bool Profiler::Dump(const char* tracePath, const char* statsPath)
+{
+	std::vector<ThreadEvents> threads = Snapshot();
+
+	u64 frameEnd = frameHead.load(std::memory_order_acquire);
+	u64 frameBegin = frameEnd > FRAME_CAPACITY ? frameEnd - FRAME_CAPACITY : 0;
+	std::vector<u64> frameMarks;
+	for (u64 i = frameBegin; i < frameEnd; ++i) { frameMarks.push_back(frames[i & (FRAME_CAPACITY - 1)]); }
+
+	// Tick rate measured over everything since the first registration, long enough to be accurate
+	u64 ticks;
+	double seconds;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		do
+		{
+			ticks = ReadTimestamp() - calibrationTicks;
+			seconds = std::chrono::duration<double>(CalibrationClock::now() - calibrationTime).count();
+		} while (seconds < 0.01);
+	}
+	double microsecondsPerTick = seconds * 1000000.0 / (double)ticks;
+
+	u64 origin = ~(u64)0;
+	u64 last = 0;
+	for (const ThreadEvents& thread : threads)
+	{
+		for (const ZoneEvent& e : thread.events)
+		{
+			origin = std::min(origin, e.start);
+			last = std::max(last, e.end);
+		}
+	}
+	for (u64 mark : frameMarks) { origin = std::min(origin, mark); }
+	if (origin == ~(u64)0) { origin = 0; }
+
+	bool succeeded = true;
+
+	if (tracePath != nullptr)
+	{
+		FILE* file = OpenForWriting(tracePath);
+		if (file == nullptr)
+		{
+			succeeded = false;
+		}
+		else
+		{
+			fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+			bool first = true;
+
+			for (const ThreadEvents& thread : threads)
+			{
+				if (thread.buffer->threadName == nullptr) { continue; }
+				fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread.buffer->threadIndex);
+				WriteJSONString(file, thread.buffer->threadName);
+				fprintf(file, "}}");
+				first = false;
+			}
+
+			for (size_t f = 0; f < frameMarks.size(); ++f)
+			{
+				fprintf(file, "%s{\"name\":\"Frame %llu\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+					first ? "" : ",\n", (unsigned long long)(frameBegin + f), (double)(frameMarks[f] - origin) * microsecondsPerTick);
+				first = false;
+			}
+
+			for (const ThreadEvents& thread : threads)
+			{
+				for (const ZoneEvent& e : thread.events)
+				{
+					fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+					WriteJSONString(file, e.name);
+					fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+						thread.buffer->threadIndex, (double)(e.start - origin) * microsecondsPerTick, (double)(e.end - e.start) * microsecondsPerTick);
+					first = false;
+				}
+			}
+
+			fprintf(file, "\n]}\n");
+			succeeded = fclose(file) == 0 && succeeded;
+		}
+	}
+
+	if (statsPath != nullptr)
+	{
+		std::vector<ZoneStats> zones;
+		std::unordered_map<std::string, size_t> zoneIndices;
+
+		for (const ThreadEvents& thread : threads)
+		{
+			// Children always end before their parent, so each zone's children are summed by the time it ends
+			double childTime[MAX_DEPTH + 1] = {};
+
+			for (const ZoneEvent& e : thread.events)
+			{
+				auto found = zoneIndices.find(e.name);
+				if (found == zoneIndices.end())
+				{
+					found = zoneIndices.emplace(e.name, zones.size()).first;
+					ZoneStats stats = { e.name, std::vector<double>(), 0.0, 0.0 };
+					zones.push_back(stats);
+				}
+				ZoneStats& stats = zones[found->second];
+
+				double duration = (double)(e.end - e.start) * microsecondsPerTick;
+				double self = duration;
+				if (e.depth < MAX_DEPTH)
+				{
+					self -= childTime[e.depth + 1];
+					childTime[e.depth + 1] = 0.0;
+					childTime[e.depth] += duration;
+				}
+
+				stats.durations.push_back(duration);
+				stats.total += duration;
+				stats.self += self;
+			}
+		}
+
+		std::sort(zones.begin(), zones.end(), [](const ZoneStats& a, const ZoneStats& b) { return a.total > b.total; });
+
+		// Frames that fall inside the recorded window, to turn call counts into calls per frame
+		u32 frameCount = 0;
+		std::vector<double> frameTimes;
+		for (size_t f = 0; f < frameMarks.size(); ++f)
+		{
+			if (frameMarks[f] < origin || frameMarks[f] > last) { continue; }
+			frameCount++;
+			if (f + 1 < frameMarks.size()) { frameTimes.push_back((double)(frameMarks[f + 1] - frameMarks[f]) * microsecondsPerTick); }
+		}
+
+		FILE* file = OpenForWriting(statsPath);
+		if (file == nullptr)
+		{
+			succeeded = false;
+		}
+		else
+		{
+			fprintf(file, "Times in microseconds, over the last %u frames recorded\n\n", frameCount);
+			fprintf(file, "%-40s %10s %10s %12s %12s %10s %10s %10s %10s %10s\n",
+				"Zone", "Calls", "Per frame", "Total", "Self", "Mean", "p50", "p90", "p99", "Max");
+
+			if (!frameTimes.empty())
+			{
+				std::sort(frameTimes.begin(), frameTimes.end());
+				double total = 0.0;
+				for (double t : frameTimes) { total += t; }
+				fprintf(file, "%-40s %10u %10s %12.1f %12s %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+					"(Frame)", (u32)frameTimes.size(), "", total, "", total / (double)frameTimes.size(),
+					Percentile(frameTimes, 0.5), Percentile(frameTimes, 0.9), Percentile(frameTimes, 0.99), frameTimes.back());
+			}
+
+			for (ZoneStats& stats : zones)
+			{
+				std::sort(stats.durations.begin(), stats.durations.end());
+				u32 calls = (u32)stats.durations.size();
+				fprintf(file, "%-40.40s %10u %10.1f %12.1f %12.1f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+					stats.name, calls, frameCount > 0 ? (double)calls / (double)frameCount : 0.0, stats.total, stats.self,
+					stats.total / (double)calls, Percentile(stats.durations, 0.5), Percentile(stats.durations, 0.9),
+					Percentile(stats.durations, 0.99), stats.durations.back());
+			}
+
+			succeeded = fclose(file) == 0 && succeeded;
+		}
+	}
+
+	return succeeded;
+}
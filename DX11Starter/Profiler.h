@@ -0,0 +1,137 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "Types.h"
+
+// Zones are compiled in for debug builds only ; define PROFILER_ENABLED as 1 or 0 to override that
+#ifndef PROFILER_ENABLED
+#if defined(DEBUG) || defined(_DEBUG)
+#define PROFILER_ENABLED 1
+#else
+#define PROFILER_ENABLED 0
+#endif
+#endif
+
+// Hierarchical CPU profiler
+//
+// Every thread records its zones into its own ring buffer, so recording a zone never takes a lock : it is two
+// timestamp reads and one slot write. A ring keeps the most recent ZONE_CAPACITY zones of its thread.
+// DXCore marks frame boundaries. Dump() writes a Chrome trace (open it in chrome://tracing or ui.perfetto.dev)
+// and per zone statistics : call counts, total and self time, and duration percentiles.
+class Profiler
+{
+public:
+	static const u32 ZONE_CAPACITY = 1 << 15;
+	static const u32 FRAME_CAPACITY = 1 << 12;
+	// Deeper zones are still recorded, but their self time is not split from their children's
+	static const u32 MAX_DEPTH = 64;
+
+	struct ZoneEvent
+	{
+		u64 start;
+		u64 end;
+		const char* name;
+		u32 depth;
+	};
+
+	// Single writer (the owning thread) ; readers copy it out while it is being written, see Snapshot()
+	struct ThreadBuffer
+	{
+		ZoneEvent events[ZONE_CAPACITY];
+		std::atomic<u64> head;
+		u32 depth;
+		u32 threadIndex;
+		const char* threadName;
+
+		inline void Push(u64 start, u64 end, const char* name, u32 zoneDepth)
+		{
+			u64 index = head.load(std::memory_order_relaxed);
+			ZoneEvent& e = events[index & (ZONE_CAPACITY - 1)];
+			e.start = start;
+			e.end = end;
+			e.name = name;
+			e.depth = zoneDepth;
+			head.store(index + 1, std::memory_order_release);
+		}
+	};
+
+	// Records the time between its construction and destruction as a zone of the calling thread
+	// The thread's buffer and the zone's depth are kept from construction, so closing the zone only has to write
+	class Zone
+	{
+	private:
+		ThreadBuffer* buffer;
+		const char* name;
+		u64 start;
+		u32 depth;
+
+	public:
+		inline Zone(const char* zoneName) :
+			buffer(GetThreadBuffer()),
+			name(zoneName),
+			depth(buffer->depth++)
+		{
+			start = ReadTimestamp();
+		}
+
+		inline ~Zone()
+		{
+			u64 end = ReadTimestamp();
+			buffer->depth = depth;
+			buffer->Push(start, end, name, depth);
+		}
+
+		Zone(const Zone&) = delete;
+		Zone& operator= (const Zone&) = delete;
+	};
+
+	inline static u64 ReadTimestamp() { return __rdtsc(); }
+
+	inline static ThreadBuffer* GetThreadBuffer()
+	{
+		ThreadBuffer* buffer = threadBuffer;
+		return buffer != nullptr ? buffer : RegisterThread();
+	}
+
+	// Names the calling thread in traces ; name must outlive the profiler (a string literal)
+	static void SetThreadName(const char* name);
+	// Called once per frame, at its start
+	static void MarkFrame();
+
+	// Returns false if a file could not be written ; either path may be null to skip that output
+	static bool Dump(const char* tracePath, const char* statsPath);
+
+private:
+	static thread_local ThreadBuffer* threadBuffer;
+
+	static u64 frames[FRAME_CAPACITY];
+	static std::atomic<u64> frameHead;
+
+	static ThreadBuffer* RegisterThread();
+};
+
+#if PROFILER_ENABLED
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILER_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_FRAME() Profiler::MarkFrame()
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+#define PROFILE_DUMP(tracePath, statsPath) Profiler::Dump(tracePath, statsPath)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_FRAME()
+#define PROFILE_THREAD(name)
+#define PROFILE_DUMP(tracePath, statsPath)
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef RENDER_DEVICE_H_
+#define RENDER_DEVICE_H_
+
+#include "Types.h"
+#include "ShaderHandles.h"
+
+class SimpleVertexShader;
+class SimplePixelShader;
+
+// GPU objects are opaque to everything but the device that made them, which decides what the pointers really are
+struct GPUBuffer;
+struct GPUTextureView;
+struct GPUSampler;
+
+enum BufferUsage : u08
+{
+	BUFFER_IMMUTABLE = 0, // Contents given at creation, never changed
+	BUFFER_DYNAMIC   = 1  // Contents replaced wholesale through UpdateBuffer
+};
+
+enum BufferBinding : u08
+{
+	BIND_VERTEX_BUFFER   = 1 << 0,
+	BIND_INDEX_BUFFER    = 1 << 1,
+	BIND_SHADER_RESOURCE = 1 << 2  // Structured, elementStride bytes an element
+};
+
+struct BufferDesc
+{
+	u32 size;          // Bytes
+	u32 elementStride; // Only used by shader resources
+	BufferUsage usage;
+	u08 bindings;      // BufferBinding flags
+};
+
+// Everything the per-frame renderer asks of the GPU
+//
+// D3D11RenderDevice forwards to a live device and context, NullRenderDevice only records what it is asked
+// so frames can be profiled and checked headless. Shaders are only ever passed through, and the null device
+// never dereferences them, so any distinct pointers (or nullptr) work there. Nothing here needs the D3D11
+// headers, so the renderer's CPU side builds on any platform.
+class RenderDevice
+{
+public:
+	virtual ~RenderDevice() { }
+
+	// <RESOURCES>
+
+	// initialData may be null, e.g. for dynamic buffers filled later
+	virtual GPUBuffer* CreateBuffer(const BufferDesc& desc, const void* initialData) = 0;
+	virtual void ReleaseBuffer(GPUBuffer* buffer) = 0;
+	// Replaces the whole contents of a dynamic buffer
+	virtual void UpdateBuffer(GPUBuffer* buffer, const void* data, u32 size) = 0;
+
+	// </RESOURCES>
+
+	// <PIPELINE STATE>
+
+	virtual void SetVertexBuffer(u32 slot, GPUBuffer* buffer, u32 stride) = 0;
+	// Indices are always 32 bit
+	virtual void SetIndexBuffer(GPUBuffer* buffer) = 0;
+
+	// Variables and resources are looked up once, then set through their handles. The lookups go through
+	// the device too, since the null device has no real shaders to ask. Shaders are only forward declared
+	// here, so each stage is named rather than passed as their common base.
+	virtual ShaderVarHandle GetVariableHandle(SimpleVertexShader* vs, const char* name) = 0;
+	virtual ShaderResourceHandle GetShaderResourceHandle(SimplePixelShader* ps, const char* name) = 0;
+	virtual ShaderResourceHandle GetSamplerHandle(SimplePixelShader* ps, const char* name) = 0;
+	// Whether vs reads its world matrix from WORLD_PER_INSTANCE inputs rather than a constant buffer
+	virtual bool IsPerInstanceCompatible(SimpleVertexShader* vs) = 0;
+
+	virtual void SetShaders(SimpleVertexShader* vs, SimplePixelShader* ps) = 0;
+	virtual void SetMatrix(SimpleVertexShader* vs, const ShaderVarHandle& variable, const float data[16]) = 0;
+	virtual void SetShaderResource(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUTextureView* view) = 0;
+	virtual void SetSampler(SimplePixelShader* ps, const ShaderResourceHandle& resource, GPUSampler* sampler) = 0;
+	// Uploads whatever shader variables were set since the last copy
+	virtual void CopyConstants(SimpleVertexShader* vs) = 0;
+	virtual void CopyConstants(SimplePixelShader* ps) = 0;
+
+	// </PIPELINE STATE>
+
+	virtual void DrawIndexed(u32 indexCount) = 0;
+	virtual void DrawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 firstInstance) = 0;
+};
+
+#endif
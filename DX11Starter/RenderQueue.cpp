@@ -0,0 +1,331 @@
+#include "RenderQueue.h"
+#include "Profiler.h"
+
+#include <cstring>
+
+namespace
+{
+	const u32 SHADER_BITS = 12;
+	const u64 SHADER_MASK = (1ull << SHADER_BITS) - 1;
+}
+
+RenderQueue::RenderQueue(RenderDevice* device) :
+	packets(),
+	scratch(),
+	items(),
+	batches(),
+	instances(),
+	materialIDs(),
+	meshIDs(),
+	shaderVS(),
+	shaderPS(),
+	shaderHandles(),
+	instancedShaders(),
+	renderDevice(device),
+	instanceBuffer(nullptr),
+	instanceCapacity(0),
+	view(),
+	nearPlane(0.0f),
+	depthScale(0.0f),
+	stats()
+{
+	// Nothing interesting to do here
+}
+
+RenderQueue::~RenderQueue()
+{
+	if (instanceBuffer != nullptr) { renderDevice->ReleaseBuffer(instanceBuffer); }
+}
+
+bool RenderQueue::SetInstancedShader(SimpleVertexShader* vs, SimpleVertexShader* instanced)
+{
+	// Otherwise every instance of a batch would be drawn with whatever world matrix the constant buffer holds
+	if (!renderDevice->IsPerInstanceCompatible(instanced)) { return false; }
+
+	InstancedShader shader;
+	shader.from = vs;
+	shader.to = instanced;
+	shader.view = renderDevice->GetVariableHandle(instanced, "view");
+	shader.projection = renderDevice->GetVariableHandle(instanced, "projection");
+	instancedShaders.push_back(shader);
+	return true;
+}
+
+const RenderQueue::InstancedShader* RenderQueue::GetInstancedShader(SimpleVertexShader* vs)
+{
+	for (u64 i = 0; i < instancedShaders.size(); ++i)
+	{
+		if (instancedShaders[i].from == vs) { return &instancedShaders[i]; }
+	}
+	return nullptr;
+}
+
+u64 RenderQueue::MakeKey(u08 pass, u16 shaderID, u16 materialID, u16 meshID, u16 depth)
+{
+	u64 state = ((u64)(shaderID & SHADER_MASK) << 32) | ((u64)materialID << 16) | meshID;
+
+	if (pass == PASS_TRANSPARENT)
+	{
+		return ((u64)pass << 60) | ((u64)(u16)~depth << 44) | state;
+	}
+
+	return ((u64)pass << 60) | (state << 16) | depth;
+}
+
+const RenderQueue::MaterialInfo& RenderQueue::GetMaterialInfo(Material* material)
+{
+	std::unordered_map<const Material*, MaterialInfo>::iterator found = materialIDs.find(material);
+	if (found != materialIDs.end()) { return found->second; }
+
+	// Only a handful of shader pairs ever exist, and this only runs once per material
+	SimpleVertexShader* vs = material->GetVertexShader();
+	SimplePixelShader* ps = material->GetPixelShader();
+	u64 shader = 0;
+	while (shader < shaderVS.size() && (shaderVS[shader] != vs || shaderPS[shader] != ps)) { ++shader; }
+	if (shader == shaderVS.size())
+	{
+		shaderVS.push_back(vs);
+		shaderPS.push_back(ps);
+
+		ShaderHandles handles;
+		handles.view = renderDevice->GetVariableHandle(vs, "view");
+		handles.projection = renderDevice->GetVariableHandle(vs, "projection");
+		handles.world = renderDevice->GetVariableHandle(vs, "world");
+		handles.res = renderDevice->GetShaderResourceHandle(ps, "res");
+		handles.normalMap = renderDevice->GetShaderResourceHandle(ps, "normalMap");
+		handles.state = renderDevice->GetSamplerHandle(ps, "state");
+		shaderHandles.push_back(handles);
+	}
+
+	MaterialInfo info = { (u16)materialIDs.size(), (u16)(shader & SHADER_MASK), (u32)shader };
+	return materialIDs.emplace(material, info).first->second;
+}
+
+u16 RenderQueue::GetMeshID(const Mesh* mesh)
+{
+	std::unordered_map<const Mesh*, u16>::iterator found = meshIDs.find(mesh);
+	if (found != meshIDs.end()) { return found->second; }
+
+	u16 id = (u16)meshIDs.size();
+	meshIDs.emplace(mesh, id);
+	return id;
+}
+
+void RenderQueue::Begin(const glm::mat4& viewMatrix, float nearClip, float farClip)
+{
+	packets.clear();
+	items.clear();
+	batches.clear();
+	instances.clear();
+
+	view = viewMatrix;
+	nearPlane = nearClip;
+	depthScale = 65535.0f / (farClip - nearClip);
+}
+
+void RenderQueue::Submit(u08 pass, Mesh* mesh, Material* material, const affine& world)
+{
+	// Only the third row of the view matrix matters for view space z
+	const glm::vec3& p = world[3];
+	float z = view[0][2] * p.x + view[1][2] * p.y + view[2][2] * p.z + view[3][2];
+	float scaled = (z - nearPlane) * depthScale;
+	u16 depth = (u16)(scaled < 0.0f ? 0.0f : (scaled > 65535.0f ? 65535.0f : scaled));
+
+	const MaterialInfo& info = GetMaterialInfo(material);
+
+	DrawPacket packet;
+	packet.key = MakeKey(pass, info.shaderID, info.id, GetMeshID(mesh), depth);
+	packet.item = items.size();
+	packets.push_back(packet);
+
+	DrawItem item = { mesh, material, world };
+	items.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	PROFILE_FUNCTION();
+
+	u64 count = packets.size();
+	if (count < 2) { return; }
+
+	scratch.resize(count);
+	DrawPacket* source = packets.data();
+	DrawPacket* target = scratch.data();
+
+	// Histograms of every byte at once, so only the scatters need their own pass over the packets
+	u32 histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (u64 i = 0; i < count; ++i)
+	{
+		u64 key = source[i].key;
+		for (u32 b = 0; b < 8; ++b) { ++histograms[b][(key >> (b * 8)) & 0xFF]; }
+	}
+
+	// Least significant byte first ; each scatter is stable, so earlier bytes stay ordered within later ones
+	for (u32 b = 0; b < 8; ++b)
+	{
+		u32 shift = b * 8;
+
+		// Bytes every key agrees on (e.g. unused passes or ids) need no scatter at all
+		if (histograms[b][(source[0].key >> shift) & 0xFF] == count) { continue; }
+
+		u32 offsets[256];
+		u32 sum = 0;
+		for (u32 d = 0; d < 256; ++d)
+		{
+			offsets[d] = sum;
+			sum += histograms[b][d];
+		}
+
+		for (u64 i = 0; i < count; ++i)
+		{
+			target[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+		}
+
+		DrawPacket* swap = source;
+		source = target;
+		target = swap;
+	}
+
+	if (source != packets.data()) { packets.swap(scratch); }
+}
+
+void RenderQueue::BuildBatches()
+{
+	PROFILE_FUNCTION();
+
+	batches.clear();
+	instances.resize(packets.size());
+
+	for (u64 i = 0; i < packets.size(); ++i)
+	{
+		const DrawItem& item = items[packets[i].item];
+		instances[i] = glm::transpose(item.world);
+
+		if (batches.size() != 0)
+		{
+			DrawBatch& last = batches[batches.size() - 1];
+			if (last.mesh == item.mesh && last.material == item.material)
+			{
+				++last.count;
+				continue;
+			}
+		}
+
+		DrawBatch batch = { item.mesh, item.material, (u32)i, 1 };
+		batches.push_back(batch);
+	}
+}
+
+void RenderQueue::UploadInstances()
+{
+	if (instances.size() > instanceCapacity)
+	{
+		if (instanceBuffer != nullptr) { renderDevice->ReleaseBuffer(instanceBuffer); }
+
+		instanceCapacity = glm::max((u32)instances.size(), instanceCapacity * 2);
+
+		BufferDesc desc = {};
+		desc.size = instanceCapacity * sizeof(InstanceData);
+		desc.usage = BUFFER_DYNAMIC;
+		desc.bindings = BIND_VERTEX_BUFFER;
+		instanceBuffer = renderDevice->CreateBuffer(desc, nullptr);
+	}
+
+	renderDevice->UpdateBuffer(instanceBuffer, instances.data(), (u32)(instances.size() * sizeof(InstanceData)));
+	renderDevice->SetVertexBuffer(1, instanceBuffer, sizeof(InstanceData));
+}
+
+void RenderQueue::Execute(const glm::mat4& viewMatrix, const glm::mat4& projMatrix)
+{
+	PROFILE_FUNCTION();
+
+	memset(&stats, 0, sizeof(stats));
+
+	// Shaders take them transposed
+	glm::mat4 shaderView = glm::transpose(viewMatrix);
+	glm::mat4 shaderProjection = glm::transpose(projMatrix);
+
+	if (instances.size() != 0 && instancedShaders.size() != 0) { UploadInstances(); }
+
+	SimpleVertexShader* vs = nullptr;
+	SimpleVertexShader* instancedVS = nullptr;
+	SimplePixelShader* ps = nullptr;
+	const ShaderHandles* handles = nullptr;
+	Material* material = nullptr;
+	Mesh* mesh = nullptr;
+
+	for (u64 b = 0; b < batches.size(); ++b)
+	{
+		const DrawBatch& batch = batches[b];
+
+		// Per frame data only has to be set once per shader
+		if (b == 0 || batch.material->GetVertexShader() != vs || batch.material->GetPixelShader() != ps)
+		{
+			vs = batch.material->GetVertexShader();
+			ps = batch.material->GetPixelShader();
+			handles = &shaderHandles[GetMaterialInfo(batch.material).shader];
+
+			const InstancedShader* instanced = GetInstancedShader(vs);
+			instancedVS = (instanced != nullptr) ? instanced->to : nullptr;
+
+			if (instanced != nullptr)
+			{
+				renderDevice->SetMatrix(instancedVS, instanced->view, &shaderView[0][0]);
+				renderDevice->SetMatrix(instancedVS, instanced->projection, &shaderProjection[0][0]);
+				renderDevice->SetShaders(instancedVS, ps);
+			}
+			else
+			{
+				renderDevice->SetMatrix(vs, handles->view, &shaderView[0][0]);
+				renderDevice->SetMatrix(vs, handles->projection, &shaderProjection[0][0]);
+				renderDevice->SetShaders(vs, ps);
+			}
+
+			// Instanced shaders have nothing else in their constant buffers
+			if (instancedVS != nullptr) { renderDevice->CopyConstants(instancedVS); }
+
+			material = nullptr;
+			++stats.shaderChanges;
+		}
+
+		if (b == 0 || batch.material != material)
+		{
+			material = batch.material;
+			renderDevice->SetShaderResource(ps, handles->res, material->GetShaderResourceView());
+			renderDevice->SetShaderResource(ps, handles->normalMap, material->GetNormalResourceView());
+			renderDevice->SetSampler(ps, handles->state, material->GetSamplerState());
+			renderDevice->CopyConstants(ps);
+			++stats.materialChanges;
+		}
+
+		if (b == 0 || batch.mesh != mesh)
+		{
+			mesh = batch.mesh;
+			renderDevice->SetVertexBuffer(0, mesh->GetVertexBuffer(), sizeof(Vertex));
+			renderDevice->SetIndexBuffer(mesh->GetIndexBuffer());
+			++stats.meshChanges;
+		}
+
+		if (instancedVS != nullptr)
+		{
+			renderDevice->DrawIndexedInstanced(mesh->GetIndexCount(), batch.count, batch.first);
+			++stats.draws;
+		}
+		else
+		{
+			// Without an instanced shader the world matrix has to go through the constant buffer every draw
+			for (u32 i = batch.first; i < batch.first + batch.count; ++i)
+			{
+				glm::mat4 world = glm::transpose(AffineToMatrix(items[packets[i].item].world));
+				renderDevice->SetMatrix(vs, handles->world, &world[0][0]);
+				renderDevice->CopyConstants(vs);
+				renderDevice->DrawIndexed(mesh->GetIndexCount());
+				++stats.draws;
+			}
+		}
+
+		stats.instances += batch.count;
+	}
+}
@@ -0,0 +1,158 @@
+#ifndef RENDER_QUEUE_H_
+#define RENDER_QUEUE_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+#include "Affine.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "RenderDevice.h"
+
+// Passes are the most significant part of a sort key, so they execute in this order
+enum RenderPass : u08
+{
+	PASS_OPAQUE      = 0, // Sorted by state, then front to back
+	PASS_TRANSPARENT = 1  // Sorted back to front, then by state
+};
+
+// Collects the draws of a frame, sorts them by a 64-bit key and executes them with as few state changes as possible
+//
+// Opaque key layout, high to low bits : pass (4) | shaders (12) | material (16) | mesh (16) | depth (16)
+// Transparent passes move the (inverted) depth right under the pass, since blending needs the order more than the state
+//
+// Keys only decide the order ; the executor compares the actual resources, so ids wrapping around
+// with very large numbers of materials or meshes cost some extra binds rather than wrong output
+//
+// Sorting leaves draws sharing a mesh and material next to each other, and those runs become batches.
+// Shaders with a registered instanced variant draw each batch with a single instanced call, reading
+// world matrices from a per-frame instance buffer instead of a constant buffer upload per draw
+class RenderQueue
+{
+public:
+	// What the last Execute had to do
+	struct Stats
+	{
+		u32 draws;     // API draw calls
+		u32 instances; // Objects drawn by those calls
+		u32 shaderChanges;
+		u32 materialChanges;
+		u32 meshChanges;
+	};
+
+private:
+	// Only the key and an index get moved around while sorting
+	struct DrawPacket
+	{
+		u64 key;
+		u64 item;
+	};
+
+	struct DrawItem
+	{
+		Mesh* mesh;
+		Material* material;
+		affine world;
+	};
+
+	struct MaterialInfo
+	{
+		u16 id;
+		u16 shaderID; // Masked to the key's shader bits
+		u32 shader;   // Index into shaderVS / shaderPS / shaderHandles
+	};
+
+	// Everything the executor sets on a shader pair, looked up once when the pair is first seen
+	struct ShaderHandles
+	{
+		ShaderVarHandle view;
+		ShaderVarHandle projection;
+		ShaderVarHandle world;
+		ShaderResourceHandle res;
+		ShaderResourceHandle normalMap;
+		ShaderResourceHandle state;
+	};
+
+	// A regular vertex shader and the instanced version to swap in for it
+	struct InstancedShader
+	{
+		SimpleVertexShader* from;
+		SimpleVertexShader* to;
+		ShaderVarHandle view;
+		ShaderVarHandle projection;
+	};
+
+	// Consecutive sorted draws sharing a mesh and material ; first is also its first instance
+	struct DrawBatch
+	{
+		Mesh* mesh;
+		Material* material;
+		u32 first;
+		u32 count;
+	};
+
+	// Rows of a world matrix, matching the WORLD_PER_INSTANCE inputs of instanced vertex shaders
+	typedef glm::mat3x4 InstanceData;
+
+	std::vector<DrawPacket> packets;
+	std::vector<DrawPacket> scratch;
+	std::vector<DrawItem> items;
+	std::vector<DrawBatch> batches;
+	std::vector<InstanceData> instances;
+
+	// Ids handed out on first sight, persistent across frames so the order stays stable
+	std::unordered_map<const Material*, MaterialInfo> materialIDs;
+	std::unordered_map<const Mesh*, u16> meshIDs;
+	std::vector<SimpleVertexShader*> shaderVS;
+	std::vector<SimplePixelShader*> shaderPS;
+	std::vector<ShaderHandles> shaderHandles;
+
+	std::vector<InstancedShader> instancedShaders;
+
+	RenderDevice* renderDevice;
+	GPUBuffer* instanceBuffer;
+	u32 instanceCapacity;
+
+	// View space depth of the current frame
+	glm::mat4 view;
+	float nearPlane;
+	float depthScale;
+
+	Stats stats;
+
+	const MaterialInfo& GetMaterialInfo(Material* material);
+	u16 GetMeshID(const Mesh* mesh);
+	const InstancedShader* GetInstancedShader(SimpleVertexShader* vs);
+	void UploadInstances();
+
+public:
+	// Every draw and instance upload goes to device, which must outlive the queue
+	RenderQueue(RenderDevice* device);
+	~RenderQueue();
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator= (const RenderQueue&) = delete;
+
+	static u64 MakeKey(u08 pass, u16 shaderID, u16 materialID, u16 meshID, u16 depth);
+
+	// Draws with materials using vs are done with instanced instead, which must read its world matrix
+	// from WORLD_PER_INSTANCE rows ; returns false, registering nothing, when it isn't per instance compatible
+	bool SetInstancedShader(SimpleVertexShader* vs, SimpleVertexShader* instanced);
+
+	// Drops last frame's draws ; view is the camera's column vector view matrix
+	void Begin(const glm::mat4& viewMatrix, float nearClip, float farClip);
+	void Submit(u08 pass, Mesh* mesh, Material* material, const affine& world);
+	// Radix sorts the draws by key
+	void Sort();
+	// Groups the sorted draws into batches and packs their world matrices ; no API calls
+	void BuildBatches();
+	void Execute(const glm::mat4& viewMatrix, const glm::mat4& projMatrix);
+
+	inline u64 GetDrawCount() const { return packets.size(); }
+	inline u64 GetBatchCount() const { return batches.size(); }
+	inline u64 GetKey(u64 i) const { return packets[i].key; }
+	inline const Stats& GetStats() const { return stats; }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <atomic>
+
+#include "Types.h"
+
+// Bounded queue between exactly one producer thread and one consumer thread
+//
+// Lock-free : each side only ever writes its own index and reads the other's, so pushing and popping are a
+// couple of atomic loads and one store. CAPACITY must be a power of two.
+template<typename T, u32 CAPACITY>
+class SPSCQueue
+{
+private:
+	// The two sides hammer their own index, so keep them on separate cache lines
+	std::atomic<u32> head; // Next item to pop, written by the consumer
+	u08 headPadding[64 - sizeof(std::atomic<u32>)];
+	std::atomic<u32> tail; // Next slot to push to, written by the producer
+	u08 tailPadding[64 - sizeof(std::atomic<u32>)];
+	T items[CAPACITY];
+
+public:
+	SPSCQueue() : head(0), tail(0) { }
+
+	SPSCQueue(const SPSCQueue&) = delete;
+	SPSCQueue& operator= (const SPSCQueue&) = delete;
+
+	// Producer only ; false when full
+	inline bool Push(const T& item)
+	{
+		u32 t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == CAPACITY) { return false; }
+
+		items[t & (CAPACITY - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only ; false when empty
+	inline bool Pop(T& item)
+	{
+		u32 h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) { return false; }
+
+		item = items[h & (CAPACITY - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+#endif
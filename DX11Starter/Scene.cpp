@@ -1,62 +1,189 @@
 #include "Scene.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <new>
 
 Scene::Scene() :
-	entities(),
+	transforms(),
+	components(),
+	entityChunks(),
+	entityGenerations(),
 	entitiesTop(),
 	entitiesAll(),
-	entityArrayGaps()
+	entityArrayGaps(),
+	commands(),
+	spawnedHandles(),
+	tagIndices(),
+	spatialIndex(),
+	spatialProxies(),
+	queryProxies()
 {
 	// Nothing interesting to do here
-	entities.reserve(1000);
-	entitiesTop.reserve(1000);
-	entitiesAll.reserve(1000);
-	entityArrayGaps.reserve(1000);
+	entityGenerations.reserve(ENTITY_CHUNK_SIZE);
+	entitiesTop.reserve(ENTITY_CHUNK_SIZE);
+	entitiesAll.reserve(ENTITY_CHUNK_SIZE);
+	entityArrayGaps.reserve(ENTITY_CHUNK_SIZE);
+	transforms.Reserve(ENTITY_CHUNK_SIZE);
 }
 
 Scene::~Scene()
 {
-	// Nothing interesting to do here
+	// Entities were constructed in place, so they have to be torn down by hand
+	u64 ec = entitiesAll.size();
+	for (u64 i = 0; i < ec; ++i)
+	{
+		entitiesAll[i]->~Entity();
+	}
+
+	u64 cc = entityChunks.size();
+	for (u64 i = 0; i < cc; ++i)
+	{
+		::operator delete(entityChunks[i]);
+	}
 }
 
-Entity* Scene::SpawnEntity(Mesh* mesh, Material* mat, Entity* parent, const Transform& transform)
+u64 Scene::ClaimEntityIndex()
 {
-	// Index at which the entity will be spawned into the entities array
+	// Index at which the entity will be spawned into the entity storage
 	u64 index;
 
-	// If there is an open spot in the entity array, insert the new entity into it
+	// If there is an open spot in the entity storage, insert the new entity into it
 	if (entityArrayGaps.size() != 0)
 	{
 		index = entityArrayGaps[entityArrayGaps.size() - 1];
 		entityArrayGaps.pop_back();
-		entities[index] = Entity(this, index, entitiesAll.size(), parent == nullptr ? entitiesTop.size() : U64_MAX, mesh, mat, transform, parent);
 	}
-	// Otherwise, add to the end of the array
+	// Otherwise, add to the end of the storage, grabbing a new chunk whenever the last one is full
 	else
 	{
-		index = entities.size();
-		entities.push_back(Entity(this, index, entitiesAll.size(), parent == nullptr ? entitiesTop.size() : U64_MAX, mesh, mat, transform, parent));
+		index = entityGenerations.size();
+		entityGenerations.push_back(1);
+
+		if ((index & ENTITY_CHUNK_MASK) == 0)
+		{
+			entityChunks.push_back(static_cast<Entity*>(::operator new(sizeof(Entity) * ENTITY_CHUNK_SIZE)));
+		}
 	}
 
+	return index;
+}
+
+Entity* Scene::SpawnEntity(Mesh* mesh, Material* mat, Entity* parent, const Transform& transform)
+{
+	u64 index = ClaimEntityIndex();
+
+	Entity* spawned = new (EntityAt(index)) Entity(this, index, entityGenerations[index], entitiesAll.size(), parent == nullptr ? entitiesTop.size() : U64_MAX, mesh, mat, transform, parent);
+
 	// Handle pointer referencing for the new entity
-	Entity* spawned = &(entities[index]);
 	if (parent == nullptr) { entitiesTop.push_back(spawned); }
 	entitiesAll.push_back(spawned);
 
 	return spawned;
 }
 
+u64 Scene::SpawnBatch(const Prefab& prefab, u64 count, const Transform* rootTransforms, EntityHandle* spawnedRoots)
+{
+	if (!prefab.IsCompiled() || prefab.GetNodeCount() == 0 || count == 0) { return 0; }
+
+	u32 nodeCount = prefab.GetNodeCount();
+	u64 total = count * nodeCount;
+
+	// Grow everything once up front
+	entityGenerations.reserve(entityGenerations.size() + total);
+	entitiesAll.reserve(entitiesAll.size() + total);
+	entitiesTop.reserve(entitiesTop.size() + count);
+
+	// Lay the transformations out level by level - node n of instance i lands at n * count + i - so each level of
+	// the whole batch stays contiguous and every parent precedes its children within the block
+	std::vector<vec3> blockPositions(total);
+	std::vector<quat> blockRotations(total);
+	std::vector<vec3> blockScales(total);
+	std::vector<u32> blockParents(total);
+
+	const vec3* positions = prefab.GetPositions();
+	const quat* rotations = prefab.GetRotations();
+	const vec3* scales = prefab.GetScales();
+	const u32* parents = prefab.GetParents();
+
+	for (u32 n = 0; n < nodeCount; ++n)
+	{
+		u64 base = n * count;
+
+		if (n == 0 && rootTransforms != nullptr)
+		{
+			for (u64 i = 0; i < count; ++i)
+			{
+				blockPositions[i] = rootTransforms[i].GetPosition();
+				blockRotations[i] = rootTransforms[i].GetRotation();
+				blockScales[i] = rootTransforms[i].GetScale();
+			}
+		}
+		else
+		{
+			std::fill(blockPositions.begin() + base, blockPositions.begin() + base + count, positions[n]);
+			std::fill(blockRotations.begin() + base, blockRotations.begin() + base + count, rotations[n]);
+			std::fill(blockScales.begin() + base, blockScales.begin() + base + count, scales[n]);
+		}
+
+		u32 parent = parents[n];
+		for (u64 i = 0; i < count; ++i)
+		{
+			blockParents[base + i] = (parent == Prefab::INVALID) ? TransformStore::INVALID : (u32)(parent * count + i);
+		}
+	}
+
+	std::vector<u32> blockSlots(total);
+	transforms.AllocateBlock((u32)total, blockPositions.data(), blockRotations.data(), blockScales.data(), blockParents.data(), blockSlots.data());
+
+	// Construct the entities straight onto their pre-claimed transform slots
+	Mesh* const* meshes = prefab.GetMeshes();
+	Material* const* materials = prefab.GetMaterials();
+
+	for (u64 k = 0; k < total; ++k)
+	{
+		u32 n = (u32)(k / count);
+		bool root = (n == 0);
+
+		u64 index = ClaimEntityIndex();
+		Entity* spawned = new (EntityAt(index)) Entity(this, index, entityGenerations[index], entitiesAll.size(), root ? entitiesTop.size() : U64_MAX, meshes[n], materials[n], blockSlots[k]);
+
+		if (root) { entitiesTop.push_back(spawned); }
+		entitiesAll.push_back(spawned);
+
+		u32 tagCount;
+		const TagID* nodeTags = prefab.GetTags(n, tagCount);
+		for (u32 t = 0; t < tagCount; ++t) { spawned->AddTag(nodeTags[t]); }
+
+		if (root && spawnedRoots != nullptr) { spawnedRoots[k] = spawned->GetHandle(); }
+	}
+
+	return total;
+}
+
 void Scene::DestroyEntity(Entity* entity)
 {
 	// TODO : Something more elegant here
 	if (entity->scene.GetScene() == this)
 	{
-		SceneRef reference = entity->scene;
-
 		// Actual mechanism for allowing the entity to free any references etc.
-		//entity->DestroyInternal();
+		//  - Done first, as destroying children can shuffle this entity's own reference points
+		entity->DestroyInternal();
 
-		// Consider the position of the entity in the array to be an open spot for future spawns
-		entityArrayGaps.push_back(reference.index);
+		// Drop the entity from the index of every tag it carries
+		for (u32 w = 0; w < TagSet::WORD_COUNT; ++w)
+		{
+			u64 word = entity->tags.GetWord(w);
+			for (u32 b = 0; word != 0; ++b, word >>= 1)
+			{
+				if (word & 1) { UnindexTag(entity, (TagID)(w * 64 + b)); }
+			}
+		}
+
+		SceneRef reference = entity->scene;
+
+		RemoveFromSpatialIndex(reference.index);
 
 		// Reclaim the reference points for other entities, to avoid creating gaps in them
 		entitiesAll[reference.sceneID] = entitiesAll[entitiesAll.size() - 1];
@@ -64,11 +191,263 @@ void Scene::DestroyEntity(Entity* entity)
 		entitiesAll.pop_back();
 
 		// Same as before, but only for top-level (parent-less)
-		if (entitiesTop[reference.topID] != U64_MAX)
+		if (reference.topID != U64_MAX)
 		{
 			entitiesTop[reference.topID] = entitiesTop[entitiesTop.size() - 1];
 			entitiesTop[reference.topID]->scene.topID = reference.topID;
 			entitiesTop.pop_back();
 		}
+
+		entity->~Entity();
+
+		// Moving the generation on invalidates every outstanding handle to this entity
+		++entityGenerations[reference.index];
+
+		// Consider the position of the entity in the storage to be an open spot for future spawns
+		entityArrayGaps.push_back(reference.index);
 	}
 }
+
+void Scene::DestroyEntity(EntityHandle handle)
+{
+	Entity* entity = GetEntity(handle);
+	if (entity != nullptr) { DestroyEntity(entity); }
+}
+
+void Scene::IndexTag(Entity* entity, TagID tag)
+{
+	if (tag >= tagIndices.size()) { tagIndices.resize(tag + 1); }
+
+	TagIndex& tagIndex = tagIndices[tag];
+	u64 index = entity->scene.GetIndex();
+	if (index >= tagIndex.positions.size()) { tagIndex.positions.resize(entityGenerations.size(), U32_MAX); }
+
+	tagIndex.positions[index] = (u32)tagIndex.entities.size();
+	tagIndex.entities.push_back(entity);
+}
+
+void Scene::UnindexTag(Entity* entity, TagID tag)
+{
+	TagIndex& tagIndex = tagIndices[tag];
+	u64 index = entity->scene.GetIndex();
+	u32 position = tagIndex.positions[index];
+
+	// Order doesn't matter, so fill the hole with the last entity in the list
+	Entity* last = tagIndex.entities[tagIndex.entities.size() - 1];
+	tagIndex.entities[position] = last;
+	tagIndex.positions[last->scene.GetIndex()] = position;
+	tagIndex.entities.pop_back();
+
+	tagIndex.positions[index] = U32_MAX;
+}
+
+const std::vector<Entity*>& Scene::GetEntitiesWithTag(TagID tag) const
+{
+	static const std::vector<Entity*> noEntities;
+	return (tag < tagIndices.size()) ? tagIndices[tag].entities : noEntities;
+}
+
+Entity* Scene::ResolveTarget(const CommandTarget& target)
+{
+	if (target.spawnIndex != CommandTarget::INVALID) { return GetEntity(spawnedHandles[target.spawnIndex]); }
+	return GetEntity(target.handle);
+}
+
+void Scene::Playback(EntityCommandBuffer& buffer)
+{
+	buffer.BeginPlayback();
+
+	const std::vector<EntityCommandBuffer::Command>& recorded = buffer.playbackCommands;
+	const std::vector<EntityCommandBuffer::SpawnData>& spawns = buffer.playbackSpawns;
+
+	// Grow everything once for the whole batch rather than once per spawn
+	u64 spawnCount = spawns.size();
+	if (spawnCount != 0)
+	{
+		entityGenerations.reserve(entityGenerations.size() + spawnCount);
+		entitiesAll.reserve(entitiesAll.size() + spawnCount);
+		entitiesTop.reserve(entitiesTop.size() + spawnCount);
+		transforms.Reserve(transforms.GetCount() + spawnCount);
+	}
+	spawnedHandles.assign(spawnCount, EntityHandle());
+
+	// Handles rather than pointers throughout, so commands aimed at entities destroyed earlier in the batch just drop out
+	for (u64 i = 0; i < recorded.size(); ++i)
+	{
+		const EntityCommandBuffer::Command& command = recorded[i];
+
+		if (command.type == EntityCommandBuffer::SPAWN)
+		{
+			Entity* parent = nullptr;
+			if (!command.other.IsNull())
+			{
+				// Spawns under a parent that no longer exists are dropped, as children of a destroyed entity would be
+				parent = ResolveTarget(command.other);
+				if (parent == nullptr) { continue; }
+			}
+
+			const EntityCommandBuffer::SpawnData& spawn = spawns[command.target.spawnIndex];
+			spawnedHandles[command.target.spawnIndex] = SpawnEntity(spawn.mesh, spawn.material, parent, spawn.transform)->GetHandle();
+			continue;
+		}
+
+		Entity* entity = ResolveTarget(command.target);
+		if (entity == nullptr) { continue; }
+
+		switch (command.type)
+		{
+		case EntityCommandBuffer::DESTROY:
+			DestroyEntity(entity);
+			break;
+		case EntityCommandBuffer::SET_PARENT:
+		{
+			Entity* parent = command.other.IsNull() ? nullptr : ResolveTarget(command.other);
+			if (parent != nullptr || command.other.IsNull()) { entity->SetParent(parent, command.keepWorldTransform); }
+			break;
+		}
+		case EntityCommandBuffer::ADD_TAG:
+			entity->AddTag(command.tag);
+			break;
+		case EntityCommandBuffer::REMOVE_TAG:
+			entity->RemoveTag(command.tag);
+			break;
+		default:
+			break;
+		}
+	}
+
+	buffer.EndPlayback();
+}
+
+void Scene::ApplyStructuralChanges()
+{
+	PROFILE_FUNCTION();
+
+	Playback(commands);
+	components.Flush(entityGenerations);
+}
+
+void Scene::UpdateTransforms()
+{
+	PROFILE_FUNCTION();
+
+	transforms.UpdateWorldMatrices(WorkerPool::Shared());
+	UpdateSpatialIndex();
+}
+
+void Scene::UpdateSpatialIndex()
+{
+	PROFILE_FUNCTION();
+
+	SpatialProxy noProxy = { DynamicAABBTree::INVALID, 0, nullptr };
+	if (spatialProxies.size() < entityGenerations.size()) { spatialProxies.resize(entityGenerations.size(), noProxy); }
+
+	// Comparing versions is all an entity that didn't move costs ; one that did only touches the tree when it leaves its fat box
+	u64 ec = entitiesAll.size();
+	for (u64 i = 0; i < ec; ++i)
+	{
+		Entity* entity = entitiesAll[i];
+		u64 index = entity->scene.GetIndex();
+		SpatialProxy& sp = spatialProxies[index];
+
+		if (entity->meshObject == nullptr)
+		{
+			RemoveFromSpatialIndex(index);
+			continue;
+		}
+
+		u32 slot = entity->GetTransformSlot();
+		u64 version = transforms.GetWorldVersion(slot);
+		if (sp.proxy != DynamicAABBTree::INVALID && sp.worldVersion == version && sp.mesh == entity->meshObject) { continue; }
+
+		const MeshBounds& bounds = entity->meshObject->GetBounds();
+		glm::vec3 center;
+		glm::vec3 extents;
+		TransformBounds(bounds, transforms.GetWorld(slot), center, extents);
+		AABB box = { center - extents, center + extents };
+
+		// Swept over the tick, since rendering interpolates from the previous world
+		if (transforms.HasPreviousWorld(slot))
+		{
+			TransformBounds(bounds, transforms.GetPreviousWorld(slot), center, extents);
+			box.min = glm::min(box.min, center - extents);
+			box.max = glm::max(box.max, center + extents);
+		}
+
+		if (sp.proxy == DynamicAABBTree::INVALID) { sp.proxy = spatialIndex.CreateProxy(box, index); }
+		else { spatialIndex.MoveProxy(sp.proxy, box); }
+		sp.worldVersion = version;
+		sp.mesh = entity->meshObject;
+	}
+}
+
+void Scene::RemoveFromSpatialIndex(u64 index)
+{
+	if (index >= spatialProxies.size() || spatialProxies[index].proxy == DynamicAABBTree::INVALID) { return; }
+
+	spatialIndex.DestroyProxy(spatialProxies[index].proxy);
+	spatialProxies[index].proxy = DynamicAABBTree::INVALID;
+}
+
+void Scene::QuerySpheres(u64 count, const glm::vec3* centers, const float* radii, std::vector<Entity*>& results, std::vector<u32>& offsets)
+{
+	spatialIndex.QuerySpheres(count, centers, radii, queryProxies, offsets);
+
+	results.resize(queryProxies.size());
+	for (u64 i = 0; i < queryProxies.size(); ++i) { results[i] = EntityAt(spatialIndex.GetUserData(queryProxies[i])); }
+}
+
+void Scene::QueryFrustums(u64 count, const Frustum* frustums, std::vector<Entity*>& results, std::vector<u32>& offsets)
+{
+	spatialIndex.QueryFrustums(count, frustums, queryProxies, offsets);
+
+	results.resize(queryProxies.size());
+	for (u64 i = 0; i < queryProxies.size(); ++i) { results[i] = EntityAt(spatialIndex.GetUserData(queryProxies[i])); }
+}
+
+Entity* Scene::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance, TagID ignoreTag)
+{
+	glm::vec3 inverseDirection = 1.0f / direction;
+	Entity* nearest = nullptr;
+	float nearestDistance = maxDistance;
+
+	// The tree only knows fat boxes, so every candidate is confirmed against its actual world box
+	spatialIndex.RayCast(origin, direction, maxDistance, [&](u32 proxy, float fatDistance)
+	{
+		// Fat boxes hold the actual ones, so a fat box no nearer than the best hit can't hold a nearer one
+		if (fatDistance >= nearestDistance) { return nearestDistance; }
+
+		Entity* entity = EntityAt(spatialIndex.GetUserData(proxy));
+		if (entity->HasTag(ignoreTag)) { return nearestDistance; }
+
+		glm::vec3 center;
+		glm::vec3 extents;
+		TransformBounds(entity->meshObject->GetBounds(), transforms.GetWorld(entity->GetTransformSlot()), center, extents);
+		float distance = DynamicAABBTree::RayDistance(AABB{ center - extents, center + extents }, origin, inverseDirection, nearestDistance);
+
+		if (distance >= 0.0f && (nearest == nullptr || distance < nearestDistance))
+		{
+			nearest = entity;
+			nearestDistance = distance;
+		}
+		return nearestDistance;
+	});
+
+	if (hitDistance != nullptr) { *hitDistance = nearestDistance; }
+	return nearest;
+}
+
+void Scene::Raycasts(u64 count, const glm::vec3* origins, const glm::vec3* directions, const float* maxDistances, Entity** hits, float* hitDistances, TagID ignoreTag)
+{
+	for (u64 i = 0; i < count; ++i)
+	{
+		hits[i] = Raycast(origins[i], directions[i], maxDistances[i], &hitDistances[i], ignoreTag);
+	}
+}
+
+void Scene::InterpolateTransforms(float alpha)
+{
+	PROFILE_FUNCTION();
+
+	transforms.InterpolateWorlds(alpha, WorkerPool::Shared());
+}
@@ -2,17 +2,75 @@
 #define SCENE_H_
 
 #include "Entity.h"
+#include "EntityHandle.h"
+#include "TransformStore.h"
+#include "Tags.h"
+#include "ComponentStore.h"
+#include "EntityCommandBuffer.h"
+#include "Prefab.h"
+#include "DynamicAABBTree.h"
 
 #include <vector>
+#include <cfloat>
 
 class Scene
 {
 private:
-	std::vector<Entity> entities;     // All entities belonging to this scene (contains gaps)
-	std::vector<Entity*> entitiesTop; // References to top level (parent-less) entities in this scene
-	std::vector<Entity*> entitiesAll; // References to all entities in this scene
+	// Entities live in fixed-size chunks that never move, so pointers and handles survive the scene growing
+	static const u32 ENTITY_CHUNK_SHIFT = 10;
+	static const u32 ENTITY_CHUNK_SIZE = 1 << ENTITY_CHUNK_SHIFT;
+	static const u32 ENTITY_CHUNK_MASK = ENTITY_CHUNK_SIZE - 1;
+
+	// Declared first so it outlives the entities releasing their slots into it
+	TransformStore transforms; // Transformation data of every entity in this scene
+	ComponentStore components; // Component data of every entity in this scene
+
+	std::vector<Entity*> entityChunks;  // Storage for all entities belonging to this scene (contains gaps)
+	std::vector<u32> entityGenerations; // Current generation of every position in the entity storage
+	std::vector<Entity*> entitiesTop;   // References to top level (parent-less) entities in this scene
+	std::vector<Entity*> entitiesAll;   // References to all entities in this scene
 	
-	std::vector<u64> entityArrayGaps; // All known gaps in the entities array
+	std::vector<u64> entityArrayGaps; // All known gaps in the entity storage
+
+	EntityCommandBuffer commands;             // Structural changes deferred to the next sync point
+	std::vector<EntityHandle> spawnedHandles; // Entities created by the spawn commands of the buffer being played back
+
+	// Finds the live entity a recorded command refers to, or nullptr
+	Entity* ResolveTarget(const CommandTarget& target);
+
+	// Entities carrying a tag, kept dense for iteration, plus the position of each entity (by storage index) in that list
+	struct TagIndex
+	{
+		std::vector<Entity*> entities;
+		std::vector<u32> positions;
+	};
+	std::vector<TagIndex> tagIndices; // Indexed by TagID, grown as tags get used
+
+	// Called by entities as their tags change
+	void IndexTag(Entity* entity, TagID tag);
+	void UnindexTag(Entity* entity, TagID tag);
+
+	// World boxes of every entity with a mesh, brought up to date by UpdateTransforms
+	//  - Each box covers the entity at both of the last two ticks, and the tree's margin covers what rotating in between adds
+	DynamicAABBTree spatialIndex;
+	struct SpatialProxy
+	{
+		u32 proxy;        // DynamicAABBTree::INVALID when the entity isn't in the index
+		u64 worldVersion; // Of the world matrix the box was made from
+		const Mesh* mesh; // Whose bounds the box was made from
+	};
+	std::vector<SpatialProxy> spatialProxies; // Indexed by entity storage index
+	std::vector<u32> queryProxies;            // Scratch for the batched queries
+
+	// Adds, moves and removes proxies for the entities whose world matrix or mesh changed since the last call
+	void UpdateSpatialIndex();
+	void RemoveFromSpatialIndex(u64 index);
+
+	friend class Entity;
+
+	inline Entity* EntityAt(u64 index) { return entityChunks[index >> ENTITY_CHUNK_SHIFT] + (index & ENTITY_CHUNK_MASK); }
+	// Finds a free position in the entity storage, growing it if needed
+	u64 ClaimEntityIndex();
 
 public:
 	Scene();
@@ -21,8 +79,90 @@ public:
 	// Spawns a new entity into the scene
 	Entity* SpawnEntity(Mesh* mesh, Material* mat, Entity* parent = nullptr, const Transform& transform = Transform());
 
-	// Destroys an entity belonging to this scene
+	// Spawns count instances of a compiled prefab, returning the number of entities created
+	//  - Each instance's root is placed at rootTransforms[i], or at the prefab's own root transformation if null
+	//  - The handles of the spawned roots are written to spawnedRoots if given (count entries)
+	u64 SpawnBatch(const Prefab& prefab, u64 count, const Transform* rootTransforms = nullptr, EntityHandle* spawnedRoots = nullptr);
+
+	// Destroys an entity belonging to this scene immediately
+	//  - Unsafe while anyone is iterating the scene's entities, record the destroy in a command buffer instead
 	void DestroyEntity(Entity* entity);
+	// Destroys the entity referred to by a handle, if it is still alive
+	void DestroyEntity(EntityHandle handle);
+
+	// Resolves a handle to its entity, or nullptr if that entity has since been destroyed
+	inline Entity* GetEntity(EntityHandle handle) { return IsAlive(handle) ? EntityAt(handle.index) : nullptr; }
+	inline bool IsAlive(EntityHandle handle) const { return handle.index < entityGenerations.size() && entityGenerations[handle.index] == handle.generation; }
+
+	inline u64 GetEntityCount() const { return entitiesAll.size(); }
+	// Every entity in this scene, in no particular order ; spawning or destroying entities invalidates the list
+	inline const std::vector<Entity*>& GetEntities() const { return entitiesAll; }
+
+	// Every entity in this scene carrying a tag, in no particular order
+	//  - Adding or removing that tag, or destroying one of the entities, invalidates the list
+	const std::vector<Entity*>& GetEntitiesWithTag(TagID tag) const;
+	inline const std::vector<Entity*>& GetEntitiesWithTag(const std::string& tag) const { return GetEntitiesWithTag(TagRegistry::Find(tag)); }
+
+	// Recalculates the world matrices of every entity whose transformation changed since the last call
+	//  - Works through the hierarchy one depth level at a time, spreading each level over the shared worker pool
+	//  - Then brings the spatial index in line with the new matrices
+	void UpdateTransforms();
+
+	// Keeps the current world matrices as the ones to interpolate from ; call at the start of each simulation tick
+	inline void SavePreviousTransforms() { transforms.SavePreviousWorlds(); }
+	// Blends every entity's world matrix alpha of the way between the last two ticks (see Object::GetRenderAffine)
+	void InterpolateTransforms(float alpha);
+
+	inline TransformStore* GetTransformStore() { return &transforms; }
+
+	// <SPATIAL QUERIES>
+
+	// Only entities with a mesh are indexed, by their (slightly enlarged) world boxes as of the last UpdateTransforms
+	// Results can include entities just outside the shape, so precise checks belong to the caller
+
+	// Each calls fn(Entity*) for every indexed entity overlapping the shape
+	template<typename F> inline void QueryBox(const AABB& box, F fn)                          { spatialIndex.QueryBox(box, [&](u32 proxy) { fn(EntityAt(spatialIndex.GetUserData(proxy))); }); }
+	template<typename F> inline void QuerySphere(const glm::vec3& center, float radius, F fn) { spatialIndex.QuerySphere(center, radius, [&](u32 proxy) { fn(EntityAt(spatialIndex.GetUserData(proxy))); }); }
+	template<typename F> inline void QueryFrustum(const Frustum& frustum, F fn)               { spatialIndex.QueryFrustum(frustum, [&](u32 proxy) { fn(EntityAt(spatialIndex.GetUserData(proxy))); }); }
+
+	// Batched versions ; the entities found by query i are results[offsets[i]] up to results[offsets[i + 1]]
+	void QuerySpheres(u64 count, const glm::vec3* centers, const float* radii, std::vector<Entity*>& results, std::vector<u32>& offsets);
+	void QueryFrustums(u64 count, const Frustum* frustums, std::vector<Entity*>& results, std::vector<u32>& offsets);
+
+	// Nearest entity whose world box (its mesh's bounds, transformed) the ray hits within maxDistance, or nullptr
+	//  - Distances are in units of direction, which needn't be normalized
+	//  - Entities carrying ignoreTag are passed through, for things like a sky box the ray starts inside of
+	Entity* Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = FLT_MAX, float* hitDistance = nullptr, TagID ignoreTag = TagRegistry::INVALID_TAG);
+	// Batched version, writing the nearest entity (or nullptr) and its distance for every ray
+	void Raycasts(u64 count, const glm::vec3* origins, const glm::vec3* directions, const float* maxDistances, Entity** hits, float* hitDistances, TagID ignoreTag = TagRegistry::INVALID_TAG);
+
+	inline const DynamicAABBTree& GetSpatialIndex() const { return spatialIndex; }
+
+	// </SPATIAL QUERIES>
+
+	// <COMPONENTS>
+
+	// Adding and removing components is deferred until the next ApplyStructuralChanges call
+	template<typename T> inline void AddComponent(EntityHandle entity, T value) { components.Add<T>(entity, std::move(value)); }
+	template<typename T> inline void RemoveComponent(EntityHandle entity)      { components.Remove<T>(entity); }
+
+	template<typename T> inline T* GetComponent(EntityHandle entity) { return IsAlive(entity) ? components.Get<T>(entity) : nullptr; }
+
+	// Calls fn(handle, Ts&...) for every entity holding all of Ts
+	template<typename... Ts, typename F> inline void ForEach(F fn) { components.ForEach<Ts...>(fn); }
+
+	// Sync point - plays back the scene's command buffer and applies every queued component change
+	//  - Must not be called while iterating
+	void ApplyStructuralChanges();
+
+	// Default buffer played back by ApplyStructuralChanges, safe to record into from any thread
+	inline EntityCommandBuffer* GetCommandBuffer() { return &commands; }
+	// Executes everything recorded in a buffer, in the order it was recorded
+	void Playback(EntityCommandBuffer& buffer);
+
+	inline ComponentStore* GetComponentStore() { return &components; }
+
+	// </COMPONENTS>
 };
 
 #endif /* SCENE_H_ */
@@ -10,6 +10,7 @@ class SceneRef
 private:
 	Scene* scene;
 	u64 index;
+	u32 generation;
 	u64 sceneID;
 	u64 topID;
 
@@ -19,15 +20,17 @@ public:
 	inline SceneRef() :
 		scene(nullptr),
 		index(U64_MAX),
+		generation(0),
 		sceneID(U64_MAX),
 		topID(U64_MAX)
 	{
 		// Nothing interesting to do here
 	}
 	
-	inline SceneRef(Scene* parentScene, u64 ind, u64 sID, u64 tID = U64_MAX) :
+	inline SceneRef(Scene* parentScene, u64 ind, u32 gen, u64 sID, u64 tID = U64_MAX) :
 		scene(parentScene),
 		index(ind),
+		generation(gen),
 		sceneID(sID),
 		topID(tID)
 	{
@@ -39,10 +42,11 @@ public:
 		// Nothing interesting to do here
 	}
 
-	inline Scene* GetScene()   { return scene; }
-	inline u64    GetIndex()   { return index; }
-	inline u64    GetSceneID() { return sceneID; }
-	inline u64    GetTopID()   { return topID; }
+	inline Scene* GetScene() const      { return scene; }
+	inline u64    GetIndex() const      { return index; }
+	inline u32    GetGeneration() const { return generation; }
+	inline u64    GetSceneID() const    { return sceneID; }
+	inline u64    GetTopID() const      { return topID; }
 };
 
 #endif
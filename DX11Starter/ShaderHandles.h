@@ -0,0 +1,31 @@
+#ifndef SHADER_HANDLES_H_
+#define SHADER_HANDLES_H_
+
+// Handles SimpleShader hands out for its variables and resources, apart from it so code that only passes them
+// around (RenderQueue, the render devices) doesn't need the D3D11 headers
+
+// --------------------------------------------------------
+// A shader variable looked up once with GetVariableHandle(),
+// so setting it skips the name lookup.  Only valid for the
+// shader it came from, until that shader is reloaded
+// --------------------------------------------------------
+struct ShaderVarHandle
+{
+	unsigned int ConstantBufferIndex;
+	unsigned int ByteOffset;
+	unsigned int Size;	// Zero if the variable doesn't exist
+
+	bool IsValid() const { return Size > 0; }
+};
+
+// --------------------------------------------------------
+// Same as above, for an SRV or sampler register
+// --------------------------------------------------------
+struct ShaderResourceHandle
+{
+	unsigned int BindIndex;	// -1 if the resource doesn't exist
+
+	bool IsValid() const { return BindIndex != (unsigned int)-1; }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "ShadowCascades.h"
+
+#include <cfloat>
+#include <cmath>
+
+const u32 ShadowCascades::MAX_CASCADES;
+
+ShadowCascades::ShadowCascades(u32 count, u32 mapResolution, float lambda, float distance) :
+	cascadeCount(glm::clamp(count, 1u, MAX_CASCADES)),
+	resolution(mapResolution),
+	splitLambda(lambda),
+	shadowDistance(distance)
+{
+	// Nothing interesting to do here
+}
+
+float ShadowCascades::SplitDepth(u32 split, u32 count, float nearClip, float farClip, float lambda)
+{
+	if (split == 0) { return nearClip; }
+	if (split >= count) { return farClip; }
+
+	float fraction = (float)split / (float)count;
+	float uniform = nearClip + (farClip - nearClip) * fraction;
+	float logarithmic = nearClip * std::pow(farClip / nearClip, fraction);
+	return uniform + (logarithmic - uniform) * lambda;
+}
+
+void ShadowCascades::Update(const glm::mat4& cameraView, const glm::mat4& cameraProjection, float nearClip, float farClip, const glm::vec3& lightDirection)
+{
+	// The view's last row is the constant one of an affine transformation ; glm's mat4x3 conversion drops the translation
+	affine worldToCamera;
+	for (u32 c = 0; c < 4; ++c) { worldToCamera[c] = glm::vec3(cameraView[c]); }
+	affine cameraToWorld = AffineInverse(worldToCamera);
+
+	// Where x / w and y / w reach -1 and 1 at view depth d is d * (s - offset) / scale, which covers off center projections
+	glm::vec2 scale(cameraProjection[0][0], cameraProjection[1][1]);
+	glm::vec2 offset(cameraProjection[2][0], cameraProjection[2][1]);
+	glm::vec2 low = (-1.0f - offset) / scale;
+	glm::vec2 high = (1.0f - offset) / scale;
+	glm::vec2 axis = -offset / scale;
+
+	// Light basis, fixed for a given direction so that snapping in it stays put as the camera moves
+	glm::vec3 forward = glm::normalize(lightDirection);
+	glm::vec3 up = glm::abs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::vec3 right = glm::normalize(glm::cross(up, forward));
+	up = glm::cross(forward, right);
+
+	float farDepth = glm::min(farClip, shadowDistance);
+	for (u32 i = 0; i < cascadeCount; ++i)
+	{
+		Cascade& cascade = cascades[i];
+		cascade.splitNear = SplitDepth(i, cascadeCount, nearClip, farDepth, splitLambda);
+		cascade.splitFar = SplitDepth(i + 1, cascadeCount, nearClip, farDepth, splitLambda);
+
+		float n = cascade.splitNear;
+		float f = cascade.splitFar;
+		glm::vec3 corners[8];
+		for (u32 k = 0; k < 8; ++k)
+		{
+			float d = (k & 4) ? f : n;
+			glm::vec3 viewCorner(d * ((k & 1) ? high.x : low.x), d * ((k & 2) ? high.y : low.y), d);
+			corners[k] = AffineTransformPoint(cameraToWorld, viewCorner);
+		}
+
+		// Smallest sphere centered on the view axis through both ends of the slice, or around the far end when the
+		// slice is wider than it is deep ; it only depends on the projection, so it's the same size whichever way the camera looks
+		float widest = glm::max(glm::abs(low.x), glm::abs(high.x));
+		float tallest = glm::max(glm::abs(low.y), glm::abs(high.y));
+		float spread = widest * widest + tallest * tallest;
+		float depth = glm::min(0.5f * (n + f) * (1.0f + spread), f);
+		glm::vec3 center = AffineTransformPoint(cameraToWorld, glm::vec3(axis * depth, depth));
+
+		float radius = 0.0f;
+		for (u32 k = 0; k < 8; ++k) { radius = glm::max(radius, glm::length(corners[k] - center)); }
+		// Rounded up, so float noise never changes the texel size from one frame to the next
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		cascade.radius = radius;
+		cascade.texelSize = 2.0f * radius / (float)resolution;
+
+		// Center moved to a whole texel in light space, so the map's texels land on the same world positions every frame,
+		// and a camera moving less than a texel leaves the cascade's matrices exactly as they were
+		glm::vec3 lightCenter(glm::dot(center, right), glm::dot(center, up), glm::dot(center, forward));
+		lightCenter = glm::floor(lightCenter / cascade.texelSize) * cascade.texelSize;
+
+		// Orthographic over the sphere, depth 0 to 1 from its front to a texel past its back, as snapping moved the
+		// center up to a texel towards the light
+		float depthRange = 2.0f * radius + cascade.texelSize;
+		float rows[2][4][4] = {
+			{
+				{ right.x, right.y, right.z, -lightCenter.x },
+				{ up.x, up.y, up.z, -lightCenter.y },
+				{ forward.x, forward.y, forward.z, -lightCenter.z },
+				{ 0.0f, 0.0f, 0.0f, 1.0f }
+			},
+			{
+				{ 1.0f / radius, 0.0f, 0.0f, 0.0f },
+				{ 0.0f, 1.0f / radius, 0.0f, 0.0f },
+				{ 0.0f, 0.0f, 1.0f / depthRange, radius / depthRange },
+				{ 0.0f, 0.0f, 0.0f, 1.0f }
+			}
+		};
+		for (u32 r = 0; r < 4; ++r)
+		{
+			for (u32 c = 0; c < 4; ++c)
+			{
+				cascade.view[c][r] = rows[0][r][c];
+				cascade.projection[c][r] = rows[1][r][c];
+			}
+		}
+		cascade.viewProjection = cascade.projection * cascade.view;
+
+		// Casters are culled against the slice itself rather than the whole sphere, open towards the light
+		// A couple of texels of margin keep casters just off the slice that filtering still reads
+		glm::vec3 minimum(FLT_MAX);
+		glm::vec3 maximum(-FLT_MAX);
+		for (u32 k = 0; k < 8; ++k)
+		{
+			glm::vec3 p(glm::dot(corners[k], right), glm::dot(corners[k], up), glm::dot(corners[k], forward));
+			minimum = glm::min(minimum, p);
+			maximum = glm::max(maximum, p);
+		}
+		float margin = 2.0f * cascade.texelSize;
+
+		Frustum& volume = cascade.casterVolume;
+		volume.planes[0] = glm::vec4(right, -(minimum.x - margin));
+		volume.planes[1] = glm::vec4(-right, maximum.x + margin);
+		volume.planes[2] = glm::vec4(up, -(minimum.y - margin));
+		volume.planes[3] = glm::vec4(-up, maximum.y + margin);
+		volume.planes[4] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		volume.planes[5] = glm::vec4(-forward, maximum.z);
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef SHADOW_CASCADES_H_
+#define SHADOW_CASCADES_H_
+
+#include "Types.h"
+#include "Bounds.h"
+#include "FrustumCulling.h"
+
+// A directional light's shadow map split into cascades along the camera's view, each an orthographic view of its
+// own covering one slice of the view frustum, all fitted on the CPU
+//  - Splits blend logarithmic and uniform spacing, so the cascades near the camera get most of the texels
+//  - Each cascade covers the bounding sphere of its slice, so its size doesn't change as the camera turns, and its
+//    origin is snapped to whole texels, so shadow edges don't crawl as the camera moves
+//  - A cascade's casters are whatever lies over its slice as seen from the light, however far towards the light ;
+//    casters nearer than the cascade's near plane are flattened onto it (the shadow rasterizer doesn't clip depth)
+class ShadowCascades
+{
+public:
+	static const u32 MAX_CASCADES = 4;
+
+	struct Cascade
+	{
+		glm::mat4 view;                 // Column vector convention, transposed before they go to shaders
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		Frustum casterVolume;           // What can shadow the slice ; the near plane never rejects anything
+		float splitNear;                // View depth range of the slice, which receivers in it sample this cascade over
+		float splitFar;
+		float radius;                   // Of the sphere the cascade covers
+		float texelSize;                // World units per shadow map texel
+	};
+
+private:
+	u32 cascadeCount;
+	u32 resolution;
+	float splitLambda;
+	float shadowDistance;
+	Cascade cascades[MAX_CASCADES];
+
+public:
+	// Lambda blends uniform (0) and logarithmic (1) splits ; shadows reach distance along the view, or the far clip if nearer
+	ShadowCascades(u32 count = MAX_CASCADES, u32 mapResolution = 2048, float lambda = 0.8f, float distance = 200.0f);
+
+	// Refits every cascade to the camera's column vector matrices ; lightDirection points away from the light
+	void Update(const glm::mat4& cameraView, const glm::mat4& cameraProjection, float nearClip, float farClip, const glm::vec3& lightDirection);
+
+	// View depth at which split i of count lies, split 0 being nearClip and split count farClip
+	static float SplitDepth(u32 split, u32 count, float nearClip, float farClip, float lambda);
+
+	inline u32 GetCascadeCount() const            { return cascadeCount; }
+	inline u32 GetResolution() const              { return resolution; }
+	inline float GetShadowDistance() const        { return shadowDistance; }
+	inline void SetShadowDistance(float distance) { shadowDistance = distance; }
+	inline const Cascade& GetCascade(u32 i) const { return cascades[i]; }
+};
+
+#endif
@@ -1,9 +1,16 @@
 #include "SimpleShader.h"
+#include "ConstantBufferRing.h"
+#include "D3D11StateCache.h"
+#include "Profiler.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+ConstantBufferRing* ISimpleShader::uploadRing = 0;
+D3D11StateCache* ISimpleShader::stateCache = 0;
+SimpleUploadStats ISimpleShader::uploadStats = {};
+
 // --------------------------------------------------------
 // Constructor accepts DirectX device & context
 // --------------------------------------------------------
@@ -180,6 +187,12 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
 		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
 
+		// The GPU buffer hasn't seen any of it yet
+		constantBuffers[b].Dirty = true;
+		constantBuffers[b].RingGeneration = 0;
+		constantBuffers[b].RingFirstConstant = 0;
+		constantBuffers[b].RingConstantCount = 0;
+
 		// Loop through all variables in this buffer
 		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
 		{
@@ -279,14 +292,9 @@ void ISimpleShader::CopyAllBufferData()
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy any that changed
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer, 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
-	}
+		UploadBuffer(&constantBuffers[i]);
 }
 
 // --------------------------------------------------------
@@ -313,10 +321,8 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer, 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -335,12 +341,163 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer, 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(cb);
+}
+
+// --------------------------------------------------------
+// Copies a buffer's local data to the GPU, unless nothing
+// has changed since the last copy.  With an upload ring the
+// data goes to a fresh slice of it, which is rebound right
+// away if this shader is the one currently set.  If that
+// wrapped the ring, every other slice is gone, so whatever
+// is bound on each stage is re-uploaded and rebound too.
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer* cb)
+{
+	PROFILE_FUNCTION();
+
+	bool useRing = uploadRing && cb->Type == D3D11_CT_CBUFFER;
+
+	// A slice from before the ring last wrapped is gone, even if the data isn't
+	bool ringStale = useRing &&
+		(cb->RingConstantCount == 0 || cb->RingGeneration != uploadRing->GetGeneration());
+
+	if (!cb->Dirty && !ringStale)
+	{
+		uploadStats.UploadsSkipped++;
+		return;
+	}
+
+	if (useRing)
+	{
+		unsigned int generation = uploadRing->GetGeneration();
+		uploadRing->Allocate(cb->LocalDataBuffer, cb->Size, cb->RingFirstConstant, cb->RingConstantCount);
+		cb->RingGeneration = uploadRing->GetGeneration();
+		uploadStats.BytesUploaded += cb->RingConstantCount * ConstantBufferRing::CONSTANT_SIZE;
+
+		if (IsBound())
+			SetConstantBuffer(cb);
+		if (cb->RingGeneration != generation)
+			RefreshBoundShaders();
+	}
+	else
+	{
+		deviceContext->UpdateSubresource(
+			cb->ConstantBuffer, 0, 0,
+			cb->LocalDataBuffer, 0, 0);
+		uploadStats.BytesUploaded += cb->Size;
+	}
+
+	uploadStats.Uploads++;
+
+	// Clean until the next change
+	cb->Dirty = false;
+}
+
+// --------------------------------------------------------
+// Re-uploads (and so rebinds) this shader's buffers whose
+// ring slices were discarded by a wrap
+// --------------------------------------------------------
+void ISimpleShader::RefreshStaleBuffers()
+{
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		SimpleConstantBuffer* cb = &constantBuffers[i];
+		if (cb->Type == D3D11_CT_CBUFFER && cb->RingGeneration != uploadRing->GetGeneration())
+			UploadBuffer(cb);
+	}
+}
+
+// --------------------------------------------------------
+// Called when the ring wraps: the shader set on each stage
+// may still have slices bound from before the wrap, and
+// nothing else would rebind them before its next draw
+// --------------------------------------------------------
+void ISimpleShader::RefreshBoundShaders()
+{
+	ISimpleShader* shaders[] = {
+		SimpleVertexShader::bound,
+		SimplePixelShader::bound,
+		SimpleDomainShader::bound,
+		SimpleHullShader::bound,
+		SimpleGeometryShader::bound,
+		SimpleComputeShader::bound };
+
+	for (ISimpleShader* shader : shaders)
+	{
+		if (shader)
+			shader->RefreshStaleBuffers();
+	}
+}
+
+// --------------------------------------------------------
+// Binds a buffer to this shader's stage, first re-uploading
+// it if its slice of the upload ring has been recycled
+// --------------------------------------------------------
+void ISimpleShader::BindBuffer(SimpleConstantBuffer* cb)
+{
+	if (uploadRing && cb->Type == D3D11_CT_CBUFFER &&
+		(cb->RingConstantCount == 0 || cb->RingGeneration != uploadRing->GetGeneration()))
+	{
+		// Binds it as well, since this shader is being set
+		UploadBuffer(cb);
+		return;
+	}
+
+	SetConstantBuffer(cb);
+}
+
+// --------------------------------------------------------
+// Clears the upload counters, usually once per frame
+// --------------------------------------------------------
+void ISimpleShader::ResetUploadStats()
+{
+	uploadStats = SimpleUploadStats();
+}
+
+
+// --------------------------------------------------------
+// Looks up a variable once, so it can be set without
+// hashing its name every time
+//
+// name - The name of the shader variable
+//
+// Returns a handle that isn't valid if the variable doesn't exist
+// --------------------------------------------------------
+ShaderVarHandle ISimpleShader::GetVariableHandle(std::string name)
+{
+	ShaderVarHandle handle = { 0, 0, 0 };
+
+	SimpleShaderVariable* var = FindVariable(name, -1);
+	if (var == 0)
+		return handle;
+
+	handle.ConstantBufferIndex = var->ConstantBufferIndex;
+	handle.ByteOffset = var->ByteOffset;
+	handle.Size = var->Size;
+	return handle;
 }
 
+// --------------------------------------------------------
+// Looks up an SRV once, for SetShaderResourceView()
+// --------------------------------------------------------
+ShaderResourceHandle ISimpleShader::GetShaderResourceHandle(std::string name)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
+	ShaderResourceHandle handle = { srvInfo ? srvInfo->BindIndex : (unsigned int)-1 };
+	return handle;
+}
+
+// --------------------------------------------------------
+// Looks up a sampler once, for SetSamplerState()
+// --------------------------------------------------------
+ShaderResourceHandle ISimpleShader::GetSamplerHandle(std::string name)
+{
+	const SimpleSampler* sampInfo = GetSamplerInfo(name);
+	ShaderResourceHandle handle = { sampInfo ? sampInfo->BindIndex : (unsigned int)-1 };
+	return handle;
+}
 
 // --------------------------------------------------------
 // Sets a variable by name with arbitrary data of the specified size
@@ -354,16 +511,39 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 // --------------------------------------------------------
 bool ISimpleShader::SetData(std::string name, const void* data, unsigned int size)
 {
-	// Look for the variable and verify
-	SimpleShaderVariable* var = FindVariable(name, size);
-	if (var == 0)
+	return this->SetData(GetVariableHandle(name), data, size);
+}
+
+// --------------------------------------------------------
+// Sets a variable by handle with arbitrary data of the specified size
+//
+// var - The shader variable, from GetVariableHandle()
+// data - The data to set in the buffer
+// size - The size of the data (this must match the variable's size)
+//
+// Returns true if data is copied, false if the handle isn't
+// valid or sizes don't match
+// --------------------------------------------------------
+bool ISimpleShader::SetData(ShaderVarHandle var, const void* data, unsigned int size)
+{
+	// Verify the handle
+	if (!var.IsValid() || var.Size != size)
 		return false;
 
+	uploadStats.SetCalls++;
+
+	// Skip data that's already there, so the buffer can stay clean
+	SimpleConstantBuffer* cb = &constantBuffers[var.ConstantBufferIndex];
+	unsigned char* dest = cb->LocalDataBuffer + var.ByteOffset;
+	if (memcmp(dest, data, size) == 0)
+	{
+		uploadStats.SetsUnchanged++;
+		return true;
+	}
+
 	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
+	memcpy(dest, data, size);
+	cb->Dirty = true;
 
 	// Success
 	return true;
@@ -449,6 +629,75 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 dat
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
 
+// --------------------------------------------------------
+// Handle versions of the setters above
+// --------------------------------------------------------
+bool ISimpleShader::SetInt(ShaderVarHandle var, int data)
+{
+	return this->SetData(var, &data, sizeof(int));
+}
+
+bool ISimpleShader::SetFloat(ShaderVarHandle var, float data)
+{
+	return this->SetData(var, &data, sizeof(float));
+}
+
+bool ISimpleShader::SetFloat2(ShaderVarHandle var, const float data[2])
+{
+	return this->SetData(var, data, sizeof(float) * 2);
+}
+
+bool ISimpleShader::SetFloat2(ShaderVarHandle var, const DirectX::XMFLOAT2& data)
+{
+	return this->SetData(var, &data, sizeof(float) * 2);
+}
+
+bool ISimpleShader::SetFloat3(ShaderVarHandle var, const float data[3])
+{
+	return this->SetData(var, data, sizeof(float) * 3);
+}
+
+bool ISimpleShader::SetFloat3(ShaderVarHandle var, const DirectX::XMFLOAT3& data)
+{
+	return this->SetData(var, &data, sizeof(float) * 3);
+}
+
+bool ISimpleShader::SetFloat4(ShaderVarHandle var, const float data[4])
+{
+	return this->SetData(var, data, sizeof(float) * 4);
+}
+
+bool ISimpleShader::SetFloat4(ShaderVarHandle var, const DirectX::XMFLOAT4& data)
+{
+	return this->SetData(var, &data, sizeof(float) * 4);
+}
+
+bool ISimpleShader::SetMatrix4x4(ShaderVarHandle var, const float data[16])
+{
+	return this->SetData(var, data, sizeof(float) * 16);
+}
+
+bool ISimpleShader::SetMatrix4x4(ShaderVarHandle var, const DirectX::XMFLOAT4X4& data)
+{
+	return this->SetData(var, &data, sizeof(float) * 16);
+}
+
+// --------------------------------------------------------
+// Sets a shader resource view by name in this shader's stage
+// --------------------------------------------------------
+bool ISimpleShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+{
+	return this->SetShaderResourceView(GetShaderResourceHandle(name), srv);
+}
+
+// --------------------------------------------------------
+// Sets a sampler state by name in this shader's stage
+// --------------------------------------------------------
+bool ISimpleShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+{
+	return this->SetSamplerState(GetSamplerHandle(name), samplerState);
+}
+
 // --------------------------------------------------------
 // Gets info about a shader variable, if it exists
 // --------------------------------------------------------
@@ -577,6 +826,8 @@ const SimpleConstantBuffer * ISimpleShader::GetBufferInfo(unsigned int index)
 // ------ SIMPLE VERTEX SHADER ------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+SimpleVertexShader* SimpleVertexShader::bound = 0;
+
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
@@ -621,6 +872,7 @@ SimpleVertexShader::~SimpleVertexShader()
 void SimpleVertexShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
+	if (bound == this) bound = 0;
 	if (shader) { shader->Release(); shader = 0; }
 	if (inputLayout) { inputLayout->Release(); inputLayout = 0; }
 }
@@ -758,8 +1010,17 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout);
-	deviceContext->VSSetShader(shader, 0, 0);
+	if (stateCache)
+	{
+		stateCache->SetInputLayout(inputLayout);
+		stateCache->SetVertexShader(shader);
+	}
+	else
+	{
+		deviceContext->IASetInputLayout(inputLayout);
+		deviceContext->VSSetShader(shader, 0, 0);
+	}
+	bound = this;
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -769,30 +1030,58 @@ void SimpleVertexShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+		BindBuffer(&constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the vertex shader stage,
+// from the upload ring if that's where it was last copied
+// --------------------------------------------------------
+void SimpleVertexShader::SetConstantBuffer(SimpleConstantBuffer* cb)
+{
+	if (stateCache)
+	{
+		if (uploadRing && cb->RingConstantCount > 0)
+			stateCache->SetConstantBuffer(STAGE_VERTEX, cb->BindIndex, *uploadRing->GetBuffer(), cb->RingFirstConstant, cb->RingConstantCount);
+		else
+			stateCache->SetConstantBuffer(STAGE_VERTEX, cb->BindIndex, cb->ConstantBuffer);
+		return;
+	}
+
+	if (uploadRing && cb->RingConstantCount > 0)
+	{
+		uploadRing->GetContext()->VSSetConstantBuffers1(
+			cb->BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			uploadRing->GetBuffer(),
+			&cb->RingFirstConstant,
+			&cb->RingConstantCount);
+		return;
 	}
+
+	deviceContext->VSSetConstantBuffers(cb->BindIndex, 1, &cb->ConstantBuffer);
 }
 
 // --------------------------------------------------------
 // Sets a shader resource view in the vertex shader stage
 //
-// name - The name of the texture resource in the shader
+// srvHandle - The texture resource, from GetShaderResourceHandle()
 // srv - The shader resource view of the texture in GPU memory
 //
-// Returns true if a texture of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimpleVertexShader::SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	// Verify the handle
+	if (!srvHandle.IsValid())
 		return false;
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	if (stateCache)
+		stateCache->SetShaderResource(STAGE_VERTEX, srvHandle.BindIndex, srv);
+	else
+		deviceContext->VSSetShaderResources(srvHandle.BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -801,20 +1090,22 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, ID3D11ShaderRes
 // --------------------------------------------------------
 // Sets a sampler state in the vertex shader stage
 //
-// name - The name of the sampler state in the shader
+// samplerHandle - The sampler state, from GetSamplerHandle()
 // samplerState - The sampler state in GPU memory
 //
-// Returns true if a sampler of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimpleVertexShader::SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	// Verify the handle
+	if (!samplerHandle.IsValid())
 		return false;
 
-	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	// Set the sampler state
+	if (stateCache)
+		stateCache->SetSampler(STAGE_VERTEX, samplerHandle.BindIndex, samplerState);
+	else
+		deviceContext->VSSetSamplers(samplerHandle.BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -825,6 +1116,8 @@ bool SimpleVertexShader::SetSamplerState(std::string name, ID3D11SamplerState* s
 // ------ SIMPLE PIXEL SHADER -------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+SimplePixelShader* SimplePixelShader::bound = 0;
+
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
@@ -848,6 +1141,7 @@ SimplePixelShader::~SimplePixelShader()
 void SimplePixelShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
+	if (bound == this) bound = 0;
 	if (shader) { shader->Release(); shader = 0; }
 }
 
@@ -885,7 +1179,11 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader, 0, 0);
+	if (stateCache)
+		stateCache->SetPixelShader(shader);
+	else
+		deviceContext->PSSetShader(shader, 0, 0);
+	bound = this;
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -895,30 +1193,58 @@ void SimplePixelShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+		BindBuffer(&constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the pixel shader stage,
+// from the upload ring if that's where it was last copied
+// --------------------------------------------------------
+void SimplePixelShader::SetConstantBuffer(SimpleConstantBuffer* cb)
+{
+	if (stateCache)
+	{
+		if (uploadRing && cb->RingConstantCount > 0)
+			stateCache->SetConstantBuffer(STAGE_PIXEL, cb->BindIndex, *uploadRing->GetBuffer(), cb->RingFirstConstant, cb->RingConstantCount);
+		else
+			stateCache->SetConstantBuffer(STAGE_PIXEL, cb->BindIndex, cb->ConstantBuffer);
+		return;
+	}
+
+	if (uploadRing && cb->RingConstantCount > 0)
+	{
+		uploadRing->GetContext()->PSSetConstantBuffers1(
+			cb->BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			uploadRing->GetBuffer(),
+			&cb->RingFirstConstant,
+			&cb->RingConstantCount);
+		return;
 	}
+
+	deviceContext->PSSetConstantBuffers(cb->BindIndex, 1, &cb->ConstantBuffer);
 }
 
 // --------------------------------------------------------
 // Sets a shader resource view in the pixel shader stage
 //
-// name - The name of the texture resource in the shader
+// srvHandle - The texture resource, from GetShaderResourceHandle()
 // srv - The shader resource view of the texture in GPU memory
 //
-// Returns true if a texture of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimplePixelShader::SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	// Verify the handle
+	if (!srvHandle.IsValid())
 		return false;
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	if (stateCache)
+		stateCache->SetShaderResource(STAGE_PIXEL, srvHandle.BindIndex, srv);
+	else
+		deviceContext->PSSetShaderResources(srvHandle.BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -927,20 +1253,22 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, ID3D11ShaderReso
 // --------------------------------------------------------
 // Sets a sampler state in the pixel shader stage
 //
-// name - The name of the sampler state in the shader
+// samplerHandle - The sampler state, from GetSamplerHandle()
 // samplerState - The sampler state in GPU memory
 //
-// Returns true if a sampler of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimplePixelShader::SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	// Verify the handle
+	if (!samplerHandle.IsValid())
 		return false;
 
-	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	// Set the sampler state
+	if (stateCache)
+		stateCache->SetSampler(STAGE_PIXEL, samplerHandle.BindIndex, samplerState);
+	else
+		deviceContext->PSSetSamplers(samplerHandle.BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -953,6 +1281,8 @@ bool SimplePixelShader::SetSamplerState(std::string name, ID3D11SamplerState* sa
 // ------ SIMPLE DOMAIN SHADER ------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+SimpleDomainShader* SimpleDomainShader::bound = 0;
+
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
@@ -976,6 +1306,7 @@ SimpleDomainShader::~SimpleDomainShader()
 void SimpleDomainShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
+	if (bound == this) bound = 0;
 	if (shader) { shader->Release(); shader = 0; }
 }
 
@@ -1013,7 +1344,11 @@ void SimpleDomainShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->DSSetShader(shader, 0, 0);
+	if (stateCache)
+		stateCache->SetDomainShader(shader);
+	else
+		deviceContext->DSSetShader(shader, 0, 0);
+	bound = this;
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1023,30 +1358,58 @@ void SimpleDomainShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->DSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+		BindBuffer(&constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the domain shader stage,
+// from the upload ring if that's where it was last copied
+// --------------------------------------------------------
+void SimpleDomainShader::SetConstantBuffer(SimpleConstantBuffer* cb)
+{
+	if (stateCache)
+	{
+		if (uploadRing && cb->RingConstantCount > 0)
+			stateCache->SetConstantBuffer(STAGE_DOMAIN, cb->BindIndex, *uploadRing->GetBuffer(), cb->RingFirstConstant, cb->RingConstantCount);
+		else
+			stateCache->SetConstantBuffer(STAGE_DOMAIN, cb->BindIndex, cb->ConstantBuffer);
+		return;
+	}
+
+	if (uploadRing && cb->RingConstantCount > 0)
+	{
+		uploadRing->GetContext()->DSSetConstantBuffers1(
+			cb->BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			uploadRing->GetBuffer(),
+			&cb->RingFirstConstant,
+			&cb->RingConstantCount);
+		return;
 	}
+
+	deviceContext->DSSetConstantBuffers(cb->BindIndex, 1, &cb->ConstantBuffer);
 }
 
 // --------------------------------------------------------
 // Sets a shader resource view in the domain shader stage
 //
-// name - The name of the texture resource in the shader
+// srvHandle - The texture resource, from GetShaderResourceHandle()
 // srv - The shader resource view of the texture in GPU memory
 //
-// Returns true if a texture of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleDomainShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimpleDomainShader::SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	// Verify the handle
+	if (!srvHandle.IsValid())
 		return false;
 
 	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	if (stateCache)
+		stateCache->SetShaderResource(STAGE_DOMAIN, srvHandle.BindIndex, srv);
+	else
+		deviceContext->DSSetShaderResources(srvHandle.BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1055,20 +1418,22 @@ bool SimpleDomainShader::SetShaderResourceView(std::string name, ID3D11ShaderRes
 // --------------------------------------------------------
 // Sets a sampler state in the domain shader stage
 //
-// name - The name of the sampler state in the shader
+// samplerHandle - The sampler state, from GetSamplerHandle()
 // samplerState - The sampler state in GPU memory
 //
-// Returns true if a sampler of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleDomainShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimpleDomainShader::SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	// Verify the handle
+	if (!samplerHandle.IsValid())
 		return false;
 
-	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	// Set the sampler state
+	if (stateCache)
+		stateCache->SetSampler(STAGE_DOMAIN, samplerHandle.BindIndex, samplerState);
+	else
+		deviceContext->DSSetSamplers(samplerHandle.BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1080,6 +1445,8 @@ bool SimpleDomainShader::SetSamplerState(std::string name, ID3D11SamplerState* s
 // ------ SIMPLE HULL SHADER --------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+SimpleHullShader* SimpleHullShader::bound = 0;
+
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
@@ -1103,6 +1470,7 @@ SimpleHullShader::~SimpleHullShader()
 void SimpleHullShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
+	if (bound == this) bound = 0;
 	if (shader) { shader->Release(); shader = 0; }
 }
 
@@ -1140,7 +1508,11 @@ void SimpleHullShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->HSSetShader(shader, 0, 0);
+	if (stateCache)
+		stateCache->SetHullShader(shader);
+	else
+		deviceContext->HSSetShader(shader, 0, 0);
+	bound = this;
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1150,30 +1522,58 @@ void SimpleHullShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->HSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+		BindBuffer(&constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the hull shader stage,
+// from the upload ring if that's where it was last copied
+// --------------------------------------------------------
+void SimpleHullShader::SetConstantBuffer(SimpleConstantBuffer* cb)
+{
+	if (stateCache)
+	{
+		if (uploadRing && cb->RingConstantCount > 0)
+			stateCache->SetConstantBuffer(STAGE_HULL, cb->BindIndex, *uploadRing->GetBuffer(), cb->RingFirstConstant, cb->RingConstantCount);
+		else
+			stateCache->SetConstantBuffer(STAGE_HULL, cb->BindIndex, cb->ConstantBuffer);
+		return;
+	}
+
+	if (uploadRing && cb->RingConstantCount > 0)
+	{
+		uploadRing->GetContext()->HSSetConstantBuffers1(
+			cb->BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			uploadRing->GetBuffer(),
+			&cb->RingFirstConstant,
+			&cb->RingConstantCount);
+		return;
 	}
+
+	deviceContext->HSSetConstantBuffers(cb->BindIndex, 1, &cb->ConstantBuffer);
 }
 
 // --------------------------------------------------------
 // Sets a shader resource view in the hull shader stage
 //
-// name - The name of the texture resource in the shader
+// srvHandle - The texture resource, from GetShaderResourceHandle()
 // srv - The shader resource view of the texture in GPU memory
 //
-// Returns true if a texture of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleHullShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimpleHullShader::SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	// Verify the handle
+	if (!srvHandle.IsValid())
 		return false;
 
 	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	if (stateCache)
+		stateCache->SetShaderResource(STAGE_HULL, srvHandle.BindIndex, srv);
+	else
+		deviceContext->HSSetShaderResources(srvHandle.BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1182,20 +1582,22 @@ bool SimpleHullShader::SetShaderResourceView(std::string name, ID3D11ShaderResou
 // --------------------------------------------------------
 // Sets a sampler state in the hull shader stage
 //
-// name - The name of the sampler state in the shader
+// samplerHandle - The sampler state, from GetSamplerHandle()
 // samplerState - The sampler state in GPU memory
 //
-// Returns true if a sampler of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleHullShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimpleHullShader::SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	// Verify the handle
+	if (!samplerHandle.IsValid())
 		return false;
 
-	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	// Set the sampler state
+	if (stateCache)
+		stateCache->SetSampler(STAGE_HULL, samplerHandle.BindIndex, samplerState);
+	else
+		deviceContext->HSSetSamplers(samplerHandle.BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1208,6 +1610,8 @@ bool SimpleHullShader::SetSamplerState(std::string name, ID3D11SamplerState* sam
 // ------ SIMPLE GEOMETRY SHADER ----------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+SimpleGeometryShader* SimpleGeometryShader::bound = 0;
+
 // --------------------------------------------------------
 // Constructor calls the base and sets up potential stream-out options
 // --------------------------------------------------------
@@ -1233,6 +1637,7 @@ SimpleGeometryShader::~SimpleGeometryShader()
 void SimpleGeometryShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
+	if (bound == this) bound = 0;
 	if (shader) { shader->Release(); shader = 0; }
 }
 
@@ -1389,7 +1794,11 @@ void SimpleGeometryShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->GSSetShader(shader, 0, 0);
+	if (stateCache)
+		stateCache->SetGeometryShader(shader);
+	else
+		deviceContext->GSSetShader(shader, 0, 0);
+	bound = this;
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1399,30 +1808,58 @@ void SimpleGeometryShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->GSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+		BindBuffer(&constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the geometry shader stage,
+// from the upload ring if that's where it was last copied
+// --------------------------------------------------------
+void SimpleGeometryShader::SetConstantBuffer(SimpleConstantBuffer* cb)
+{
+	if (stateCache)
+	{
+		if (uploadRing && cb->RingConstantCount > 0)
+			stateCache->SetConstantBuffer(STAGE_GEOMETRY, cb->BindIndex, *uploadRing->GetBuffer(), cb->RingFirstConstant, cb->RingConstantCount);
+		else
+			stateCache->SetConstantBuffer(STAGE_GEOMETRY, cb->BindIndex, cb->ConstantBuffer);
+		return;
+	}
+
+	if (uploadRing && cb->RingConstantCount > 0)
+	{
+		uploadRing->GetContext()->GSSetConstantBuffers1(
+			cb->BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			uploadRing->GetBuffer(),
+			&cb->RingFirstConstant,
+			&cb->RingConstantCount);
+		return;
 	}
+
+	deviceContext->GSSetConstantBuffers(cb->BindIndex, 1, &cb->ConstantBuffer);
 }
 
 // --------------------------------------------------------
 // Sets a shader resource view in the Geometry shader stage
 //
-// name - The name of the texture resource in the shader
+// srvHandle - The texture resource, from GetShaderResourceHandle()
 // srv - The shader resource view of the texture in GPU memory
 //
-// Returns true if a texture of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleGeometryShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimpleGeometryShader::SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	// Verify the handle
+	if (!srvHandle.IsValid())
 		return false;
 
 	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	if (stateCache)
+		stateCache->SetShaderResource(STAGE_GEOMETRY, srvHandle.BindIndex, srv);
+	else
+		deviceContext->GSSetShaderResources(srvHandle.BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1431,20 +1868,22 @@ bool SimpleGeometryShader::SetShaderResourceView(std::string name, ID3D11ShaderR
 // --------------------------------------------------------
 // Sets a sampler state in the Geometry shader stage
 //
-// name - The name of the sampler state in the shader
+// samplerHandle - The sampler state, from GetSamplerHandle()
 // samplerState - The sampler state in GPU memory
 //
-// Returns true if a sampler of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleGeometryShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimpleGeometryShader::SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	// Verify the handle
+	if (!samplerHandle.IsValid())
 		return false;
 
-	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	// Set the sampler state
+	if (stateCache)
+		stateCache->SetSampler(STAGE_GEOMETRY, samplerHandle.BindIndex, samplerState);
+	else
+		deviceContext->GSSetSamplers(samplerHandle.BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1473,6 +1912,8 @@ unsigned int SimpleGeometryShader::CalcComponentCount(unsigned int mask)
 // ------ SIMPLE COMPUTE SHADER -----------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+SimpleComputeShader* SimpleComputeShader::bound = 0;
+
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
@@ -1496,6 +1937,7 @@ SimpleComputeShader::~SimpleComputeShader()
 void SimpleComputeShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
+	if (bound == this) bound = 0;
 	if (shader) { shader->Release(); shader = 0; }
 
 	uavTable.clear();
@@ -1579,7 +2021,11 @@ void SimpleComputeShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->CSSetShader(shader, 0, 0);
+	if (stateCache)
+		stateCache->SetComputeShader(shader);
+	else
+		deviceContext->CSSetShader(shader, 0, 0);
+	bound = this;
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1589,11 +2035,37 @@ void SimpleComputeShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->CSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+		BindBuffer(&constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the compute shader stage,
+// from the upload ring if that's where it was last copied
+// --------------------------------------------------------
+void SimpleComputeShader::SetConstantBuffer(SimpleConstantBuffer* cb)
+{
+	if (stateCache)
+	{
+		if (uploadRing && cb->RingConstantCount > 0)
+			stateCache->SetConstantBuffer(STAGE_COMPUTE, cb->BindIndex, *uploadRing->GetBuffer(), cb->RingFirstConstant, cb->RingConstantCount);
+		else
+			stateCache->SetConstantBuffer(STAGE_COMPUTE, cb->BindIndex, cb->ConstantBuffer);
+		return;
+	}
+
+	if (uploadRing && cb->RingConstantCount > 0)
+	{
+		uploadRing->GetContext()->CSSetConstantBuffers1(
+			cb->BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			uploadRing->GetBuffer(),
+			&cb->RingFirstConstant,
+			&cb->RingConstantCount);
+		return;
 	}
+
+	deviceContext->CSSetConstantBuffers(cb->BindIndex, 1, &cb->ConstantBuffer);
 }
 
 // --------------------------------------------------------
@@ -1652,20 +2124,22 @@ void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int
 // --------------------------------------------------------
 // Sets a shader resource view in the Compute shader stage
 //
-// name - The name of the texture resource in the shader
+// srvHandle - The texture resource, from GetShaderResourceHandle()
 // srv - The shader resource view of the texture in GPU memory
 //
-// Returns true if a texture of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleComputeShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
+bool SimpleComputeShader::SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	// Verify the handle
+	if (!srvHandle.IsValid())
 		return false;
 
 	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	if (stateCache)
+		stateCache->SetShaderResource(STAGE_COMPUTE, srvHandle.BindIndex, srv);
+	else
+		deviceContext->CSSetShaderResources(srvHandle.BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1674,20 +2148,22 @@ bool SimpleComputeShader::SetShaderResourceView(std::string name, ID3D11ShaderRe
 // --------------------------------------------------------
 // Sets a sampler state in the Compute shader stage
 //
-// name - The name of the sampler state in the shader
+// samplerHandle - The sampler state, from GetSamplerHandle()
 // samplerState - The sampler state in GPU memory
 //
-// Returns true if a sampler of the given name was found, false otherwise
+// Returns true if the handle is valid, false otherwise
 // --------------------------------------------------------
-bool SimpleComputeShader::SetSamplerState(std::string name, ID3D11SamplerState* samplerState)
+bool SimpleComputeShader::SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	// Verify the handle
+	if (!samplerHandle.IsValid())
 		return false;
 
-	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	// Set the sampler state
+	if (stateCache)
+		stateCache->SetSampler(STAGE_COMPUTE, samplerHandle.BindIndex, samplerState);
+	else
+		deviceContext->CSSetSamplers(samplerHandle.BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
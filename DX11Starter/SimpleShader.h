@@ -10,6 +10,11 @@
 #include <vector>
 #include <string>
 
+#include "ShaderHandles.h"
+
+class ConstantBufferRing;
+class D3D11StateCache;
+
 // --------------------------------------------------------
 // Used by simple shaders to store information about
 // specific variables in constant buffers
@@ -35,6 +40,27 @@ struct SimpleConstantBuffer
 	ID3D11Buffer* ConstantBuffer;
 	unsigned char* LocalDataBuffer;
 	std::vector<SimpleShaderVariable> Variables;
+
+	// LocalDataBuffer changed since the last copy to the GPU
+	bool Dirty;
+
+	// Where the last copy landed in the upload ring, if one is in use
+	unsigned int RingGeneration;
+	unsigned int RingFirstConstant;
+	unsigned int RingConstantCount;
+};
+
+// --------------------------------------------------------
+// Counts constant buffer traffic across all shaders, so
+// the savings from skipping unchanged data can be seen
+// --------------------------------------------------------
+struct SimpleUploadStats
+{
+	unsigned int SetCalls;		// Variables set through SetData()
+	unsigned int SetsUnchanged;	// ...of which already held that value
+	unsigned int Uploads;		// Buffers copied to the GPU
+	unsigned int UploadsSkipped;// Copies skipped since nothing changed
+	unsigned int BytesUploaded;	// Size of the copied buffers
 };
 
 // --------------------------------------------------------
@@ -77,8 +103,15 @@ public:
 	void CopyBufferData(unsigned int index);
 	void CopyBufferData(std::string bufferName);
 
+	// Looking up variables and resources once, for the
+	// handle versions of the setters below
+	ShaderVarHandle GetVariableHandle(std::string name);
+	ShaderResourceHandle GetShaderResourceHandle(std::string name);
+	ShaderResourceHandle GetSamplerHandle(std::string name);
+
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
+	bool SetData(ShaderVarHandle var, const void* data, unsigned int size);
 
 	bool SetInt(std::string name, int data);
 	bool SetFloat(std::string name, float data);
@@ -91,9 +124,22 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	bool SetInt(ShaderVarHandle var, int data);
+	bool SetFloat(ShaderVarHandle var, float data);
+	bool SetFloat2(ShaderVarHandle var, const float data[2]);
+	bool SetFloat2(ShaderVarHandle var, const DirectX::XMFLOAT2& data);
+	bool SetFloat3(ShaderVarHandle var, const float data[3]);
+	bool SetFloat3(ShaderVarHandle var, const DirectX::XMFLOAT3& data);
+	bool SetFloat4(ShaderVarHandle var, const float data[4]);
+	bool SetFloat4(ShaderVarHandle var, const DirectX::XMFLOAT4& data);
+	bool SetMatrix4x4(ShaderVarHandle var, const float data[16]);
+	bool SetMatrix4x4(ShaderVarHandle var, const DirectX::XMFLOAT4X4& data);
+
 	// Setting shader resources
-	virtual bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv) = 0;
-	virtual bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState) = 0;
+	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	virtual bool SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv) = 0;
+	virtual bool SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState) = 0;
 
 	// Getting data about variables and resources
 	const SimpleShaderVariable* GetVariableInfo(std::string name);
@@ -115,7 +161,24 @@ public:
 	// Misc getters
 	ID3DBlob* GetShaderBlob() { return shaderBlob; }
 
+	// Changed buffers are sub-allocated from this ring when set, otherwise
+	// each buffer is updated in place.  The ring must outlive any draws.
+	static void SetUploadRing(ConstantBufferRing* ring) { uploadRing = ring; }
+
+	// Upload counters since the last reset (DXCore resets them every frame)
+	static const SimpleUploadStats& GetUploadStats() { return uploadStats; }
+	static void ResetUploadStats();
+
+	// Shaders, constant buffers, SRVs and samplers are bound through this
+	// cache when set, so rebinding what's already there costs nothing
+	static void SetStateCache(D3D11StateCache* cache) { stateCache = cache; }
+	static D3D11StateCache* GetStateCache() { return stateCache; }
+
 protected:
+
+	static ConstantBufferRing* uploadRing;
+	static D3D11StateCache* stateCache;
+	static SimpleUploadStats uploadStats;
 	
 	bool shaderValid;
 	ID3DBlob* shaderBlob;
@@ -137,12 +200,20 @@ protected:
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(ID3DBlob* shaderBlob) = 0;
 	virtual void SetShaderAndCBs() = 0;
+	virtual void SetConstantBuffer(SimpleConstantBuffer* cb) = 0;
+	virtual bool IsBound() = 0;
 
 	virtual void CleanUp();
 
 	// Helpers for finding data by name
 	SimpleShaderVariable* FindVariable(std::string name, int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
+
+	// Helpers for getting constant buffers to the GPU
+	void UploadBuffer(SimpleConstantBuffer* cb);
+	void BindBuffer(SimpleConstantBuffer* cb);
+	void RefreshStaleBuffers();
+	static void RefreshBoundShaders();
 };
 
 // --------------------------------------------------------
@@ -158,15 +229,21 @@ public:
 	ID3D11InputLayout* GetInputLayout() { return inputLayout; }
 	bool GetPerInstanceCompatible() { return perInstanceCompatible; }
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
+	bool SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState);
 
 protected:
 	bool perInstanceCompatible;
 	ID3D11InputLayout* inputLayout;
 	ID3D11VertexShader* shader;
+	static SimpleVertexShader* bound;
+	friend class ISimpleShader;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCBs();
+	void SetConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsBound() { return bound == this; }
 	void CleanUp();
 };
 
@@ -181,13 +258,19 @@ public:
 	~SimplePixelShader();
 	ID3D11PixelShader* GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
+	bool SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState);
 
 protected:
 	ID3D11PixelShader* shader;
+	static SimplePixelShader* bound;
+	friend class ISimpleShader;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCBs();
+	void SetConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsBound() { return bound == this; }
 	void CleanUp();
 };
 
@@ -201,13 +284,19 @@ public:
 	~SimpleDomainShader();
 	ID3D11DomainShader* GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
+	bool SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState);
 
 protected:
 	ID3D11DomainShader* shader;
+	static SimpleDomainShader* bound;
+	friend class ISimpleShader;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCBs();
+	void SetConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsBound() { return bound == this; }
 	void CleanUp();
 };
 
@@ -221,13 +310,19 @@ public:
 	~SimpleHullShader();
 	ID3D11HullShader* GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
+	bool SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState);
 
 protected:
 	ID3D11HullShader* shader;
+	static SimpleHullShader* bound;
+	friend class ISimpleShader;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCBs();
+	void SetConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsBound() { return bound == this; }
 	void CleanUp();
 };
 
@@ -241,8 +336,10 @@ public:
 	~SimpleGeometryShader();
 	ID3D11GeometryShader* GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
+	bool SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState);
 
 	bool CreateCompatibleStreamOutBuffer(ID3D11Buffer** buffer, int vertexCount);
 
@@ -251,6 +348,8 @@ public:
 protected:
 	// Shader itself
 	ID3D11GeometryShader* shader;
+	static SimpleGeometryShader* bound;
+	friend class ISimpleShader;
 
 	// Stream out related
 	bool useStreamOut;
@@ -260,6 +359,8 @@ protected:
 	bool CreateShader(ID3DBlob* shaderBlob);
 	bool CreateShaderWithStreamOut(ID3DBlob* shaderBlob);
 	void SetShaderAndCBs();
+	void SetConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsBound() { return bound == this; }
 	void CleanUp();
 
 	// Helpers
@@ -280,14 +381,18 @@ public:
 	void DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ);
 	void DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ);
 
-	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
-	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
+	bool SetShaderResourceView(ShaderResourceHandle srvHandle, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(ShaderResourceHandle samplerHandle, ID3D11SamplerState* samplerState);
 	bool SetUnorderedAccessView(std::string name, ID3D11UnorderedAccessView* uav, unsigned int appendConsumeOffset = -1);
 
 	int GetUnorderedAccessViewIndex(std::string name);
 
 protected:
 	ID3D11ComputeShader* shader;
+	static SimpleComputeShader* bound;
+	friend class ISimpleShader;
 	std::unordered_map<std::string, unsigned int> uavTable;
 
 	unsigned int threadsX;
@@ -297,5 +402,7 @@ protected:
 
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCBs();
+	void SetConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsBound() { return bound == this; }
 	void CleanUp();
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "Tags.h"
+
+const u32 TagRegistry::MAX_TAGS;
+const TagID TagRegistry::INVALID_TAG;
+
+TagRegistry::TagRegistry() :
+	ids(),
+	names()
+{
+	ids.reserve(MAX_TAGS);
+	names.reserve(MAX_TAGS);
+}
+
+TagRegistry& TagRegistry::Get()
+{
+	static TagRegistry registry;
+	return registry;
+}
+
+TagID TagRegistry::Intern(const std::string& name)
+{
+	TagRegistry& registry = Get();
+
+	std::unordered_map<std::string, TagID>::const_iterator found = registry.ids.find(name);
+	if (found != registry.ids.end()) { return found->second; }
+
+	if (registry.names.size() >= MAX_TAGS) { return INVALID_TAG; }
+
+	TagID id = (TagID)registry.names.size();
+	registry.ids.emplace(name, id);
+	registry.names.push_back(name);
+	return id;
+}
+
+TagID TagRegistry::Find(const std::string& name)
+{
+	TagRegistry& registry = Get();
+
+	std::unordered_map<std::string, TagID>::const_iterator found = registry.ids.find(name);
+	return (found != registry.ids.end()) ? found->second : INVALID_TAG;
+}
+
+const std::string& TagRegistry::GetName(TagID tag)
+{
+	return Get().names[tag];
+}
+
+u32 TagRegistry::GetCount()
+{
+	return (u32)Get().names.size();
+}
+
+std::vector<TagID> TagSet::ToVector() const
+{
+	std::vector<TagID> tags;
+
+	for (u32 w = 0; w < WORD_COUNT; ++w)
+	{
+		u64 word = words[w];
+		for (u32 b = 0; word != 0; ++b, word >>= 1)
+		{
+			if (word & 1) { tags.push_back((TagID)(w * 64 + b)); }
+		}
+	}
+
+	return tags;
+}
@@ -0,0 +1,67 @@
+#ifndef TAGS_H_
+#define TAGS_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+
+// Interned tag identifier - cheap to compare, hash and store, unlike the string it was made from
+typedef u16 TagID;
+
+// Global string <-> TagID table
+// Interning is not thread-safe ; it is expected to happen while loading or from the main thread
+class TagRegistry
+{
+public:
+	// Per-entity tag sets are fixed-size bitsets, which caps the number of distinct tags
+	static const u32 MAX_TAGS = 256;
+	static const TagID INVALID_TAG = 0xFFFF;
+
+private:
+	std::unordered_map<std::string, TagID> ids;
+	std::vector<std::string> names;
+
+	TagRegistry();
+
+	static TagRegistry& Get();
+
+public:
+	// Returns the ID for a tag, registering it on first use (INVALID_TAG once MAX_TAGS is exceeded)
+	static TagID Intern(const std::string& name);
+	// Returns the ID for an already registered tag without registering it, or INVALID_TAG
+	static TagID Find(const std::string& name);
+
+	static const std::string& GetName(TagID tag);
+	static u32 GetCount();
+};
+
+// Fixed-size set of TagIDs, stored as a bitset
+class TagSet
+{
+public:
+	static const u32 WORD_COUNT = TagRegistry::MAX_TAGS / 64;
+
+private:
+	u64 words[WORD_COUNT];
+
+public:
+	inline TagSet() { Clear(); }
+
+	inline bool Has(TagID tag) const { return tag < TagRegistry::MAX_TAGS && (words[tag >> 6] & (1ull << (tag & 63))) != 0; }
+	inline void Add(TagID tag)       { words[tag >> 6] |= (1ull << (tag & 63)); }
+	inline void Remove(TagID tag)    { words[tag >> 6] &= ~(1ull << (tag & 63)); }
+	inline void Clear()              { for (u32 i = 0; i < WORD_COUNT; ++i) { words[i] = 0; } }
+
+	inline bool IsEmpty() const { for (u32 i = 0; i < WORD_COUNT; ++i) { if (words[i] != 0) { return false; } } return true; }
+	inline u64  GetWord(u32 i) const { return words[i]; }
+
+	// True if every tag of another set is also in this one
+	inline bool HasAll(const TagSet& other) const { for (u32 i = 0; i < WORD_COUNT; ++i) { if ((words[i] & other.words[i]) != other.words[i]) { return false; } } return true; }
+
+	// Lists the tags in this set in ascending order
+	std::vector<TagID> ToVector() const;
+};
+
+#endif
@@ -48,9 +48,9 @@ void Terrain::GenerateGrid()
 		for (int j = 0; i < resolution; j++) 
 		{
 			TerrainVertex V = TerrainVertex();
-			V.Position = XMFLOAT3(i,heightArray[i+j],j);
-			V.UV = XMFLOAT2(0, 0);
-			V.Normal = XMFLOAT3(0,1,0);
+			V.Position = glm::vec3(i,heightArray[i+j],j);
+			V.UV = glm::vec2(0, 0);
+			V.Normal = glm::vec3(0,1,0);
 			vertexArray[i + j] = V;
 		}
 	}
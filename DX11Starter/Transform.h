@@ -5,6 +5,8 @@
 #include "glm/glm.hpp"
 #include "glm/gtx/quaternion.hpp"
 
+#include "Affine.h"
+
 using namespace glm;
 
 class Transform
@@ -59,6 +61,8 @@ public:
 	inline vec3 UpVector()      const { return rotate(rot, vec3(0.0f, 1.0f, 0.0f)); }
 
 	inline mat4 GetMatrix() const { return scale(translate(identity<mat4>(), pos) * toMat4(rot), sca); }
+	inline affine GetAffine() const        { return AffineFromTRS(pos, rot, sca); }
+	inline affine GetInverseAffine() const { return AffineInverseTRS(pos, rot, sca); }
 
 	// Translate with respect to self
 	inline void TranslateLocal(vec3 v) { pos += rotate(rot, v); }
@@ -0,0 +1,149 @@
+#include "TransformKernels.h"
+
+#include <xmmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace
+{
+	// Splits 4 packed vec3s into one register per component
+	inline void LoadVec3x4(const float* v, __m128& x, __m128& y, __m128& z)
+	{
+		__m128 a = _mm_loadu_ps(v);     // x0 y0 z0 x1
+		__m128 b = _mm_loadu_ps(v + 4); // y1 z1 x2 y2
+		__m128 c = _mm_loadu_ps(v + 8); // z2 x3 y3 z3
+
+		x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	// Writes 4 affines from one register per matrix element (column by column)
+	inline void StoreAffinex4(float* out, __m128 m[12])
+	{
+		// Each group of 4 elements transposes into the same 4 floats of every matrix
+		for (u32 g = 0; g < 3; ++g)
+		{
+			__m128 r0 = m[g * 4 + 0], r1 = m[g * 4 + 1], r2 = m[g * 4 + 2], r3 = m[g * 4 + 3];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out + 0 * 12 + g * 4, r0);
+			_mm_storeu_ps(out + 1 * 12 + g * 4, r1);
+			_mm_storeu_ps(out + 2 * 12 + g * 4, r2);
+			_mm_storeu_ps(out + 3 * 12 + g * 4, r3);
+		}
+	}
+
+	struct Dispatch
+	{
+		ComposeTRSFunction fn;
+		const char* name;
+	};
+
+	// Picked once, on first use from whichever thread gets there first
+	const Dispatch& GetDispatch()
+	{
+		static const Dispatch dispatch = CPUSupportsAVX2() ? Dispatch{ &ComposeTRSAVX2, "AVX2" } : Dispatch{ &ComposeTRSSSE, "SSE" };
+		return dispatch;
+	}
+}
+
+void ComposeTRSScalar(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out)
+{
+	for (u64 i = 0; i < count; ++i)
+	{
+		out[i] = AffineFromTRS(positions[i], rotations[i], scales[i]);
+	}
+}
+
+void ComposeTRSSSE(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	u64 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 px, py, pz, sx, sy, sz;
+		LoadVec3x4(&positions[i].x, px, py, pz);
+		LoadVec3x4(&scales[i].x, sx, sy, sz);
+
+		__m128 qx = _mm_loadu_ps(&rotations[i + 0].x);
+		__m128 qy = _mm_loadu_ps(&rotations[i + 1].x);
+		__m128 qz = _mm_loadu_ps(&rotations[i + 2].x);
+		__m128 qw = _mm_loadu_ps(&rotations[i + 3].x);
+		_MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+
+		// Same terms as glm's quaternion to matrix conversion
+		__m128 x2 = _mm_mul_ps(qx, two), y2 = _mm_mul_ps(qy, two), z2 = _mm_mul_ps(qz, two);
+		__m128 xx = _mm_mul_ps(qx, x2), yy = _mm_mul_ps(qy, y2), zz = _mm_mul_ps(qz, z2);
+		__m128 xy = _mm_mul_ps(qx, y2), xz = _mm_mul_ps(qx, z2), yz = _mm_mul_ps(qy, z2);
+		__m128 wx = _mm_mul_ps(qw, x2), wy = _mm_mul_ps(qw, y2), wz = _mm_mul_ps(qw, z2);
+
+		__m128 m[12];
+		m[0]  = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+		m[1]  = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+		m[2]  = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+		m[3]  = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+		m[4]  = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+		m[5]  = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+		m[6]  = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+		m[7]  = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+		m[8]  = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+		m[9]  = px;
+		m[10] = py;
+		m[11] = pz;
+
+		StoreAffinex4(&out[i][0].x, m);
+	}
+
+	ComposeTRSScalar(count - i, positions + i, rotations + i, scales + i, out + i);
+}
+
+bool CPUSupportsAVX2()
+{
+	u32 leaf1[4] = { 0, 0, 0, 0 };
+	u32 leaf7[4] = { 0, 0, 0, 0 };
+
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7) { return false; }
+	__cpuid(regs, 1);
+	for (u32 r = 0; r < 4; ++r) { leaf1[r] = (u32)regs[r]; }
+	__cpuidex(regs, 7, 0);
+	for (u32 r = 0; r < 4; ++r) { leaf7[r] = (u32)regs[r]; }
+#else
+	if (__get_cpuid_max(0, nullptr) < 7) { return false; }
+	__cpuid(1, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+	__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+#endif
+
+	bool fma = (leaf1[2] & (1u << 12)) != 0;
+	bool osxsave = (leaf1[2] & (1u << 27)) != 0;
+	bool avx2 = (leaf7[1] & (1u << 5)) != 0;
+	if (!fma || !osxsave || !avx2) { return false; }
+
+	// The OS also has to save the upper halves of the YMM registers on context switches
+#ifdef _MSC_VER
+	u64 xcr0 = _xgetbv(0);
+#else
+	u32 lo, hi;
+	__asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	u64 xcr0 = ((u64)hi << 32) | lo;
+#endif
+	return (xcr0 & 6) == 6;
+}
+
+void ComposeTRS(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out)
+{
+	GetDispatch().fn(count, positions, rotations, scales, out);
+}
+
+const char* GetComposeTRSPathName()
+{
+	return GetDispatch().name;
+}
@@ -0,0 +1,29 @@
+#ifndef TRANSFORM_KERNELS_H_
+#define TRANSFORM_KERNELS_H_
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "Types.h"
+#include "Affine.h"
+
+// Batch kernels turning arrays of positions, rotations and scales into affine matrices
+// Equivalent to calling AffineFromTRS on each element, only several elements at a time
+
+typedef void (*ComposeTRSFunction)(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out);
+
+// One element at a time, the reference the vector paths are validated against
+void ComposeTRSScalar(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out);
+// 4 elements at a time
+void ComposeTRSSSE(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out);
+// 8 elements at a time, only callable when the CPU supports AVX2 and FMA
+void ComposeTRSAVX2(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out);
+
+bool CPUSupportsAVX2();
+
+// Fastest path the running CPU supports, picked on first use
+void ComposeTRS(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out);
+const char* GetComposeTRSPathName();
+
+#endif
@@ -0,0 +1,111 @@
+// Built with AVX2 code generation enabled (see the project file), so only call into here after checking CPUSupportsAVX2
+//
+// As in FrustumCullingAVX.cpp, nothing inline from outside this file (glm included) may be called here, or the
+// AVX2 copy could end up shared with code running on CPUs without it ; only data members are touched
+#include "TransformKernels.h"
+
+#include <immintrin.h>
+
+namespace
+{
+	// Gathers are slower than shuffles on most chips, so inputs are split 4 at a time and the halves joined
+	inline void LoadVec3x4(const float* v, __m128& x, __m128& y, __m128& z)
+	{
+		__m128 a = _mm_loadu_ps(v);
+		__m128 b = _mm_loadu_ps(v + 4);
+		__m128 c = _mm_loadu_ps(v + 8);
+
+		x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	inline void LoadVec3x8(const float* v, __m256& x, __m256& y, __m256& z)
+	{
+		__m128 xl, yl, zl, xh, yh, zh;
+		LoadVec3x4(v, xl, yl, zl);
+		LoadVec3x4(v + 12, xh, yh, zh);
+		x = _mm256_insertf128_ps(_mm256_castps128_ps256(xl), xh, 1);
+		y = _mm256_insertf128_ps(_mm256_castps128_ps256(yl), yh, 1);
+		z = _mm256_insertf128_ps(_mm256_castps128_ps256(zl), zh, 1);
+	}
+
+	inline void LoadQuatx8(const float* q, __m256& x, __m256& y, __m256& z, __m256& w)
+	{
+		// Pairs quat i with quat i + 4 in each register, so one 8-wide transpose splits all of them
+		__m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q + 0)),  _mm_loadu_ps(q + 16), 1);
+		__m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q + 4)),  _mm_loadu_ps(q + 20), 1);
+		__m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q + 8)),  _mm_loadu_ps(q + 24), 1);
+		__m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q + 12)), _mm_loadu_ps(q + 28), 1);
+
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		__m256 t1 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t2 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+		x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+		y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+		z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		w = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	// Lane k of each register belongs to matrix k (low half) or k + 4 (high half), so transposing within
+	// the 128-bit halves lines up 4 floats of two matrices at once
+	inline void StoreAffinex8(float* out, __m256 m[12])
+	{
+		for (u32 g = 0; g < 3; ++g)
+		{
+			__m256 t0 = _mm256_unpacklo_ps(m[g * 4 + 0], m[g * 4 + 1]);
+			__m256 t1 = _mm256_unpacklo_ps(m[g * 4 + 2], m[g * 4 + 3]);
+			__m256 t2 = _mm256_unpackhi_ps(m[g * 4 + 0], m[g * 4 + 1]);
+			__m256 t3 = _mm256_unpackhi_ps(m[g * 4 + 2], m[g * 4 + 3]);
+			__m256 r[4];
+			r[0] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+			r[1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+			r[2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			r[3] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+			for (u32 k = 0; k < 4; ++k)
+			{
+				_mm_storeu_ps(out + k * 12 + g * 4, _mm256_castps256_ps128(r[k]));
+				_mm_storeu_ps(out + (k + 4) * 12 + g * 4, _mm256_extractf128_ps(r[k], 1));
+			}
+		}
+	}
+}
+
+void ComposeTRSAVX2(u64 count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, affine* out)
+{
+	const __m256 two = _mm256_set1_ps(2.0f);
+
+	u64 i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 px, py, pz, sx, sy, sz, qx, qy, qz, qw;
+		LoadVec3x8(&positions[i].x, px, py, pz);
+		LoadVec3x8(&scales[i].x, sx, sy, sz);
+		LoadQuatx8(&rotations[i].x, qx, qy, qz, qw);
+
+		__m256 x2 = _mm256_mul_ps(qx, two), y2 = _mm256_mul_ps(qy, two), z2 = _mm256_mul_ps(qz, two);
+		__m256 xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+		__m256 xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+		__m256 wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+
+		__m256 m[12];
+		m[0]  = _mm256_fnmadd_ps(_mm256_add_ps(yy, zz), sx, sx); // (1 - (yy + zz)) * sx
+		m[1]  = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+		m[2]  = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+		m[3]  = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+		m[4]  = _mm256_fnmadd_ps(_mm256_add_ps(xx, zz), sy, sy);
+		m[5]  = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+		m[6]  = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+		m[7]  = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+		m[8]  = _mm256_fnmadd_ps(_mm256_add_ps(xx, yy), sz, sz);
+		m[9]  = px;
+		m[10] = py;
+		m[11] = pz;
+
+		StoreAffinex8(reinterpret_cast<float*>(out + i), m);
+	}
+
+	ComposeTRSScalar(count - i, positions + i, rotations + i, scales + i, out + i);
+}
@@ -0,0 +1,635 @@
+#include "TransformStore.h"
+#include "TransformKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+const u32 TransformStore::INVALID;
+const u32 TransformStore::COMPOSE_BATCH;
+
+void TransformStore::LinkChild(u32 parentSlot, u32 childSlot)
+{
+	parentSlots[childSlot] = parentSlot;
+	prevSibling[childSlot] = INVALID;
+	nextSibling[childSlot] = INVALID;
+
+	if (parentSlot == INVALID) { return; }
+
+	// Push to the front of the parent's child list, order doesn't matter
+	u32 head = firstChild[parentSlot];
+	nextSibling[childSlot] = head;
+	if (head != INVALID) { prevSibling[head] = childSlot; }
+	firstChild[parentSlot] = childSlot;
+	++childCounts[parentSlot];
+}
+
+void TransformStore::UnlinkChild(u32 childSlot)
+{
+	u32 parentSlot = parentSlots[childSlot];
+	if (parentSlot == INVALID) { return; }
+
+	u32 prev = prevSibling[childSlot];
+	u32 next = nextSibling[childSlot];
+
+	if (prev != INVALID) { nextSibling[prev] = next; }
+	else                 { firstChild[parentSlot] = next; }
+	if (next != INVALID) { prevSibling[next] = prev; }
+
+	--childCounts[parentSlot];
+
+	parentSlots[childSlot] = INVALID;
+	prevSibling[childSlot] = INVALID;
+	nextSibling[childSlot] = INVALID;
+}
+
+void TransformStore::Sort()
+{
+	u32 slotCount = (u32)slotToPacked.size();
+	u32 packedCount = (u32)packedToSlot.size();
+
+	// Work out the depth of every live slot, walking up only as far as the first ancestor already known
+	std::vector<u32> slotDepths(slotCount, INVALID);
+	std::vector<u32> chain;
+	u32 maxDepth = 0;
+
+	for (u32 p = 0; p < packedCount; ++p)
+	{
+		u32 s = packedToSlot[p];
+		if (s == INVALID) { continue; }
+
+		chain.clear();
+		while (s != INVALID && slotDepths[s] == INVALID)
+		{
+			chain.push_back(s);
+			s = parentSlots[s];
+		}
+
+		u32 d = (s == INVALID) ? 0 : slotDepths[s] + 1;
+		for (u64 i = chain.size(); i > 0; --i)
+		{
+			slotDepths[chain[i - 1]] = d++;
+		}
+
+		if (d - 1 > maxDepth) { maxDepth = d - 1; }
+	}
+
+	// Counting sort by depth, which is stable and guarantees parents precede their children
+	levelStarts.assign(maxDepth + 2, 0);
+	for (u32 p = 0; p < packedCount; ++p)
+	{
+		u32 s = packedToSlot[p];
+		if (s != INVALID) { ++levelStarts[slotDepths[s] + 1]; }
+	}
+	for (u32 d = 1; d < levelStarts.size(); ++d)
+	{
+		levelStarts[d] += levelStarts[d - 1];
+	}
+
+	std::vector<u32> order(liveCount);
+	std::vector<u32> cursors(levelStarts.begin(), levelStarts.end() - 1);
+	for (u32 p = 0; p < packedCount; ++p)
+	{
+		u32 s = packedToSlot[p];
+		if (s != INVALID) { order[cursors[slotDepths[s]]++] = p; }
+	}
+
+	// Permute every packed array into the new order
+	std::vector<vec3> newPositions(liveCount);
+	std::vector<quat> newRotations(liveCount);
+	std::vector<vec3> newScales(liveCount);
+	std::vector<affine> newWorlds(liveCount);
+	std::vector<affine> newInverses(liveCount);
+	std::vector<quat> newWorldRotations(liveCount);
+	std::vector<affine> newPreviousWorlds(liveCount);
+	std::vector<quat> newPreviousWorldRotations(liveCount);
+	std::vector<affine> newRenderWorlds(liveCount);
+	std::vector<u64>  newLocalVersions(liveCount);
+	std::vector<u64>  newWorldVersions(liveCount);
+	std::vector<u64>  newInverseVersions(liveCount);
+	std::vector<u64>  newValidated(liveCount);
+	std::vector<u32>  newDepths(liveCount);
+	std::vector<u08>  newFlags(liveCount);
+	std::vector<u32>  newPackedToSlot(liveCount);
+
+	for (u32 i = 0; i < liveCount; ++i)
+	{
+		u32 p = order[i];
+		u32 s = packedToSlot[p];
+
+		newPositions[i] = positions[p];
+		newRotations[i] = rotations[p];
+		newScales[i] = scales[p];
+		newWorlds[i] = worlds[p];
+		newInverses[i] = inverses[p];
+		newWorldRotations[i] = worldRotations[p];
+		newPreviousWorlds[i] = previousWorlds[p];
+		newPreviousWorldRotations[i] = previousWorldRotations[p];
+		newRenderWorlds[i] = renderWorlds[p];
+		newLocalVersions[i] = localVersions[p];
+		newWorldVersions[i] = worldVersions[p];
+		newInverseVersions[i] = inverseVersions[p];
+		newValidated[i] = validated[p];
+		newDepths[i] = slotDepths[s];
+		newFlags[i] = flags[p];
+		newPackedToSlot[i] = s;
+
+		slotToPacked[s] = i;
+	}
+
+	positions.swap(newPositions);
+	rotations.swap(newRotations);
+	scales.swap(newScales);
+	worlds.swap(newWorlds);
+	inverses.swap(newInverses);
+	worldRotations.swap(newWorldRotations);
+	previousWorlds.swap(newPreviousWorlds);
+	previousWorldRotations.swap(newPreviousWorldRotations);
+	renderWorlds.swap(newRenderWorlds);
+	localVersions.swap(newLocalVersions);
+	worldVersions.swap(newWorldVersions);
+	inverseVersions.swap(newInverseVersions);
+	validated.swap(newValidated);
+	depths.swap(newDepths);
+	flags.swap(newFlags);
+	packedToSlot.swap(newPackedToSlot);
+
+	// Parent links can only be remapped once every slot knows its new packed index
+	parents.resize(liveCount);
+	for (u32 i = 0; i < liveCount; ++i)
+	{
+		u32 ps = parentSlots[packedToSlot[i]];
+		parents[i] = (ps == INVALID) ? INVALID : slotToPacked[ps];
+	}
+
+	needsSort = false;
+}
+
+void TransformStore::RecalculateWorld(u32 p)
+{
+	RecalculateWorld(p, AffineFromTRS(positions[p], rotations[p], scales[p]));
+}
+
+void TransformStore::RecalculateWorld(u32 p, const affine& local)
+{
+	u32 par = parents[p];
+
+	if (par != INVALID)
+	{
+		worlds[p] = AffineMultiply(worlds[par], local);
+		worldRotations[p] = cross(worldRotations[par], rotations[p]);
+		worldVersions[p] = glm::max(localVersions[p], worldVersions[par]);
+	}
+	else
+	{
+		worlds[p] = local;
+		worldRotations[p] = rotations[p];
+		worldVersions[p] = localVersions[p];
+	}
+}
+
+void TransformStore::RecalculateInverse(u32 p, u32 par)
+{
+	// The local part is inverted analytically from its decomposition, no general matrix inverse needed
+	affine localInverse = AffineInverseTRS(positions[p], rotations[p], scales[p]);
+
+	if (par == INVALID)
+	{
+		inverses[p] = localInverse;
+	}
+	else if (inverseVersions[par] == worldVersions[par])
+	{
+		inverses[p] = AffineMultiply(localInverse, inverses[par]);
+	}
+	else
+	{
+		// Parent doesn't keep an inverse around, and a scaled parent may introduce shear, so invert the general way
+		inverses[p] = AffineInverse(worlds[p]);
+	}
+
+	inverseVersions[p] = worldVersions[p];
+}
+
+TransformStore::TransformStore() :
+	levelStarts(1, 0),
+	clock(0),
+	passClock(0),
+	liveCount(0),
+	needsSort(false)
+{
+	// Nothing interesting to do here
+}
+
+TransformStore::~TransformStore()
+{
+	// Nothing interesting to do here
+}
+
+TransformStore* TransformStore::Shared()
+{
+	static TransformStore shared;
+	return &shared;
+}
+
+void TransformStore::Reserve(u64 count)
+{
+	positions.reserve(count);
+	rotations.reserve(count);
+	scales.reserve(count);
+	worlds.reserve(count);
+	inverses.reserve(count);
+	worldRotations.reserve(count);
+	previousWorlds.reserve(count);
+	previousWorldRotations.reserve(count);
+	renderWorlds.reserve(count);
+	localVersions.reserve(count);
+	worldVersions.reserve(count);
+	inverseVersions.reserve(count);
+	validated.reserve(count);
+	parents.reserve(count);
+	depths.reserve(count);
+	flags.reserve(count);
+	packedToSlot.reserve(count);
+
+	slotToPacked.reserve(count);
+	owners.reserve(count);
+	parentSlots.reserve(count);
+	firstChild.reserve(count);
+	nextSibling.reserve(count);
+	prevSibling.reserve(count);
+	childCounts.reserve(count);
+}
+
+u32 TransformStore::Allocate(Object* owner, const Transform& t, u32 parentSlot)
+{
+	u32 slot;
+
+	// Reuse an old slot if possible, otherwise grow the slot arrays
+	if (freeSlots.size() != 0)
+	{
+		slot = freeSlots[freeSlots.size() - 1];
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = (u32)slotToPacked.size();
+		slotToPacked.push_back(INVALID);
+		owners.push_back(nullptr);
+		parentSlots.push_back(INVALID);
+		firstChild.push_back(INVALID);
+		nextSibling.push_back(INVALID);
+		prevSibling.push_back(INVALID);
+		childCounts.push_back(0);
+	}
+
+	// New entries always go at the end, which keeps them behind their parent
+	u32 p = (u32)packedToSlot.size();
+	u32 par = (parentSlot == INVALID) ? INVALID : slotToPacked[parentSlot];
+
+	positions.push_back(t.GetPosition());
+	rotations.push_back(t.GetRotation());
+	scales.push_back(t.GetScale());
+	worlds.push_back(affine(1.0f));
+	inverses.push_back(affine(1.0f));
+	worldRotations.push_back(identity<quat>());
+	previousWorlds.push_back(affine(1.0f));
+	previousWorldRotations.push_back(identity<quat>());
+	renderWorlds.push_back(affine(1.0f));
+	localVersions.push_back(++clock);
+	worldVersions.push_back(0);
+	inverseVersions.push_back(0);
+	validated.push_back(0);
+	u32 depth = (par == INVALID) ? 0 : depths[par] + 1;
+
+	parents.push_back(par);
+	depths.push_back(depth);
+	flags.push_back(NO_PREVIOUS_WORLD);
+	packedToSlot.push_back(slot);
+
+	// Appending keeps every level contiguous as long as this entry is at least as deep as the last one
+	u64 levelCount = levelStarts.size() - 1;
+	if (levelCount != 0 && depth == levelCount - 1) { levelStarts[levelCount] = p + 1; }
+	else if (depth == levelCount)                   { levelStarts.push_back(p + 1); }
+	else                                            { needsSort = true; }
+
+	slotToPacked[slot] = p;
+	owners[slot] = owner;
+	firstChild[slot] = INVALID;
+	childCounts[slot] = 0;
+	LinkChild(parentSlot, slot);
+
+	++liveCount;
+
+	return slot;
+}
+
+void TransformStore::AllocateBlock(u32 count, const vec3* blockPositions, const quat* blockRotations, const vec3* blockScales, const u32* blockParents, u32* blockSlots)
+{
+	// Reuse old slots first, like a single allocation, so waves spawned and destroyed over and over don't keep growing
+	// the slot arrays
+	u32 reused = (u32)std::min<u64>(count, freeSlots.size());
+	for (u32 i = 0; i < reused; ++i) { blockSlots[i] = freeSlots[freeSlots.size() - 1 - i]; }
+	freeSlots.resize(freeSlots.size() - reused);
+
+	u32 firstNewSlot = (u32)slotToPacked.size();
+	for (u32 i = reused; i < count; ++i) { blockSlots[i] = firstNewSlot + (i - reused); }
+
+	u32 firstPacked = (u32)packedToSlot.size();
+	u32 slotEnd = firstNewSlot + (count - reused);
+	u32 packedEnd = firstPacked + count;
+
+	// Grow every array once, copying the local transformations across as whole blocks
+	slotToPacked.resize(slotEnd);
+	owners.resize(slotEnd, nullptr);
+	parentSlots.resize(slotEnd, INVALID);
+	firstChild.resize(slotEnd, INVALID);
+	nextSibling.resize(slotEnd, INVALID);
+	prevSibling.resize(slotEnd, INVALID);
+	childCounts.resize(slotEnd, 0);
+
+	positions.insert(positions.end(), blockPositions, blockPositions + count);
+	rotations.insert(rotations.end(), blockRotations, blockRotations + count);
+	scales.insert(scales.end(), blockScales, blockScales + count);
+	worlds.resize(packedEnd, affine(1.0f));
+	inverses.resize(packedEnd, affine(1.0f));
+	worldRotations.resize(packedEnd, identity<quat>());
+	previousWorlds.resize(packedEnd, affine(1.0f));
+	previousWorldRotations.resize(packedEnd, identity<quat>());
+	renderWorlds.resize(packedEnd, affine(1.0f));
+	localVersions.resize(packedEnd, ++clock);
+	worldVersions.resize(packedEnd, 0);
+	inverseVersions.resize(packedEnd, 0);
+	validated.resize(packedEnd, 0);
+	parents.resize(packedEnd);
+	depths.resize(packedEnd);
+	flags.resize(packedEnd, NO_PREVIOUS_WORLD);
+	packedToSlot.resize(packedEnd);
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		u32 p = firstPacked + i;
+		u32 slot = blockSlots[i];
+		u32 blockParent = blockParents[i];
+
+		slotToPacked[slot] = p;
+		packedToSlot[p] = slot;
+		owners[slot] = nullptr;
+		firstChild[slot] = INVALID;
+		childCounts[slot] = 0;
+
+		if (blockParent == INVALID)
+		{
+			parents[p] = INVALID;
+			depths[p] = 0;
+			LinkChild(INVALID, slot);
+		}
+		else
+		{
+			parents[p] = firstPacked + blockParent;
+			depths[p] = depths[firstPacked + blockParent] + 1;
+			LinkChild(blockSlots[blockParent], slot);
+		}
+
+		// Same level bookkeeping as a single allocation
+		u32 depth = depths[p];
+		u64 levelCount = levelStarts.size() - 1;
+		if (levelCount != 0 && depth == levelCount - 1) { levelStarts[levelCount] = p + 1; }
+		else if (depth == levelCount)                   { levelStarts.push_back(p + 1); }
+		else                                            { needsSort = true; }
+	}
+
+	liveCount += count;
+}
+
+void TransformStore::Release(u32 slot)
+{
+	// Orphan any remaining children
+	u32 child = firstChild[slot];
+	while (child != INVALID)
+	{
+		u32 next = nextSibling[child];
+		UnlinkChild(child);
+		parents[slotToPacked[child]] = INVALID;
+		MarkChanged(child);
+		child = next;
+	}
+
+	UnlinkChild(slot);
+
+	// Leave a dead entry in the packed arrays, it gets dropped by the next sort
+	u32 p = slotToPacked[slot];
+	packedToSlot[p] = INVALID;
+	parents[p] = INVALID;
+	flags[p] = 0;
+
+	slotToPacked[slot] = INVALID;
+	owners[slot] = nullptr;
+	freeSlots.push_back(slot);
+
+	--liveCount;
+	needsSort = true;
+}
+
+void TransformStore::SetParent(u32 slot, u32 parentSlot)
+{
+	UnlinkChild(slot);
+	LinkChild(parentSlot, slot);
+
+	parents[slotToPacked[slot]] = (parentSlot == INVALID) ? INVALID : slotToPacked[parentSlot];
+	MarkChanged(slot);
+
+	// The new parent may well live further back in the packed arrays than this subtree
+	needsSort = true;
+}
+
+const affine& TransformStore::ResolveWorld(u32 slot)
+{
+	u32 p = slotToPacked[slot];
+
+	// Nothing changed anywhere since this was last known to be current
+	if (passClock == clock || validated[p] == clock) { return worlds[p]; }
+
+	u32 ps = parentSlots[slot];
+	u64 parentVersion = 0;
+
+	// Only walks up as far as the first ancestor already validated at this clock value
+	if (ps != INVALID)
+	{
+		ResolveWorld(ps);
+		parentVersion = worldVersions[slotToPacked[ps]];
+	}
+
+	if (localVersions[p] > worldVersions[p] || parentVersion > worldVersions[p])
+	{
+		affine local = AffineFromTRS(positions[p], rotations[p], scales[p]);
+
+		if (ps != INVALID)
+		{
+			u32 par = slotToPacked[ps];
+			worlds[p] = AffineMultiply(worlds[par], local);
+			worldRotations[p] = cross(worldRotations[par], rotations[p]);
+		}
+		else
+		{
+			worlds[p] = local;
+			worldRotations[p] = rotations[p];
+		}
+
+		worldVersions[p] = glm::max(localVersions[p], parentVersion);
+	}
+
+	validated[p] = clock;
+	return worlds[p];
+}
+
+const affine& TransformStore::ResolveInverse(u32 slot)
+{
+	u32 p = slotToPacked[slot];
+
+	// Remembered so the next pass can get the inverse ready ahead of time
+	flags[p] |= INVERSE_REQUESTED;
+
+#ifndef CORE_OBJECT_NO_DYNAMIC_UPDATE
+	ResolveWorld(slot);
+#endif
+	// World matrices only change during passes in no-dynamic mode, so the cached one is used as is there
+
+	if (inverseVersions[p] != worldVersions[p])
+	{
+		// Packed parent links are only rebuilt by the next pass, the slot links are always current
+		u32 ps = parentSlots[slot];
+		RecalculateInverse(p, ps == INVALID ? INVALID : slotToPacked[ps]);
+	}
+
+	return inverses[p];
+}
+
+void TransformStore::UpdateRange(u32 begin, u32 end)
+{
+	affine locals[COMPOSE_BATCH];
+	bool stale[COMPOSE_BATCH];
+
+	for (u32 block = begin; block < end; block += COMPOSE_BATCH)
+	{
+		u32 blockEnd = glm::min(block + COMPOSE_BATCH, end);
+		u32 staleCount = 0;
+
+		// Parents live in an earlier level, so their world version is already final for this pass
+		for (u32 p = block; p < blockEnd; ++p)
+		{
+			u32 par = parents[p];
+			stale[p - block] = packedToSlot[p] != INVALID &&
+				(localVersions[p] > worldVersions[p] || (par != INVALID && worldVersions[par] > worldVersions[p]));
+			staleCount += stale[p - block] ? 1 : 0;
+		}
+
+		// Mostly stale blocks (e.g. everything moving) go through the vector kernel as a whole, the rest one by one
+		bool batched = staleCount * 2 > blockEnd - block;
+		if (batched) { ComposeTRS(blockEnd - block, &positions[block], &rotations[block], &scales[block], locals); }
+
+		for (u32 p = block; p < blockEnd; ++p)
+		{
+			if (packedToSlot[p] == INVALID) { continue; }
+
+			if (stale[p - block])
+			{
+				if (batched) { RecalculateWorld(p, locals[p - block]); }
+				else { RecalculateWorld(p); }
+			}
+
+			// Only pay for the inverse up front if somebody asked for it since the last pass
+			if ((flags[p] & INVERSE_REQUESTED) && inverseVersions[p] != worldVersions[p])
+			{
+				RecalculateInverse(p, parents[p]);
+			}
+
+			flags[p] &= ~INVERSE_REQUESTED;
+		}
+	}
+}
+
+void TransformStore::UpdateWorldMatrices(WorkerPool* pool)
+{
+	if (needsSort) { Sort(); }
+
+	// Each level only depends on the one before it, so a level can be split up freely between threads
+	u64 levelCount = levelStarts.size() - 1;
+	for (u64 d = 0; d < levelCount; ++d)
+	{
+		u32 begin = levelStarts[d];
+		u32 end = levelStarts[d + 1];
+
+		if (pool == nullptr || end - begin <= PARALLEL_GRAIN)
+		{
+			UpdateRange(begin, end);
+		}
+		else
+		{
+			pool->ParallelFor(end - begin, PARALLEL_GRAIN, [this, begin](u64 first, u64 last)
+			{
+				UpdateRange(begin + (u32)first, begin + (u32)last);
+			});
+		}
+	}
+
+	// Every entry is current until the next change, which lets lazy resolves skip the ancestor walk
+	passClock = clock;
+}
+
+void TransformStore::SavePreviousWorlds()
+{
+	// Same size every tick, so these copies don't allocate
+	previousWorlds = worlds;
+	previousWorldRotations = worldRotations;
+
+	// Entries whose world has been calculated once now have a proper previous one
+	for (u64 p = 0; p < flags.size(); ++p)
+	{
+		if (worldVersions[p] != 0) { flags[p] &= ~NO_PREVIOUS_WORLD; }
+	}
+}
+
+void TransformStore::InterpolateRange(u32 begin, u32 end, float alpha)
+{
+	for (u32 p = begin; p < end; ++p)
+	{
+		const affine& from = previousWorlds[p];
+		const affine& to = worlds[p];
+
+		// Most entries don't move from one tick to the next
+		if ((flags[p] & NO_PREVIOUS_WORLD) || memcmp(&from, &to, sizeof(affine)) == 0)
+		{
+			renderWorlds[p] = to;
+			continue;
+		}
+
+		quat r0 = previousWorldRotations[p];
+		quat r1 = worldRotations[p];
+		if (dot(r0, r1) < 0.0f) { r1 = -r1; } // Shortest way round
+		quat r = normalize(r0 * (1.0f - alpha) + r1 * alpha);
+
+		// What the rotation leaves behind (scale, plus shear under non-uniformly scaled parents) blends linearly
+		mat3 stretch0 = transpose(toMat3(r0)) * mat3(from[0], from[1], from[2]);
+		mat3 stretch1 = transpose(toMat3(r1)) * mat3(to[0], to[1], to[2]);
+		mat3 m = toMat3(r) * (stretch0 + (stretch1 - stretch0) * alpha);
+
+		renderWorlds[p] = affine(m[0], m[1], m[2], mix(from[3], to[3], alpha));
+	}
+}
+
+void TransformStore::InterpolateWorlds(float alpha, WorkerPool* pool)
+{
+	u32 count = (u32)worlds.size();
+
+	// Entries are independent of each other, unlike during propagation
+	if (pool == nullptr || count <= PARALLEL_GRAIN)
+	{
+		InterpolateRange(0, count, alpha);
+	}
+	else
+	{
+		pool->ParallelFor(count, PARALLEL_GRAIN, [this, alpha](u64 first, u64 last)
+		{
+			InterpolateRange((u32)first, (u32)last, alpha);
+		});
+	}
+}
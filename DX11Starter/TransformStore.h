@@ -0,0 +1,173 @@
+#ifndef TRANSFORM_STORE_H_
+#define TRANSFORM_STORE_H_
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <vector>
+
+#include "Types.h"
+#include "Transform.h"
+#include "Affine.h"
+#include "WorkerPool.h"
+
+class Object;
+
+// Structure-of-arrays storage for the transformations of every Object sharing it (usually one per Scene)
+//
+// Objects only hold a slot into the store. Slots never move, while the packed arrays behind them are kept
+// sorted by hierarchy depth, so every parent precedes all of its children and world matrices can be
+// propagated in a single linear pass instead of chasing pointers through the hierarchy.
+//
+// Staleness is tracked with version stamps taken from a store-wide clock rather than dirty flags. A local
+// change only stamps its own entry, and a world matrix is stamped with the newest local stamp among the
+// entry and its ancestors, so an entry is stale whenever its own or its parent's stamp is newer than its
+// world stamp. Invalidating a subtree is O(1) - nobody below gets touched until they are next read.
+class TransformStore
+{
+public:
+	static const u32 INVALID = 0xFFFFFFFF;
+
+	// Smallest amount of entries worth handing to another thread during propagation
+	static const u32 PARALLEL_GRAIN = 512;
+	// Entries composed per batch kernel call during propagation
+	static const u32 COMPOSE_BATCH = 64;
+
+	// Per-entry state bits
+	enum Flags : u08
+	{
+		INVERSE_REQUESTED = 0x01, // Inverse was asked for since the last propagation pass
+		NO_PREVIOUS_WORLD = 0x02  // Created after the last SavePreviousWorlds, so there is nothing to interpolate from
+	};
+
+private:
+	// Packed data, indexed by position in the depth-sorted order
+	std::vector<vec3> positions;      // Local position relative to parent
+	std::vector<quat> rotations;      // Local rotation relative to parent
+	std::vector<vec3> scales;         // Local scale
+	std::vector<affine> worlds;       // Cached world matrices
+	std::vector<affine> inverses;     // Cached inverse world matrices
+	std::vector<quat> worldRotations; // Cached world rotations (calculated alongside world matrices)
+	std::vector<affine> previousWorlds;         // World matrices as of the last SavePreviousWorlds
+	std::vector<quat>   previousWorldRotations; // Ditto for world rotations
+	std::vector<affine> renderWorlds;           // Blend of the previous and current worlds, see InterpolateWorlds
+	std::vector<u64>  localVersions;  // Clock value of the last change to the local transformation
+	std::vector<u64>  worldVersions;  // Newest local version among this entry and its ancestors when its world was calculated
+	std::vector<u64>  inverseVersions;// World version the cached inverse was calculated from
+	std::vector<u64>  validated;      // Clock value at which this entry was last confirmed up to date
+	std::vector<u32>  parents;        // Packed index of the parent (INVALID for roots)
+	std::vector<u32>  depths;         // Depth within the hierarchy (0 for roots)
+	std::vector<u08>  flags;          // Combination of Flags
+	std::vector<u32>  packedToSlot;   // Slot owning each packed entry (INVALID for dead entries)
+	std::vector<u32>  levelStarts;    // Packed index where each depth level begins, plus one past the end
+
+	// Slot data, indexed by the stable slot handed out to objects
+	std::vector<u32>     slotToPacked; // Current packed index of each slot
+	std::vector<Object*> owners;       // Object currently bound to each slot
+	std::vector<u32>     parentSlots;  // Slot of the parent (INVALID for roots)
+	std::vector<u32>     firstChild;   // Intrusive child list, avoids a heap-allocated vector per object
+	std::vector<u32>     nextSibling;
+	std::vector<u32>     prevSibling;
+	std::vector<u32>     childCounts;
+	std::vector<u32>     freeSlots;
+
+	u64 clock;      // Bumped on every change to any entry
+	u64 passClock;  // Clock value as of the last full propagation pass
+	u32 liveCount;  // Number of packed entries that are still bound to a slot
+	bool needsSort; // Packed order no longer matches the hierarchy (reparenting or releases)
+
+	void LinkChild(u32 parentSlot, u32 childSlot);
+	void UnlinkChild(u32 childSlot);
+
+	// Restores the parent-before-child order and drops dead packed entries
+	void Sort();
+
+	void RecalculateWorld(u32 p);
+	// Same, from an already composed local matrix
+	void RecalculateWorld(u32 p, const affine& local);
+	// Parent (packed index) world and inverse, when kept, must already be current
+	void RecalculateInverse(u32 p, u32 par);
+	// Propagation pass over a range of packed entries, whose parents must all be up to date
+	void UpdateRange(u32 begin, u32 end);
+	// Blends a range of packed entries between their previous and current worlds
+	void InterpolateRange(u32 begin, u32 end, float alpha);
+
+public:
+	TransformStore();
+	~TransformStore();
+
+	// Shared store for objects created without a scene (e.g. standalone objects and their children)
+	static TransformStore* Shared();
+
+	void Reserve(u64 count);
+
+	// Claims a slot for an object, optionally as a child of another slot
+	u32 Allocate(Object* owner, const Transform& t, u32 parentSlot = INVALID);
+	// Claims count slots in one go, writing the slot of each block entry to blockSlots
+	//  - Released slots are reused before new ones are added, so the slots needn't be consecutive
+	//  - Parents are given as offsets within the block (INVALID for roots) and must precede their children
+	//  - Slots start without an owner, bind them with Rebind once the owning objects exist
+	void AllocateBlock(u32 count, const vec3* blockPositions, const quat* blockRotations, const vec3* blockScales, const u32* blockParents, u32* blockSlots);
+	// Returns a slot to the store ; its children are detached and become roots
+	void Release(u32 slot);
+	// Rebinds a slot to a different object (used when objects are moved in memory)
+	inline void Rebind(u32 slot, Object* owner) { owners[slot] = owner; }
+
+	void SetParent(u32 slot, u32 parentSlot);
+
+	inline u32     GetParent(u32 slot) const        { return parentSlots[slot]; }
+	inline Object* GetOwner(u32 slot) const         { return slot == INVALID ? nullptr : owners[slot]; }
+	inline u32     GetFirstChild(u32 slot) const    { return firstChild[slot]; }
+	inline u32     GetNextSibling(u32 slot) const   { return nextSibling[slot]; }
+	inline u32     GetChildCount(u32 slot) const    { return childCounts[slot]; }
+	inline u64     GetCount() const                 { return liveCount; }
+	// Slots ever handed out, live or waiting for reuse
+	inline u64     GetSlotCapacity() const          { return slotToPacked.size(); }
+
+	// Local transformation accessors
+	inline vec3 GetPosition(u32 slot) const { return positions[slotToPacked[slot]]; }
+	inline quat GetRotation(u32 slot) const { return rotations[slotToPacked[slot]]; }
+	inline vec3 GetScale(u32 slot) const    { return scales[slotToPacked[slot]]; }
+	inline Transform GetTransform(u32 slot) const { u32 p = slotToPacked[slot]; return Transform(positions[p], rotations[p], scales[p]); }
+
+	inline void SetPosition(u32 slot, vec3 v) { positions[slotToPacked[slot]] = v; }
+	inline void SetRotation(u32 slot, quat q) { rotations[slotToPacked[slot]] = q; }
+	inline void SetScale(u32 slot, vec3 v)    { scales[slotToPacked[slot]] = v; }
+	inline void SetTransform(u32 slot, const Transform& t) { u32 p = slotToPacked[slot]; positions[p] = t.GetPosition(); rotations[p] = t.GetRotation(); scales[p] = t.GetScale(); }
+
+	// Cached data, possibly stale
+	inline const affine& GetWorld(u32 slot) const       { return worlds[slotToPacked[slot]]; }
+	inline const affine& GetInverse(u32 slot) const     { return inverses[slotToPacked[slot]]; }
+	inline const quat& GetWorldRotation(u32 slot) const { return worldRotations[slotToPacked[slot]]; }
+	// Only valid after InterpolateWorlds
+	inline const affine& GetRenderWorld(u32 slot) const { return renderWorlds[slotToPacked[slot]]; }
+	// World as of the last SavePreviousWorlds, unless the slot was created after it
+	inline const affine& GetPreviousWorld(u32 slot) const { return previousWorlds[slotToPacked[slot]]; }
+	inline bool HasPreviousWorld(u32 slot) const          { return (flags[slotToPacked[slot]] & NO_PREVIOUS_WORLD) == 0; }
+	// Changes whenever the world matrix does, so callers can tell whether anything they derived from it is stale
+	inline u64 GetWorldVersion(u32 slot) const            { return worldVersions[slotToPacked[slot]]; }
+
+	// Flags the local transformation of a slot as changed, which implicitly invalidates its whole subtree
+	inline void MarkChanged(u32 slot) { localVersions[slotToPacked[slot]] = ++clock; }
+
+	// Lazily brings a single slot up to date by pulling from its ancestors
+	const affine& ResolveWorld(u32 slot);
+	const affine& ResolveInverse(u32 slot);
+	inline const quat& ResolveWorldRotation(u32 slot) { ResolveWorld(slot); return worldRotations[slotToPacked[slot]]; }
+
+	// Recalculates every stale world matrix one depth level at a time
+	// Levels are split across the pool when given ; inverses are only recalculated for entries that asked for one
+	void UpdateWorldMatrices(WorkerPool* pool = nullptr);
+
+	inline u64 GetLevelCount() const { return levelStarts.size() - 1; }
+
+	// Keeps the current world matrices around as the previous ones ; called at the start of each simulation tick
+	void SavePreviousWorlds();
+	// Blends every entry alpha of the way from its previous world to its current one, for rendering between ticks
+	//  - World matrices must be current (i.e. UpdateWorldMatrices ran since the last change)
+	//  - Rotations are blended as quaternions, so spinning objects don't shrink halfway through a tick
+	void InterpolateWorlds(float alpha, WorkerPool* pool = nullptr);
+};
+
+#endif
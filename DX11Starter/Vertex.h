@@ -1,6 +1,6 @@
 #pragma once
 
-#include <DirectXMath.h>
+#include <glm/glm.hpp>
 
 // --------------------------------------------------------
 // A custom vertex definition
@@ -9,15 +9,15 @@
 // --------------------------------------------------------
 struct Vertex
 {
-	DirectX::XMFLOAT3 Position;	    // The position of the vertex
-	DirectX::XMFLOAT3 Normal;		// Normals of the models
-	DirectX::XMFLOAT2 UV;			// UV's of the model
-	DirectX::XMFLOAT3 Tangent;		// normal mapping
+	glm::vec3 Position;	    // The position of the vertex
+	glm::vec3 Normal;		// Normals of the models
+	glm::vec2 UV;			// UV's of the model
+	glm::vec3 Tangent;		// normal mapping
 };
 
 struct TerrainVertex
 {
-	DirectX::XMFLOAT3 Position;
-	DirectX::XMFLOAT3 Normal;
-	DirectX::XMFLOAT2 UV;
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 UV;
 };
\ No newline at end of file
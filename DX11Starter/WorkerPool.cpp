@@ -0,0 +1,426 @@
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+const u32 WorkerPool::AUTO_WORKER_COUNT;
+const u32 WorkerPool::JOB_POOL_SIZE;
+const u32 WorkerPool::FOREIGN_THREAD;
+const u32 WorkerPool::SPIN_COUNT;
+
+thread_local WorkerPool* WorkerPool::threadPool = nullptr;
+thread_local u32 WorkerPool::threadIndex = 0;
+
+WorkerPool::JobDeque::JobDeque() :
+	top(0),
+	bottom(0)
+{
+	for (u32 i = 0; i < JOB_POOL_SIZE; ++i) { slots[i].store(nullptr, std::memory_order_relaxed); }
+}
+
+bool WorkerPool::JobDeque::Push(Job* job)
+{
+	i64 b = bottom.load(std::memory_order_relaxed);
+	i64 t = top.load(std::memory_order_acquire);
+	if (b - t >= (i64)JOB_POOL_SIZE) { return false; }
+
+	slots[b & (JOB_POOL_SIZE - 1)].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+Job* WorkerPool::JobDeque::Pop()
+{
+	i64 b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	// The bottom store has to be visible before top is read, or a thief and the owner could both take the last job
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	i64 t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = slots[b & (JOB_POOL_SIZE - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last job : race the thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { job = nullptr; }
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* WorkerPool::JobDeque::Steal()
+{
+	i64 t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	i64 b = bottom.load(std::memory_order_acquire);
+	if (t >= b) { return nullptr; }
+
+	Job* job = slots[t & (JOB_POOL_SIZE - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { return nullptr; }
+	return job;
+}
+
+WorkerPool::WorkerPool(u32 workerCount) :
+	mainThread(std::this_thread::get_id()),
+	mainJobCount(0),
+	injectedCount(0),
+	queuedJobs(0),
+	sleepingWorkers(0),
+	quitting(false)
+{
+	if (workerCount == AUTO_WORKER_COUNT)
+	{
+		u32 hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	// Every slot exists before any worker starts stealing from them
+	slots.reserve(workerCount + 1);
+	for (u32 i = 0; i <= workerCount; ++i)
+	{
+		WorkerSlot* slot = new WorkerSlot();
+		slot->jobs = new Job[JOB_POOL_SIZE];
+		for (u32 j = 0; j < JOB_POOL_SIZE; ++j) { slot->jobs[j].finished.store(true, std::memory_order_relaxed); }
+		slot->nextJob = 0;
+		slot->random = 0x9E3779B9u * (i + 1);
+		slots.push_back(slot);
+	}
+
+	for (u32 i = 1; i <= workerCount; ++i)
+	{
+		slots[i]->thread = std::thread(&WorkerPool::WorkerMain, this, i);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+
+	for (u64 i = 1; i < slots.size(); ++i)
+	{
+		slots[i]->thread.join();
+	}
+
+	for (WorkerSlot* slot : slots)
+	{
+		delete[] slot->jobs;
+		delete slot;
+	}
+}
+
+WorkerPool* WorkerPool::Shared()
+{
+	static WorkerPool shared;
+	return &shared;
+}
+
+void WorkerPool::WorkerMain(u32 index)
+{
+	PROFILE_THREAD("Worker");
+
+	threadPool = this;
+	threadIndex = index;
+
+	u32 idleRounds = 0;
+	for (;;)
+	{
+		if (RunOneJob(index))
+		{
+			idleRounds = 0;
+			continue;
+		}
+
+		if (++idleRounds < SPIN_COUNT)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Nothing to steal for a while : sleep until something is queued
+		std::unique_lock<std::mutex> lock(mutex);
+		sleepingWorkers.fetch_add(1);
+		wake.wait(lock, [&]() { return quitting || queuedJobs.load() > 0; });
+		sleepingWorkers.fetch_sub(1);
+
+		if (quitting) { return; }
+		idleRounds = 0;
+	}
+}
+
+u32 WorkerPool::CurrentIndex() const
+{
+	if (threadPool == this) { return threadIndex; }
+	if (std::this_thread::get_id() == mainThread) { return 0; }
+	return FOREIGN_THREAD;
+}
+
+Job* WorkerPool::AllocateJob(u32 index)
+{
+	if (index == FOREIGN_THREAD)
+	{
+		Job* job = new Job();
+		job->heap = true;
+		return job;
+	}
+
+	WorkerSlot* slot = slots[index];
+	Job* job = &slot->jobs[slot->nextJob++ & (JOB_POOL_SIZE - 1)];
+
+	// The slot's previous job is still queued or running ; help until it is done
+	while (!job->finished.load(std::memory_order_acquire))
+	{
+		if (!RunOneJob(index)) { std::this_thread::yield(); }
+	}
+
+	job->finished.store(false, std::memory_order_relaxed);
+	job->heap = false;
+	return job;
+}
+
+void WorkerPool::Submit(const JobFunction& fn, JobCounter* counter, JobCounter* dependency, bool mainThreadOnly)
+{
+	u32 index = CurrentIndex();
+
+	Job* job = AllocateJob(index);
+	job->fn = fn;
+	job->counter = counter;
+	job->mainThread = mainThreadOnly;
+
+	if (counter != nullptr) { counter->pending.fetch_add(1); }
+
+	if (dependency != nullptr)
+	{
+		// Checked under the lock so the dependency can't finish between the check and the push
+		std::lock_guard<std::mutex> lock(dependency->continuationLock);
+		if (dependency->pending.load() != 0)
+		{
+			dependency->continuations.push_back(job);
+			return;
+		}
+	}
+
+	Schedule(job, index);
+}
+
+void WorkerPool::Schedule(Job* job, u32 index)
+{
+	if (job->mainThread)
+	{
+		std::lock_guard<std::mutex> lock(mainLock);
+		mainJobs.push_back(job);
+		mainJobCount.fetch_add(1);
+		return;
+	}
+
+	// Counted before it can be taken, so the count never dips below zero
+	queuedJobs.fetch_add(1);
+
+	if (index == FOREIGN_THREAD)
+	{
+		std::lock_guard<std::mutex> lock(injectedLock);
+		injectedJobs.push_back(job);
+		injectedCount.fetch_add(1);
+	}
+	else if (!slots[index]->deque.Push(job))
+	{
+		// Deque full : just run it
+		queuedJobs.fetch_sub(1);
+		Execute(job, index);
+		return;
+	}
+
+	if (sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wake.notify_one();
+	}
+}
+
+Job* WorkerPool::FindJob(u32 index)
+{
+	Job* job = nullptr;
+
+	if (index != FOREIGN_THREAD)
+	{
+		job = slots[index]->deque.Pop();
+		if (job != nullptr)
+		{
+			queuedJobs.fetch_sub(1);
+			return job;
+		}
+	}
+
+	if (index == 0 && mainJobCount.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(mainLock);
+		if (!mainJobs.empty())
+		{
+			job = mainJobs.front();
+			mainJobs.pop_front();
+			mainJobCount.fetch_sub(1);
+			return job;
+		}
+	}
+
+	if (injectedCount.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(injectedLock);
+		if (!injectedJobs.empty())
+		{
+			job = injectedJobs.front();
+			injectedJobs.pop_front();
+			injectedCount.fetch_sub(1);
+			queuedJobs.fetch_sub(1);
+			return job;
+		}
+	}
+
+	// Steal, starting from a random victim so thieves spread out
+	u32 slotCount = (u32)slots.size();
+	u32 start = 0;
+	if (index != FOREIGN_THREAD)
+	{
+		u32& random = slots[index]->random;
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		start = random % slotCount;
+	}
+
+	for (u32 i = 0; i < slotCount; ++i)
+	{
+		u32 victim = (start + i) % slotCount;
+		if (victim == index) { continue; }
+
+		job = slots[victim]->deque.Steal();
+		if (job != nullptr)
+		{
+			queuedJobs.fetch_sub(1);
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void WorkerPool::Execute(Job* job, u32 index)
+{
+	job->fn();
+	job->fn = nullptr;
+
+	JobCounter* counter = job->counter;
+	if (job->heap) { delete job; }
+	else { job->finished.store(true, std::memory_order_release); }
+
+	if (counter == nullptr) { return; }
+
+	counter->finishing.fetch_add(1);
+	if (counter->pending.fetch_sub(1) != 1)
+	{
+		counter->finishing.fetch_sub(1);
+		return;
+	}
+
+	// Last job of the counter : release whatever was waiting on it
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->continuationLock);
+		ready.swap(counter->continuations);
+	}
+	counter->finishing.fetch_sub(1);
+
+	for (Job* next : ready) { Schedule(next, index); }
+}
+
+bool WorkerPool::RunOneJob(u32 index)
+{
+	Job* job = FindJob(index);
+	if (job == nullptr) { return false; }
+
+	Execute(job, index);
+	return true;
+}
+
+void WorkerPool::Run(const JobFunction& fn, JobCounter* counter, JobCounter* dependency)
+{
+	Submit(fn, counter, dependency, false);
+}
+
+void WorkerPool::RunOnMainThread(const JobFunction& fn, JobCounter* counter, JobCounter* dependency)
+{
+	Submit(fn, counter, dependency, true);
+}
+
+void WorkerPool::Wait(JobCounter* counter)
+{
+	u32 index = CurrentIndex();
+	while (!counter->IsDone())
+	{
+		if (!RunOneJob(index)) { std::this_thread::yield(); }
+	}
+}
+
+void WorkerPool::RunMainThreadJobs()
+{
+	while (mainJobCount.load(std::memory_order_relaxed) > 0)
+	{
+		Job* job = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mainLock);
+			if (mainJobs.empty()) { return; }
+			job = mainJobs.front();
+			mainJobs.pop_front();
+			mainJobCount.fetch_sub(1);
+		}
+		Execute(job, 0);
+	}
+}
+
+void WorkerPool::RunChunks(const RangeFunction* fn, u64 count, u64 grain, std::atomic<u64>* nextIndex)
+{
+	for (;;)
+	{
+		u64 begin = nextIndex->fetch_add(grain);
+		if (begin >= count) { return; }
+
+		u64 end = begin + grain < count ? begin + grain : count;
+		PROFILE_ZONE("WorkerPool chunk");
+		(*fn)(begin, end);
+	}
+}
+
+void WorkerPool::ParallelFor(u64 count, u64 grain, const RangeFunction& fn)
+{
+	if (count == 0) { return; }
+	if (grain == 0) { grain = 1; }
+
+	// Not worth a job for a single chunk, nor with nobody to help ; the chunks still keep to the grain
+	u64 chunks = (count + grain - 1) / grain;
+	if (slots.size() == 1 || chunks == 1)
+	{
+		for (u64 begin = 0; begin < count; begin += grain) { fn(begin, begin + grain < count ? begin + grain : count); }
+		return;
+	}
+
+	// One job per thread that could help rather than one per chunk ; each claims chunks until none are left,
+	// so an uneven loop still balances without flooding the deques
+	std::atomic<u64> nextIndex(0);
+	u64 helpers = (chunks < slots.size() ? chunks : slots.size()) - 1;
+
+	JobCounter counter;
+	for (u64 i = 0; i < helpers; ++i)
+	{
+		Run([&]() { RunChunks(&fn, count, grain, &nextIndex); }, &counter);
+	}
+
+	RunChunks(&fn, count, grain, &nextIndex);
+	Wait(&counter);
+}
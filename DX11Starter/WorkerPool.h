@@ -0,0 +1,166 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Types.h"
+
+struct Job;
+
+// Counts unfinished jobs ; jobs can be run after a counter reaches zero, and WorkerPool::Wait() blocks on one
+// A counter can be reused once it has reached zero
+class JobCounter
+{
+	friend class WorkerPool;
+
+private:
+	std::atomic<u32> pending;
+	// Jobs still touching the counter after their decrement ; it must not be destroyed under them
+	std::atomic<u32> finishing;
+
+	// Jobs waiting for this counter to reach zero
+	std::mutex continuationLock;
+	std::vector<Job*> continuations;
+
+public:
+	JobCounter() : pending(0), finishing(0) { }
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator= (const JobCounter&) = delete;
+
+	inline bool IsDone() const { return pending.load() == 0 && finishing.load() == 0; }
+};
+
+struct Job
+{
+	std::function<void()> fn;
+	JobCounter* counter;       // Decremented once fn has run
+	std::atomic<bool> finished; // Pool slots are only reused once their job finished
+	bool mainThread;           // Only ever run by the pool's main thread, for device calls
+	bool heap;                 // Submitted from a thread outside the pool, deleted after running
+};
+
+// Work-stealing job scheduler every engine system runs its parallel work on
+//
+// Each thread owns a Chase-Lev deque : it pushes and pops its own jobs at one end (LIFO, cache friendly) while
+// idle threads steal from the other end. The thread that creates the pool is its main thread ; it takes part
+// whenever it waits, and is the only one to run jobs submitted with RunOnMainThread().
+// Waiting never blocks a thread that could be working : Wait() runs other jobs until its counter reaches zero,
+// so jobs can wait on jobs they started.
+class WorkerPool
+{
+public:
+	// Processes the half-open index range [begin, end)
+	typedef std::function<void(u64 begin, u64 end)> RangeFunction;
+	typedef std::function<void()> JobFunction;
+
+	// One worker per hardware thread, minus the main thread
+	static const u32 AUTO_WORKER_COUNT = ~0u;
+	// Jobs each thread can have in flight, and deque capacity ; both are powers of two
+	static const u32 JOB_POOL_SIZE = 4096;
+
+private:
+	// Marks a thread outside the pool ; its jobs go through a locked queue
+	static const u32 FOREIGN_THREAD = ~0u;
+	// Steal rounds an idle worker makes before going to sleep
+	static const u32 SPIN_COUNT = 64;
+
+	class JobDeque
+	{
+	private:
+		// Thieves hammer top while the owner works bottom, so keep them on separate cache lines
+		std::atomic<i64> top;
+		u08 topPadding[64 - sizeof(std::atomic<i64>)];
+		std::atomic<i64> bottom;
+		u08 bottomPadding[64 - sizeof(std::atomic<i64>)];
+		std::atomic<Job*> slots[JOB_POOL_SIZE];
+
+	public:
+		JobDeque();
+
+		// Owner only
+		bool Push(Job* job);
+		Job* Pop();
+		// Any thread
+		Job* Steal();
+	};
+
+	struct WorkerSlot
+	{
+		JobDeque deque;
+		Job* jobs; // JOB_POOL_SIZE slots, handed out round robin by the owner
+		u32 nextJob;
+		u32 random; // Steal victim selection
+		std::thread thread;
+	};
+
+	std::vector<WorkerSlot*> slots; // Slot 0 is the main thread
+	std::thread::id mainThread;
+
+	std::mutex mainLock;
+	std::deque<Job*> mainJobs;
+	std::atomic<u32> mainJobCount;
+
+	std::mutex injectedLock;
+	std::deque<Job*> injectedJobs;
+	std::atomic<u32> injectedCount;
+
+	// Sleeping workers are woken when jobs are queued
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<u32> queuedJobs;
+	std::atomic<u32> sleepingWorkers;
+	bool quitting;
+
+	static thread_local WorkerPool* threadPool;
+	static thread_local u32 threadIndex;
+
+	void WorkerMain(u32 index);
+	u32 CurrentIndex() const;
+
+	Job* AllocateJob(u32 index);
+	void Submit(const JobFunction& fn, JobCounter* counter, JobCounter* dependency, bool mainThreadOnly);
+	// Queues a job whose dependency (if any) is done
+	void Schedule(Job* job, u32 index);
+	Job* FindJob(u32 index);
+	void Execute(Job* job, u32 index);
+	bool RunOneJob(u32 index);
+
+	// Claims and runs chunks of a loop until there are none left
+	void RunChunks(const RangeFunction* fn, u64 count, u64 grain, std::atomic<u64>* nextIndex);
+
+public:
+	WorkerPool(u32 workerCount = AUTO_WORKER_COUNT);
+	// Outstanding jobs must have been waited for
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator= (const WorkerPool&) = delete;
+
+	// Shared pool used by engine systems ; DXCore creates it first thing, making the render thread its main thread
+	static WorkerPool* Shared();
+
+	inline u32 GetWorkerCount() const { return (u32)slots.size() - 1; }
+
+	// Queues fn, counting it on counter if there is one. With a dependency, fn only starts once that reached zero.
+	void Run(const JobFunction& fn, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+	// Same, but only the main thread runs it (in Wait() or RunMainThreadJobs())
+	void RunOnMainThread(const JobFunction& fn, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Runs jobs until counter reaches zero
+	void Wait(JobCounter* counter);
+	// Main thread only ; runs the main thread jobs that are ready
+	void RunMainThreadJobs();
+
+	// Runs fn over [0, count) in chunks of at most grain indices, returning once every chunk is complete
+	// fn may itself start jobs or loops on the same pool
+	void ParallelFor(u64 count, u64 grain, const RangeFunction& fn);
+};
+
+#endif